@@ -464,6 +464,11 @@ int virAdmServerSetClientLimits(virAdmServerPtr srv,
 int virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
                                unsigned int flags);
 
+int virAdmServerGetStats(virAdmServerPtr srv,
+                         virTypedParameterPtr *params,
+                         int *nparams,
+                         unsigned int flags);
+
 int virAdmConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                    char **outputs,
                                    unsigned int flags);
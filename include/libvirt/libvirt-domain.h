@@ -1081,7 +1081,9 @@ typedef enum {
 
     /* Send memory pages to the destination host through several network
      * connections. See VIR_MIGRATE_PARAM_PARALLEL_* parameters for
-     * configuring the parallel migration.
+     * configuring the parallel migration. Since 11.9.0 this can be combined
+     * with VIR_MIGRATE_TUNNELLED if the destination supports it, in which
+     * case each connection is tunnelled through its own stream.
      *
      * Since: 5.2.0
      */
@@ -2827,6 +2829,26 @@ struct _virDomainStatsRecord {
  */
 # define VIR_DOMAIN_STATS_STATE_REASON "state.reason"
 
+/**
+ * VIR_DOMAIN_STATS_STATE_JOB_QUEUE_LENGTH:
+ *
+ * Number of APIs waiting to start a job on the domain, returned as
+ * unsigned long long.
+ *
+ * Since: 11.9.0
+ */
+# define VIR_DOMAIN_STATS_STATE_JOB_QUEUE_LENGTH "state.job_queue.length"
+
+/**
+ * VIR_DOMAIN_STATS_STATE_JOB_QUEUE_AGENT_LENGTH:
+ *
+ * Number of APIs waiting to start a guest agent job on the domain,
+ * returned as unsigned long long.
+ *
+ * Since: 11.9.0
+ */
+# define VIR_DOMAIN_STATS_STATE_JOB_QUEUE_AGENT_LENGTH "state.job_queue.agent_length"
+
 
 /**
  * VIR_DOMAIN_STATS_CPU_TIME:
@@ -3860,6 +3882,17 @@ struct _virDomainStatsRecord {
  */
 # define VIR_DOMAIN_STATS_MEMORY_BANDWIDTH_MONITOR_SUFFIX_NODE_SUFFIX_BYTES_TOTAL ".bytes.total"
 
+/**
+ * VIR_DOMAIN_STATS_MEMORY_PLACEMENT_NODESET:
+ *
+ * The host NUMA nodes chosen by automatic placement (placement='auto' of
+ * <vcpu> or <numatune>) when the domain was started, as a string. Not
+ * reported for domains which don't use automatic placement.
+ *
+ * Since: 11.9.0
+ */
+# define VIR_DOMAIN_STATS_MEMORY_PLACEMENT_NODESET "memory.placement.nodeset"
+
 
 /**
  * VIR_DOMAIN_STATS_DIRTYRATE_CALC_STATUS:
@@ -3978,6 +4011,9 @@ typedef enum {
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_SHUTOFF = VIR_CONNECT_LIST_DOMAINS_SHUTOFF, /* (Since: 1.2.8) */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_OTHER = VIR_CONNECT_LIST_DOMAINS_OTHER, /* (Since: 1.2.8) */
 
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_DELTA = 1 << 28, /* report only fields which changed since
+                                                          the previous call on the same connection
+                                                          (Since: 11.9.0) */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT = 1 << 29, /* report statistics that can be obtained
                                                            immediately without any blocking (Since: 4.5.0) */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING = 1 << 30, /* include backing chain for block stats (Since: 1.2.12) */
@@ -3996,6 +4032,35 @@ int virDomainListGetStats(virDomainPtr *doms,
 
 void virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats);
 
+/**
+ * virDomainStatsExportRecord:
+ *
+ * Statistics of a single domain read from a statistics export file by
+ * virDomainStatsExportRead().
+ *
+ * Since: 11.9.0
+ */
+typedef struct _virDomainStatsExportRecord virDomainStatsExportRecord;
+
+/**
+ * virDomainStatsExportRecordPtr:
+ *
+ * Since: 11.9.0
+ */
+typedef virDomainStatsExportRecord *virDomainStatsExportRecordPtr;
+struct _virDomainStatsExportRecord {
+    char *name; /* name of the domain */
+    virTypedParameterPtr params;
+    int nparams;
+};
+
+int virDomainStatsExportRead(const char *path,
+                             virDomainStatsExportRecordPtr **records,
+                             unsigned long long *timestamp,
+                             unsigned int flags);
+
+void virDomainStatsExportRecordListFree(virDomainStatsExportRecordPtr *records);
+
 /*
  * Perf Event API
  */
@@ -5842,6 +5907,30 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_VFIO_DATA_TRANSFERRED "vfio_data_transferred"
 
+/**
+ * VIR_DOMAIN_JOB_QUEUE_POSITION:
+ * virDomainGetJobStats field: position of an outgoing migration waiting for
+ * other migrations to finish before it can start, as VIR_TYPED_PARAM_UINT.
+ * The migration will be started once the position drops to 0, in which case
+ * the field is omitted.
+ *
+ * Since: 11.9.0
+ */
+# define VIR_DOMAIN_JOB_QUEUE_POSITION "queue_position"
+
+/**
+ * VIR_DOMAIN_JOB_STARTUP_PHASE_PREFIX:
+ * virDomainGetJobStats field prefix: the time in microseconds spent in
+ * individual phases of starting the domain, as VIR_TYPED_PARAM_ULLONG. The
+ * prefix is followed by the name of the phase, e.g., "startup_phase.launch".
+ * The set of phases is hypervisor specific. The fields are reported for
+ * completed jobs which started the domain, i.e., domain start, restore, and
+ * incoming migration.
+ *
+ * Since: 11.9.0
+ */
+# define VIR_DOMAIN_JOB_STARTUP_PHASE_PREFIX "startup_phase."
+
 /**
  * virConnectDomainEventGenericCallback:
  * @conn: the connection pointer
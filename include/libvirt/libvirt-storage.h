@@ -483,6 +483,8 @@ int                     virStorageVolWipe               (virStorageVolPtr vol,
 int                     virStorageVolWipePattern        (virStorageVolPtr vol,
                                                          unsigned int algorithm,
                                                          unsigned int flags);
+int                     virStorageVolWipeAbort          (virStorageVolPtr vol,
+                                                         unsigned int flags);
 int                     virStorageVolRef                (virStorageVolPtr vol);
 int                     virStorageVolFree               (virStorageVolPtr vol);
 
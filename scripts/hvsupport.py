@@ -226,6 +226,10 @@ apis["virDomainMigrateConfirm3Params"] = {
     "vers": "1.1.0"
 }
 
+apis["virDomainMigrateAddTunnelChannel"] = {
+    "vers": "11.9.0"
+}
+
 
 # Now we want to get the mapping between public APIs
 # and driver struct fields. This lets us later match
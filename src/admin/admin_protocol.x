@@ -46,6 +46,9 @@ const ADMIN_CLIENT_INFO_PARAMETERS_MAX = 64;
 /* Upper limit on number of client processing controls */
 const ADMIN_SERVER_CLIENT_LIMITS_MAX = 32;
 
+/* Upper limit on number of server statistics */
+const ADMIN_SERVER_STATS_MAX = 65536;
+
 /* A long string, which may NOT be NULL. */
 typedef string admin_nonnull_string<ADMIN_STRING_MAX>;
 
@@ -223,6 +226,15 @@ struct admin_connect_daemon_shutdown_args {
     unsigned int flags;
 };
 
+struct admin_server_get_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_STATS_MAX>;
+};
+
 /* Define the program number, protocol version and procedure numbers here. */
 const ADMIN_PROGRAM = 0x06900690;
 const ADMIN_PROTOCOL_VERSION = 1;
@@ -343,5 +355,10 @@ enum admin_procedure {
     /**
      * @generate: both
      */
-    ADMIN_PROC_CONNECT_DAEMON_SHUTDOWN = 20
+    ADMIN_PROC_CONNECT_DAEMON_SHUTDOWN = 20,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_STATS = 21
 };
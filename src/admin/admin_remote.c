@@ -345,6 +345,37 @@ remoteAdminServerGetClientLimits(virAdmServerPtr srv,
     return 0;
 }
 
+static int
+remoteAdminServerGetStats(virAdmServerPtr srv,
+                          virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags)
+{
+    admin_server_get_stats_args args;
+    g_auto(admin_server_get_stats_ret) ret = {0};
+    remoteAdminPriv *priv = srv->conn->privateData;
+    VIR_LOCK_GUARD lock = virObjectLockGuard(priv);
+
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_STATS,
+             (xdrproc_t) xdr_admin_server_get_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_stats_ret,
+             (char *) &ret) == -1)
+        return -1;
+
+    if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        return -1;
+
+    return 0;
+}
+
 static int
 remoteAdminServerSetClientLimits(virAdmServerPtr srv,
                                  virTypedParameterPtr params,
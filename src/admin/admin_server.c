@@ -24,6 +24,7 @@
 #include "virerror.h"
 #include "viridentity.h"
 #include "virlog.h"
+#include "virmetrics.h"
 #include "rpc/virnetdaemon.h"
 #include "rpc/virnetserver.h"
 #include "virtypedparam.h"
@@ -322,3 +323,22 @@ adminServerUpdateTlsFiles(virNetServer *srv,
 
     return virNetServerUpdateTlsFiles(srv);
 }
+
+int
+adminServerGetStats(virNetServer *srv,
+                    virTypedParameterPtr *params,
+                    int *nparams,
+                    unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = virTypedParamListNew();
+
+    virCheckFlags(0, -1);
+
+    virNetServerGetMetrics(srv, paramlist);
+    virMetricsGetParams(paramlist);
+
+    if (virTypedParamListSteal(paramlist, params, nparams) < 0)
+        return -1;
+
+    return 0;
+}
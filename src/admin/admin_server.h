@@ -69,3 +69,8 @@ int adminServerSetClientLimits(virNetServer *srv,
 
 int adminServerUpdateTlsFiles(virNetServer *srv,
                               unsigned int flags);
+
+int adminServerGetStats(virNetServer *srv,
+                        virTypedParameterPtr *params,
+                        int *nparams,
+                        unsigned int flags);
@@ -412,6 +412,43 @@ adminDispatchServerSetClientLimits(virNetServer *server G_GNUC_UNUSED,
     return rv;
 }
 
+static int
+adminDispatchServerGetStats(virNetServer *server G_GNUC_UNUSED,
+                            virNetServerClient *client,
+                            virNetMessage *msg G_GNUC_UNUSED,
+                            struct virNetMessageError *rerr,
+                            admin_server_get_stats_args *args,
+                            admin_server_get_stats_ret *ret)
+{
+    int rv = -1;
+    virNetServer *srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetStats(srv, &params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_SERVER_STATS_MAX,
+                                (struct _virTypedParameterRemote **) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
 /* Returns the number of outputs stored in @outputs */
 static int
 adminConnectGetLoggingOutputs(char **outputs, unsigned int flags)
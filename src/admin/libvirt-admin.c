@@ -1158,6 +1158,73 @@ virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
     return ret;
 }
 
+/**
+ * virAdmServerGetStats:
+ * @srv: a valid server object reference
+ * @params: pointer to statistics object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve runtime statistics collected by the daemon running server @srv.
+ * The statistics are latency histograms, each of them reported as a set of
+ * VIR_TYPED_PARAM_ULLONG parameters:
+ *
+ *  - "NAME.count": number of recorded values,
+ *  - "NAME.sum": sum of the recorded values,
+ *  - "NAME.max": the largest recorded value,
+ *  - "NAME.bucket.BOUND": number of recorded values smaller than BOUND and
+ *    at least as large as the bound of the previous bucket; bounds are
+ *    powers of two and only non-empty buckets are reported, values larger
+ *    than any bound are counted in "NAME.bucket.inf".
+ *
+ * Unless documented otherwise, the values are durations in microseconds.
+ * The set of histograms depends on the daemon and the drivers it runs, e.g.
+ * the QEMU driver reports "qemu.startup.PHASE" histograms with the time
+ * spent in individual phases of starting domains.
+ *
+ * If the daemon is configured to collect metrics, it also reports
+ * "rpc.PROCEDURE.queue_wait", "rpc.PROCEDURE.exec" and
+ * "rpc.PROCEDURE.serialize" histograms with the time RPC calls spent
+ * waiting for a worker thread, being executed and (de)serializing their
+ * arguments and return values, where PROCEDURE is the name of the
+ * procedure, such as "remoteDomainGetInfo". Unlike the rest of the
+ * statistics, which are collected for the whole daemon, these histograms
+ * only cover procedures served by @srv. Time spent waiting for the
+ * lock of a domain object is reported in "domain.lock_wait" and time spent
+ * waiting for a domain job in "domain.job_wait.JOB",
+ * "domain.agent_job_wait.JOB" and "domain.async_job_wait.JOB".
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ *
+ * Since: 11.9.0
+ */
+int
+virAdmServerGetStats(virAdmServerPtr srv,
+                     virTypedParameterPtr *params,
+                     int *nparams,
+                     unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=0x%x",
+              srv, params, nparams, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetStats(srv, params, nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
 /**
  * virAdmConnectGetLoggingOutputs:
  * @conn: pointer to an active admin connection
@@ -1501,6 +1501,8 @@ chConnectSupportsFeature(virConnectPtr conn,
         case VIR_DRV_FEATURE_REMOTE:
         case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
         case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+        case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD:
+        case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
         case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
         case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
         case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
@@ -1515,6 +1517,7 @@ chConnectSupportsFeature(virConnectPtr conn,
         case VIR_DRV_FEATURE_MIGRATE_CHANGE_PROTECTION:
         case VIR_DRV_FEATURE_XML_MIGRATABLE:
         case VIR_DRV_FEATURE_MIGRATION_OFFLINE:
+        case VIR_DRV_FEATURE_MIGRATION_TUNNEL_CHANNELS:
         case VIR_DRV_FEATURE_MIGRATION_PARAMS:
         case VIR_DRV_FEATURE_MIGRATION_DIRECT:
         case VIR_DRV_FEATURE_MIGRATION_V1:
@@ -4287,6 +4287,8 @@ virDomainObjNew(virDomainXMLOption *xmlopt)
                             &xmlopt->jobObjConfig.cb,
                             &xmlopt->jobObjConfig.jobDataPrivateCb) < 0)
         goto error;
+    domain->job->maxQueuedJobs = xmlopt->jobObjConfig.maxQueuedJobs;
+    domain->job->failBusyQueries = xmlopt->jobObjConfig.failBusyQueries;
 
     virObjectLock(domain);
     virDomainObjSetState(domain, VIR_DOMAIN_SHUTOFF,
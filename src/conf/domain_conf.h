@@ -3608,6 +3608,7 @@ struct _virDomainJobObjConfig {
     virDomainObjPrivateJobCallbacks cb;
     virDomainJobDataPrivateDataCallbacks jobDataPrivateCb;
     unsigned int maxQueuedJobs;
+    bool failBusyQueries;
 };
 
 
@@ -449,6 +449,96 @@ virStorageVolDefFree(virStorageVolDef *def)
 }
 
 
+virStorageVolWipeJob *
+virStorageVolWipeJobNew(void)
+{
+    g_autofree virStorageVolWipeJob *job = g_new0(virStorageVolWipeJob, 1);
+
+    if (virMutexInit(&job->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to init volume wipe job mutex"));
+        return NULL;
+    }
+
+    return g_steal_pointer(&job);
+}
+
+
+void
+virStorageVolWipeJobFree(virStorageVolWipeJob *job)
+{
+    if (!job)
+        return;
+
+    virMutexDestroy(&job->lock);
+    g_free(job);
+}
+
+
+/**
+ * virStorageVolWipeJobStart:
+ * @job: wipe job
+ * @total: number of bytes to be zeroed
+ *
+ * To be called by the backend once it starts zeroing data in a way which
+ * reports progress and checks whether the job was aborted. Until then the
+ * job can't be aborted.
+ */
+void
+virStorageVolWipeJobStart(virStorageVolWipeJob *job,
+                          unsigned long long total)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&job->lock);
+
+    job->total = total;
+    job->done = 0;
+}
+
+
+/**
+ * virStorageVolWipeJobUpdate:
+ * @job: wipe job
+ * @len: number of bytes zeroed since the last update
+ *
+ * Returns false if the job was aborted and zeroing should stop,
+ * true otherwise.
+ */
+bool
+virStorageVolWipeJobUpdate(virStorageVolWipeJob *job,
+                           unsigned long long len)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&job->lock);
+
+    job->done += len;
+    return !job->abort;
+}
+
+
+/**
+ * virStorageVolWipeJobAbort:
+ * @job: wipe job
+ *
+ * Asks the thread wiping the volume to stop.
+ *
+ * Returns 0 on success, -1 if the wipe can't be aborted (with error
+ * reported).
+ */
+int
+virStorageVolWipeJobAbort(virStorageVolWipeJob *job)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&job->lock);
+
+    if (job->total == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("wiping of the volume cannot be aborted"));
+        return -1;
+    }
+
+    job->abort = true;
+    return 0;
+}
+
+
 void
 virStoragePoolSourceDeviceClear(virStoragePoolSourceDevice *dev)
 {
@@ -1592,6 +1682,22 @@ virStorageVolDefFormat(virStoragePoolDef *pool,
         virBufferAsprintf(&buf, "<physical unit='bytes'>%llu</physical>\n",
                           def->target.physical);
 
+    /* Display only as well, progress of a running wipe */
+    if (def->wipeJob) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&def->wipeJob->lock) {
+            if (def->wipeJob->total > 0) {
+                virBufferAddLit(&buf, "<wipe>\n");
+                virBufferAdjustIndent(&buf, 2);
+                virBufferAsprintf(&buf, "<total unit='bytes'>%llu</total>\n",
+                                  def->wipeJob->total);
+                virBufferAsprintf(&buf, "<done unit='bytes'>%llu</done>\n",
+                                  def->wipeJob->done);
+                virBufferAdjustIndent(&buf, -2);
+                virBufferAddLit(&buf, "</wipe>\n");
+            }
+        }
+    }
+
     if (virStorageVolTargetDefFormat(options, &buf,
                                      &def->target, "target") < 0)
         return NULL;
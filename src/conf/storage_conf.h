@@ -27,6 +27,7 @@
 #include "object_event.h"
 #include "storage_adapter_conf.h"
 #include "virenum.h"
+#include "virthread.h"
 #include "virxml.h"
 
 
@@ -71,6 +72,16 @@ typedef enum {
 
 VIR_ENUM_DECL(virStorageVolDefRefreshAllocation);
 
+/* Progress of wiping a volume. The wiping thread updates it without
+ * holding the lock of the pool. */
+typedef struct _virStorageVolWipeJob virStorageVolWipeJob;
+struct _virStorageVolWipeJob {
+    virMutex lock;
+    unsigned long long total; /* bytes to be zeroed, 0 if not tracked */
+    unsigned long long done;  /* bytes zeroed so far */
+    bool abort;
+};
+
 typedef struct _virStorageVolDef virStorageVolDef;
 struct _virStorageVolDef {
     char *name;
@@ -79,6 +90,7 @@ struct _virStorageVolDef {
 
     bool building;
     unsigned int in_use;
+    virStorageVolWipeJob *wipeJob; /* set while the volume is being wiped */
 
     virStorageVolSource source;
     virStorageSource target;
@@ -314,6 +326,23 @@ virStoragePoolSaveConfig(const char *configFile,
 void
 virStorageVolDefFree(virStorageVolDef *def);
 
+virStorageVolWipeJob *
+virStorageVolWipeJobNew(void);
+
+void
+virStorageVolWipeJobFree(virStorageVolWipeJob *job);
+
+void
+virStorageVolWipeJobStart(virStorageVolWipeJob *job,
+                          unsigned long long total);
+
+bool
+virStorageVolWipeJobUpdate(virStorageVolWipeJob *job,
+                           unsigned long long len);
+
+int
+virStorageVolWipeJobAbort(virStorageVolWipeJob *job);
+
 void
 virStoragePoolSourceClear(virStoragePoolSource *source);
 
@@ -12,6 +12,7 @@
 #include "viralloc.h"
 #include "virthreadjob.h"
 #include "virlog.h"
+#include "virmetrics.h"
 #include "virtime.h"
 #include "domain_conf.h"
 
@@ -132,20 +133,9 @@ virDomainObjInitJob(virDomainJobObj *job,
     job->cb = g_memdup2(cb, sizeof(*cb));
     job->jobDataPrivateCb = g_memdup2(jobDataPrivateCb, sizeof(*jobDataPrivateCb));
 
-    if (virCondInit(&job->cond) < 0)
-        return -1;
-
-    if (virCondInit(&job->asyncCond) < 0) {
-        virCondDestroy(&job->cond);
-        return -1;
-    }
-
     if (job->cb && job->cb->allocJobPrivate &&
-        !(job->privateData = job->cb->allocJobPrivate())) {
-        virCondDestroy(&job->cond);
-        virCondDestroy(&job->asyncCond);
+        !(job->privateData = job->cb->allocJobPrivate()))
         return -1;
-    }
 
     return 0;
 }
@@ -226,8 +216,6 @@ virDomainObjClearJob(virDomainJobObj *job)
     virDomainObjResetAsyncJob(job);
     g_clear_pointer(&job->current, virDomainJobDataFree);
     g_clear_pointer(&job->completed, virDomainJobDataFree);
-    virCondDestroy(&job->cond);
-    virCondDestroy(&job->asyncCond);
 
     if (job->cb && job->cb->freeJobPrivate)
         g_clear_pointer(&job->privateData, job->cb->freeJobPrivate);
@@ -271,9 +259,309 @@ virDomainObjCanSetJob(virDomainJobObj *job,
              job->agentActive == VIR_AGENT_JOB_NONE));
 }
 
+
+/* A thread waiting in virDomainObjBeginJobInternal. It lives on the
+ * stack of the waiting thread and is linked in job->waiters until the
+ * job is handed over to it or it gives up waiting. */
+struct _virDomainJobWaiter {
+    virCond cond;
+    virDomainJob job;
+    virDomainAgentJob agentJob;
+    virDomainAsyncJob asyncJob;
+    unsigned long long owner;   /* Thread id of the waiting thread */
+    const char *ownerAPI;       /* The API the thread runs */
+    bool urgent;
+    bool granted;
+
+    virDomainJobWaiter *next;
+};
+
+
+/* Jobs which overtake all other waiters as they either end the domain or
+ * its async job or are needed for the async job to make progress. */
+static bool
+virDomainJobIsUrgent(virDomainJob job)
+{
+    return job == VIR_JOB_DESTROY ||
+           job == VIR_JOB_ABORT ||
+           job == VIR_JOB_ASYNC_NESTED;
+}
+
+
+static void
+virDomainJobObjAddWaiter(virDomainJobObj *job,
+                         virDomainJobWaiter *waiter)
+{
+    virDomainJobWaiter **next = &job->waiters;
+
+    while (*next && (!waiter->urgent || (*next)->urgent))
+        next = &(*next)->next;
+
+    waiter->next = *next;
+    *next = waiter;
+
+    if (waiter->job)
+        job->jobsWaiting++;
+    if (waiter->agentJob)
+        job->agentJobsWaiting++;
+}
+
+
+static void
+virDomainJobObjRemoveWaiter(virDomainJobObj *job,
+                            virDomainJobWaiter *waiter)
+{
+    virDomainJobWaiter **next = &job->waiters;
+
+    while (*next && *next != waiter)
+        next = &(*next)->next;
+
+    if (!*next)
+        return;
+
+    *next = waiter->next;
+    waiter->next = NULL;
+
+    if (waiter->job)
+        job->jobsWaiting--;
+    if (waiter->agentJob)
+        job->agentJobsWaiting--;
+}
+
+
+/* Starts the job @waiter asks for on its behalf */
+static void
+virDomainObjSetJob(virDomainObj *obj,
+                   virDomainJobObj *jobObj,
+                   virDomainJobWaiter *waiter)
+{
+    unsigned long long now = 0;
+
+    ignore_value(virTimeMillisNow(&now));
+
+    if (waiter->job) {
+        virDomainObjResetJob(jobObj);
+
+        if (waiter->job != VIR_JOB_ASYNC) {
+            VIR_DEBUG("Started job: %s (async=%s vm=%p name=%s)",
+                      virDomainJobTypeToString(waiter->job),
+                      virDomainAsyncJobTypeToString(jobObj->asyncJob),
+                      obj, obj->def->name);
+            jobObj->active = waiter->job;
+            jobObj->owner = waiter->owner;
+            jobObj->ownerAPI = g_strdup(waiter->ownerAPI);
+            jobObj->started = now;
+        } else {
+            VIR_DEBUG("Started async job: %s (vm=%p name=%s)",
+                      virDomainAsyncJobTypeToString(waiter->asyncJob),
+                      obj, obj->def->name);
+            virDomainObjResetAsyncJob(jobObj);
+            jobObj->current = virDomainJobDataInit(jobObj->jobDataPrivateCb);
+            jobObj->current->status = VIR_DOMAIN_JOB_STATUS_ACTIVE;
+            jobObj->asyncJob = waiter->asyncJob;
+            jobObj->asyncOwner = waiter->owner;
+            jobObj->asyncOwnerAPI = g_strdup(waiter->ownerAPI);
+            jobObj->asyncStarted = now;
+            jobObj->current->started = now;
+        }
+    }
+
+    if (waiter->agentJob) {
+        virDomainObjResetAgentJob(jobObj);
+        VIR_DEBUG("Started agent job: %s (vm=%p name=%s job=%s async=%s)",
+                  virDomainAgentJobTypeToString(waiter->agentJob),
+                  obj, obj->def->name,
+                  virDomainJobTypeToString(jobObj->active),
+                  virDomainAsyncJobTypeToString(jobObj->asyncJob));
+        jobObj->agentActive = waiter->agentJob;
+        jobObj->agentOwner = waiter->owner;
+        jobObj->agentOwnerAPI = g_strdup(waiter->ownerAPI);
+        jobObj->agentStarted = now;
+    }
+}
+
+
+/*
+ * Hands the job over to waiting threads in the order they are queued in
+ * as long as the requested jobs can be set. The job is started on behalf
+ * of the waiting thread before it is woken up so that no other thread can
+ * take it in the meantime. A waiter which cannot get the job blocks all
+ * waiters behind it asking for the kind of job it can't get, except for waiters
+ * for jobs not allowed by the current async job, which would otherwise
+ * stall everyone until the async job finishes.
+ */
+static void
+virDomainJobObjDispatch(virDomainObj *obj,
+                        virDomainJobObj *job)
+{
+    virDomainJobWaiter *waiter = job->waiters;
+    bool jobBlocked = false;
+    bool agentJobBlocked = false;
+
+    while (waiter) {
+        virDomainJobWaiter *next = waiter->next;
+        bool jobBusy;
+        bool agentJobBusy;
+
+        if (waiter->job != VIR_JOB_ASYNC_NESTED &&
+            !virDomainNestedJobAllowed(job, waiter->job)) {
+            waiter = next;
+            continue;
+        }
+
+        /* Only the kind of job which can't be set blocks waiters behind,
+         * e.g. a thread waiting for both a job and an agent job because
+         * of a hung agent must not block threads waiting just for a job. */
+        jobBusy = waiter->job &&
+                  (jobBlocked || job->active != VIR_JOB_NONE);
+        agentJobBusy = waiter->agentJob &&
+                       (agentJobBlocked || job->agentActive != VIR_AGENT_JOB_NONE);
+
+        if (jobBusy || agentJobBusy) {
+            if (jobBusy)
+                jobBlocked = true;
+            if (agentJobBusy)
+                agentJobBlocked = true;
+            waiter = next;
+            continue;
+        }
+
+        virDomainJobObjRemoveWaiter(job, waiter);
+        virDomainObjSetJob(obj, job, waiter);
+
+        waiter->granted = true;
+        virCondSignal(&waiter->cond);
+
+        waiter = next;
+    }
+}
+
+
+/**
+ * virDomainObjDispatchJob:
+ * @obj: locked domain object
+ *
+ * Hands the job of @obj over to threads waiting for it. Must be called
+ * whenever a job ends or the set of jobs allowed during an async job
+ * changes.
+ */
+void
+virDomainObjDispatchJob(virDomainObj *obj)
+{
+    virDomainJobObjDispatch(obj, obj->job);
+}
+
+
+/*
+ * Queues @waiter and waits until the job it asks for is handed over to it
+ * or @then passes. If @nowait is true, the function doesn't wait at all.
+ *
+ * Returns 0 if the job was handed over, 1 if it wasn't and @nowait is
+ * true, -1 with errno set otherwise.
+ */
+static int
+virDomainObjWaitForJob(virDomainObj *obj,
+                       virDomainJobObj *job,
+                       virDomainJobWaiter *waiter,
+                       bool nowait,
+                       unsigned long long then)
+{
+    int ret = 0;
+    int save_errno;
+
+    if (virCondInit(&waiter->cond) < 0)
+        return -1;
+
+    virDomainJobObjAddWaiter(job, waiter);
+    virDomainJobObjDispatch(obj, job);
+
+    while (!waiter->granted) {
+        if (nowait) {
+            ret = 1;
+            break;
+        }
+
+        VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
+        if (virCondWaitUntil(&waiter->cond, &obj->parent.lock, then) < 0 &&
+            !waiter->granted) {
+            ret = -1;
+            break;
+        }
+    }
+
+    save_errno = errno;
+
+    if (ret != 0) {
+        /* @waiter might have been blocking waiters which can run now */
+        virDomainJobObjRemoveWaiter(job, waiter);
+        virDomainJobObjDispatch(obj, job);
+    }
+
+    virCondDestroy(&waiter->cond);
+    errno = save_errno;
+
+    return ret;
+}
+
+
 /* Give up waiting for mutex after 30 seconds */
 #define VIR_JOB_WAIT_TIME (1000ull * 30)
 
+/*
+ * Records @waited microseconds spent waiting for a job of @kind called
+ * @name in the "domain.KIND_wait.NAME" histogram. Waits which did not
+ * end with the job are distinguished by @suffix.
+ */
+static void
+virDomainObjJobWaitAddMetric(const char *kind,
+                             const char *name,
+                             const char *suffix,
+                             unsigned long long waited)
+{
+    g_autofree char *metric = g_strdup_printf("domain.%s_wait.%s%s",
+                                              kind, name, suffix);
+
+    /* some job names contain spaces */
+    g_strdelimit(metric, " ", '_');
+
+    virMetricsHistogramAdd(virMetricsHistogramGet("%s", metric), waited);
+}
+
+
+/*
+ * Records the time since @waitStart in the histograms of all jobs a thread
+ * asked for. Nothing is recorded if @waitStart is 0, i.e., metrics were
+ * disabled when the thread started waiting.
+ */
+static void
+virDomainObjJobWaitRecord(virDomainJob job,
+                          virDomainAgentJob agentJob,
+                          virDomainAsyncJob asyncJob,
+                          unsigned long long waitStart,
+                          const char *suffix)
+{
+    unsigned long long waited;
+
+    if (!waitStart)
+        return;
+
+    waited = g_get_monotonic_time() - waitStart;
+
+    if (job == VIR_JOB_ASYNC)
+        virDomainObjJobWaitAddMetric("async_job",
+                                     virDomainAsyncJobTypeToString(asyncJob),
+                                     suffix, waited);
+    else if (job)
+        virDomainObjJobWaitAddMetric("job", virDomainJobTypeToString(job),
+                                     suffix, waited);
+
+    if (agentJob)
+        virDomainObjJobWaitAddMetric("agent_job",
+                                     virDomainAgentJobTypeToString(agentJob),
+                                     suffix, waited);
+}
+
+
 /**
  * virDomainObjBeginJobInternal:
  * @obj: virDomainObj = domain object
@@ -286,12 +574,16 @@ virDomainObjCanSetJob(virDomainJobObj *job,
  * Acquires job for a domain object which must be locked before
  * calling. If there's already a job running waits up to
  * VIR_JOB_WAIT_TIME after which the functions fails reporting
- * an error unless @nowait is set.
+ * an error unless @nowait is set. Waiting threads get the job
+ * in the order they asked for it, see virDomainObjDispatchJob.
  *
  * If @nowait is true this function tries to acquire job and if
  * it fails, then it returns immediately without waiting. No
  * error is reported in this case.
  *
+ * If failBusyQueries is set in @jobObj, query jobs don't wait
+ * either, but fail with VIR_ERR_RESOURCE_BUSY.
+ *
  * Returns: 0 on success,
  *         -2 if unable to start job because of timeout or
  *            maxQueuedJobs limit,
@@ -314,7 +606,20 @@ virDomainObjBeginJobInternal(virDomainObj *obj,
     unsigned long long duration = 0;
     unsigned long long agentDuration = 0;
     unsigned long long asyncDuration = 0;
+    unsigned long long waitStart = 0;
     const char *currentAPI = virThreadJobGet();
+    virDomainJobWaiter waiter = {
+        .job = job,
+        .agentJob = agentJob,
+        .asyncJob = asyncJob,
+        .owner = virThreadSelfID(),
+        .ownerAPI = currentAPI,
+        .urgent = virDomainJobIsUrgent(job),
+    };
+    bool query = (job == VIR_JOB_QUERY && !agentJob) ||
+                 (!job && agentJob == VIR_AGENT_JOB_QUERY);
+    bool failBusy = !nowait && query && jobObj->failBusyQueries;
+    int rc;
 
     VIR_DEBUG("Starting job: API=%s job=%s agentJob=%s asyncJob=%s "
               "(vm=%p name=%s, current job=%s agentJob=%s async=%s)",
@@ -330,10 +635,12 @@ virDomainObjBeginJobInternal(virDomainObj *obj,
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
+    if (virMetricsIsEnabled())
+        waitStart = g_get_monotonic_time();
+
     jobObj->jobsQueued++;
     then = now + VIR_JOB_WAIT_TIME;
 
- retry:
     if (job != VIR_JOB_ASYNC &&
         job != VIR_JOB_DESTROY &&
         jobObj->maxQueuedJobs &&
@@ -341,32 +648,46 @@ virDomainObjBeginJobInternal(virDomainObj *obj,
         goto error;
     }
 
-    while (!nested && !virDomainNestedJobAllowed(jobObj, job)) {
-        if (nowait)
-            goto cleanup;
-
-        VIR_DEBUG("Waiting for async job (vm=%p name=%s)", obj, obj->def->name);
-        if (virCondWaitUntil(&jobObj->asyncCond, &obj->parent.lock, then) < 0)
-            goto error;
-    }
-
-    while (!virDomainObjCanSetJob(jobObj, job, agentJob)) {
-        if (nowait)
-            goto cleanup;
+    if ((rc = virDomainObjWaitForJob(obj, jobObj, &waiter,
+                                     nowait || failBusy, then)) < 0)
+        goto error;
 
-        VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
-        if (virCondWaitUntil(&jobObj->cond, &obj->parent.lock, then) < 0)
-            goto error;
+    if (rc > 0) {
+        if (failBusy) {
+            virDomainObjJobWaitRecord(job, agentJob, asyncJob, waitStart,
+                                      ".busy");
+
+            if (agentJob)
+                blocker = jobObj->agentOwnerAPI;
+            else if (virDomainNestedJobAllowed(jobObj, job))
+                blocker = jobObj->ownerAPI;
+            else
+                blocker = jobObj->asyncOwnerAPI;
+
+            if (blocker) {
+                virReportError(VIR_ERR_RESOURCE_BUSY,
+                               _("domain '%1$s' is busy (state change lock held by %2$s)"),
+                               obj->def->name, blocker);
+            } else {
+                virReportError(VIR_ERR_RESOURCE_BUSY,
+                               _("domain '%1$s' is busy"), obj->def->name);
+            }
+        }
+        goto cleanup;
     }
 
-    /* No job is active but a new async job could have been started while obj
-     * was unlocked, so we need to recheck it. */
-    if (!nested && !virDomainNestedJobAllowed(jobObj, job))
-        goto retry;
-
     if (obj->removing) {
         char uuidstr[VIR_UUID_STRING_BUFLEN];
 
+        /* give the job back */
+        if (job == VIR_JOB_ASYNC)
+            virDomainObjResetAsyncJob(jobObj);
+        else if (job)
+            virDomainObjResetJob(jobObj);
+        if (agentJob)
+            virDomainObjResetAgentJob(jobObj);
+        virDomainJobObjDispatch(obj, jobObj);
+
         virUUIDFormat(obj->def->uuid, uuidstr);
         virReportError(VIR_ERR_NO_DOMAIN,
                        _("no domain with matching uuid '%1$s' (%2$s)"),
@@ -374,47 +695,7 @@ virDomainObjBeginJobInternal(virDomainObj *obj,
         goto cleanup;
     }
 
-    ignore_value(virTimeMillisNow(&now));
-
-    if (job) {
-        virDomainObjResetJob(jobObj);
-
-        if (job != VIR_JOB_ASYNC) {
-            VIR_DEBUG("Started job: %s (async=%s vm=%p name=%s)",
-                      virDomainJobTypeToString(job),
-                      virDomainAsyncJobTypeToString(jobObj->asyncJob),
-                      obj, obj->def->name);
-            jobObj->active = job;
-            jobObj->owner = virThreadSelfID();
-            jobObj->ownerAPI = g_strdup(virThreadJobGet());
-            jobObj->started = now;
-        } else {
-            VIR_DEBUG("Started async job: %s (vm=%p name=%s)",
-                      virDomainAsyncJobTypeToString(asyncJob),
-                      obj, obj->def->name);
-            virDomainObjResetAsyncJob(jobObj);
-            jobObj->current = virDomainJobDataInit(jobObj->jobDataPrivateCb);
-            jobObj->current->status = VIR_DOMAIN_JOB_STATUS_ACTIVE;
-            jobObj->asyncJob = asyncJob;
-            jobObj->asyncOwner = virThreadSelfID();
-            jobObj->asyncOwnerAPI = g_strdup(virThreadJobGet());
-            jobObj->asyncStarted = now;
-            jobObj->current->started = now;
-        }
-    }
-
-    if (agentJob) {
-        virDomainObjResetAgentJob(jobObj);
-        VIR_DEBUG("Started agent job: %s (vm=%p name=%s job=%s async=%s)",
-                  virDomainAgentJobTypeToString(agentJob),
-                  obj, obj->def->name,
-                  virDomainJobTypeToString(jobObj->active),
-                  virDomainAsyncJobTypeToString(jobObj->asyncJob));
-        jobObj->agentActive = agentJob;
-        jobObj->agentOwner = virThreadSelfID();
-        jobObj->agentOwnerAPI = g_strdup(virThreadJobGet());
-        jobObj->agentStarted = now;
-    }
+    virDomainObjJobWaitRecord(job, agentJob, asyncJob, waitStart, "");
 
     if (virDomainTrackJob(job) && jobObj->cb &&
         jobObj->cb->saveStatusPrivate)
@@ -460,6 +741,9 @@ virDomainObjBeginJobInternal(virDomainObj *obj,
         agentBlocker = jobObj->agentOwnerAPI;
 
     if (errno == ETIMEDOUT) {
+        virDomainObjJobWaitRecord(job, agentJob, asyncJob, waitStart,
+                                  ".timeout");
+
         if (blocker && agentBlocker) {
             virReportError(VIR_ERR_OPERATION_TIMEOUT,
                            _("cannot acquire state change lock (held by monitor=%1$s agent=%2$s)"),
@@ -479,6 +763,9 @@ virDomainObjBeginJobInternal(virDomainObj *obj,
         ret = -2;
     } else if (jobObj->maxQueuedJobs &&
                jobObj->jobsQueued > jobObj->maxQueuedJobs) {
+        virDomainObjJobWaitRecord(job, agentJob, asyncJob, waitStart,
+                                  ".busy");
+
         if (blocker && agentBlocker) {
             virReportError(VIR_ERR_OPERATION_FAILED,
                            _("cannot acquire state change lock (held by monitor=%1$s agent=%2$s) due to max_queued limit"),
@@ -621,9 +908,8 @@ virDomainObjEndJob(virDomainObj *obj)
     if (virDomainTrackJob(job) && obj->job->cb &&
         obj->job->cb->saveStatusPrivate)
         obj->job->cb->saveStatusPrivate(obj);
-    /* We indeed need to wake up ALL threads waiting because
-     * grabbing a job requires checking more variables. */
-    virCondBroadcast(&obj->job->cond);
+
+    virDomainObjDispatchJob(obj);
 }
 
 void
@@ -639,9 +925,8 @@ virDomainObjEndAgentJob(virDomainObj *obj)
               obj, obj->def->name);
 
     virDomainObjResetAgentJob(obj->job);
-    /* We indeed need to wake up ALL threads waiting because
-     * grabbing a job requires checking more variables. */
-    virCondBroadcast(&obj->job->cond);
+
+    virDomainObjDispatchJob(obj);
 }
 
 void
@@ -656,5 +941,6 @@ virDomainObjEndAsyncJob(virDomainObj *obj)
     virDomainObjResetAsyncJob(obj->job);
     if (obj->job->cb && obj->job->cb->saveStatusPrivate)
         obj->job->cb->saveStatusPrivate(obj);
-    virCondBroadcast(&obj->job->asyncCond);
+
+    virDomainObjDispatchJob(obj);
 }
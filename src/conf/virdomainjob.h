@@ -155,12 +155,18 @@ virDomainJobStatusToType(virDomainJobStatus status);
 
 typedef struct _virDomainObjPrivateJobCallbacks virDomainObjPrivateJobCallbacks;
 
+typedef struct _virDomainJobWaiter virDomainJobWaiter;
+
 typedef struct _virDomainJobObj virDomainJobObj;
 struct _virDomainJobObj {
-    virCond cond;               /* Use to coordinate jobs */
+    virDomainJobWaiter *waiters; /* Threads waiting for a job in the order
+                                    in which they get it */
+    size_t jobsWaiting;          /* Number of waiters for VIR_JOB_* */
+    size_t agentJobsWaiting;     /* Number of waiters for VIR_AGENT_JOB_* */
 
     int jobsQueued;
     unsigned int maxQueuedJobs;
+    bool failBusyQueries;       /* Don't wait for query jobs */
 
     /* The following members are for VIR_JOB_* */
     virDomainJob active;        /* currently running job */
@@ -175,7 +181,6 @@ struct _virDomainJobObj {
     unsigned long long agentStarted;    /* When the current agent job started */
 
     /* The following members are for VIR_ASYNC_JOB_* */
-    virCond asyncCond;                  /* Use to coordinate with async jobs */
     virDomainAsyncJob asyncJob;        /* Currently active async job */
     unsigned long long asyncOwner;      /* Thread which set current async job */
     char *asyncOwnerAPI;                /* The API which owns the async job */
@@ -243,6 +248,8 @@ bool virDomainObjCanSetJob(virDomainJobObj *job,
                            virDomainJob newJob,
                            virDomainAgentJob newAgentJob);
 
+void virDomainObjDispatchJob(virDomainObj *obj);
+
 int virDomainObjBeginJobInternal(virDomainObj *obj,
                                  virDomainJobObj *jobObj,
                                  virDomainJob job,
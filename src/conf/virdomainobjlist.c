@@ -28,6 +28,7 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virmetrics.h"
 #include "virstring.h"
 #include "virdomainsnapshotobjlist.h"
 #include "virdomaincheckpointobjlist.h"
@@ -88,6 +89,33 @@ static void virDomainObjListDispose(void *obj)
 }
 
 
+/*
+ * Locks @obj looked up on behalf of an API, recording how long it took
+ * in the "domain.lock_wait" histogram if metrics are enabled.
+ */
+static void
+virDomainObjListLockObj(virDomainObj *obj)
+{
+    static virMetricsHistogram *lockWait;
+    virMetricsHistogram *hist;
+    unsigned long long start;
+
+    if (!virMetricsIsEnabled()) {
+        virObjectLock(obj);
+        return;
+    }
+
+    if (!(hist = g_atomic_pointer_get(&lockWait))) {
+        hist = virMetricsHistogramGet("domain.lock_wait");
+        g_atomic_pointer_set(&lockWait, hist);
+    }
+
+    start = g_get_monotonic_time();
+    virObjectLock(obj);
+    virMetricsHistogramAdd(hist, g_get_monotonic_time() - start);
+}
+
+
 static int virDomainObjListSearchID(const void *payload,
                                     const char *name G_GNUC_UNUSED,
                                     const void *data)
@@ -116,7 +144,7 @@ virDomainObjListFindByID(virDomainObjList *doms,
     virObjectRef(obj);
     virObjectRWUnlock(doms);
     if (obj) {
-        virObjectLock(obj);
+        virDomainObjListLockObj(obj);
         if (obj->removing)
             virDomainObjEndAPI(&obj);
     }
@@ -136,7 +164,7 @@ virDomainObjListFindByUUIDLocked(virDomainObjList *doms,
     obj = virHashLookup(doms->objs, uuidstr);
     if (obj) {
         virObjectRef(obj);
-        virObjectLock(obj);
+        virDomainObjListLockObj(obj);
     }
     return obj;
 }
@@ -176,7 +204,7 @@ virDomainObjListFindByNameLocked(virDomainObjList *doms,
     obj = virHashLookup(doms->objsName, name);
     if (obj) {
         virObjectRef(obj);
-        virObjectLock(obj);
+        virDomainObjListLockObj(obj);
     }
     return obj;
 }
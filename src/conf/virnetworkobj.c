@@ -27,6 +27,7 @@
 #include "virerror.h"
 #include "virfile.h"
 #include "virhash.h"
+#include "virlease.h"
 #include "virlog.h"
 #include "virstring.h"
 
@@ -286,6 +287,8 @@ virNetworkObjMacMgrAdd(virNetworkObj *obj,
 {
     char macStr[VIR_MAC_STRING_BUFLEN];
     g_autofree char *file = NULL;
+    int leaseIndexLock;
+    int rc;
 
     if (!obj->macmap)
         return 0;
@@ -298,10 +301,12 @@ virNetworkObjMacMgrAdd(virNetworkObj *obj,
     if (virMacMapAdd(obj->macmap, domain, macStr) < 0)
         return -1;
 
-    if (virMacMapWriteFile(obj->macmap, file) < 0)
-        return -1;
+    /* The MAC map is covered by the index of leases of the NSS module */
+    leaseIndexLock = virLeaseIndexUpdateBegin(dnsmasqStateDir);
+    rc = virMacMapWriteFile(obj->macmap, file);
+    virLeaseIndexUpdateEnd(dnsmasqStateDir, leaseIndexLock);
 
-    return 0;
+    return rc;
 }
 
 
@@ -313,6 +318,8 @@ virNetworkObjMacMgrDel(virNetworkObj *obj,
 {
     char macStr[VIR_MAC_STRING_BUFLEN];
     g_autofree char *file = NULL;
+    int leaseIndexLock;
+    int rc;
 
     if (!obj->macmap)
         return 0;
@@ -325,10 +332,12 @@ virNetworkObjMacMgrDel(virNetworkObj *obj,
     if (virMacMapRemove(obj->macmap, domain, macStr) < 0)
         return -1;
 
-    if (virMacMapWriteFile(obj->macmap, file) < 0)
-        return -1;
+    /* The MAC map is covered by the index of leases of the NSS module */
+    leaseIndexLock = virLeaseIndexUpdateBegin(dnsmasqStateDir);
+    rc = virMacMapWriteFile(obj->macmap, file);
+    virLeaseIndexUpdateEnd(dnsmasqStateDir, leaseIndexLock);
 
-    return 0;
+    return rc;
 }
 
 
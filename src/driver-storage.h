@@ -161,6 +161,10 @@ typedef int
                                unsigned int algorithm,
                                unsigned int flags);
 
+typedef int
+(*virDrvStorageVolWipeAbort)(virStorageVolPtr vol,
+                             unsigned int flags);
+
 typedef int
 (*virDrvStorageVolGetInfo)(virStorageVolPtr vol,
                            virStorageVolInfoPtr info);
@@ -276,4 +280,5 @@ struct _virStorageDriver {
     virDrvStorageVolResize storageVolResize;
     virDrvStoragePoolIsActive storagePoolIsActive;
     virDrvStoragePoolIsPersistent storagePoolIsPersistent;
+    virDrvStorageVolWipeAbort storageVolWipeAbort;
 };
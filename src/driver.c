@@ -346,10 +346,12 @@ virDriverFeatureIsGlobal(virDrvFeature feat,
     /* keepalive is handled at RPC level, driver implementations must always
      * return 0, to signal that direct/embedded use doesn't use keepalive */
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
-    /* Support for close callbacks and remote event filtering are both features
-     * of the RPC protocol and thus normal drivers must not signal support
-     * for them. */
+    /* Support for close callbacks, remote event filtering, large stream
+     * payloads and compact domain stats are all features of the RPC protocol
+     * and thus normal drivers must not signal support for them. */
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
         *supported = 0;
         return true;
@@ -380,6 +382,7 @@ virDriverFeatureIsGlobal(virDrvFeature feat,
     case VIR_DRV_FEATURE_MIGRATION_PARAMS:
     case VIR_DRV_FEATURE_MIGRATION_DIRECT:
     case VIR_DRV_FEATURE_MIGRATION_V1:
+    case VIR_DRV_FEATURE_MIGRATION_TUNNEL_CHANNELS:
     default:
         return false;
     }
@@ -31,6 +31,8 @@
 #include "driver.h"
 #include "virlog.h"
 #include "virsystemd.h"
+#include "virtypedparam.h"
+#include "viruuid.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -1027,3 +1029,207 @@ virDomainDriverAutoShutdown(virDomainDriverAutoShutdownConfig *cfg)
 
     VIR_FREE(domains);
 }
+
+
+/* Stats of a domain as last returned to a connection */
+typedef struct _virDomainDriverStatsSnapshot virDomainDriverStatsSnapshot;
+struct _virDomainDriverStatsSnapshot {
+    virTypedParameterPtr params;
+    int nparams;
+};
+
+
+static void
+virDomainDriverStatsSnapshotFree(void *opaque)
+{
+    virDomainDriverStatsSnapshot *snapshot = opaque;
+
+    virTypedParamsFree(snapshot->params, snapshot->nparams);
+    g_free(snapshot);
+}
+
+
+struct _virDomainDriverStatsCursors {
+    virMutex lock;
+    /* virConnectPtr -> GHashTable (domain UUID -> virDomainDriverStatsSnapshot) */
+    GHashTable *conns;
+};
+
+
+virDomainDriverStatsCursors *
+virDomainDriverStatsCursorsNew(void)
+{
+    virDomainDriverStatsCursors *cursors = g_new0(virDomainDriverStatsCursors, 1);
+
+    if (virMutexInit(&cursors->lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        g_free(cursors);
+        return NULL;
+    }
+
+    cursors->conns = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                           (GDestroyNotify) g_hash_table_unref);
+
+    return cursors;
+}
+
+
+void
+virDomainDriverStatsCursorsFree(virDomainDriverStatsCursors *cursors)
+{
+    if (!cursors)
+        return;
+
+    g_clear_pointer(&cursors->conns, g_hash_table_unref);
+    virMutexDestroy(&cursors->lock);
+    g_free(cursors);
+}
+
+
+static bool
+virDomainDriverStatsParamEqual(virTypedParameterPtr a,
+                               virTypedParameterPtr b)
+{
+    if (a->type != b->type)
+        return false;
+
+    switch ((virTypedParameterType) a->type) {
+    case VIR_TYPED_PARAM_INT:
+        return a->value.i == b->value.i;
+    case VIR_TYPED_PARAM_UINT:
+        return a->value.ui == b->value.ui;
+    case VIR_TYPED_PARAM_LLONG:
+        return a->value.l == b->value.l;
+    case VIR_TYPED_PARAM_ULLONG:
+        return a->value.ul == b->value.ul;
+    case VIR_TYPED_PARAM_DOUBLE:
+        return a->value.d == b->value.d;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        return a->value.b == b->value.b;
+    case VIR_TYPED_PARAM_STRING:
+        return STREQ_NULLABLE(a->value.s, b->value.s);
+    case VIR_TYPED_PARAM_LAST:
+        break;
+    }
+
+    return false;
+}
+
+
+/*
+ * Drop fields of @record whose value didn't change since @prev was
+ * returned. If some field of @prev is gone (e.g. after a device was
+ * unplugged) the record is kept complete as the caller wouldn't be
+ * able to tell otherwise.
+ */
+static void
+virDomainDriverStatsDelta(virDomainDriverStatsSnapshot *prev,
+                          virDomainStatsRecordPtr record)
+{
+    g_autoptr(GHashTable) prevParams = g_hash_table_new(g_str_hash, g_str_equal);
+    int nfound = 0;
+    int i;
+    int j;
+
+    for (i = 0; i < prev->nparams; i++)
+        g_hash_table_insert(prevParams, prev->params[i].field, prev->params + i);
+
+    for (i = 0; i < record->nparams; i++) {
+        if (g_hash_table_contains(prevParams, record->params[i].field))
+            nfound++;
+    }
+
+    if (nfound != prev->nparams)
+        return;
+
+    for (i = 0, j = 0; i < record->nparams; i++) {
+        virTypedParameterPtr param = record->params + i;
+        virTypedParameterPtr old = g_hash_table_lookup(prevParams, param->field);
+
+        if (old && virDomainDriverStatsParamEqual(old, param)) {
+            virTypedParamsClear(param, 1);
+            continue;
+        }
+
+        if (i != j)
+            record->params[j] = *param;
+        j++;
+    }
+
+    record->nparams = j;
+}
+
+
+/**
+ * virDomainDriverStatsCursorsFilter:
+ * @cursors: stats cursors of the driver
+ * @conn: connection the stats are returned to
+ * @records: stats records about to be returned
+ * @nrecords: number of items in @records
+ * @all: whether @records cover all domains the connection asked about
+ *
+ * Implements VIR_CONNECT_GET_ALL_DOMAINS_STATS_DELTA: removes from
+ * @records all fields which were already returned to @conn with the
+ * same value. Domains not seen by @conn before get all their fields.
+ *
+ * If @all is true, domains not found in @records are forgotten so that
+ * the state doesn't grow with domains which no longer exist.
+ */
+void
+virDomainDriverStatsCursorsFilter(virDomainDriverStatsCursors *cursors,
+                                  virConnectPtr conn,
+                                  virDomainStatsRecordPtr *records,
+                                  int nrecords,
+                                  bool all)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&cursors->lock);
+    GHashTable *cursor = g_hash_table_lookup(cursors->conns, conn);
+    GHashTable *next = cursor;
+    size_t i;
+
+    if (!cursor || all) {
+        next = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                     virDomainDriverStatsSnapshotFree);
+    }
+
+    for (i = 0; i < nrecords; i++) {
+        virDomainStatsRecordPtr record = records[i];
+        virDomainDriverStatsSnapshot *snapshot;
+        virDomainDriverStatsSnapshot *prev = NULL;
+        char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+        virUUIDFormat(record->dom->uuid, uuidstr);
+
+        snapshot = g_new0(virDomainDriverStatsSnapshot, 1);
+        virTypedParamsCopy(&snapshot->params, record->params, record->nparams);
+        snapshot->nparams = record->nparams;
+
+        if (cursor)
+            prev = g_hash_table_lookup(cursor, uuidstr);
+
+        if (prev)
+            virDomainDriverStatsDelta(prev, record);
+
+        g_hash_table_insert(next, g_strdup(uuidstr), snapshot);
+    }
+
+    if (next != cursor)
+        g_hash_table_insert(cursors->conns, conn, next);
+}
+
+
+/**
+ * virDomainDriverStatsCursorsRemove:
+ * @cursors: stats cursors of the driver
+ * @conn: connection being closed
+ *
+ * Forget what stats were returned to @conn.
+ */
+void
+virDomainDriverStatsCursorsRemove(virDomainDriverStatsCursors *cursors,
+                                  virConnectPtr conn)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&cursors->lock);
+
+    g_hash_table_remove(cursors->conns, conn);
+}
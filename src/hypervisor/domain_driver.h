@@ -118,3 +118,17 @@ typedef struct _virDomainDriverAutoShutdownConfig {
 
 bool virDomainDriverAutoShutdownActive(virDomainDriverAutoShutdownConfig *cfg);
 void virDomainDriverAutoShutdown(virDomainDriverAutoShutdownConfig *cfg);
+
+typedef struct _virDomainDriverStatsCursors virDomainDriverStatsCursors;
+
+virDomainDriverStatsCursors *virDomainDriverStatsCursorsNew(void);
+void virDomainDriverStatsCursorsFree(virDomainDriverStatsCursors *cursors);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virDomainDriverStatsCursors, virDomainDriverStatsCursorsFree);
+
+void virDomainDriverStatsCursorsFilter(virDomainDriverStatsCursors *cursors,
+                                       virConnectPtr conn,
+                                       virDomainStatsRecordPtr *records,
+                                       int nrecords,
+                                       bool all);
+void virDomainDriverStatsCursorsRemove(virDomainDriverStatsCursors *cursors,
+                                       virConnectPtr conn);
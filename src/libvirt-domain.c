@@ -25,6 +25,7 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virstatsexport.h"
 #include "virtypedparam.h"
 #include "virutil.h"
 
@@ -3881,10 +3882,6 @@ virDomainMigrate(virDomainPtr domain,
                              VIR_MIGRATE_NON_SHARED_INC,
                              error);
 
-    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_MIGRATE_TUNNELLED,
-                             VIR_MIGRATE_PARALLEL,
-                             error);
-
     VIR_REQUIRE_FLAG_GOTO(VIR_MIGRATE_NON_SHARED_SYNCHRONOUS_WRITES,
                           VIR_MIGRATE_NON_SHARED_DISK | VIR_MIGRATE_NON_SHARED_INC,
                           error);
@@ -4080,10 +4077,6 @@ virDomainMigrate2(virDomainPtr domain,
                              VIR_MIGRATE_NON_SHARED_INC,
                              error);
 
-    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_MIGRATE_TUNNELLED,
-                             VIR_MIGRATE_PARALLEL,
-                             error);
-
     VIR_REQUIRE_FLAG_GOTO(VIR_MIGRATE_NON_SHARED_SYNCHRONOUS_WRITES,
                           VIR_MIGRATE_NON_SHARED_DISK | VIR_MIGRATE_NON_SHARED_INC,
                           error);
@@ -4556,10 +4549,6 @@ virDomainMigrateToURI(virDomainPtr domain,
     virCheckNonNullArgGoto(duri, error);
     virCheckNonEmptyOptStringArgGoto(dname, error);
 
-    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_MIGRATE_TUNNELLED,
-                             VIR_MIGRATE_PARALLEL,
-                             error);
-
     if (virDomainMigrateUnmanagedCheckCompat(domain, flags) < 0)
         goto error;
 
@@ -4636,10 +4625,6 @@ virDomainMigrateToURI2(virDomainPtr domain,
 
     virCheckNonEmptyOptStringArgGoto(dname, error);
 
-    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_MIGRATE_TUNNELLED,
-                             VIR_MIGRATE_PARALLEL,
-                             error);
-
     if (virDomainMigrateUnmanagedCheckCompat(domain, flags) < 0)
         goto error;
 
@@ -4715,10 +4700,6 @@ virDomainMigrateToURI3(virDomainPtr domain,
     virCheckDomainReturn(domain, -1);
     virCheckReadOnlyGoto(domain->conn->flags, error);
 
-    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_MIGRATE_TUNNELLED,
-                             VIR_MIGRATE_PARALLEL,
-                             error);
-
     if (virDomainMigrateUnmanagedCheckCompat(domain, flags) < 0)
         goto error;
 
@@ -5454,6 +5435,51 @@ virDomainMigratePrepareTunnel3Params(virConnectPtr conn,
 }
 
 
+/*
+ * Not for public use.  This function is part of the internal
+ * implementation of migration in the remote case.
+ *
+ * Connects @st as another channel to the tunnelled migration with
+ * VIR_MIGRATE_PARALLEL incoming to @domain.
+ */
+int
+virDomainMigrateAddTunnelChannel(virDomainPtr domain,
+                                 virStreamPtr st,
+                                 unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(domain, "stream=%p, flags=0x%x", st, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn != st->conn) {
+        virReportInvalidArg(conn, "%s",
+                            _("conn must match stream connection"));
+        goto error;
+    }
+
+    if (conn->driver->domainMigrateAddTunnelChannel) {
+        int rv;
+        rv = conn->driver->domainMigrateAddTunnelChannel(domain, st, flags);
+        if (rv < 0)
+            goto error;
+        return rv;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /*
  * Not for public use.  This function is part of the internal
  * implementation of migration in the remote case.
@@ -12393,7 +12419,8 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * (although not necessarily implemented for each hypervisor):
  *
  * VIR_DOMAIN_STATS_STATE:
- *     Return domain state and reason for entering that state.
+ *     Return domain state and reason for entering that state and the number
+ *     of APIs waiting to start a job on the domain.
  *     The VIR_DOMAIN_STATS_STATE_* constants define the known typed
  *     parameter keys.
  *
@@ -12470,7 +12497,8 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     parameter keys.
  *
  * VIR_DOMAIN_STATS_MEMORY:
- *     Return memory bandwidth statistics and the usage information. The typed
+ *     Return memory bandwidth statistics and the usage information and the
+ *     host NUMA nodes chosen by automatic placement. The typed
  *     parameter keys are in this format:
  *     The VIR_DOMAIN_STATS_MEMORY_* constants define the known typed
  *     parameter keys.
@@ -12527,6 +12555,13 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_DELTA in @flags makes the
+ * hypervisor remember, per connection, the values returned for each
+ * domain and return only fields whose value changed since then. The
+ * first call for a domain, and any call after some of its fields
+ * disappeared (e.g. on device unplug), returns all fields. Callers are
+ * expected to merge the result into the values they already have.
+ *
  * Similarly to virConnectListAllDomains, @flags can contain various flags to
  * filter the list of domains to provide stats for.
  *
@@ -12676,6 +12711,13 @@ virConnectGetAllDomainStats(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_DELTA in @flags makes the
+ * hypervisor remember, per connection, the values returned for each
+ * domain and return only fields whose value changed since then. The
+ * first call for a domain, and any call after some of its fields
+ * disappeared (e.g. on device unplug), returns all fields. Callers are
+ * expected to merge the result into the values they already have.
+ *
  * Note that any of the domain list filtering flags in @flags may be rejected
  * by this function.
  *
@@ -12773,6 +12815,101 @@ virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats)
 }
 
 
+/**
+ * virDomainStatsExportRead:
+ * @path: statistics export file
+ * @records: pointer to a variable to store the NULL terminated array of
+ *           records
+ * @timestamp: optional pointer to a variable to store the time of the
+ *             last update of the file (milliseconds since epoch)
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Reads statistics of running domains which a hypervisor driver
+ * periodically publishes in a memory mapped file, such as the one written
+ * by the QEMU driver when stats_export_interval is set in qemu.conf. No
+ * connection is needed, the caller only has to be allowed to read @path.
+ * The file is never locked, so readers can't delay the daemon updating
+ * it. The layout of the file is described in the QEMU driver
+ * documentation for programs which want to parse it without libvirt.
+ *
+ * Every record contains the name of a domain and the same typed
+ * parameters virConnectGetAllDomainStats() would report for it.
+ *
+ * Returns the number of records stored in @records on success, -1 on
+ * error. The array should be freed by the caller using
+ * virDomainStatsExportRecordListFree().
+ *
+ * Since: 11.9.0
+ */
+int
+virDomainStatsExportRead(const char *path,
+                         virDomainStatsExportRecordPtr **records,
+                         unsigned long long *timestamp,
+                         unsigned int flags)
+{
+    virStatsExportRecord *exported = NULL;
+    size_t nexported = 0;
+    virDomainStatsExportRecordPtr *ret;
+    size_t i;
+
+    VIR_DEBUG("path=%s, records=%p, timestamp=%p, flags=0x%x",
+              NULLSTR(path), records, timestamp, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(path, error);
+    virCheckNonNullArgGoto(records, error);
+    virCheckFlagsGoto(0, error);
+
+    if (virStatsExportRead(path, &exported, &nexported, timestamp) < 0)
+        goto error;
+
+    ret = g_new0(virDomainStatsExportRecordPtr, nexported + 1);
+    for (i = 0; i < nexported; i++) {
+        ret[i] = g_new0(virDomainStatsExportRecord, 1);
+        ret[i]->name = g_steal_pointer(&exported[i].name);
+        ret[i]->params = g_steal_pointer(&exported[i].params);
+        ret[i]->nparams = exported[i].nparams;
+        exported[i].nparams = 0;
+    }
+    virStatsExportRecordsFree(exported, nexported);
+
+    *records = ret;
+    return nexported;
+
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+
+/**
+ * virDomainStatsExportRecordListFree:
+ * @records: NULL terminated array of virDomainStatsExportRecords to free
+ *
+ * Convenience function to free a list of records returned by
+ * virDomainStatsExportRead.
+ *
+ * Since: 11.9.0
+ */
+void
+virDomainStatsExportRecordListFree(virDomainStatsExportRecordPtr *records)
+{
+    virDomainStatsExportRecordPtr *next;
+
+    if (!records)
+        return;
+
+    for (next = records; *next; next++) {
+        virTypedParamsFree((*next)->params, (*next)->nparams);
+        g_free((*next)->name);
+        g_free(*next);
+    }
+
+    g_free(records);
+}
+
+
 /**
  * virDomainGetFSInfo:
  * @dom: a domain object
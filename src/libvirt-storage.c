@@ -1965,6 +1965,55 @@ virStorageVolWipePattern(virStorageVolPtr vol,
 }
 
 
+/**
+ * virStorageVolWipeAbort:
+ * @vol: pointer to storage volume
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Abort wiping of @vol started by virStorageVolWipe or
+ * virStorageVolWipePattern in another thread or by another client. The
+ * wiping call then fails with VIR_ERR_OPERATION_ABORTED, leaving the
+ * volume partially wiped.
+ *
+ * While a volume is being wiped, its XML description reports the number
+ * of bytes wiped so far in the <wipe> element. Only wipes which report
+ * progress this way can be aborted, which currently means zeroing of
+ * volumes in local pools.
+ *
+ * Returns 0 on success, or -1 on error
+ *
+ * Since: 11.9.0
+ */
+int
+virStorageVolWipeAbort(virStorageVolPtr vol,
+                       unsigned int flags)
+{
+    virConnectPtr conn;
+    VIR_DEBUG("vol=%p, flags=0x%x", vol, flags);
+
+    virResetLastError();
+
+    virCheckStorageVolReturn(vol, -1);
+    conn = vol->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->storageDriver && conn->storageDriver->storageVolWipeAbort) {
+        int ret;
+        ret = conn->storageDriver->storageVolWipeAbort(vol, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(vol->conn);
+    return -1;
+}
+
+
 /**
  * virStorageVolFree:
  * @vol: pointer to storage volume
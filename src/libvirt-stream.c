@@ -32,6 +32,33 @@ VIR_LOG_INIT("libvirt.stream");
  * redefine this constant. Its value can't ever change, so we're
  * safe to do so. */
 #define VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX 262120
+#define VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX 4194304
+
+
+/*
+ * virStreamGetChunkSize:
+ * @stream: pointer to the stream object
+ *
+ * Returns how much data the virStream*All() helpers should move at once.
+ * Larger chunks are only used when the remote side has agreed to accept
+ * them, otherwise the legacy payload size is used.
+ */
+static size_t
+virStreamGetChunkSize(virStreamPtr stream)
+{
+    virConnectPtr conn = stream->conn;
+    int rc;
+
+    rc = VIR_DRV_SUPPORTS_FEATURE(conn->driver, conn,
+                                  VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD);
+    if (rc < 0)
+        virResetLastError();
+
+    if (rc > 0)
+        return VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
+
+    return VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+}
 
 
 /**
@@ -600,7 +627,7 @@ virStreamSendAll(virStreamPtr stream,
                  void *opaque)
 {
     g_autofree char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = 0;
     int ret = -1;
     VIR_DEBUG("stream=%p, handler=%p, opaque=%p", stream, handler, opaque);
 
@@ -615,6 +642,7 @@ virStreamSendAll(virStreamPtr stream,
         goto cleanup;
     }
 
+    want = virStreamGetChunkSize(stream);
     bytes = g_new0(char, want);
 
     errno = 0;
@@ -732,7 +760,7 @@ int virStreamSparseSendAll(virStreamPtr stream,
                            void *opaque)
 {
     g_autofree char *bytes = NULL;
-    size_t bufLen = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t bufLen = 0;
     int ret = -1;
     unsigned long long dataLen = 0;
 
@@ -752,6 +780,7 @@ int virStreamSparseSendAll(virStreamPtr stream,
         goto cleanup;
     }
 
+    bufLen = virStreamGetChunkSize(stream);
     bytes = g_new0(char, bufLen);
 
     errno = 0;
@@ -872,7 +901,7 @@ virStreamRecvAll(virStreamPtr stream,
                  void *opaque)
 {
     g_autofree char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = 0;
     int ret = -1;
     VIR_DEBUG("stream=%p, handler=%p, opaque=%p", stream, handler, opaque);
 
@@ -888,6 +917,7 @@ virStreamRecvAll(virStreamPtr stream,
     }
 
 
+    want = virStreamGetChunkSize(stream);
     bytes = g_new0(char, want);
 
     errno = 0;
@@ -988,7 +1018,7 @@ virStreamSparseRecvAll(virStreamPtr stream,
                        void *opaque)
 {
     g_autofree char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = 0;
     const unsigned int flags = VIR_STREAM_RECV_STOP_AT_HOLE;
     int ret = -1;
 
@@ -1007,6 +1037,7 @@ virStreamSparseRecvAll(virStreamPtr stream,
         goto cleanup;
     }
 
+    want = virStreamGetChunkSize(stream);
     bytes = g_new0(char, want);
 
     errno = 0;
@@ -132,6 +132,26 @@ typedef enum {
      * Whether the virNetworkUpdate() API implementation passes arguments to
      * the driver's callback in correct order. */
     VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER = 16,
+
+    /*
+     * Remote party accepts stream data packets larger than
+     * VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX and keeps several of them in
+     * flight. Querying the feature also opts the client in to receiving
+     * such packets from the daemon.
+     */
+    VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD = 17,
+
+    /*
+     * Remote party supports REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT
+     * which sends field names of domain stats only once per call.
+     */
+    VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS = 18,
+
+    /*
+     * Support for tunnelled migration with VIR_MIGRATE_PARALLEL, i.e.,
+     * additional streams opened via virDomainMigrateAddTunnelChannel.
+     */
+    VIR_DRV_FEATURE_MIGRATION_TUNNEL_CHANNELS = 19,
 } virDrvFeature;
 
 
@@ -272,6 +292,10 @@ int virDomainMigratePrepareTunnel3Params(virConnectPtr conn,
                                          int *cookieoutlen,
                                          unsigned int flags);
 
+int virDomainMigrateAddTunnelChannel(virDomainPtr domain,
+                                     virStreamPtr st,
+                                     unsigned int flags);
+
 int virDomainMigratePerform3Params(virDomainPtr domain,
                                    const char *dconnuri,
                                    virTypedParameterPtr params,
@@ -61,6 +61,7 @@
 #include "network_event.h"
 #include "virhook.h"
 #include "virjson.h"
+#include "virlease.h"
 #include "virnetworkportdef.h"
 #include "virutil.h"
 #include "virsystemd.h"
@@ -338,6 +339,7 @@ networkCleanupInactive(virNetworkDriverState *driver,
     g_autofree char *macMapFile = NULL;
     g_autoptr(dnsmasqContext) dctx = NULL;
     virNetworkDef *def = virNetworkObjGetPersistentDef(obj);
+    int leaseIndexLock;
 
     /* remove the (possibly) existing dnsmasq files */
     if (!(dctx = dnsmasqContextNew(def->name,
@@ -362,12 +364,18 @@ networkCleanupInactive(virNetworkDriverState *driver,
 
     /* dnsmasq */
     dnsmasqDelete(dctx);
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        g_hash_table_remove(driver->dnsmasqHostsdirs, def->name);
+    }
     unlink(leasefile);
-    unlink(customleasefile);
     unlink(configfile);
 
-    /* MAC map manager */
+    /* custom lease file and MAC map manager, both covered by the index of
+     * leases used by the NSS modules */
+    leaseIndexLock = virLeaseIndexUpdateBegin(cfg->dnsmasqStateDir);
+    unlink(customleasefile);
     unlink(macMapFile);
+    virLeaseIndexUpdateEnd(cfg->dnsmasqStateDir, leaseIndexLock);
 
     /* remove status file */
     unlink(statusfile);
@@ -645,6 +653,9 @@ networkStateInitialize(bool privileged,
 
     network_driver->privileged = privileged;
 
+    network_driver->dnsmasqHostsdirs =
+        virHashNew((GDestroyNotify) dnsmasqHostsdirCacheFree);
+
     if (!(network_driver->xmlopt = networkDnsmasqCreateXMLConf()))
         goto error;
 
@@ -807,6 +818,7 @@ networkStateCleanup(void)
 
     virObjectUnref(network_driver->config);
     virObjectUnref(network_driver->dnsmasqCaps);
+    g_clear_pointer(&network_driver->dnsmasqHostsdirs, g_hash_table_unref);
 
     virMutexDestroy(&network_driver->lock);
 
@@ -882,6 +894,8 @@ networkConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
     case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
@@ -896,6 +910,7 @@ networkConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_MIGRATE_CHANGE_PROTECTION:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     case VIR_DRV_FEATURE_MIGRATION_OFFLINE:
+    case VIR_DRV_FEATURE_MIGRATION_TUNNEL_CHANNELS:
     case VIR_DRV_FEATURE_MIGRATION_PARAMS:
     case VIR_DRV_FEATURE_MIGRATION_DIRECT:
     case VIR_DRV_FEATURE_MIGRATION_V1:
@@ -1406,16 +1421,25 @@ networkDnsmasqConfContents(virNetworkObj *obj,
      * listening for DHCP, we should write a 0-length hosts
      * file to allow for runtime additions.
      */
-    if (ipv4def || ipv6def)
-        virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
-                          dctx->hostsfile->path);
+    if (ipv4def || ipv6def) {
+        if (dctx->hostsdirs)
+            virBufferAsprintf(&configbuf, "dhcp-hostsdir=%s\n",
+                              dctx->hostsfile->dir);
+        else
+            virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
+                              dctx->hostsfile->path);
+    }
 
     /* Likewise, always create this file and put it on the
      * commandline, to allow for runtime additions.
      */
     if (wantDNS) {
-        virBufferAsprintf(&configbuf, "addn-hosts=%s\n",
-                          dctx->addnhostsfile->path);
+        if (dctx->hostsdirs)
+            virBufferAsprintf(&configbuf, "hostsdir=%s\n",
+                              dctx->addnhostsfile->dir);
+        else
+            virBufferAsprintf(&configbuf, "addn-hosts=%s\n",
+                              dctx->addnhostsfile->path);
     }
 
     /* Configure DHCP to tell clients about the MTU. */
@@ -1474,6 +1498,9 @@ networkBuildDhcpDaemonCommandLine(virNetworkDriverState *driver,
 
     virNetworkObjSetDnsmasqPid(obj, -1);
 
+    /* Hosts directories let dnsmasq pick up new hosts without a reload */
+    dctx->hostsdirs = dnsmasqCapsGet(dnsmasq_caps, DNSMASQ_CAPS_HOSTSDIR);
+
     if (networkDnsmasqConfContents(obj, pidfile, &configstr, &hostsfilestr,
                                    dctx, dnsmasq_caps) < 0)
         return -1;
@@ -1510,6 +1537,37 @@ networkBuildDhcpDaemonCommandLine(virNetworkDriverState *driver,
 }
 
 
+/* Hands contents of hosts directories of network @name saved last time
+ * over to @dctx so that saving doesn't have to read them */
+static void
+networkDnsmasqHostsdirCacheTake(virNetworkDriverState *driver,
+                                const char *name,
+                                dnsmasqContext *dctx)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&driver->lock);
+    g_autofree char *key = NULL;
+
+    g_hash_table_steal_extended(driver->dnsmasqHostsdirs, name,
+                                (void **) &key, (void **) &dctx->hostsdirCache);
+}
+
+
+static void
+networkDnsmasqHostsdirCacheStore(virNetworkDriverState *driver,
+                                 const char *name,
+                                 dnsmasqContext *dctx)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&driver->lock);
+
+    if (dctx->hostsdirCache) {
+        g_hash_table_insert(driver->dnsmasqHostsdirs, g_strdup(name),
+                            g_steal_pointer(&dctx->hostsdirCache));
+    } else {
+        g_hash_table_remove(driver->dnsmasqHostsdirs, name);
+    }
+}
+
+
 static int
 networkStartDhcpDaemon(virNetworkDriverState *driver,
                        virNetworkObj *obj)
@@ -1523,6 +1581,7 @@ networkStartDhcpDaemon(virNetworkDriverState *driver,
     g_autofree char *pidfile = NULL;
     pid_t dnsmasqPid;
     g_autoptr(dnsmasqContext) dctx = NULL;
+    int rc;
 
     /* see if there are any IP addresses that need a dhcp server */
     i = 0;
@@ -1565,7 +1624,11 @@ networkStartDhcpDaemon(virNetworkDriverState *driver,
     if (networkBuildDhcpDaemonCommandLine(driver, obj, &cmd, pidfile, dctx) < 0)
         return -1;
 
-    if (dnsmasqSave(dctx) < 0)
+    /* The new dnsmasq reads all files, whatever was cached before, so the
+     * cache is built from the directories */
+    rc = dnsmasqSave(dctx);
+    networkDnsmasqHostsdirCacheStore(driver, def->name, dctx);
+    if (rc < 0)
         return -1;
 
     if (virCommandRun(cmd, NULL) < 0)
@@ -1591,7 +1654,9 @@ networkStartDhcpDaemon(virNetworkDriverState *driver,
 /* networkRefreshDhcpDaemon:
  *  Update dnsmasq config files, then send a SIGHUP so that it rereads
  *  them.   This only works for the dhcp-hostsfile and the
- *  addn-hosts file.
+ *  addn-hosts file. If dnsmasq was started with hosts directories
+ *  instead, only files of changed hosts are rewritten and no SIGHUP is
+ *  sent unless a DHCP host was modified or removed.
  *
  *  Returns 0 on success, -1 on failure.
  */
@@ -1607,6 +1672,8 @@ networkRefreshDhcpDaemon(virNetworkDriverState *driver,
     virNetworkIPDef *ipv4def;
     virNetworkIPDef *ipv6def;
     g_autoptr(dnsmasqContext) dctx = NULL;
+    bool reload;
+    int rc;
 
     /* if no IP addresses specified, nothing to do */
     if (!virNetworkDefGetIPByIndex(def, AF_UNSPEC, 0))
@@ -1621,6 +1688,12 @@ networkRefreshDhcpDaemon(virNetworkDriverState *driver,
     if (!(dctx = dnsmasqContextNew(def->name, cfg->dnsmasqStateDir)))
         return -1;
 
+    /* The running dnsmasq may have been started with hosts files, e.g. by
+     * an older libvirt; the directories exist only if it uses them. */
+    dctx->hostsdirs = virFileIsDir(dctx->hostsfile->dir);
+    if (dctx->hostsdirs)
+        networkDnsmasqHostsdirCacheTake(driver, def->name, dctx);
+
     /* Look for first IPv4 address that has dhcp defined.
      * We only support dhcp-host config on one IPv4 subnetwork
      * and on one IPv6 subnetwork.
@@ -1650,9 +1723,14 @@ networkRefreshDhcpDaemon(virNetworkDriverState *driver,
     if (networkBuildDnsmasqHostsList(dctx, &def->dns) < 0)
         return -1;
 
-    if (dnsmasqSave(dctx) < 0)
+    rc = dnsmasqSaveChanges(dctx, &reload);
+    networkDnsmasqHostsdirCacheStore(driver, def->name, dctx);
+    if (rc < 0)
         return -1;
 
+    if (!reload)
+        return 0;
+
     return kill(dnsmasqPid, SIGHUP);
 
 }
@@ -71,6 +71,10 @@ struct _virNetworkDriverState {
      */
     dnsmasqCaps *dnsmasqCaps;
 
+    /* Require lock, network name -> dnsmasqHostsdirCache of the
+     * network's running dnsmasq */
+    GHashTable *dnsmasqHostsdirs;
+
     /* Immutable pointer, self-locking APIs */
     virObjectEventState *networkEventState;
 
@@ -81,6 +81,7 @@ main(int argc, char **argv)
 {
     g_autofree char *pid_file = NULL;
     g_autofree char *custom_lease_file = NULL;
+    const char *lease_dir = LOCALSTATEDIR "/lib/libvirt/dnsmasq";
     const char *ip = NULL;
     const char *mac = NULL;
     const char *leases_str = NULL;
@@ -91,6 +92,8 @@ main(int argc, char **argv)
     g_autofree char *server_duid = NULL;
     int action = -1;
     int pid_file_fd = -1;
+    int index_lock_fd = -1;
+    int rc;
     int rv = EXIT_FAILURE;
     bool delete = false;
     g_autoptr(virJSONValue) lease_new = NULL;
@@ -153,8 +156,7 @@ main(int argc, char **argv)
 
     server_duid = g_strdup(getenv("DNSMASQ_SERVER_DUID"));
 
-    custom_lease_file = g_strdup_printf(LOCALSTATEDIR "/lib/libvirt/dnsmasq/%s.status",
-                                        interface);
+    custom_lease_file = g_strdup_printf("%s/%s.status", lease_dir, interface);
 
     pid_file = g_strdup(RUNSTATEDIR "/leaseshelper.pid");
 
@@ -219,6 +221,9 @@ main(int argc, char **argv)
         if (virLeasePrintLeases(leases_array_new, server_duid) < 0)
             goto cleanup;
 
+        /* Index the leases of a network which was just started */
+        index_lock_fd = virLeaseIndexUpdateBegin(lease_dir);
+        virLeaseIndexUpdateEnd(lease_dir, index_lock_fd);
         break;
 
     case VIR_LEASE_ACTION_OLD:
@@ -237,8 +242,17 @@ main(int argc, char **argv)
             goto cleanup;
         }
 
+        /* The lease index must not describe leases which are no longer in
+         * the file, so it is removed first and written again once the file
+         * is updated */
+        index_lock_fd = virLeaseIndexUpdateBegin(lease_dir);
+
         /* Write to file */
-        if (virFileRewriteStr(custom_lease_file, 0644, leases_str) < 0)
+        rc = virFileRewriteStr(custom_lease_file, 0644, leases_str);
+
+        virLeaseIndexUpdateEnd(lease_dir, index_lock_fd);
+
+        if (rc < 0)
             goto cleanup;
         break;
 
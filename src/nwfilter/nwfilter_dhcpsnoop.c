@@ -44,6 +44,10 @@
 #include <poll.h>
 
 #include <net/if.h>
+#include <netpacket/packet.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
 
 #include "virlog.h"
 #include "datatypes.h"
@@ -58,6 +62,10 @@
 #include "configmake.h"
 #include "virtime.h"
 #include "virstring.h"
+#include "virutil.h"
+
+#define LIBVIRT_NWFILTER_DHCPSNOOPPRIV_H_ALLOW
+#include "nwfilter_dhcpsnooppriv.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -74,93 +82,44 @@ struct virNWFilterSnoopState {
     int                  leaseFD;
     int                  nLeases; /* number of active leases */
     int                  wLeases; /* number of written leases */
-    int                  nThreads; /* number of running threads */
+    virBuffer            leaseBuf; /* leases not written yet */
     /* thread management */
     GHashTable *     snoopReqs;
     GHashTable *     ifnameToKey;
-    virMutex             snoopLock;  /* protects SnoopReqs and IfNameToKey */
+    virMutex             snoopLock;  /* protects SnoopReqs, IfNameToKey
+                                        and LeaseBuf */
     GHashTable *     active;
     virMutex             activeLock; /* protects Active */
-};
-
-# define VIR_IFKEY_LEN   ((VIR_UUID_STRING_BUFLEN) + (VIR_MAC_STRING_BUFLEN))
-
-typedef struct _virNWFilterSnoopReq virNWFilterSnoopReq;
-
-typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
-
-typedef enum {
-    THREAD_STATUS_NONE,
-    THREAD_STATUS_OK,
-    THREAD_STATUS_FAIL,
-} virNWFilterSnoopThreadStatus;
-
-struct _virNWFilterSnoopReq {
-    /*
-     * reference counter: while the req is on the
-     * publicSnoopReqs hash, the refctr may only
-     * be modified with the SnoopLock held
-     */
-    int                                  refctr;
-
-    virNWFilterTechDriver *            techdriver;
-    virNWFilterBindingDef *            binding;
-    int                                  ifindex;
-    char                                 ifkey[VIR_IFKEY_LEN];
-    virNWFilterDriverState *           driver;
-    /* start and end of lease list, ordered by lease time */
-    virNWFilterSnoopIPLease *          start;
-    virNWFilterSnoopIPLease *          end;
-    char                                *threadkey;
-    virErrorPtr                          threadError;
-
-    virNWFilterSnoopThreadStatus         threadStatus;
-    virCond                              threadStatusCond;
-
-    int                                  jobCompletionStatus;
-    /* the number of submitted jobs in the worker's queue */
-    /*
-     * protect those members that can change while the
-     * req is on the public SnoopReq hash and
-     * at least one reference is held:
-     * - ifname
-     * - threadkey
-     * - start
-     * - end
-     * - a lease while it is on the list
-     * - threadStatus
-     * (for refctr, see above)
-     */
-    virMutex                             lock;
+    /* packet capture shared by all interfaces */
+    int                  captureFD;
+    struct sock_filter * snoopFilter; /* compiled SNOOP_FILTER */
+    size_t               nsnoopFilter;
+    int                  wakeupFD[2];
+    int                  captureQuit;
+    virThread            captureThread;
+    virThreadPool *      decodePool;
+    GHashTable *     decodeReqs; /* requests handed to decodePool */
+    virMutex             decodeLock; /* protects DecodeReqs */
+    GHashTable *     captureIfs; /* ifindex -> virNWFilterSnoopCaptureIf */
+    GSList *             captureStale; /* interfaces to be released */
+    virMutex             captureLock; /* protects CaptureIfs, CaptureStale,
+                                         their contents and the filter
+                                         of CaptureFD */
 };
 
 /*
  * Note about lock-order:
  * 1st: virNWFilterSnoopState.snoopLock
  * 2nd: &req->lock
+ * 3rd: virNWFilterSnoopState.captureLock
+ * 4th: &req->jobLock
+ * 5th: virNWFilterSnoopState.decodeLock
  *
- * Rationale: Former protects the SnoopReqs hash, latter its contents
+ * Rationale: The first protects the SnoopReqs hash, the second its
+ * contents. The capture thread only takes the latter two so that it
+ * is never held up by the workers instantiating filters.
  */
 
-struct _virNWFilterSnoopIPLease {
-    virSocketAddr              ipAddress;
-    virSocketAddr              ipServer;
-    virNWFilterSnoopReq *    snoopReq;
-    time_t                     timeout;
-    /* timer list */
-    virNWFilterSnoopIPLease *prev;
-    virNWFilterSnoopIPLease *next;
-};
-
-typedef struct _virNWFilterSnoopEthHdr virNWFilterSnoopEthHdr;
-struct _virNWFilterSnoopEthHdr {
-    virMacAddr eh_dst;
-    virMacAddr eh_src;
-    uint16_t eh_type;
-    uint8_t eh_data[];
-} ATTRIBUTE_PACKED;
-G_STATIC_ASSERT(sizeof(struct _virNWFilterSnoopEthHdr) == 14);
-
 typedef struct _virNWFilterSnoopDHCPHdr virNWFilterSnoopDHCPHdr;
 struct _virNWFilterSnoopDHCPHdr {
     uint8_t   d_op;
@@ -198,18 +157,8 @@ G_STATIC_ASSERT(sizeof(struct _virNWFilterSnoopDHCPHdr) == 236);
      sizeof(struct udphdr) + \
      offsetof(virNWFilterSnoopDHCPHdr, d_opts))
 
-# define PCAP_PBUFSIZE              576 /* >= IP/TCP/DHCP headers */
-# define PCAP_READ_MAXERRS          25 /* retries on failing device */
 # define PCAP_FLOOD_TIMEOUT_MS      10 /* ms */
 
-typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
-struct _virNWFilterDHCPDecodeJob {
-    unsigned char packet[PCAP_PBUFSIZE];
-    int caplen;
-    bool fromVM;
-    int *qCtr;
-};
-
 # define DHCP_PKT_RATE          10 /* pkts/sec */
 # define DHCP_PKT_BURST         50 /* pkts/sec */
 # define DHCP_BURST_INTERVAL_S  10 /* sec */
@@ -221,23 +170,43 @@ struct _virNWFilterSnoopRateLimitConf {
     time_t prev;
     unsigned int pkt_ctr;
     time_t burst;
-    const unsigned int rate;
-    const unsigned int burstRate;
-    const unsigned int burstInterval;
+    unsigned int rate;
+    unsigned int burstRate;
+    unsigned int burstInterval;
 };
-# define SNOOP_POLL_MAX_TIMEOUT_MS  (10 * 1000) /* milliseconds */
 
-typedef struct _virNWFilterSnoopPcapConf virNWFilterSnoopPcapConf;
-struct _virNWFilterSnoopPcapConf {
-    pcap_t *handle;
-    const pcap_direction_t dir;
-    const char *filter;
+# define SNOOP_SWEEP_INTERVAL_MS    1000 /* lease file writes */
+# define SNOOP_TIMER_INTERVAL_MS    (10 * 1000) /* lease timers */
+# define SNOOP_READ_BATCH           64 /* pkts per wakeup */
+# define SNOOP_RCVBUF_SIZE          (1024 * 1024)
+# define DHCP_DECODE_WORKERS        4
+
+/* DHCP in both directions: from VM (client to server) and to VM */
+# define SNOOP_FILTER \
+    "ip and udp and ((src port 68 and dst port 67) or " \
+    "(src port 67 and dst port 68))"
+
+typedef struct _virNWFilterSnoopCaptureDir virNWFilterSnoopCaptureDir;
+struct _virNWFilterSnoopCaptureDir {
     virNWFilterSnoopRateLimitConf rateLimit; /* indep. rate limiters */
-    int qCtr; /* number of jobs in the worker's queue */
-    const unsigned int maxQSize;
     unsigned long long penaltyTimeoutAbs;
 };
 
+/*
+ * State of the capture thread for one snooped interface. It is only
+ * accessed with the CaptureLock held.
+ */
+typedef struct _virNWFilterSnoopCaptureIf virNWFilterSnoopCaptureIf;
+struct _virNWFilterSnoopCaptureIf {
+    virNWFilterSnoopReq *req;
+    char *ifname;
+    char *threadkey;
+    virMacAddr mac;
+    virNWFilterSnoopCaptureDir dirs[2]; /* indexed by 'fromVM' */
+    time_t lastDisplayed;
+    time_t lastDisplayedQueue;
+};
+
 /* local function prototypes */
 static int virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReq *req,
                                        virSocketAddr *ipaddr,
@@ -245,11 +214,13 @@ static int virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReq *req,
                                        bool instantiate);
 
 static void virNWFilterSnoopLeaseFileLoad(void);
-static void virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLease *ipl);
+static void virNWFilterSnoopLeaseFileSync(void);
 
 /* local variables */
 static struct virNWFilterSnoopState virNWFilterSnoopState = {
     .leaseFD = -1,
+    .captureFD = -1,
+    .wakeupFD = { -1, -1 },
 };
 
 static const unsigned char dhcp_magic[4] = { 99, 130, 83, 99 };
@@ -467,7 +438,7 @@ virNWFilterSnoopReqLeaseTimerRun(virNWFilterSnoopReq *req)
 /*
  * Get a reference to the given Snoop request
  */
-static void
+void
 virNWFilterSnoopReqGet(virNWFilterSnoopReq *req)
 {
     g_atomic_int_add(&req->refctr, 1);
@@ -478,7 +449,7 @@ virNWFilterSnoopReqGet(virNWFilterSnoopReq *req)
  * interface key. The caller must release the request with a call
  * to virNWFilerSnoopReqPut(req).
  */
-static virNWFilterSnoopReq *
+virNWFilterSnoopReq *
 virNWFilterSnoopReqNew(const char *ifkey)
 {
     g_autofree virNWFilterSnoopReq *req = g_new0(virNWFilterSnoopReq, 1);
@@ -491,18 +462,18 @@ virNWFilterSnoopReqNew(const char *ifkey)
         return NULL;
     }
 
-    req->threadStatus = THREAD_STATUS_NONE;
-
     if (virStrcpyStatic(req->ifkey, ifkey) < 0 ||
         virMutexInitRecursive(&req->lock) < 0) {
         return NULL;
     }
 
-    if (virCondInit(&req->threadStatusCond) < 0) {
+    if (virMutexInit(&req->jobLock) < 0) {
         virMutexDestroy(&req->lock);
         return NULL;
     }
 
+    g_queue_init(&req->jobs);
+
     virNWFilterSnoopReqGet(req);
     return g_steal_pointer(&req);
 }
@@ -530,9 +501,10 @@ virNWFilterSnoopReqFree(virNWFilterSnoopReq *req)
     /* free all req data */
     virNWFilterBindingDefFree(req->binding);
 
+    g_queue_clear_full(&req->jobs, g_free);
+
     virMutexDestroy(&req->lock);
-    virCondDestroy(&req->threadStatusCond);
-    virFreeError(req->threadError);
+    virMutexDestroy(&req->jobLock);
 
     g_free(req);
 }
@@ -580,7 +552,7 @@ virNWFilterSnoopReqGetByIFKey(const char *ifkey)
  * Drop the reference to the Snoop request. Don't use the req
  * after this call.
  */
-static void
+void
 virNWFilterSnoopReqPut(virNWFilterSnoopReq *req)
 {
     VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.snoopLock);
@@ -908,135 +880,352 @@ virNWFilterSnoopDHCPDecode(virNWFilterSnoopReq *req,
     return 0;
 }
 
-static pcap_t *
-virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
-                         const char *filter, pcap_direction_t dir)
+/*
+ * Build a socket filter accepting only packets seen on one of the
+ * @nifindexes interfaces in @ifindexes and passing them on to the
+ * @ninsns instructions of @insns:
+ *
+ *     ld  #ifidx
+ *     jeq #IFINDEX0, 0, 1
+ *     ja  insns
+ *     ...
+ *     ret #0
+ *   insns:
+ *     ...
+ *
+ * Returns the filter, its length in @len, or NULL if it would exceed
+ * the maximum length of socket filters.
+ */
+struct sock_filter *
+virNWFilterSnoopCaptureFilterBuild(const struct sock_filter *insns,
+                                   size_t ninsns,
+                                   const int *ifindexes,
+                                   size_t nifindexes,
+                                   size_t *len)
 {
-    pcap_t *handle = NULL;
-    struct bpf_program fp;
-    char pcap_errbuf[PCAP_ERRBUF_SIZE];
-    g_autofree char *ext_filter = NULL;
-    char macaddr[VIR_MAC_STRING_BUFLEN];
+    struct sock_filter *filter;
+    size_t prefix = 2 * nifindexes + 2;
+    size_t i;
 
-    virMacAddrFormat(mac, macaddr);
+    if (prefix + ninsns > BPF_MAXINSNS)
+        return NULL;
 
-    if (dir == PCAP_D_IN /* from VM */) {
-        /*
-         * don't want to hear about another VM's DHCP requests
-         *
-         * extend the filter with the macaddr of the VM; filter the
-         * more unlikely parameters first, then go for the MAC
-         */
-        ext_filter = g_strdup_printf("%s and ether src %s", filter, macaddr);
-    } else {
-        /*
-         * Some DHCP servers respond via MAC broadcast; we rely on later
-         * filtering of responses by comparing the MAC address inside the
-         * DHCP response against the one of the VM. Assuming that the
-         * bridge learns the VM's MAC address quickly this should not
-         * generate much more traffic than if we filtered by VM and
-         * braodcast MAC as well
-         */
-        ext_filter = g_strdup(filter);
+    filter = g_new0(struct sock_filter, prefix + ninsns);
+
+    filter[0] = (struct sock_filter)
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX);
+
+    for (i = 0; i < nifindexes; i++) {
+        size_t pos = 2 * i + 1;
+
+        filter[pos] = (struct sock_filter)
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ifindexes[i], 0, 1);
+        /* jumps are relative to the next instruction */
+        filter[pos + 1] = (struct sock_filter)
+            BPF_STMT(BPF_JMP | BPF_JA, prefix - pos - 2);
     }
 
-    handle = pcap_create(ifname, pcap_errbuf);
+    filter[prefix - 1] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
 
-    if (handle == NULL) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("pcap_create failed"));
-        return NULL;
+    memcpy(filter + prefix, insns, ninsns * sizeof(*insns));
+
+    *len = prefix + ninsns;
+    return filter;
+}
+
+/*
+ * Attach a filter passing only the DHCP traffic of the snooped
+ * interfaces to the packet socket @fd, replacing the previous filter.
+ * Must be called whenever the set of snooped interfaces changes.
+ * Call this function with the CaptureLock held.
+ */
+static int
+virNWFilterSnoopCaptureSetFilter(int fd)
+{
+    g_autofree int *ifindexes = NULL;
+    g_autofree struct sock_filter *filter = NULL;
+    size_t nifindexes = 0;
+    struct sock_fprog prog;
+    GHashTableIter iter;
+    void *key;
+    size_t len;
+
+    ifindexes = g_new0(int, g_hash_table_size(virNWFilterSnoopState.captureIfs));
+
+    g_hash_table_iter_init(&iter, virNWFilterSnoopState.captureIfs);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        ifindexes[nifindexes++] = GPOINTER_TO_INT(key);
+
+    if (!(filter = virNWFilterSnoopCaptureFilterBuild(virNWFilterSnoopState.snoopFilter,
+                                                      virNWFilterSnoopState.nsnoopFilter,
+                                                      ifindexes, nifindexes,
+                                                      &len))) {
+        /* the capture thread ignores packets of other interfaces anyway */
+        VIR_WARN("Too many interfaces to filter DHCP packets by interface");
+        filter = g_memdup2(virNWFilterSnoopState.snoopFilter,
+                           virNWFilterSnoopState.nsnoopFilter * sizeof(*filter));
+        len = virNWFilterSnoopState.nsnoopFilter;
     }
 
-    if (pcap_set_snaplen(handle, PCAP_PBUFSIZE) < 0 ||
-        pcap_set_immediate_mode(handle, 1) < 0 ||
-        pcap_activate(handle) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("setup of pcap handle failed: %1$s"),
-                       pcap_geterr(handle));
-        goto cleanup;
+    prog.len = len;
+    prog.filter = filter;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to attach filter to packet socket"));
+        return -1;
     }
 
-    if (pcap_compile(handle, &fp, ext_filter, 1, PCAP_NETMASK_UNKNOWN) != 0) {
+    return 0;
+}
+
+/*
+ * Update the filter of the packet socket after interfaces were added
+ * or removed, unless the capture isn't running.
+ * Call this function with the CaptureLock held.
+ */
+static int
+virNWFilterSnoopCaptureUpdateFilter(void)
+{
+    if (virNWFilterSnoopState.captureFD < 0)
+        return 0;
+
+    return virNWFilterSnoopCaptureSetFilter(virNWFilterSnoopState.captureFD);
+}
+
+/*
+ * Open the packet socket shared by all snooped interfaces.
+ *
+ * The socket is not bound to any interface. Instead, its filter only
+ * passes the DHCP traffic of the snooped interfaces; the capture thread
+ * demultiplexes the packets by the index of the interface they were seen
+ * on. The filter is attached before the socket is bound, so no
+ * unfiltered packets are ever queued on it.
+ */
+static int
+virNWFilterSnoopCaptureOpen(void)
+{
+    struct bpf_program fp;
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ALL),
+    };
+    int rcvbuf = SNOOP_RCVBUF_SIZE;
+    pcap_t *handle;
+    int fd = -1;
+
+    if (!(handle = pcap_open_dead(DLT_EN10MB, PCAP_PBUFSIZE))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("pcap_open_dead failed"));
+        return -1;
+    }
+
+    if (pcap_compile(handle, &fp, SNOOP_FILTER, 1, PCAP_NETMASK_UNKNOWN) != 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("pcap_compile: %1$s"), pcap_geterr(handle));
-        goto cleanup;
+        pcap_close(handle);
+        return -1;
     }
 
-    if (pcap_setfilter(handle, &fp) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_setfilter: %1$s"), pcap_geterr(handle));
-        goto cleanup_freecode;
+    pcap_close(handle);
+
+    /* struct bpf_insn and struct sock_filter have the same layout */
+    g_free(virNWFilterSnoopState.snoopFilter);
+    virNWFilterSnoopState.snoopFilter = g_memdup2(fp.bf_insns,
+                                                  fp.bf_len * sizeof(struct sock_filter));
+    virNWFilterSnoopState.nsnoopFilter = fp.bf_len;
+    pcap_freecode(&fp);
+
+    /* the protocol is set by bind() once the filter is in place */
+    if ((fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to open packet socket"));
+        return -1;
     }
 
-    if (pcap_setdirection(handle, dir) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_setdirection: %1$s"),
-                       pcap_geterr(handle));
-        goto cleanup_freecode;
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.captureLock) {
+        if (virNWFilterSnoopCaptureSetFilter(fd) < 0) {
+            VIR_FORCE_CLOSE(fd);
+            return -1;
+        }
     }
 
-    pcap_freecode(&fp);
-    return handle;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+        VIR_WARN("Unable to set receive buffer of packet socket: %s",
+                 g_strerror(errno));
 
- cleanup_freecode:
-    pcap_freecode(&fp);
- cleanup:
-    pcap_close(handle);
-    return NULL;
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to bind packet socket"));
+        VIR_FORCE_CLOSE(fd);
+    }
+
+    return fd;
 }
 
 /*
- * Worker function to decode the DHCP message and with that
- * also do the time-consuming work of instantiating the filters
+ * Worker function to decode the DHCP messages queued for a request and
+ * with that also do the time-consuming work of instantiating the filters.
+ * Also runs the request's lease timers.
+ *
+ * A request is handed to at most one worker at a time so that its
+ * packets are processed in the order they were received.
  */
-static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
+static void virNWFilterDHCPDecodeWorker(void *jobdata,
+                                        void *opaque G_GNUC_UNUSED)
 {
-    virNWFilterSnoopReq *req = opaque;
-    g_autofree virNWFilterDHCPDecodeJob *job = jobdata;
-    virNWFilterSnoopEthHdr *packet = (virNWFilterSnoopEthHdr *)job->packet;
+    virNWFilterSnoopReq *req = jobdata;
 
-    if (virNWFilterSnoopDHCPDecode(req, packet,
-                                   job->caplen, job->fromVM) == -1) {
-        req->jobCompletionStatus = -1;
+    virNWFilterSnoopReqLeaseTimerRun(req);
 
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Instantiation of rules failed on interface '%1$s'"),
-                       req->binding->portdevname);
+    while (true) {
+        g_autofree virNWFilterDHCPDecodeJob *job = NULL;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&req->jobLock) {
+            if (!(job = g_queue_pop_head(&req->jobs))) {
+                req->jobScheduled = false;
+
+                VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.decodeLock) {
+                    g_hash_table_remove(virNWFilterSnoopState.decodeReqs, req);
+                }
+            }
+        }
+
+        if (!job)
+            break;
+
+        /* the capture thread will stop snooping on the interface or
+         * the daemon is shutting down */
+        if (g_atomic_int_get(&req->jobCompletionStatus) != 0 ||
+            g_atomic_int_get(&virNWFilterSnoopState.captureQuit))
+            continue;
+
+        if (virNWFilterSnoopDHCPDecode(req,
+                                       (virNWFilterSnoopEthHdr *)job->packet,
+                                       job->caplen, job->fromVM) == -1) {
+            g_atomic_int_set(&req->jobCompletionStatus, -1);
+
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Instantiation of rules failed on interface '%1$s'"),
+                           req->binding->portdevname);
+        }
+    }
+
+    virNWFilterSnoopReqPut(req);
+}
+
+/*
+ * Have a worker thread process the queued packets and the lease timers
+ * of the request unless one is already busy with it.
+ * Call this function with the req's jobLock held.
+ */
+static int
+virNWFilterSnoopReqSchedule(virNWFilterSnoopReq *req)
+{
+    if (req->jobScheduled)
+        return 0;
+
+    /* the worker drops this reference */
+    virNWFilterSnoopReqGet(req);
+
+    if (virThreadPoolSendJob(virNWFilterSnoopState.decodePool, 0, req) < 0) {
+        /* the capture interface still holds a reference */
+        ignore_value(g_atomic_int_dec_and_test(&req->refctr));
+        return -1;
+    }
+
+    req->jobScheduled = true;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.decodeLock) {
+        g_hash_table_add(virNWFilterSnoopState.decodeReqs, req);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Start the workers decoding the queued packets, at most @workers of
+ * them at a time.
+ */
+int
+virNWFilterSnoopDecodeStart(size_t workers)
+{
+    virNWFilterSnoopState.decodePool =
+        virThreadPoolNewFull(MIN(workers, 1), workers, 0,
+                             virNWFilterDHCPDecodeWorker,
+                             "dhcp-decode", NULL, NULL);
+    if (!virNWFilterSnoopState.decodePool)
+        return -1;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.decodeLock) {
+        virNWFilterSnoopState.decodeReqs =
+            g_hash_table_new(g_direct_hash, g_direct_equal);
     }
-    ignore_value(g_atomic_int_dec_and_test(job->qCtr));
+
+    return 0;
 }
 
+
 /*
- * Submit a job to the worker thread doing the time-consuming work...
+ * Stop the decoding workers. Workers finish the request they are busy
+ * with, while requests which were scheduled but not picked up by any
+ * worker have their queued packets dropped and the reference taken by
+ * virNWFilterSnoopReqSchedule released here, as the thread pool would
+ * just forget about them.
+ * Call this function only once the capture thread is gone, as nothing
+ * else may schedule requests.
+ */
+static void
+virNWFilterSnoopDecodeStop(void)
+{
+    g_autoptr(GHashTable) leftover = NULL;
+    GHashTableIter iter;
+    virNWFilterSnoopReq *req;
+
+    if (!virNWFilterSnoopState.decodePool)
+        return;
+
+    g_clear_pointer(&virNWFilterSnoopState.decodePool, virThreadPoolFree);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.decodeLock) {
+        leftover = g_steal_pointer(&virNWFilterSnoopState.decodeReqs);
+    }
+
+    g_hash_table_iter_init(&iter, leftover);
+    while (g_hash_table_iter_next(&iter, (void **)&req, NULL)) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&req->jobLock) {
+            g_queue_clear_full(&req->jobs, g_free);
+            req->jobScheduled = false;
+        }
+
+        virNWFilterSnoopReqPut(req);
+    }
+}
+
+/*
+ * Queue a packet for the worker threads doing the time-consuming work...
  */
 static int
-virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPool *pool,
+virNWFilterSnoopDHCPDecodeJobSubmit(virNWFilterSnoopReq *req,
                                     virNWFilterSnoopEthHdr *pep,
-                                    int len, pcap_direction_t dir,
-                                    int *qCtr)
+                                    int len, bool fromVM)
 {
+    VIR_LOCK_GUARD lock = virLockGuardLock(&req->jobLock);
     virNWFilterDHCPDecodeJob *job;
-    int ret;
 
-    if (len <= MIN_VALID_DHCP_PKT_SIZE || len > sizeof(job->packet))
-        return 0;
+    if (g_queue_get_length(&req->jobs) >= MAX_QUEUED_JOBS)
+        return 1;
 
     job = g_new0(virNWFilterDHCPDecodeJob, 1);
 
     memcpy(job->packet, pep, len);
     job->caplen = len;
-    job->fromVM = (dir == PCAP_D_IN);
-    job->qCtr = qCtr;
+    job->fromVM = fromVM;
 
-    ret = virThreadPoolSendJob(pool, 0, job);
+    g_queue_push_tail(&req->jobs, job);
 
-    if (ret == 0)
-        g_atomic_int_add(qCtr, 1);
-    else
-        g_free(job);
-
-    return ret;
+    return virNWFilterSnoopReqSchedule(req);
 }
 
 /*
@@ -1088,309 +1277,453 @@ virNWFilterSnoopRateLimit(virNWFilterSnoopRateLimitConf *rl)
 /*
  * virNWFilterSnoopRatePenalty
  *
- * @pc: pointer to the virNWFilterSnoopPcapConf
+ * @dir: pointer to the virNWFilterSnoopCaptureDir
  * @diff: the amount of pkts beyond the rate, i.e., if the rate is 10
  *        and 13 pkts have been received now in one seconds, then
  *        this should be 3.
  *
- * Adjusts the timeout the virNWFilterSnooPcapConf will be penalized for
+ * Adjusts the timeout the virNWFilterSnoopCaptureDir will be penalized for
  * sending too many packets.
  */
 static void
-virNWFilterSnoopRatePenalty(virNWFilterSnoopPcapConf *pc,
+virNWFilterSnoopRatePenalty(virNWFilterSnoopCaptureDir *dir,
                             unsigned int diff, unsigned int limit)
 {
     if (diff > limit) {
         unsigned long long now;
 
         if (virTimeMillisNowRaw(&now) < 0) {
-            g_usleep(PCAP_FLOOD_TIMEOUT_MS); /* 1 ms */
-            pc->penaltyTimeoutAbs = 0;
+            dir->penaltyTimeoutAbs = 0;
         } else {
-            /* don't listen to the fd for 1 ms */
-            pc->penaltyTimeoutAbs = now + PCAP_FLOOD_TIMEOUT_MS;
+            /* ignore the packets in this direction for 10 ms */
+            dir->penaltyTimeoutAbs = now + PCAP_FLOOD_TIMEOUT_MS;
         }
     }
 }
 
-static int
-virNWFilterSnoopAdjustPoll(virNWFilterSnoopPcapConf *pc,
-                           size_t nPc, struct pollfd *pfd,
-                           int *pollTo)
+static bool
+virNWFilterSnoopIsPenalized(virNWFilterSnoopCaptureDir *dir)
 {
-    int ret = 0;
-    size_t i;
-    int tmp;
-    unsigned long long now = 0;
+    unsigned long long now;
+
+    if (dir->penaltyTimeoutAbs == 0)
+        return false;
+
+    if (virTimeMillisNowRaw(&now) == 0 && now < dir->penaltyTimeoutAbs)
+        return true;
 
-    *pollTo = -1;
+    dir->penaltyTimeoutAbs = 0;
+    return false;
+}
+
+static void
+virNWFilterSnoopCaptureIfFree(virNWFilterSnoopCaptureIf *iface)
+{
+    if (!iface)
+        return;
+
+    g_free(iface->ifname);
+    g_free(iface->threadkey);
+    g_free(iface);
+}
+
+/*
+ * An interface is no longer snooped once its request was cancelled or
+ * a previously submitted job failed.
+ */
+static bool
+virNWFilterSnoopCaptureIfIsStale(virNWFilterSnoopCaptureIf *iface)
+{
+    return !virNWFilterSnoopIsActive(iface->threadkey) ||
+        g_atomic_int_get(&iface->req->jobCompletionStatus) != 0;
+}
+
+/*
+ * Release an interface removed from the capture thread, dropping the
+ * reference to its request. If snooping ended due to an error, the
+ * request is also disassociated from the interface.
+ */
+static void
+virNWFilterSnoopCaptureIfRelease(virNWFilterSnoopCaptureIf *iface)
+{
+    virNWFilterSnoopReq *req = iface->req;
+
+    /* protect IfNameToKey */
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.snoopLock) {
+        /* protect req->binding->portdevname & req->threadkey */
+        VIR_WITH_MUTEX_LOCK_GUARD(&req->lock) {
+            if (STREQ_NULLABLE(req->threadkey, iface->threadkey)) {
+                virNWFilterSnoopCancel(&req->threadkey);
 
-    for (i = 0; i < nPc; i++) {
-        if (pc[i].penaltyTimeoutAbs != 0) {
-            if (now == 0) {
-                if (virTimeMillisNow(&now) < 0) {
-                    ret = -1;
-                    break;
+                if (req->binding->portdevname) {
+                    ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
+                                                    req->binding->portdevname));
                 }
-            }
 
-            if (now < pc[i].penaltyTimeoutAbs) {
-                /* don't listen to incoming data on the fd for some time */
-                pfd[i].events &= ~POLLIN;
-                /*
-                 * calc the max. time to spend in poll() until adjustments
-                 * to the pollfd array are needed again.
-                 */
-                tmp = pc[i].penaltyTimeoutAbs - now;
-                if (*pollTo == -1 || tmp < *pollTo)
-                    *pollTo = tmp;
-            } else {
-                /* listen again to the fd */
-                pfd[i].events |= POLLIN;
-
-                pc[i].penaltyTimeoutAbs = 0;
+                g_clear_pointer(&req->binding->portdevname, g_free);
             }
         }
     }
 
-    return ret;
+    virNWFilterSnoopReqPut(req);
+
+    virNWFilterSnoopCaptureIfFree(iface);
 }
 
 /*
- * The DHCP snooping thread. It spends most of its time in the pcap
- * library and if it gets suitable packets, it submits them to the worker
- * thread for processing.
+ * Start demultiplexing the DHCP packets seen on the req's interface to
+ * the request. The capture thread takes over the caller's reference to
+ * the request even if updating the filter of the packet socket fails.
+ * Call this function with the req's lock held.
+ *
+ * Returns 0 on success, -1 on error.
  */
-static void
-virNWFilterDHCPSnoopThread(void *req0)
+int
+virNWFilterSnoopCaptureAdd(virNWFilterSnoopReq *req)
 {
-    virNWFilterSnoopReq *req = req0;
-    struct pcap_pkthdr *hdr;
-    virNWFilterSnoopEthHdr *packet;
-    int ifindex = 0;
-    int errcount = 0;
-    int tmp = -1, rv, n, pollTo;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.captureLock);
+    virNWFilterSnoopCaptureIf *iface = g_new0(virNWFilterSnoopCaptureIf, 1);
+    virNWFilterSnoopCaptureIf *old = NULL;
     size_t i;
-    g_autofree char *threadkey = NULL;
-    virThreadPool *worker = NULL;
-    time_t last_displayed = 0, last_displayed_queue = 0;
-    virNWFilterSnoopPcapConf pcapConf[] = {
-        {
-            .dir = PCAP_D_IN, /* from VM */
-            .filter = "dst port 67 and src port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        }, {
-            .dir = PCAP_D_OUT, /* to VM */
-            .filter = "src port 67 and dst port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        },
-    };
-    struct pollfd fds[] = {
-        {
-            /* get a POLLERR if interface goes down or disappears */
-            .events = POLLIN | POLLERR,
-        }, {
-            .events = POLLIN | POLLERR,
-        },
-    };
-    bool error = false;
 
-    /* whoever started us increased the reference counter for the req for us */
+    iface->req = req;
+    iface->ifname = g_strdup(req->binding->portdevname);
+    iface->threadkey = g_strdup(req->threadkey);
+    virMacAddrSet(&iface->mac, &req->binding->mac);
 
-    /* protect req->binding->portdevname & req->threadkey */
-    VIR_WITH_MUTEX_LOCK_GUARD(&req->lock) {
-        if (req->binding->portdevname && req->threadkey) {
-            for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-                pcapConf[i].handle =
-                    virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                             &req->binding->mac,
-                                             pcapConf[i].filter,
-                                             pcapConf[i].dir);
-                if (!pcapConf[i].handle) {
-                    error = true;
-                    break;
-                }
-                fds[i].fd = pcap_fileno(pcapConf[i].handle);
-            }
-            tmp = virNetDevGetIndex(req->binding->portdevname, &ifindex);
-            threadkey = g_strdup(req->threadkey);
-            worker = virThreadPoolNewFull(1, 1, 0, virNWFilterDHCPDecodeWorker,
-                                          "dhcp-decode", NULL, req);
-        }
+    for (i = 0; i < G_N_ELEMENTS(iface->dirs); i++) {
+        iface->dirs[i].rateLimit.prev = time(0);
+        iface->dirs[i].rateLimit.rate = DHCP_PKT_RATE;
+        iface->dirs[i].rateLimit.burstRate = DHCP_PKT_BURST;
+        iface->dirs[i].rateLimit.burstInterval = DHCP_BURST_INTERVAL_S;
+    }
 
-        /* let creator know how well we initialized */
-        if (error || !threadkey || tmp < 0 || !worker || ifindex != req->ifindex) {
-            virErrorPreserveLast(&req->threadError);
-            req->threadStatus = THREAD_STATUS_FAIL;
-        } else {
-            req->threadStatus = THREAD_STATUS_OK;
-        }
+    g_atomic_int_set(&req->jobCompletionStatus, 0);
 
-        virCondSignal(&req->threadStatusCond);
+    /*
+     * Interface indexes are unique, so an entry found here belongs to an
+     * interface which went away in the meantime; let the capture thread
+     * release it.
+     */
+    if (g_hash_table_steal_extended(virNWFilterSnoopState.captureIfs,
+                                    GINT_TO_POINTER(req->ifindex),
+                                    NULL, (void **)&old)) {
+        virNWFilterSnoopState.captureStale =
+            g_slist_prepend(virNWFilterSnoopState.captureStale, old);
     }
 
-    if (req->threadStatus != THREAD_STATUS_OK)
-        goto cleanup;
+    g_hash_table_insert(virNWFilterSnoopState.captureIfs,
+                        GINT_TO_POINTER(req->ifindex), iface);
 
-    while (!error) {
-        if (virNWFilterSnoopAdjustPoll(pcapConf,
-                                       G_N_ELEMENTS(pcapConf),
-                                       fds, &pollTo) < 0) {
-            break;
-        }
+    return virNWFilterSnoopCaptureUpdateFilter();
+}
 
-        /* cap pollTo so we don't hold up the join for too long */
-        if (pollTo < 0 || pollTo > SNOOP_POLL_MAX_TIMEOUT_MS)
-            pollTo = SNOOP_POLL_MAX_TIMEOUT_MS;
+/*
+ * Stop demultiplexing the DHCP packets of the req's interface.
+ *
+ * Returns true if the interface was removed, in which case the caller
+ * has to drop the reference the capture thread held on the request.
+ */
+static bool
+virNWFilterSnoopCaptureRemove(virNWFilterSnoopReq *req)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.captureLock);
+    virNWFilterSnoopCaptureIf *iface;
 
-        n = poll(fds, G_N_ELEMENTS(fds), pollTo);
+    iface = g_hash_table_lookup(virNWFilterSnoopState.captureIfs,
+                                GINT_TO_POINTER(req->ifindex));
+    if (!iface || iface->req != req)
+        return false;
 
-        if (n < 0) {
-            if (errno != EAGAIN && errno != EINTR)
-                error = true;
-        }
+    g_hash_table_steal(virNWFilterSnoopState.captureIfs,
+                       GINT_TO_POINTER(req->ifindex));
+    virNWFilterSnoopCaptureIfFree(iface);
 
-        virNWFilterSnoopReqLeaseTimerRun(req);
+    /* packets of the interface are ignored even if this fails */
+    ignore_value(virNWFilterSnoopCaptureUpdateFilter());
 
-        /*
-         * Check whether we were cancelled or whether
-         * a previously submitted job failed.
-         */
-        if (!virNWFilterSnoopIsActive(threadkey) ||
-            req->jobCompletionStatus != 0)
-            goto cleanup;
+    return true;
+}
 
-        for (i = 0; n > 0 && i < G_N_ELEMENTS(fds); i++) {
-            if (!fds[i].revents)
-                continue;
+/*
+ * Hand a captured packet to the request of the interface it was seen
+ * on, subject to the interface's rate limits.
+ */
+void
+virNWFilterSnoopCaptureDispatch(virNWFilterSnoopEthHdr *pep,
+                                int len,
+                                const struct sockaddr_ll *sll)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.captureLock);
+    virNWFilterSnoopCaptureIf *iface;
+    virNWFilterSnoopCaptureDir *dir;
+    /* packets the host transmits on the tap device are headed to the VM */
+    bool fromVM = sll->sll_pkttype != PACKET_OUTGOING;
+    unsigned int diff;
+    int rc;
+
+    if (len <= MIN_VALID_DHCP_PKT_SIZE || len > PCAP_PBUFSIZE)
+        return;
 
-            fds[i].revents = 0;
-            n--;
+    iface = g_hash_table_lookup(virNWFilterSnoopState.captureIfs,
+                                GINT_TO_POINTER(sll->sll_ifindex));
+    if (!iface || g_atomic_int_get(&iface->req->jobCompletionStatus) != 0)
+        return;
 
-            rv = pcap_next_ex(pcapConf[i].handle, &hdr,
-                              (const u_char **)&packet);
+    /*
+     * don't want to hear about another VM's DHCP requests
+     *
+     * Some DHCP servers respond via MAC broadcast; responses are filtered
+     * later by comparing the MAC address inside the DHCP response against
+     * the one of the VM.
+     */
+    if (fromVM && virMacAddrCmp(&iface->mac, &pep->eh_src) != 0)
+        return;
 
-            if (rv < 0) {
-                /* error reading from socket */
-                tmp = -1;
+    dir = &iface->dirs[fromVM];
 
-                /* protect req->binding->portdevname */
-                VIR_WITH_MUTEX_LOCK_GUARD(&req->lock) {
-                    if (req->binding->portdevname)
-                        tmp = virNetDevValidateConfig(req->binding->portdevname, NULL, ifindex);
-                }
+    if (virNWFilterSnoopIsPenalized(dir))
+        return;
 
-                if (tmp <= 0) {
-                    error = true;
-                    break;
-                }
+    diff = virNWFilterSnoopRateLimit(&dir->rateLimit);
+    if (diff > 0) {
+        virNWFilterSnoopRatePenalty(dir, diff, DHCP_PKT_RATE);
+        /* rate-limited warnings */
+        if (time(0) - iface->lastDisplayed > 10) {
+            iface->lastDisplayed = time(0);
+            VIR_WARN("Too many DHCP packets on interface '%s'",
+                     iface->ifname);
+        }
+        return;
+    }
 
-                if (++errcount > PCAP_READ_MAXERRS) {
-                    g_clear_pointer(&pcapConf[i].handle, pcap_close);
-
-                    /* protect req->binding->portdevname */
-                    VIR_WITH_MUTEX_LOCK_GUARD(&req->lock) {
-                        virReportError(VIR_ERR_INTERNAL_ERROR,
-                                       _("interface '%1$s' failing; reopening"),
-                                       req->binding->portdevname);
-                        if (req->binding->portdevname)
-                            pcapConf[i].handle =
-                                virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                                         &req->binding->mac,
-                                                         pcapConf[i].filter,
-                                                         pcapConf[i].dir);
-                    }
-
-                    if (!pcapConf[i].handle) {
-                        error = true;
-                        break;
-                    }
-                }
+    rc = virNWFilterSnoopDHCPDecodeJobSubmit(iface->req, pep, len, fromVM);
+    if (rc < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Job submission failed on interface '%1$s'"),
+                       iface->ifname);
+        /* have the interface removed by the next sweep */
+        g_atomic_int_set(&iface->req->jobCompletionStatus, -1);
+    } else if (rc > 0) {
+        if (time(0) - iface->lastDisplayedQueue > 10) {
+            iface->lastDisplayedQueue = time(0);
+            VIR_WARN("Worker thread for interface '%s' has a "
+                     "job queue that is too long",
+                     iface->ifname);
+        }
+    }
+}
+
+/*
+ * Read the packets waiting on the packet socket, but not more than
+ * SNOOP_READ_BATCH of them so that a flood can't hold up the sweep.
+ */
+static void
+virNWFilterSnoopCaptureRead(int fd)
+{
+    unsigned char packet[PCAP_PBUFSIZE];
+    size_t i;
+
+    for (i = 0; i < SNOOP_READ_BATCH; i++) {
+        struct sockaddr_ll sll;
+        socklen_t slen = sizeof(sll);
+        ssize_t len;
+
+        len = recvfrom(fd, packet, sizeof(packet), 0,
+                       (struct sockaddr *)&sll, &slen);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                VIR_WARN("Reading from packet socket failed: %s",
+                         g_strerror(errno));
+            return;
+        }
+
+        virNWFilterSnoopCaptureDispatch((virNWFilterSnoopEthHdr *)packet,
+                                        len, &sll);
+    }
+}
+
+/*
+ * Periodic housekeeping of the capture thread: release interfaces which
+ * are no longer snooped, have the lease timers run and write out the
+ * leases collected since the last sweep.
+ */
+static void
+virNWFilterSnoopCaptureSweep(bool runTimers)
+{
+    GSList *stale = NULL;
+    GSList *next;
+    GHashTableIter iter;
+    virNWFilterSnoopCaptureIf *iface;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.captureLock) {
+        stale = g_steal_pointer(&virNWFilterSnoopState.captureStale);
+
+        g_hash_table_iter_init(&iter, virNWFilterSnoopState.captureIfs);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&iface)) {
+            if (virNWFilterSnoopCaptureIfIsStale(iface)) {
+                g_hash_table_iter_steal(&iter);
+                stale = g_slist_prepend(stale, iface);
                 continue;
             }
 
-            errcount = 0;
-
-            if (rv) {
-                unsigned int diff;
-
-                /* submit packet to worker thread */
-                if (g_atomic_int_get(&pcapConf[i].qCtr) >
-                    pcapConf[i].maxQSize) {
-                    if (last_displayed_queue - time(0) > 10) {
-                        last_displayed_queue = time(0);
-                        VIR_WARN("Worker thread for interface '%s' has a "
-                                 "job queue that is too long",
-                                 req->binding->portdevname);
-                    }
-                    continue;
+            if (runTimers) {
+                VIR_WITH_MUTEX_LOCK_GUARD(&iface->req->jobLock) {
+                    ignore_value(virNWFilterSnoopReqSchedule(iface->req));
                 }
+            }
+        }
 
-                diff = virNWFilterSnoopRateLimit(&pcapConf[i].rateLimit);
-                if (diff > 0) {
-                    virNWFilterSnoopRatePenalty(&pcapConf[i], diff,
-                                                DHCP_PKT_RATE);
-                    /* rate-limited warnings */
-                    if (time(0) - last_displayed > 10) {
-                         last_displayed = time(0);
-                         VIR_WARN("Too many DHCP packets on interface '%s'",
-                                  req->binding->portdevname);
-                    }
-                    continue;
-                }
+        if (stale)
+            ignore_value(virNWFilterSnoopCaptureUpdateFilter());
+    }
 
-                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, packet,
-                                                      hdr->caplen,
-                                                      pcapConf[i].dir,
-                                                      &pcapConf[i].qCtr) < 0) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("Job submission failed on interface '%1$s'"),
-                                   req->binding->portdevname);
-                    error = true;
-                    break;
-                }
+    for (next = stale; next; next = next->next)
+        virNWFilterSnoopCaptureIfRelease(next->data);
+    g_slist_free(stale);
+
+    virNWFilterSnoopLeaseFileSync();
+}
+
+/*
+ * The DHCP snooping thread. It waits for DHCP packets on the packet
+ * socket shared by all snooped interfaces and submits them to the
+ * worker threads for processing.
+ */
+static void
+virNWFilterSnoopCaptureThread(void *opaque G_GNUC_UNUSED)
+{
+    struct pollfd fds[] = {
+        {
+            .fd = virNWFilterSnoopState.captureFD,
+            .events = POLLIN,
+        }, {
+            .fd = virNWFilterSnoopState.wakeupFD[0],
+            .events = POLLIN,
+        },
+    };
+    unsigned long long nextSweep = 0;
+    unsigned long long nextTimers = 0;
+
+    while (!g_atomic_int_get(&virNWFilterSnoopState.captureQuit)) {
+        unsigned long long now = 0;
+        int pollTo = SNOOP_SWEEP_INTERVAL_MS;
+
+        if (virTimeMillisNowRaw(&now) == 0) {
+            if (now >= nextSweep) {
+                bool runTimers = now >= nextTimers;
+
+                virNWFilterSnoopCaptureSweep(runTimers);
+
+                nextSweep = now + SNOOP_SWEEP_INTERVAL_MS;
+                if (runTimers)
+                    nextTimers = now + SNOOP_TIMER_INTERVAL_MS;
             }
-        } /* for all fds */
-    } /* while (!error) */
 
-    /* protect IfNameToKey */
-    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.snoopLock) {
-        /* protect req->binding->portdevname & req->threadkey */
-        VIR_WITH_MUTEX_LOCK_GUARD(&req->lock) {
-            virNWFilterSnoopCancel(&req->threadkey);
+            pollTo = nextSweep - now;
+        }
 
-            ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
-                                            req->binding->portdevname));
+        if (poll(fds, G_N_ELEMENTS(fds), pollTo) < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                VIR_WARN("poll on packet socket failed: %s",
+                         g_strerror(errno));
+            continue;
+        }
 
-            g_clear_pointer(&req->binding->portdevname, g_free);
+        if (fds[1].revents) {
+            char buf[16];
+
+            while (read(fds[1].fd, buf, sizeof(buf)) > 0)
+                ; /* empty */
         }
+
+        if (fds[0].revents)
+            virNWFilterSnoopCaptureRead(fds[0].fd);
     }
+}
 
- cleanup:
-    virThreadPoolFree(worker);
+/*
+ * Open the packet socket and start the capture thread along with the
+ * decoding workers unless they are running already.
+ * Call this function with the SnoopLock held.
+ */
+static int
+virNWFilterSnoopCaptureStart(void)
+{
+    if (virNWFilterSnoopState.captureFD >= 0)
+        return 0;
 
-    virNWFilterSnoopReqPut(req);
+    if (virPipeNonBlock(virNWFilterSnoopState.wakeupFD) < 0)
+        return -1;
+
+    if ((virNWFilterSnoopState.captureFD = virNWFilterSnoopCaptureOpen()) < 0)
+        goto error;
 
-    for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-        if (pcapConf[i].handle)
-            pcap_close(pcapConf[i].handle);
+    if (virNWFilterSnoopDecodeStart(DHCP_DECODE_WORKERS) < 0)
+        goto error;
+
+    g_atomic_int_set(&virNWFilterSnoopState.captureQuit, 0);
+
+    if (virThreadCreateFull(&virNWFilterSnoopState.captureThread, true,
+                            virNWFilterSnoopCaptureThread,
+                            "dhcp-snoop", false, NULL) != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to create DHCP snooping thread"));
+        goto error;
     }
 
-    ignore_value(g_atomic_int_dec_and_test(&virNWFilterSnoopState.nThreads));
+    return 0;
 
-    return;
+ error:
+    virNWFilterSnoopDecodeStop();
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.captureFD);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFD[0]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFD[1]);
+    return -1;
+}
+
+/*
+ * Stop the capture thread and the decoding workers and release all
+ * interfaces.
+ */
+void
+virNWFilterSnoopCaptureStop(void)
+{
+    GSList *stale = NULL;
+    GSList *next;
+    GHashTableIter iter;
+    virNWFilterSnoopCaptureIf *iface;
+
+    g_atomic_int_set(&virNWFilterSnoopState.captureQuit, 1);
+
+    if (virNWFilterSnoopState.captureFD >= 0) {
+        ignore_value(safewrite(virNWFilterSnoopState.wakeupFD[1], "", 1));
+        virThreadJoin(&virNWFilterSnoopState.captureThread);
+    }
+
+    /* drop the references of scheduled requests before the interfaces
+     * release theirs */
+    virNWFilterSnoopDecodeStop();
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.captureLock) {
+        stale = g_steal_pointer(&virNWFilterSnoopState.captureStale);
+
+        g_hash_table_iter_init(&iter, virNWFilterSnoopState.captureIfs);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&iface)) {
+            g_hash_table_iter_steal(&iter);
+            stale = g_slist_prepend(stale, iface);
+        }
+    }
+
+    for (next = stale; next; next = next->next)
+        virNWFilterSnoopCaptureIfRelease(next->data);
+    g_slist_free(stale);
+
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.captureFD);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFD[0]);
+    VIR_FORCE_CLOSE(virNWFilterSnoopState.wakeupFD[1]);
+    g_clear_pointer(&virNWFilterSnoopState.snoopFilter, g_free);
+    virNWFilterSnoopState.nsnoopFilter = 0;
 }
 
 static void
@@ -1411,9 +1744,8 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriver *techdriver,
     bool isnewreq;
     char ifkey[VIR_IFKEY_LEN];
     int tmp;
-    virThread thread;
     virNWFilterVarValue *dhcpsrvrs;
-    bool threadPuts = false;
+    bool capturePuts = false;
 
     virNWFilterSnoopIFKeyFMT(ifkey, binding->owneruuid, &binding->mac);
 
@@ -1477,20 +1809,11 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriver *techdriver,
         goto exit_rem_ifnametokey;
     }
 
-    /* prevent thread from holding req */
+    /* prevent workers from holding req */
     virMutexLock(&req->lock);
 
-    if (virThreadCreateFull(&thread, false, virNWFilterDHCPSnoopThread,
-                            "dhcp-snoop", false, req) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("virNWFilterDHCPSnoopReq virThreadCreate failed on interface '%1$s'"),
-                       binding->portdevname);
+    if (virNWFilterSnoopCaptureStart() < 0)
         goto exit_snoopreq_unlock;
-    }
-
-    threadPuts = true;
-
-    g_atomic_int_add(&virNWFilterSnoopState.nThreads, 1);
 
     req->threadkey = virNWFilterSnoopActivate(req);
     if (!req->threadkey) {
@@ -1500,6 +1823,11 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriver *techdriver,
         goto exit_snoopreq_unlock;
     }
 
+    /* the capture thread owns the reference now, even on failure */
+    capturePuts = true;
+    if (virNWFilterSnoopCaptureAdd(req) < 0)
+        goto exit_snoop_cancel;
+
     if (virNWFilterSnoopReqRestore(req) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Restoring of leases failed on interface '%1$s'"),
@@ -1507,27 +1835,17 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriver *techdriver,
         goto exit_snoop_cancel;
     }
 
-    /* sync with thread */
-    if (virCondWait(&req->threadStatusCond, &req->lock) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("unable to wait on dhcp snoop thread"));
-        goto exit_snoop_cancel;
-    }
-
-    if (req->threadStatus != THREAD_STATUS_OK) {
-        virErrorRestore(&req->threadError);
-        goto exit_snoop_cancel;
-    }
-
     virMutexUnlock(&req->lock);
 
     virMutexUnlock(&virNWFilterSnoopState.snoopLock);
 
-    /* do not 'put' the req -- the thread will do this */
+    /* do not 'put' the req -- the capture thread will do this */
 
     return 0;
 
  exit_snoop_cancel:
+    if (virNWFilterSnoopCaptureRemove(req))
+        capturePuts = false;
     virNWFilterSnoopCancel(&req->threadkey);
  exit_snoopreq_unlock:
     virMutexUnlock(&req->lock);
@@ -1536,7 +1854,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriver *techdriver,
  exit_snoopunlock:
     virMutexUnlock(&virNWFilterSnoopState.snoopLock);
  exit_snoopreqput:
-    if (!threadPuts)
+    if (!capturePuts)
         virNWFilterSnoopReqPut(req);
 
     return -1;
@@ -1545,6 +1863,9 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriver *techdriver,
 static void
 virNWFilterSnoopLeaseFileClose(void)
 {
+    if (virNWFilterSnoopState.leaseFD >= 0)
+        virNWFilterSnoopLeaseFileFlush();
+
     VIR_FORCE_CLOSE(virNWFilterSnoopState.leaseFD);
 }
 
@@ -1558,28 +1879,49 @@ virNWFilterSnoopLeaseFileOpen(void)
 }
 
 /*
- * Write a single lease to the given file.
- *
+ * Append leases to @fd instead of the lease file; for tests.
+ */
+void
+virNWFilterSnoopLeaseFileSetFD(int fd)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.snoopLock);
+
+    virNWFilterSnoopLeaseFileClose();
+    virNWFilterSnoopState.leaseFD = fd;
+}
+
+/*
+ * Format a single lease into the given buffer.
  */
 static int
-virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
-                               virNWFilterSnoopIPLease *ipl)
+virNWFilterSnoopLeaseFileFormat(virBuffer *buf, const char *ifkey,
+                                virNWFilterSnoopIPLease *ipl)
 {
-    g_autofree char *lbuf = NULL;
     g_autofree char *ipstr = virSocketAddrFormat(&ipl->ipAddress);
     g_autofree char *dhcpstr = virSocketAddrFormat(&ipl->ipServer);
-    int len;
 
     if (!dhcpstr || !ipstr)
         return -1;
 
     /* time intf ip dhcpserver */
-    lbuf = g_strdup_printf("%llu %s %s %s\n",
-                           (unsigned long long) ipl->timeout,
-                           ifkey, ipstr, dhcpstr);
-    len = strlen(lbuf);
+    virBufferAsprintf(buf, "%llu %s %s %s\n",
+                      (unsigned long long) ipl->timeout,
+                      ifkey, ipstr, dhcpstr);
+    return 0;
+}
+
+/*
+ * Write the leases formatted into the buffer to the given file.
+ */
+static int
+virNWFilterSnoopLeaseFileWrite(int lfd, virBuffer *buf)
+{
+    size_t len = virBufferUse(buf);
 
-    if (safewrite(lfd, lbuf, len) != len) {
+    if (len == 0)
+        return 0;
+
+    if (safewrite(lfd, virBufferCurrentContent(buf), len) < 0) {
         virReportSystemError(errno, "%s", _("lease file write failed"));
         return -1;
     }
@@ -1589,27 +1931,62 @@ virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
 }
 
 /*
- * Append a single lease to the end of the lease file.
- * To keep a limited number of dead leases, re-read the lease
- * file if the threshold of active leases versus written ones
- * exceeds a threshold.
+ * Queue a single lease to be appended to the end of the lease file.
+ * The capture thread writes the queued leases out periodically so
+ * that a burst of leases costs a single write.
  */
-static void
+void
 virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLease *ipl)
 {
     VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.snoopLock);
     virNWFilterSnoopReq *req = ipl->snoopReq;
 
+    if (virNWFilterSnoopLeaseFileFormat(&virNWFilterSnoopState.leaseBuf,
+                                        req->ifkey, ipl) < 0)
+        return;
+
+    g_atomic_int_add(&virNWFilterSnoopState.wLeases, 1);
+}
+
+/*
+ * Append the queued leases to the end of the lease file.
+ * Call this function with the SnoopLock held.
+ */
+void
+virNWFilterSnoopLeaseFileFlush(void)
+{
+    if (virBufferUse(&virNWFilterSnoopState.leaseBuf) == 0)
+        return;
+
     if (virNWFilterSnoopState.leaseFD < 0)
         virNWFilterSnoopLeaseFileOpen();
-    if (virNWFilterSnoopLeaseFileWrite(virNWFilterSnoopState.leaseFD,
-                                       req->ifkey, ipl) < 0)
+
+    ignore_value(virNWFilterSnoopLeaseFileWrite(virNWFilterSnoopState.leaseFD,
+                                                &virNWFilterSnoopState.leaseBuf));
+
+    virBufferFreeAndReset(&virNWFilterSnoopState.leaseBuf);
+}
+
+/*
+ * Write out the queued leases.
+ * To keep a limited number of dead leases, re-read the lease
+ * file if the threshold of active leases versus written ones
+ * exceeds a threshold.
+ */
+static void
+virNWFilterSnoopLeaseFileSync(void)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.snoopLock);
+
+    if (virBufferUse(&virNWFilterSnoopState.leaseBuf) == 0)
         return;
 
     /* keep dead leases at < ~95% of file size */
-    if (g_atomic_int_add(&virNWFilterSnoopState.wLeases, 1) >=
+    if (g_atomic_int_get(&virNWFilterSnoopState.wLeases) >=
         g_atomic_int_get(&virNWFilterSnoopState.nLeases) * 20)
         virNWFilterSnoopLeaseFileLoad();   /* load & refresh lease file */
+    else
+        virNWFilterSnoopLeaseFileFlush();
 }
 
 /*
@@ -1639,7 +2016,7 @@ virNWFilterSnoopPruneIter(const void *payload,
 }
 
 /*
- * Iterator to write all leases of a single request to a file.
+ * Iterator to format all leases of a single request into a buffer.
  * Call this function with the SnoopLock held.
  */
 static int
@@ -1648,14 +2025,14 @@ virNWFilterSnoopSaveIter(void *payload,
                          void *data)
 {
     virNWFilterSnoopReq *req = payload;
-    int tfd = *(int *)data;
+    virBuffer *buf = data;
     virNWFilterSnoopIPLease *ipl;
 
     /* protect req->start */
     VIR_LOCK_GUARD lock = virLockGuardLock(&req->lock);
 
     for (ipl = req->start; ipl; ipl = ipl->next)
-        ignore_value(virNWFilterSnoopLeaseFileWrite(tfd, req->ifkey, ipl));
+        ignore_value(virNWFilterSnoopLeaseFileFormat(buf, req->ifkey, ipl));
 
     return 0;
 }
@@ -1668,6 +2045,7 @@ virNWFilterSnoopSaveIter(void *payload,
 static void
 virNWFilterSnoopLeaseFileRefresh(void)
 {
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
     int tfd;
 
     if (g_mkdir_with_parents(LEASEFILE_DIR, 0700) < 0) {
@@ -1691,7 +2069,13 @@ virNWFilterSnoopLeaseFileRefresh(void)
                          virNWFilterSnoopPruneIter, NULL);
         /* now save them */
         virHashForEach(virNWFilterSnoopState.snoopReqs,
-                       virNWFilterSnoopSaveIter, (void *)&tfd);
+                       virNWFilterSnoopSaveIter, &buf);
+    }
+
+    if (virNWFilterSnoopLeaseFileWrite(tfd, &buf) < 0) {
+        VIR_FORCE_CLOSE(tfd);
+        unlink(TMPLEASEFILE);
+        goto cleanup;
     }
 
     if (VIR_CLOSE(tfd) < 0) {
@@ -1724,6 +2108,9 @@ virNWFilterSnoopLeaseFileLoad(void)
     int ln = 0, tmp;
     VIR_LOCK_GUARD lock = virLockGuardLock(&virNWFilterSnoopState.snoopLock);
 
+    /* the file must reflect all leases before it is read back */
+    virNWFilterSnoopLeaseFileFlush();
+
     fp = fopen(LEASEFILE, "r");
     time(&now);
     while (fp && fgets(line, sizeof(line), fp)) {
@@ -1787,19 +2174,6 @@ virNWFilterSnoopLeaseFileLoad(void)
     virNWFilterSnoopLeaseFileRefresh();
 }
 
-/*
- * Wait until all threads have ended.
- */
-static void
-virNWFilterSnoopJoinThreads(void)
-{
-    while (g_atomic_int_get(&virNWFilterSnoopState.nThreads) != 0) {
-        VIR_WARN("Waiting for snooping threads to terminate: %u",
-                 g_atomic_int_get(&virNWFilterSnoopState.nThreads));
-        g_usleep(1000 * 1000);
-    }
-}
-
 /*
  * Iterator to remove a request, repeatedly called on one
  * request after another.
@@ -1837,7 +2211,7 @@ virNWFilterSnoopRemAllReqIter(const void *payload,
 
 
 /*
- * Terminate all threads; keep the SnoopReqs hash allocated
+ * Stop snooping on all interfaces; keep the SnoopReqs hash allocated
  */
 static void
 virNWFilterSnoopEndThreads(void)
@@ -1849,14 +2223,13 @@ virNWFilterSnoopEndThreads(void)
                      NULL);
 }
 
+/*
+ * Initialize the locks and tables of the snooping state without
+ * touching the lease file.
+ */
 int
-virNWFilterDHCPSnoopInit(void)
+virNWFilterSnoopStateInit(void)
 {
-    if (virNWFilterSnoopState.snoopReqs)
-        return 0;
-
-    VIR_DEBUG("Initializing DHCP snooping");
-
     if (virMutexInitRecursive(&virNWFilterSnoopState.snoopLock) < 0)
         return -1;
 
@@ -1865,10 +2238,39 @@ virNWFilterDHCPSnoopInit(void)
         return -1;
     }
 
+    if (virMutexInit(&virNWFilterSnoopState.captureLock) < 0) {
+        virMutexDestroy(&virNWFilterSnoopState.activeLock);
+        virMutexDestroy(&virNWFilterSnoopState.snoopLock);
+        return -1;
+    }
+
+    if (virMutexInit(&virNWFilterSnoopState.decodeLock) < 0) {
+        virMutexDestroy(&virNWFilterSnoopState.captureLock);
+        virMutexDestroy(&virNWFilterSnoopState.activeLock);
+        virMutexDestroy(&virNWFilterSnoopState.snoopLock);
+        return -1;
+    }
+
     virNWFilterSnoopState.ifnameToKey = virHashNew(NULL);
     virNWFilterSnoopState.active = virHashNew(NULL);
     virNWFilterSnoopState.snoopReqs =
         virHashNew(virNWFilterSnoopReqRelease);
+    virNWFilterSnoopState.captureIfs =
+        g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    return 0;
+}
+
+int
+virNWFilterDHCPSnoopInit(void)
+{
+    if (virNWFilterSnoopState.snoopReqs)
+        return 0;
+
+    VIR_DEBUG("Initializing DHCP snooping");
+
+    if (virNWFilterSnoopStateInit() < 0)
+        return -1;
 
     virNWFilterSnoopLeaseFileLoad();
     virNWFilterSnoopLeaseFileOpen();
@@ -1907,6 +2309,7 @@ virNWFilterDHCPSnoopEnd(const char *ifname)
 
     if (ifkey) {
         virNWFilterSnoopReq *req;
+        bool captured = false;
 
         req = virNWFilterSnoopReqGetByIFKey(ifkey);
         if (!req) {
@@ -1920,16 +2323,22 @@ virNWFilterDHCPSnoopEnd(const char *ifname)
             /* keep valid lease req; drop interface association */
             virNWFilterSnoopCancel(&req->threadkey);
 
+            captured = virNWFilterSnoopCaptureRemove(req);
+
             g_clear_pointer(&req->binding->portdevname, g_free);
         }
 
+        /* drop the reference held by the capture thread */
+        if (captured)
+            virNWFilterSnoopReqPut(req);
+
         virNWFilterSnoopReqPut(req);
     } else {                      /* free all of them */
         virNWFilterSnoopLeaseFileClose();
 
         virHashRemoveAll(virNWFilterSnoopState.ifnameToKey);
 
-        /* tell the threads to terminate */
+        /* stop snooping; the capture thread releases the interfaces */
         virNWFilterSnoopEndThreads();
 
         virNWFilterSnoopLeaseFileLoad();
@@ -1943,7 +2352,7 @@ virNWFilterDHCPSnoopShutdown(void)
         return;
 
     virNWFilterSnoopEndThreads();
-    virNWFilterSnoopJoinThreads();
+    virNWFilterSnoopCaptureStop();
 
     VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.snoopLock) {
         virNWFilterSnoopLeaseFileClose();
@@ -1953,6 +2362,13 @@ virNWFilterDHCPSnoopShutdown(void)
 
     virMutexDestroy(&virNWFilterSnoopState.snoopLock);
 
+    VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.captureLock) {
+        g_clear_pointer(&virNWFilterSnoopState.captureIfs, g_hash_table_unref);
+    }
+
+    virMutexDestroy(&virNWFilterSnoopState.captureLock);
+    virMutexDestroy(&virNWFilterSnoopState.decodeLock);
+
     VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.activeLock) {
         g_clear_pointer(&virNWFilterSnoopState.active, g_hash_table_unref);
     }
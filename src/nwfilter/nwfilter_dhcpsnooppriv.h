@@ -0,0 +1,146 @@
+/*
+ * nwfilter_dhcpsnooppriv.h: private declarations for DHCP snooping
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_NWFILTER_DHCPSNOOPPRIV_H_ALLOW
+# error "nwfilter_dhcpsnooppriv.h may only be included by nwfilter_dhcpsnoop.c or test suites"
+#endif /* LIBVIRT_NWFILTER_DHCPSNOOPPRIV_H_ALLOW */
+
+#pragma once
+
+#include <netpacket/packet.h>
+#include <linux/filter.h>
+
+#include "nwfilter_tech_driver.h"
+#include "virsocketaddr.h"
+#include "virthread.h"
+
+#define VIR_IFKEY_LEN   ((VIR_UUID_STRING_BUFLEN) + (VIR_MAC_STRING_BUFLEN))
+
+#define PCAP_PBUFSIZE              576 /* >= IP/TCP/DHCP headers */
+
+typedef struct _virNWFilterSnoopReq virNWFilterSnoopReq;
+
+typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
+
+struct _virNWFilterSnoopReq {
+    /*
+     * reference counter: while the req is on the
+     * publicSnoopReqs hash, the refctr may only
+     * be modified with the SnoopLock held
+     */
+    int                                  refctr;
+
+    virNWFilterTechDriver *            techdriver;
+    virNWFilterBindingDef *            binding;
+    int                                  ifindex;
+    char                                 ifkey[VIR_IFKEY_LEN];
+    virNWFilterDriverState *           driver;
+    /* start and end of lease list, ordered by lease time */
+    virNWFilterSnoopIPLease *          start;
+    virNWFilterSnoopIPLease *          end;
+    char                                *threadkey;
+
+    int                                  jobCompletionStatus;
+    /*
+     * protect those members that can change while the
+     * req is on the public SnoopReq hash and
+     * at least one reference is held:
+     * - ifname
+     * - threadkey
+     * - start
+     * - end
+     * - a lease while it is on the list
+     * (for refctr, see above)
+     */
+    virMutex                             lock;
+
+    /* packets waiting for a worker thread */
+    GQueue                               jobs;
+    /* whether a worker thread has been asked to process the req */
+    bool                                 jobScheduled;
+    /* protects jobs and jobScheduled */
+    virMutex                             jobLock;
+};
+
+struct _virNWFilterSnoopIPLease {
+    virSocketAddr              ipAddress;
+    virSocketAddr              ipServer;
+    virNWFilterSnoopReq *    snoopReq;
+    time_t                     timeout;
+    /* timer list */
+    virNWFilterSnoopIPLease *prev;
+    virNWFilterSnoopIPLease *next;
+};
+
+typedef struct _virNWFilterSnoopEthHdr virNWFilterSnoopEthHdr;
+struct _virNWFilterSnoopEthHdr {
+    virMacAddr eh_dst;
+    virMacAddr eh_src;
+    uint16_t eh_type;
+    uint8_t eh_data[];
+} ATTRIBUTE_PACKED;
+G_STATIC_ASSERT(sizeof(struct _virNWFilterSnoopEthHdr) == 14);
+
+typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
+struct _virNWFilterDHCPDecodeJob {
+    unsigned char packet[PCAP_PBUFSIZE];
+    int caplen;
+    bool fromVM;
+};
+
+int
+virNWFilterSnoopStateInit(void);
+
+virNWFilterSnoopReq *
+virNWFilterSnoopReqNew(const char *ifkey);
+
+void
+virNWFilterSnoopReqGet(virNWFilterSnoopReq *req);
+
+void
+virNWFilterSnoopReqPut(virNWFilterSnoopReq *req);
+
+int
+virNWFilterSnoopDecodeStart(size_t workers);
+
+int
+virNWFilterSnoopCaptureAdd(virNWFilterSnoopReq *req);
+
+struct sock_filter *
+virNWFilterSnoopCaptureFilterBuild(const struct sock_filter *insns,
+                                   size_t ninsns,
+                                   const int *ifindexes,
+                                   size_t nifindexes,
+                                   size_t *len);
+
+void
+virNWFilterSnoopCaptureDispatch(virNWFilterSnoopEthHdr *pep,
+                                int len,
+                                const struct sockaddr_ll *sll);
+
+void
+virNWFilterSnoopCaptureStop(void);
+
+void
+virNWFilterSnoopLeaseFileSetFD(int fd);
+
+void
+virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLease *ipl);
+
+void
+virNWFilterSnoopLeaseFileFlush(void);
@@ -836,7 +836,14 @@ qemuBackupBegin(virDomainObj *vm,
             goto endjob;
     }
 
-    if (!(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, VIR_ASYNC_JOB_BACKUP)))
+    /* Creating the backup images requires current allocation of the disks,
+     * otherwise the cached data is enough to plan the bitmaps */
+    if (reuse)
+        blockNamedNodeData = qemuBlockGetNamedNodeDataCached(vm, VIR_ASYNC_JOB_BACKUP);
+    else
+        blockNamedNodeData = qemuBlockGetNamedNodeData(vm, VIR_ASYNC_JOB_BACKUP);
+
+    if (!blockNamedNodeData)
         goto endjob;
 
     if ((ndd = qemuBackupDiskPrepareData(vm, def, blockNamedNodeData, actions,
@@ -2931,6 +2931,60 @@ qemuBlockGetNamedNodeData(virDomainObj *vm,
 }
 
 
+/**
+ * qemuBlockGetNamedNodeDataCached:
+ * @vm: domain object
+ * @asyncJob: current asynchronous job
+ *
+ * Same as qemuBlockGetNamedNodeData, but the data is kept in the private data
+ * of @vm and reused as long as no command sent to QEMU nor any event received
+ * from it could have modified the block node graph or the dirty bitmaps since
+ * it was queried (see qemuMonitorGetBlockGeneration). This is meant for code
+ * planning operations on bitmaps which only needs to know which bitmaps exist
+ * and where. Volatile statistics, i.e. the allocation of images and the dirty
+ * count of bitmaps, may be out of date in the returned data.
+ *
+ * The returned hash table is shared and must not be modified.
+ *
+ * Returns a new reference to the hash table on success, NULL on error.
+ */
+GHashTable *
+qemuBlockGetNamedNodeDataCached(virDomainObj *vm,
+                                virDomainAsyncJob asyncJob)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    GHashTable *blockNamedNodeData = NULL;
+    unsigned int generation;
+
+    if (qemuDomainObjEnterMonitorAsync(vm, asyncJob) < 0)
+        return NULL;
+
+    generation = qemuMonitorGetBlockGeneration(priv->mon);
+
+    if (priv->blockNamedNodeData &&
+        priv->blockNamedNodeDataGeneration == generation) {
+        qemuDomainObjExitMonitor(vm);
+        VIR_DEBUG("Using cached block node data of generation %u", generation);
+        return g_hash_table_ref(priv->blockNamedNodeData);
+    }
+
+    blockNamedNodeData = qemuMonitorBlockGetNamedNodeData(priv->mon);
+
+    qemuDomainObjExitMonitor(vm);
+
+    if (!blockNamedNodeData)
+        return NULL;
+
+    /* Anything happening while the query was in flight already changed the
+     * generation so the data is never stored newer than it really is */
+    g_clear_pointer(&priv->blockNamedNodeData, g_hash_table_unref);
+    priv->blockNamedNodeData = g_hash_table_ref(blockNamedNodeData);
+    priv->blockNamedNodeDataGeneration = generation;
+
+    return blockNamedNodeData;
+}
+
+
 /**
  * qemuBlockGetBitmapMergeActionsGetBitmaps:
  *
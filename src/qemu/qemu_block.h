@@ -279,6 +279,10 @@ GHashTable *
 qemuBlockGetNamedNodeData(virDomainObj *vm,
                           virDomainAsyncJob asyncJob);
 
+GHashTable *
+qemuBlockGetNamedNodeDataCached(virDomainObj *vm,
+                                virDomainAsyncJob asyncJob);
+
 int
 qemuBlockGetBitmapMergeActions(virStorageSource *topsrc,
                                virStorageSource *basesrc,
@@ -232,6 +232,8 @@ virQEMUDriverConfig *virQEMUDriverConfigNew(bool privileged,
         cfg->swtpm_group = (gid_t)-1;
     }
 
+    cfg->statsExportGroup = (gid_t)-1;
+
     cfg->configDir = g_strdup_printf("%s/qemu", cfg->configBaseDir);
     cfg->autostartDir = g_strdup_printf("%s/qemu/autostart", cfg->configBaseDir);
     cfg->slirpStateDir = g_strdup_printf("%s/slirp", cfg->stateDir);
@@ -291,6 +293,9 @@ virQEMUDriverConfig *virQEMUDriverConfigNew(bool privileged,
     cfg->logTimestamp = true;
     cfg->glusterDebugLevel = 4;
     cfg->stdioLogD = true;
+#if !WITH_NUMAD
+    cfg->numaPlacementBuiltin = true;
+#endif
 
     cfg->namespaces = virBitmapNew(QEMU_DOMAIN_NS_LAST);
 
@@ -787,8 +792,10 @@ virQEMUDriverConfigLoadProcessEntry(virQEMUDriverConfig *cfg,
 {
     g_auto(GStrv) hugetlbfs = NULL;
     g_autofree char *stdioHandler = NULL;
+    g_autofree char *numaPlacement = NULL;
     g_autofree char *corestr = NULL;
     g_autofree char *schedCore = NULL;
+    g_autofree char *statsExportGroup = NULL;
     size_t i;
 
     if (virConfGetValueStringList(conf, "hugetlbfs_mount", true,
@@ -836,6 +843,8 @@ virQEMUDriverConfigLoadProcessEntry(virQEMUDriverConfig *cfg,
         return -1;
     if (virConfGetValueUInt(conf, "max_threads_per_process", &cfg->maxThreadsPerProc) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "max_reconnect_workers", &cfg->maxReconnectWorkers) < 0)
+        return -1;
 
     if (virConfGetValueType(conf, "max_core") == VIR_CONF_STRING) {
         if (virConfGetValueString(conf, "max_core", &corestr) < 0)
@@ -869,6 +878,30 @@ virQEMUDriverConfigLoadProcessEntry(virQEMUDriverConfig *cfg,
         }
     }
 
+    if (virConfGetValueString(conf, "numa_placement", &numaPlacement) < 0)
+        return -1;
+    if (numaPlacement) {
+        if (STREQ(numaPlacement, "builtin")) {
+            cfg->numaPlacementBuiltin = true;
+        } else if (STREQ(numaPlacement, "numad")) {
+            cfg->numaPlacementBuiltin = false;
+        } else {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("Unknown NUMA placement engine %1$s"),
+                           numaPlacement);
+            return -1;
+        }
+    }
+
+    if (virConfGetValueUInt(conf, "stats_export_interval", &cfg->statsExportInterval) < 0)
+        return -1;
+
+    if (virConfGetValueString(conf, "stats_export_group", &statsExportGroup) < 0)
+        return -1;
+    if (statsExportGroup &&
+        virGetGroupID(statsExportGroup, &cfg->statsExportGroup) < 0)
+        return -1;
+
     if (virConfGetValueString(conf, "sched_core", &schedCore) < 0)
         return -1;
     if (schedCore) {
@@ -934,6 +967,10 @@ virQEMUDriverConfigLoadRPCEntry(virQEMUDriverConfig *cfg,
 {
     if (virConfGetValueUInt(conf, "max_queued", &cfg->maxQueuedJobs) < 0)
         return -1;
+    if (virConfGetValueBool(conf, "fail_busy_queries", &cfg->failBusyQueries) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "max_event_workers", &cfg->maxEventWorkers) < 0)
+        return -1;
     if (virConfGetValueInt(conf, "keepalive_interval", &cfg->keepAliveInterval) < 0)
         return -1;
     if (virConfGetValueUInt(conf, "keepalive_count", &cfg->keepAliveCount) < 0)
@@ -991,6 +1028,12 @@ virQEMUDriverConfigLoadNetworkEntry(virQEMUDriverConfig *cfg,
         return -1;
     }
 
+    if (virConfGetValueUInt(conf, "migration_max_outgoing", &cfg->migrationMaxOutgoing) < 0)
+        return -1;
+
+    if (virConfGetValueULLong(conf, "migration_host_bandwidth", &cfg->migrationHostBandwidth) < 0)
+        return -1;
+
     return 0;
 }
 
@@ -1562,6 +1605,7 @@ virQEMUDriverCreateXMLConf(virQEMUDriver *driver,
     virQEMUDriverDomainDefParserConfig.priv = driver;
     virQEMUDriverDomainDefParserConfig.defSecModel = defsecmodel;
     virQEMUDriverDomainJobConfig.maxQueuedJobs = cfg->maxQueuedJobs;
+    virQEMUDriverDomainJobConfig.failBusyQueries = cfg->failBusyQueries;
 
     ret = virDomainXMLOptionNew(&virQEMUDriverDomainDefParserConfig,
                                 &virQEMUDriverPrivateDataCallbacks,
@@ -37,8 +37,11 @@
 #include "locking/lock_manager.h"
 #include "qemu_capabilities.h"
 #include "qemu_nbdkit.h"
+#include "qemu_migration_sched.h"
 #include "virclosecallbacks.h"
 #include "virhostdev.h"
+#include "virnuma.h"
+#include "virstatsexport.h"
 #include "virfile.h"
 #include "virfilecache.h"
 #include "virfirmware.h"
@@ -211,6 +214,9 @@ struct _virQEMUDriverConfig {
     bool dumpGuestCore;
 
     unsigned int maxQueuedJobs;
+    bool failBusyQueries;
+    unsigned int maxReconnectWorkers;
+    unsigned int maxEventWorkers;
 
     char **securityDriverNames;
     bool securityDefaultConfined;
@@ -238,9 +244,14 @@ struct _virQEMUDriverConfig {
     char *migrationAddress;
     unsigned int migrationPortMin;
     unsigned int migrationPortMax;
+    unsigned int migrationMaxOutgoing;
+    unsigned long long migrationHostBandwidth;
 
     bool logTimestamp;
     bool stdioLogD;
+    bool numaPlacementBuiltin;
+    unsigned int statsExportInterval;
+    gid_t statsExportGroup;
 
     virFirmware **firmwares;
     size_t nfirmwares;
@@ -282,6 +293,18 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPool *workerPool;
 
+    /* Domains running when the daemon started which still wait for
+     * a reconnect worker, in the order they will be reconnected.
+     * Require lock to access the queue */
+    GQueue *reconnectQueue;
+
+    /* Immutable after qemuProcessReconnectAll */
+    virThread reconnectThread;
+    bool reconnectThreadActive;
+
+    /* Atomic set only, no more domains are reconnected once set */
+    int reconnectStop;
+
     /* Atomic increment only */
     int lastvmid;
 
@@ -348,6 +371,18 @@ struct _virQEMUDriver {
 
     /* Immutable pointer, self-locking APIs */
     virFileCache *nbdkitCapsCache;
+
+    /* Immutable pointer, self-locking APIs */
+    virNumaPlacement *numaPlacement;
+
+    /* Immutable pointer, NULL if disabled. Only accessed by its own thread */
+    virStatsExport *statsExport;
+
+    /* Immutable pointer, self-locking APIs */
+    virDomainDriverStatsCursors *statsCursors;
+
+    /* Immutable pointer, NULL if disabled, self-locking APIs */
+    qemuMigrationScheduler *migrationScheduler;
 };
 
 virQEMUDriverConfig *virQEMUDriverConfigNew(bool privileged,
@@ -38,6 +38,7 @@
 #include "qemu_validate.h"
 #include "qemu_namespace.h"
 #include "qemu_postparse.h"
+#include "qemu_process.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virerror.h"
@@ -66,6 +67,7 @@
 #include "backup_conf.h"
 #include "virutil.h"
 #include "virsecureerase.h"
+#include "virmetrics.h"
 #include "cpu/cpu_x86.h"
 
 #include <sys/time.h>
@@ -106,6 +108,7 @@ qemuJobFreePrivate(void *opaque)
     qemuMigrationParamsFree(priv->migParams);
     g_slist_free_full(priv->migTempBitmaps,
                       (GDestroyNotify) qemuDomainJobPrivateMigrateTempBitmapFree);
+    g_clear_object(&priv->migIdentity);
     g_free(priv);
 }
 
@@ -119,6 +122,7 @@ qemuJobResetPrivate(void *opaque)
     priv->spiceMigrated = false;
     priv->dumpCompleted = false;
     g_clear_pointer(&priv->migParams, qemuMigrationParamsFree);
+    g_clear_object(&priv->migIdentity);
 }
 
 
@@ -422,6 +426,7 @@ virDomainJobObjConfig virQEMUDriverDomainJobConfig = {
         .freePrivateData = qemuJobDataFreePrivateData,
     },
     .maxQueuedJobs = 0,
+    .failBusyQueries = false,
 };
 
 /**
@@ -450,6 +455,9 @@ qemuDomainObjFromDomain(virDomainPtr domain)
         return NULL;
     }
 
+    /* Don't make the client wait until all other domains are reconnected */
+    qemuProcessReconnectPrioritize(driver, vm);
+
     return vm;
 }
 
@@ -1912,6 +1920,7 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivate *priv)
     g_clear_pointer(&priv->migrationCaps, virBitmapFree);
 
     virHashRemoveAll(priv->blockjobs);
+    g_clear_pointer(&priv->blockNamedNodeData, g_hash_table_unref);
 
     g_clear_pointer(&priv->pflash0, virObjectUnref);
     g_clear_pointer(&priv->backup, virDomainBackupDefFree);
@@ -1981,6 +1990,9 @@ qemuDomainObjPrivateFree(void *data)
         g_object_unref(priv->eventThread);
     }
 
+    g_clear_pointer(&priv->events, g_queue_free);
+    virMutexDestroy(&priv->eventsLock);
+
     if (priv->statsSchema)
         g_clear_pointer(&priv->statsSchema, g_hash_table_destroy);
 
@@ -1997,6 +2009,13 @@ qemuDomainObjPrivateAlloc(void *opaque)
 {
     g_autoptr(qemuDomainObjPrivate) priv = g_new0(qemuDomainObjPrivate, 1);
 
+    if (virMutexInit(&priv->eventsLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to init domain event queue mutex"));
+        return NULL;
+    }
+    priv->events = g_queue_new();
+
     if (!(priv->devs = virChrdevAlloc()))
         return NULL;
 
@@ -2015,6 +2034,9 @@ qemuDomainObjPrivateAlloc(void *opaque)
     priv->schedCoreChildPID = -1;
     priv->schedCoreChildFD = -1;
 
+    priv->namespaceHelperPID = -1;
+    priv->namespaceHelperFD = -1;
+
     return g_steal_pointer(&priv);
 }
 
@@ -6397,29 +6419,34 @@ qemuDomainPrepareStorageSource(virStorageSource *src,
 
 
 /**
- * qemuDomainDetermineDiskChain:
+ * qemuDomainDetermineDiskChainProbe:
  * @driver: qemu driver object
  * @vm: domain object
  * @disk: disk definition
  * @disksrc: source to determine the chain for, may be NULL
+ * @probe: filled with state for qemuDomainDetermineDiskChainFinish
  *
- * Prepares and initializes the backing chain of disk @disk. In cases where
- * a new source is to be associated with @disk the @disksrc parameter can be
- * used to override the source.
+ * First half of qemuDomainDetermineDiskChain which accesses the images of
+ * @disk to detect the backing chain. It modifies only the chain of @disk and
+ * accesses @vm read-only, therefore it's safe to probe several disks of @vm
+ * in parallel as long as the domain object is locked by the caller.
  */
 int
-qemuDomainDetermineDiskChain(virQEMUDriver *driver,
-                             virDomainObj *vm,
-                             virDomainDiskDef *disk,
-                             virStorageSource *disksrc)
+qemuDomainDetermineDiskChainProbe(virQEMUDriver *driver,
+                                  virDomainObj *vm,
+                                  virDomainDiskDef *disk,
+                                  virStorageSource *disksrc,
+                                  qemuDomainDiskChainProbe *probe)
 {
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
-    bool hadDataStore = false;
     virStorageSource *src; /* iterator for the backing chain declared in XML */
-    virStorageSource *n; /* iterator for the backing chain detected from disk */
     uid_t uid;
     gid_t gid;
 
+    probe->src = NULL;
+    probe->hadDataStore = false;
+    probe->validate = false;
+
     if (!disksrc)
         disksrc = disk->src;
 
@@ -6483,38 +6510,74 @@ qemuDomainDetermineDiskChain(virQEMUDriver *driver,
         }
     }
 
+    probe->validate = true;
+
     /* We skipped to the end of the chain. Skip detection if there's the
      * terminator. (An allocated but empty backingStore) */
-    if (src->backingStore) {
-        if (qemuDomainStorageSourceValidateDepth(disksrc, 0, disk->dst) < 0)
-            return -1;
-
+    if (src->backingStore)
         return 0;
-    }
 
     qemuDomainGetImageIds(cfg, vm->def, src, disksrc, &uid, &gid);
 
-    hadDataStore = !!src->dataFileStore;
+    probe->hadDataStore = !!src->dataFileStore;
 
     if (virStorageSourceGetMetadata(src, uid, gid,
                                     QEMU_DOMAIN_STORAGE_SOURCE_CHAIN_MAX_DEPTH,
                                     true) < 0)
         return -1;
 
-    /* As we perform image properties detection on the last member of the
-     * backing chain we need to also consider the data store part of the current
-     * image */
-    if (src->dataFileStore && !hadDataStore &&
-        qemuDomainPrepareStorageSource(src->dataFileStore, vm, disk, cfg) < 0)
-        return -1;
+    probe->src = src;
 
-    for (n = src->backingStore; virStorageSourceIsBacking(n); n = n->backingStore) {
-        if (qemuDomainPrepareStorageSource(n, vm, disk, cfg) < 0)
-            return -1;
+    return 0;
+}
 
-        if (n->dataFileStore &&
-            qemuDomainPrepareStorageSource(n->dataFileStore, vm, disk, cfg) < 0)
+
+/**
+ * qemuDomainDetermineDiskChainFinish:
+ * @driver: qemu driver object
+ * @vm: domain object
+ * @disk: disk definition
+ * @disksrc: source to determine the chain for, may be NULL
+ * @probe: state filled by qemuDomainDetermineDiskChainProbe
+ *
+ * Second half of qemuDomainDetermineDiskChain which prepares the detected
+ * part of the backing chain for use with @vm. Unlike probing this modifies
+ * the private data of @vm (e.g. allocates node names) and thus must be called
+ * for one disk at a time.
+ */
+int
+qemuDomainDetermineDiskChainFinish(virQEMUDriver *driver,
+                                   virDomainObj *vm,
+                                   virDomainDiskDef *disk,
+                                   virStorageSource *disksrc,
+                                   qemuDomainDiskChainProbe *probe)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    virStorageSource *src = probe->src;
+    virStorageSource *n; /* iterator for the backing chain detected from disk */
+
+    if (!probe->validate)
+        return 0;
+
+    if (!disksrc)
+        disksrc = disk->src;
+
+    if (src) {
+        /* As we perform image properties detection on the last member of the
+         * backing chain we need to also consider the data store part of the
+         * current image */
+        if (src->dataFileStore && !probe->hadDataStore &&
+            qemuDomainPrepareStorageSource(src->dataFileStore, vm, disk, cfg) < 0)
             return -1;
+
+        for (n = src->backingStore; virStorageSourceIsBacking(n); n = n->backingStore) {
+            if (qemuDomainPrepareStorageSource(n, vm, disk, cfg) < 0)
+                return -1;
+
+            if (n->dataFileStore &&
+                qemuDomainPrepareStorageSource(n->dataFileStore, vm, disk, cfg) < 0)
+                return -1;
+        }
     }
 
     if (qemuDomainStorageSourceValidateDepth(disksrc, 0, disk->dst) < 0)
@@ -6524,6 +6587,32 @@ qemuDomainDetermineDiskChain(virQEMUDriver *driver,
 }
 
 
+/**
+ * qemuDomainDetermineDiskChain:
+ * @driver: qemu driver object
+ * @vm: domain object
+ * @disk: disk definition
+ * @disksrc: source to determine the chain for, may be NULL
+ *
+ * Prepares and initializes the backing chain of disk @disk. In cases where
+ * a new source is to be associated with @disk the @disksrc parameter can be
+ * used to override the source.
+ */
+int
+qemuDomainDetermineDiskChain(virQEMUDriver *driver,
+                             virDomainObj *vm,
+                             virDomainDiskDef *disk,
+                             virStorageSource *disksrc)
+{
+    qemuDomainDiskChainProbe probe;
+
+    if (qemuDomainDetermineDiskChainProbe(driver, vm, disk, disksrc, &probe) < 0)
+        return -1;
+
+    return qemuDomainDetermineDiskChainFinish(driver, vm, disk, disksrc, &probe);
+}
+
+
 /**
  * qemuDomainDiskGetTopNodename:
  *
@@ -10263,6 +10352,115 @@ qemuProcessEventFree(struct qemuProcessEvent *event)
 }
 
 
+static void
+qemuDomainEventQueueScheduleLocked(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    struct qemuProcessEvent *event;
+
+    if (virThreadPoolSendJob(priv->driver->workerPool, 0,
+                             virObjectRef(vm)) == 0) {
+        priv->eventsScheduled = true;
+        return;
+    }
+
+    /* The pool is shutting down, nobody is going to process the events.
+     * The caller holds a reference to @vm so dropping the ones held by the
+     * events can't free it. */
+    virObjectUnref(vm);
+    priv->eventsScheduled = false;
+
+    while ((event = g_queue_pop_head(priv->events))) {
+        virObjectUnref(event->vm);
+        qemuProcessEventFree(event);
+    }
+}
+
+
+/**
+ * qemuDomainEventQueuePush:
+ * @vm: domain object
+ * @event: event to be processed, the queue takes ownership
+ *
+ * Appends @event to the event queue of @vm and makes sure a job which
+ * processes the queue is scheduled on the driver's worker pool. Events of
+ * one domain are processed in the order they were pushed, while events of
+ * different domains are processed in parallel.
+ */
+void
+qemuDomainEventQueuePush(virDomainObj *vm,
+                         struct qemuProcessEvent *event)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&priv->eventsLock);
+
+    event->queued = g_get_monotonic_time();
+    g_queue_push_tail(priv->events, event);
+
+    if (!priv->eventsScheduled)
+        qemuDomainEventQueueScheduleLocked(vm);
+}
+
+
+/**
+ * qemuDomainEventQueuePop:
+ * @vm: domain object
+ *
+ * Removes the oldest event from the event queue of @vm and records the
+ * time it spent queued in the qemu.event.queue_wait histogram. To be
+ * called by the worker processing the queue.
+ *
+ * Returns the event or NULL if the queue is empty.
+ */
+struct qemuProcessEvent *
+qemuDomainEventQueuePop(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&priv->eventsLock);
+    struct qemuProcessEvent *event;
+    unsigned long long waited;
+
+    if (!(event = g_queue_pop_head(priv->events)))
+        return NULL;
+
+    waited = g_get_monotonic_time() - event->queued;
+
+    VIR_DEBUG("vm=%p, event=%d, waited=%lluus, pending=%u",
+              vm, event->eventType, waited,
+              g_queue_get_length(priv->events));
+
+    virMetricsHistogramAdd(virMetricsHistogramGet("qemu.event.queue_wait"),
+                           waited);
+
+    return event;
+}
+
+
+/**
+ * qemuDomainEventQueueFinish:
+ * @vm: domain object
+ *
+ * To be called by the worker once it processed an event of @vm. If more
+ * events are queued a new job is scheduled at the end of the worker pool
+ * queue so that a busy domain doesn't starve the others. Releases the
+ * reference to @vm held by the job.
+ */
+void
+qemuDomainEventQueueFinish(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&priv->eventsLock) {
+        if (g_queue_is_empty(priv->events))
+            priv->eventsScheduled = false;
+        else
+            qemuDomainEventQueueScheduleLocked(vm);
+    }
+
+    virObjectUnref(vm);
+}
+
+
 char *
 qemuDomainGetManagedPRSocketPath(qemuDomainObjPrivate *priv)
 {
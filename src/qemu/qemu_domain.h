@@ -41,6 +41,7 @@
 #include "virchrdev.h"
 #include "virobject.h"
 #include "virgdbus.h"
+#include "viridentity.h"
 #include "virdomainmomentobjlist.h"
 #include "virenum.h"
 #include "vireventthread.h"
@@ -103,6 +104,8 @@ struct _qemuDomainSecretInfo {
     char *ciphertext; /* encoded/encrypted secret */
 };
 
+typedef struct _qemuProcessReconnectData qemuProcessReconnectData;
+
 typedef struct _qemuDomainObjPrivate qemuDomainObjPrivate;
 struct _qemuDomainObjPrivate {
     virQEMUDriver *driver;
@@ -231,6 +234,12 @@ struct _qemuDomainObjPrivate {
     /* running block jobs */
     GHashTable *blockjobs;
 
+    /* block node data as returned by qemuBlockGetNamedNodeData and the
+     * monitor block generation it was queried at, see
+     * qemuBlockGetNamedNodeDataCached */
+    GHashTable *blockNamedNodeData;
+    unsigned int blockNamedNodeDataGeneration;
+
     bool disableSlirp;
 
     /* Until we add full support for backing chains for pflash drives, these
@@ -259,12 +268,38 @@ struct _qemuDomainObjPrivate {
     pid_t schedCoreChildPID;
     pid_t schedCoreChildFD;
 
+    /* Long lived helper process running inside the domain's mount
+     * namespace, see qemu_namespace.c. Don't save/parse into XML. */
+    pid_t namespaceHelperPID;
+    int namespaceHelperFD;
+
     GSList *threadContextAliases; /* List of IDs of thread-context objects */
 
     /* named file descriptor groups associated with the VM */
     GHashTable *fds;
 
     char *memoryBackingDir;
+
+    /* Time in milliseconds it took to prepare host side of disks during the
+     * last start, reported in the domain log. Don't save/parse into XML. */
+    unsigned long long prepareStorageTime;
+
+    /* Time spent in individual phases of the last start of the domain and
+     * the monotonic time (in microseconds) when the current phase started.
+     * Don't save/parse into XML. */
+    qemuDomainStartupStats startup;
+    unsigned long long startupPhaseStart;
+
+    /* Events waiting for processing by driver->workerPool. At most one
+     * worker handles events of a domain at a time so that they are
+     * processed in order. Protected by eventsLock. */
+    virMutex eventsLock;
+    GQueue *events;
+    bool eventsScheduled;
+
+    /* Non-NULL while the domain waits in driver->reconnectQueue after the
+     * daemon was restarted, owned by qemu_process.c. */
+    qemuProcessReconnectData *reconnect;
 };
 
 #define QEMU_DOMAIN_PRIVATE(vm) \
@@ -492,10 +527,16 @@ struct qemuProcessEvent {
     int action;
     int status;
     void *data;
+    unsigned long long queued; /* monotonic time in microseconds */
 };
 
 void qemuProcessEventFree(struct qemuProcessEvent *event);
 
+void qemuDomainEventQueuePush(virDomainObj *vm,
+                              struct qemuProcessEvent *event);
+struct qemuProcessEvent *qemuDomainEventQueuePop(virDomainObj *vm);
+void qemuDomainEventQueueFinish(virDomainObj *vm);
+
 typedef struct _qemuDomainSaveCookie qemuDomainSaveCookie;
 struct _qemuDomainSaveCookie {
     virObject parent;
@@ -584,6 +625,8 @@ struct _qemuDomainJobPrivate {
                                          * deleting snapshot */
     qemuMigrationParams *migParams;
     GSList *migTempBitmaps;  /* temporary block dirty bitmaps - qemuDomainJobPrivateMigrateTempBitmap */
+    virIdentity *migIdentity;  /* client which started a parallel tunnelled
+                                * incoming migration */
 };
 
 int qemuDomainObjStartWorker(virDomainObj *dom);
@@ -715,6 +758,24 @@ int qemuDomainDetermineDiskChain(virQEMUDriver *driver,
                                  virDomainDiskDef *disk,
                                  virStorageSource *disksrc);
 
+typedef struct _qemuDomainDiskChainProbe qemuDomainDiskChainProbe;
+struct _qemuDomainDiskChainProbe {
+    virStorageSource *src; /* image whose backing chain was detected */
+    bool hadDataStore;
+    bool validate; /* the chain supports backing images */
+};
+
+int qemuDomainDetermineDiskChainProbe(virQEMUDriver *driver,
+                                      virDomainObj *vm,
+                                      virDomainDiskDef *disk,
+                                      virStorageSource *disksrc,
+                                      qemuDomainDiskChainProbe *probe);
+int qemuDomainDetermineDiskChainFinish(virQEMUDriver *driver,
+                                       virDomainObj *vm,
+                                       virDomainDiskDef *disk,
+                                       virStorageSource *disksrc,
+                                       qemuDomainDiskChainProbe *probe);
+
 bool qemuDomainDiskChangeSupported(virDomainDiskDef *disk,
                                    virDomainDiskDef *orig_disk);
 
@@ -31,6 +31,24 @@
 
 VIR_LOG_INIT("qemu.qemu_domainjob");
 
+VIR_ENUM_IMPL(qemuDomainStartupPhase,
+              QEMU_DOMAIN_STARTUP_PHASE_LAST,
+              "capabilities",
+              "init",
+              "prepare_domain",
+              "prepare_host",
+              "launch",
+              "exec",
+              "namespace",
+              "cgroups",
+              "process_setup",
+              "security_labels",
+              "monitor",
+              "device_setup",
+              "load_state",
+              "finish",
+);
+
 void
 qemuDomainJobSetStatsType(virDomainJobData *jobData,
                           qemuDomainJobStatsType type)
@@ -236,6 +254,7 @@ qemuDomainJobDataToInfo(virDomainJobData *jobData,
         info->fileRemaining = info->fileTotal - info->fileProcessed;
         break;
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_STARTUP:
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         break;
     }
@@ -248,6 +267,31 @@ qemuDomainJobDataToInfo(virDomainJobData *jobData,
 }
 
 
+static int
+qemuDomainStartupStatsToParams(qemuDomainStartupStats *stats,
+                               virTypedParameterPtr *par,
+                               int *npar,
+                               int *maxpar)
+{
+    size_t i;
+
+    if (!stats->set)
+        return 0;
+
+    for (i = 0; i < QEMU_DOMAIN_STARTUP_PHASE_LAST; i++) {
+        g_autofree char *name = g_strdup_printf("%s%s",
+                                                VIR_DOMAIN_JOB_STARTUP_PHASE_PREFIX,
+                                                qemuDomainStartupPhaseTypeToString(i));
+
+        if (virTypedParamsAddULLong(par, npar, maxpar, name,
+                                    stats->phases[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 qemuDomainMigrationJobDataToParams(virDomainJobData *jobData,
                                    int *type,
@@ -280,6 +324,12 @@ qemuDomainMigrationJobDataToParams(virDomainJobData *jobData,
                                 jobData->timeElapsed - jobData->timeDelta) < 0)
         goto error;
 
+    if (priv->queuePosition &&
+        virTypedParamsAddUInt(&par, &npar, &maxpar,
+                              VIR_DOMAIN_JOB_QUEUE_POSITION,
+                              priv->queuePosition) < 0)
+        goto error;
+
     if (stats->downtime_set &&
         virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_DOWNTIME,
@@ -420,6 +470,9 @@ qemuDomainMigrationJobDataToParams(virDomainJobData *jobData,
                                 stats->vfio_data_transferred) < 0)
         goto error;
 
+    if (qemuDomainStartupStatsToParams(&priv->startup, &par, &npar, &maxpar) < 0)
+        goto error;
+
  done:
     *type = virDomainJobStatusToType(jobData->status);
     *params = par;
@@ -515,6 +568,41 @@ qemuDomainBackupJobDataToParams(virDomainJobData *jobData,
 }
 
 
+static int
+qemuDomainStartupJobDataToParams(virDomainJobData *jobData,
+                                 int *type,
+                                 virTypedParameterPtr *params,
+                                 int *nparams)
+{
+    qemuDomainJobDataPrivate *priv = jobData->privateData;
+    virTypedParameterPtr par = NULL;
+    int maxpar = 0;
+    int npar = 0;
+
+    if (virTypedParamsAddInt(&par, &npar, &maxpar,
+                             VIR_DOMAIN_JOB_OPERATION,
+                             jobData->operation) < 0)
+        goto error;
+
+    if (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_TIME_ELAPSED,
+                                jobData->timeElapsed) < 0)
+        goto error;
+
+    if (qemuDomainStartupStatsToParams(&priv->startup, &par, &npar, &maxpar) < 0)
+        goto error;
+
+    *type = virDomainJobStatusToType(jobData->status);
+    *params = par;
+    *nparams = npar;
+    return 0;
+
+ error:
+    virTypedParamsFree(par, npar);
+    return -1;
+}
+
+
 int
 qemuDomainJobDataToParams(virDomainJobData *jobData,
                           int *type,
@@ -534,6 +622,9 @@ qemuDomainJobDataToParams(virDomainJobData *jobData,
     case QEMU_DOMAIN_JOB_STATS_TYPE_BACKUP:
         return qemuDomainBackupJobDataToParams(jobData, type, params, nparams);
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_STARTUP:
+        return qemuDomainStartupJobDataToParams(jobData, type, params, nparams);
+
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("invalid job statistics type"));
@@ -617,6 +708,7 @@ qemuDomainObjSetAsyncJobMask(virDomainObj *obj,
         return;
 
     obj->job->mask = allowedJobs | JOB_MASK(VIR_JOB_DESTROY);
+    virDomainObjDispatchJob(obj);
 }
 
 void
@@ -626,6 +718,7 @@ qemuDomainObjDiscardAsyncJob(virDomainObj *obj)
         virDomainObjResetJob(obj->job);
     virDomainObjResetAsyncJob(obj->job);
     qemuDomainSaveStatus(obj);
+    virDomainObjDispatchJob(obj);
 }
 
 void
@@ -29,9 +29,39 @@ typedef enum {
     QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP,
     QEMU_DOMAIN_JOB_STATS_TYPE_MEMDUMP,
     QEMU_DOMAIN_JOB_STATS_TYPE_BACKUP,
+    QEMU_DOMAIN_JOB_STATS_TYPE_STARTUP,
 } qemuDomainJobStatsType;
 
 
+/* Phases of starting a domain in the order in which they happen */
+typedef enum {
+    QEMU_DOMAIN_STARTUP_PHASE_CAPABILITIES,
+    QEMU_DOMAIN_STARTUP_PHASE_INIT,
+    QEMU_DOMAIN_STARTUP_PHASE_PREPARE_DOMAIN,
+    QEMU_DOMAIN_STARTUP_PHASE_PREPARE_HOST,
+    QEMU_DOMAIN_STARTUP_PHASE_LAUNCH,
+    QEMU_DOMAIN_STARTUP_PHASE_EXEC,
+    QEMU_DOMAIN_STARTUP_PHASE_NAMESPACE,
+    QEMU_DOMAIN_STARTUP_PHASE_CGROUPS,
+    QEMU_DOMAIN_STARTUP_PHASE_PROCESS_SETUP,
+    QEMU_DOMAIN_STARTUP_PHASE_SECURITY_LABELS,
+    QEMU_DOMAIN_STARTUP_PHASE_MONITOR,
+    QEMU_DOMAIN_STARTUP_PHASE_DEVICE_SETUP,
+    QEMU_DOMAIN_STARTUP_PHASE_LOAD_STATE,
+    QEMU_DOMAIN_STARTUP_PHASE_FINISH,
+
+    QEMU_DOMAIN_STARTUP_PHASE_LAST
+} qemuDomainStartupPhase;
+
+VIR_ENUM_DECL(qemuDomainStartupPhase);
+
+typedef struct _qemuDomainStartupStats qemuDomainStartupStats;
+struct _qemuDomainStartupStats {
+    bool set;
+    unsigned long long phases[QEMU_DOMAIN_STARTUP_PHASE_LAST]; /* microseconds */
+};
+
+
 typedef struct _qemuDomainMirrorStats qemuDomainMirrorStats;
 struct _qemuDomainMirrorStats {
     unsigned long long transferred;
@@ -56,6 +86,10 @@ struct _qemuDomainJobDataPrivate {
         qemuDomainBackupStats backup;
     } stats;
     qemuDomainMirrorStats mirrorStats;
+    unsigned int queuePosition; /* position in the migration queue, 0 if not queued */
+    /* Reported by jobs which started the domain, including incoming
+     * migration which otherwise uses migration statistics */
+    qemuDomainStartupStats startup;
 };
 
 void qemuDomainJobSetStatsType(virDomainJobData *jobData,
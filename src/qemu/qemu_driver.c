@@ -104,6 +104,7 @@
 #include "virenum.h"
 #include "virdomaincheckpointobjlist.h"
 #include "virutil.h"
+#include "virmetrics.h"
 #include "backup_conf.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
@@ -535,6 +536,7 @@ qemuStateInitialize(bool privileged,
     uid_t run_uid = -1;
     gid_t run_gid = -1;
     size_t i;
+    size_t eventWorkers;
     const char *defsecmodel = NULL;
     g_autoptr(virIdentity) identity = virIdentityGetCurrent();
     virDomainDriverAutoStartConfig autostartCfg;
@@ -720,6 +722,18 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->hostdevMgr = virHostdevManagerGetDefault()))
         goto error;
 
+    if (!(qemu_driver->numaPlacement = virNumaPlacementNew()))
+        goto error;
+
+    if (!(qemu_driver->statsCursors = virDomainDriverStatsCursorsNew()))
+        goto error;
+
+    if ((cfg->migrationMaxOutgoing > 0 || cfg->migrationHostBandwidth > 0) &&
+        !(qemu_driver->migrationScheduler =
+          qemuMigrationSchedulerNew(cfg->migrationMaxOutgoing,
+                                    cfg->migrationHostBandwidth)))
+        goto error;
+
     if (qemuMigrationDstErrorInit(qemu_driver) < 0)
         goto error;
 
@@ -893,7 +907,16 @@ qemuStateInitialize(bool privileged,
     /* must be initialized before trying to reconnect to all the
      * running domains since there might occur some QEMU monitor
      * events that will be dispatched to the worker pool */
-    qemu_driver->workerPool = virThreadPoolNewFull(0, 1, 0, qemuProcessEventHandler,
+    if ((eventWorkers = cfg->maxEventWorkers) == 0) {
+        int ncpus = virHostCPUGetCount();
+
+        if (ncpus < 0)
+            virResetLastError();
+        eventWorkers = MAX(ncpus, 1);
+    }
+
+    qemu_driver->workerPool = virThreadPoolNewFull(0, eventWorkers, 0,
+                                                   qemuProcessEventHandler,
                                                    "qemu-event",
                                                    identity,
                                                    qemu_driver);
@@ -902,6 +925,20 @@ qemuStateInitialize(bool privileged,
 
     qemuProcessReconnectAll(qemu_driver);
 
+    if (cfg->statsExportInterval > 0) {
+        g_autofree char *statsPath = g_strdup_printf("%s/domstats", cfg->stateDir);
+
+        if (!(qemu_driver->statsExport = virStatsExportNew(statsPath,
+                                                           cfg->statsExportGroup)))
+            goto error;
+
+        if (virStatsExportStart(qemu_driver->statsExport,
+                                cfg->statsExportInterval,
+                                qemuDomainStatsExportCollect,
+                                qemu_driver) < 0)
+            goto error;
+    }
+
     autostartCfg = (virDomainDriverAutoStartConfig) {
         .stateDir = cfg->stateDir,
         .callback = qemuAutostartDomain,
@@ -978,6 +1015,7 @@ static int
 qemuStateShutdownPrepare(void)
 {
     virThreadPoolStop(qemu_driver->workerPool);
+    g_atomic_int_set(&qemu_driver->reconnectStop, 1);
     return 0;
 }
 
@@ -996,6 +1034,7 @@ qemuDomainObjStopWorkerIter(virDomainObj *vm,
 static int
 qemuStateShutdownWait(void)
 {
+    qemuProcessReconnectCancel(qemu_driver);
     virDomainObjListForEach(qemu_driver->domains, false,
                             qemuDomainObjStopWorkerIter, NULL);
     virThreadPoolDrain(qemu_driver->workerPool);
@@ -1014,6 +1053,8 @@ qemuStateCleanup(void)
     if (!qemu_driver)
         return -1;
 
+    virStatsExportFree(qemu_driver->statsExport);
+    qemuProcessReconnectCancel(qemu_driver);
     virThreadPoolFree(qemu_driver->workerPool);
     virObjectUnref(qemu_driver->migrationErrors);
     virLockManagerPluginUnref(qemu_driver->lockManager);
@@ -1023,6 +1064,9 @@ qemuStateCleanup(void)
     virPortAllocatorRangeFree(qemu_driver->rdpPorts);
     virPortAllocatorRangeFree(qemu_driver->remotePorts);
     virObjectUnref(qemu_driver->hostdevMgr);
+    virNumaPlacementFree(qemu_driver->numaPlacement);
+    virDomainDriverStatsCursorsFree(qemu_driver->statsCursors);
+    qemuMigrationSchedulerFree(qemu_driver->migrationScheduler);
     virObjectUnref(qemu_driver->securityManager);
     virObjectUnref(qemu_driver->domainEventState);
     virObjectUnref(qemu_driver->qemuCapsCache);
@@ -1109,6 +1153,7 @@ static int qemuConnectClose(virConnectPtr conn)
     virQEMUDriver *driver = conn->privateData;
 
     virCloseCallbacksDomainRunForConn(driver->domains, conn);
+    virDomainDriverStatsCursorsRemove(driver->statsCursors, conn);
     conn->privateData = NULL;
 
     return 0;
@@ -1130,6 +1175,8 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
     case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
@@ -1144,6 +1191,7 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_MIGRATE_CHANGE_PROTECTION:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     case VIR_DRV_FEATURE_MIGRATION_OFFLINE:
+    case VIR_DRV_FEATURE_MIGRATION_TUNNEL_CHANNELS:
     case VIR_DRV_FEATURE_MIGRATION_PARAMS:
         return 1;
     case VIR_DRV_FEATURE_MIGRATION_DIRECT:
@@ -4063,11 +4111,19 @@ processShutdownCompletedEvent(virDomainObj *vm)
 
 static void qemuProcessEventHandler(void *data, void *opaque)
 {
-    struct qemuProcessEvent *processEvent = data;
-    virDomainObj *vm = processEvent->vm;
+    virDomainObj *obj = data;
+    struct qemuProcessEvent *processEvent;
+    virDomainObj *vm;
     virQEMUDriver *driver = opaque;
+    unsigned long long started;
+
+    if (!(processEvent = qemuDomainEventQueuePop(obj))) {
+        qemuDomainEventQueueFinish(obj);
+        return;
+    }
 
-    VIR_DEBUG("vm=%p, event=%d", vm, processEvent->eventType);
+    vm = processEvent->vm;
+    started = g_get_monotonic_time();
 
     virObjectLock(vm);
 
@@ -4133,6 +4189,11 @@ static void qemuProcessEventHandler(void *data, void *opaque)
 
     virDomainObjEndAPI(&vm);
     qemuProcessEventFree(processEvent);
+
+    virMetricsHistogramAdd(virMetricsHistogramGet("qemu.event.exec"),
+                           g_get_monotonic_time() - started);
+
+    qemuDomainEventQueueFinish(obj);
 }
 
 
@@ -11523,6 +11584,31 @@ qemuDomainMigrateConfirm3(virDomainPtr domain,
                                    flags, cancelled);
 }
 
+
+static int
+qemuDomainMigrateAddTunnelChannel(virDomainPtr domain,
+                                  virStreamPtr st,
+                                  unsigned int flags)
+{
+    virDomainObj *vm;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomainObjFromDomain(domain)))
+        return -1;
+
+    if (virDomainMigrateAddTunnelChannelEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = qemuMigrationDstAddTunnelChannel(vm, st);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
 static int
 qemuDomainMigrateConfirm3Params(virDomainPtr domain,
                                 virTypedParameterPtr params,
@@ -12058,9 +12144,17 @@ qemuDomainGetJobInfoMigrationStats(virDomainObj *vm,
                                    virDomainJobData *jobData)
 {
     qemuDomainJobDataPrivate *privStats = jobData->privateData;
+    qemuDomainObjPrivate *priv = vm->privateData;
 
     switch (jobData->status) {
     case VIR_DOMAIN_JOB_STATUS_ACTIVE:
+        if (priv->driver->migrationScheduler &&
+            jobData->operation == VIR_DOMAIN_JOB_OPERATION_MIGRATION_OUT) {
+            privStats->queuePosition =
+                qemuMigrationSchedulerGetPosition(priv->driver->migrationScheduler,
+                                                  vm);
+        }
+
         if (privStats->statsType == QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION &&
             qemuMigrationSrcFetchMirrorStats(vm, VIR_ASYNC_JOB_NONE,
                                              jobData) < 0)
@@ -12195,6 +12289,7 @@ qemuDomainGetJobStatsInternal(virDomainObj *vm,
             goto cleanup;
         break;
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_STARTUP:
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         break;
     }
@@ -16746,6 +16841,10 @@ qemuDomainGetStatsState(virQEMUDriver *driver G_GNUC_UNUSED,
                             VIR_DOMAIN_STATS_STATE_STATE);
     virTypedParamListAddInt(params, dom->state.reason,
                             VIR_DOMAIN_STATS_STATE_REASON);
+    virTypedParamListAddULLong(params, dom->job->jobsWaiting,
+                               VIR_DOMAIN_STATS_STATE_JOB_QUEUE_LENGTH);
+    virTypedParamListAddULLong(params, dom->job->agentJobsWaiting,
+                               VIR_DOMAIN_STATS_STATE_JOB_QUEUE_AGENT_LENGTH);
 }
 
 
@@ -17156,6 +17255,22 @@ qemuDomainGetStatsCpu(virQEMUDriver *driver,
 }
 
 
+static void
+qemuDomainGetStatsMemoryPlacement(virDomainObj *dom,
+                                  virTypedParamList *params)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+    g_autofree char *nodeset = NULL;
+
+    if (!virDomainObjIsActive(dom) || !priv->autoNodeset)
+        return;
+
+    nodeset = virBitmapFormat(priv->autoNodeset);
+    virTypedParamListAddString(params, nodeset,
+                               VIR_DOMAIN_STATS_MEMORY_PLACEMENT_NODESET);
+}
+
+
 static void
 qemuDomainGetStatsMemory(virQEMUDriver *driver,
                          virDomainObj *dom,
@@ -17164,6 +17279,7 @@ qemuDomainGetStatsMemory(virQEMUDriver *driver,
 
 {
     qemuDomainGetStatsMemoryBandwidth(driver, dom, params);
+    qemuDomainGetStatsMemoryPlacement(dom, params);
 }
 
 
@@ -18032,6 +18148,62 @@ qemuDomainGetStatsNeedMonitor(unsigned int stats)
 }
 
 
+static virTypedParamList *
+qemuDomainGetStatsParams(virQEMUDriver *driver,
+                         virDomainObj *dom,
+                         unsigned int stats,
+                         unsigned int flags)
+{
+    virTypedParamList *params = virTypedParamListNew();
+    qemuDomainObjPrivate *priv = dom->privateData;
+    unsigned int prefetch = 0;
+    size_t i;
+
+    /* Send the queries done by the workers below to QEMU at once rather
+     * than waiting for each reply before issuing the next one. */
+    if (HAVE_JOB(flags) && virDomainObjIsActive(dom)) {
+        if (stats & VIR_DOMAIN_STATS_BLOCK)
+            prefetch |= QEMU_MONITOR_PREFETCH_BLOCKSTATS;
+        if (stats & VIR_DOMAIN_STATS_IOTHREAD)
+            prefetch |= QEMU_MONITOR_PREFETCH_IOTHREADS;
+        if (stats & VIR_DOMAIN_STATS_VCPU) {
+            /* see qemuDomainRefreshVcpuHalted */
+            if (dom->def->virtType != VIR_DOMAIN_VIRT_QEMU &&
+                ARCH_IS_S390(dom->def->os.arch))
+                prefetch |= QEMU_MONITOR_PREFETCH_CPUS;
+            if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_STATS_SCHEMAS))
+                prefetch |= QEMU_MONITOR_PREFETCH_VCPU_STATS;
+        }
+    }
+
+    if (prefetch) {
+        int rc;
+
+        qemuDomainObjEnterMonitor(dom);
+        rc = qemuMonitorPrefetch(priv->mon, prefetch);
+        qemuDomainObjExitMonitor(dom);
+
+        /* the workers will simply ask again */
+        if (rc < 0)
+            virResetLastError();
+    }
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        if (stats & qemuDomainGetStatsWorkers[i].stats) {
+            qemuDomainGetStatsWorkers[i].func(driver, dom, params, flags);
+        }
+    }
+
+    if (prefetch) {
+        qemuDomainObjEnterMonitor(dom);
+        qemuMonitorPrefetchClear(priv->mon);
+        qemuDomainObjExitMonitor(dom);
+    }
+
+    return params;
+}
+
+
 static int
 qemuDomainGetStats(virConnectPtr conn,
                    virDomainObj *dom,
@@ -18041,15 +18213,8 @@ qemuDomainGetStats(virConnectPtr conn,
 {
     g_autofree virDomainStatsRecordPtr tmp = NULL;
     g_autoptr(virTypedParamList) params = NULL;
-    size_t i;
-
-    params = virTypedParamListNew();
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
-        if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params, flags);
-        }
-    }
+    params = qemuDomainGetStatsParams(conn->privateData, dom, stats, flags);
 
     tmp = g_new0(virDomainStatsRecord, 1);
 
@@ -18090,6 +18255,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_DELTA |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
 
@@ -18156,6 +18322,10 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
         tmpstats[nstats++] = tmp;
     }
 
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_DELTA)
+        virDomainDriverStatsCursorsFilter(driver->statsCursors, conn,
+                                          tmpstats, nstats, ndoms == 0);
+
     *retStats = g_steal_pointer(&tmpstats);
 
     ret = nstats;
@@ -18170,6 +18340,80 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 }
 
 
+/**
+ * qemuDomainStatsExportCollect:
+ *
+ * Gathers all supported statistics of running domains for the
+ * shared memory export. Domains which are busy with another job are
+ * not waited for and report only the data available without the
+ * monitor.
+ */
+static int
+qemuDomainStatsExportCollect(virStatsExportRecord **records,
+                             size_t *nrecords,
+                             void *opaque)
+{
+    virQEMUDriver *driver = opaque;
+    virDomainObj **vms = NULL;
+    size_t nvms;
+    virStatsExportRecord *tmprecords = NULL;
+    size_t ntmprecords = 0;
+    size_t i;
+    int ret = -1;
+
+    virDomainObjListCollect(driver->domains, NULL, &vms, &nvms, NULL,
+                            VIR_CONNECT_LIST_DOMAINS_ACTIVE);
+
+    tmprecords = g_new0(virStatsExportRecord, nvms);
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObj *vm = vms[i];
+        virStatsExportRecord *record = tmprecords + ntmprecords;
+        g_autoptr(virTypedParamList) params = NULL;
+        unsigned int stats = 0;
+        unsigned int domflags = 0;
+
+        virObjectLock(vm);
+
+        if (!virDomainObjIsActive(vm)) {
+            virObjectUnlock(vm);
+            continue;
+        }
+
+        ignore_value(qemuDomainGetStatsCheckSupport(&stats, false, vm));
+
+        if (qemuDomainGetStatsNeedMonitor(stats)) {
+            if (virDomainObjBeginJobNowait(vm, VIR_JOB_QUERY) == 0)
+                domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+            else
+                virResetLastError();
+        }
+
+        params = qemuDomainGetStatsParams(driver, vm, stats, domflags);
+
+        if (HAVE_JOB(domflags))
+            virDomainObjEndJob(vm);
+
+        record->name = g_strdup(vm->def->name);
+        ntmprecords++;
+
+        virObjectUnlock(vm);
+
+        if (virTypedParamListSteal(params, &record->params, &record->nparams) < 0)
+            goto cleanup;
+    }
+
+    *records = g_steal_pointer(&tmprecords);
+    *nrecords = ntmprecords;
+    ret = 0;
+
+ cleanup:
+    virStatsExportRecordsFree(tmprecords, ntmprecords);
+    virObjectListFreeCount(vms, nvms);
+    return ret;
+}
+
+
 static int
 qemuNodeAllocPages(virConnectPtr conn,
                    unsigned int npages,
@@ -20636,6 +20880,7 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .domainSetAutostartOnce = qemuDomainSetAutostartOnce, /* 11.2.0 */
     .domainSetThrottleGroup = qemuDomainSetThrottleGroup, /* 11.2.0 */
     .domainDelThrottleGroup = qemuDomainDelThrottleGroup, /* 11.2.0 */
+    .domainMigrateAddTunnelChannel = qemuDomainMigrateAddTunnelChannel, /* 11.9.0 */
 };
 
 
@@ -26,6 +26,8 @@
 #include <poll.h>
 
 #include "qemu_migration.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu_migrationpriv.h"
 #include "qemu_migration_cookie.h"
 #include "qemu_migration_params.h"
 #include "qemu_monitor.h"
@@ -2204,6 +2206,179 @@ qemuMigrationAnyCompleted(virDomainObj *vm,
 }
 
 
+/* How often the bandwidth of running migrations is rebalanced (ms) */
+#define QEMU_MIGRATION_SCHEDULER_INTERVAL 1000
+
+/**
+ * qemuMigrationSrcScheduleDirtyRate:
+ * @vm: domain object
+ * @dirtyRate: filled in with the dirty rate in MiB/s
+ *
+ * Gets the dirty rate of @vm measured by the last dirty rate calculation
+ * (see virDomainStartDirtyRateCalc). The rate is 0 when unknown.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuMigrationSrcScheduleDirtyRate(virDomainObj *vm,
+                                  unsigned long long *dirtyRate)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuMonitorDirtyRateInfo info = { 0 };
+    int rc;
+
+    *dirtyRate = 0;
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_DIRTY_RATE))
+        return 0;
+
+    if (qemuDomainObjEnterMonitorAsync(vm, VIR_ASYNC_JOB_MIGRATION_OUT) < 0)
+        return -1;
+
+    rc = qemuMonitorQueryDirtyRate(priv->mon, &info);
+
+    qemuDomainObjExitMonitor(vm);
+
+    if (rc < 0) {
+        /* not fatal, the migration is just queued as if the rate was 0 */
+        virResetLastError();
+        return 0;
+    }
+
+    if (info.status == VIR_DOMAIN_DIRTYRATE_MEASURED && info.dirtyRate > 0)
+        *dirtyRate = info.dirtyRate;
+
+    g_free(info.rates);
+    return 0;
+}
+
+
+/**
+ * qemuMigrationSrcSchedule:
+ * @vm: domain object
+ * @dconn: connection to the destination (may be NULL)
+ *
+ * Registers the outgoing migration of @vm with the migration scheduler and
+ * waits until it is allowed to start. The domain object is unlocked while
+ * waiting so that the queue position can be queried using job info APIs
+ * and the job can be aborted. Once admitted, the bandwidth the migration
+ * should use is stored in priv->migMaxBandwidth.
+ *
+ * Returns 0 on success, -1 on error (the migration is no longer registered
+ * with the scheduler in this case).
+ */
+static int
+qemuMigrationSrcSchedule(virDomainObj *vm,
+                         virConnectPtr dconn)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuMigrationScheduler *sched = priv->driver->migrationScheduler;
+    unsigned long long dirtyRate;
+    unsigned long long bandwidth;
+
+    if (!sched)
+        return 0;
+
+    if (qemuMigrationSrcScheduleDirtyRate(vm, &dirtyRate) < 0)
+        return -1;
+
+    if (!qemuMigrationSchedulerEnqueue(sched, vm, dirtyRate,
+                                       priv->migMaxBandwidth)) {
+        VIR_DEBUG("Outgoing migration of domain %s queued (dirty rate %llu MiB/s)",
+                  vm->def->name, dirtyRate);
+
+        while (!qemuMigrationSchedulerIsActive(sched, vm)) {
+            unsigned long long now;
+
+            if (vm->job->abortJob) {
+                vm->job->current->status = VIR_DOMAIN_JOB_STATUS_CANCELED;
+                virReportError(VIR_ERR_OPERATION_ABORTED, _("%1$s: %2$s"),
+                               virDomainAsyncJobTypeToString(vm->job->asyncJob),
+                               _("canceled by client"));
+                goto error;
+            }
+
+            if (dconn && virConnectIsAlive(dconn) <= 0) {
+                virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                               _("Lost connection to destination host"));
+                goto error;
+            }
+
+            /* The scheduler signals the domain condition without holding
+             * the domain lock, a wake up may thus be missed and we need to
+             * check the state periodically. */
+            if (virTimeMillisNow(&now) < 0 ||
+                virDomainObjWaitUntil(vm, now + QEMU_MIGRATION_SCHEDULER_INTERVAL) < 0)
+                goto error;
+
+            if (priv->beingDestroyed) {
+                virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                               _("domain is not running"));
+                goto error;
+            }
+        }
+
+        VIR_DEBUG("Outgoing migration of domain %s admitted", vm->def->name);
+    }
+
+    bandwidth = qemuMigrationSchedulerGetBandwidth(sched, vm, dirtyRate);
+    if (bandwidth > 0)
+        priv->migMaxBandwidth = bandwidth;
+
+    return 0;
+
+ error:
+    qemuMigrationSchedulerRemove(sched, vm);
+    return -1;
+}
+
+
+/**
+ * qemuMigrationSrcScheduleRebalance:
+ * @vm: domain object
+ *
+ * Updates the maximum bandwidth of the running outgoing migration of @vm to
+ * its current share of the host bandwidth budget based on the dirty rate
+ * reported by QEMU. Failures are not fatal.
+ */
+static void
+qemuMigrationSrcScheduleRebalance(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    virDomainJobData *jobData = vm->job->current;
+    qemuDomainJobDataPrivate *privJob = jobData->privateData;
+    qemuMonitorMigrationStats *stats = &privJob->stats.mig;
+    unsigned long long dirtyRate;
+    unsigned long long bandwidth;
+
+    if (qemuMigrationAnyFetchStats(vm, VIR_ASYNC_JOB_MIGRATION_OUT,
+                                   jobData, NULL) < 0)
+        goto error;
+
+    dirtyRate = stats->ram_dirty_rate * stats->ram_page_size / (1024 * 1024);
+
+    bandwidth = qemuMigrationSchedulerGetBandwidth(priv->driver->migrationScheduler,
+                                                   vm, dirtyRate);
+    if (bandwidth == 0 || bandwidth == priv->migMaxBandwidth)
+        return;
+
+    VIR_DEBUG("Changing migration bandwidth of domain %s from %lu to %llu MiB/s",
+              vm->def->name, priv->migMaxBandwidth, bandwidth);
+
+    if (qemuMigrationParamsSetMaxBandwidth(vm, VIR_ASYNC_JOB_MIGRATION_OUT,
+                                           bandwidth) < 0)
+        goto error;
+
+    priv->migMaxBandwidth = bandwidth;
+    return;
+
+ error:
+    VIR_WARN("Failed to update migration bandwidth of domain %s: %s",
+             vm->def->name, virGetLastErrorMessage());
+    virResetLastError();
+}
+
+
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
@@ -2213,16 +2388,48 @@ qemuMigrationSrcWaitForCompletion(virDomainObj *vm,
                                   virConnectPtr dconn,
                                   unsigned int flags)
 {
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(priv->driver);
     virDomainJobData *jobData = vm->job->current;
+    unsigned long long rebalance = 0; /* time of the next bandwidth update */
     int rv;
 
     jobData->status = VIR_DOMAIN_JOB_STATUS_MIGRATING;
 
+    /* With a host bandwidth budget the share of this migration is updated
+     * periodically rather than only when QEMU sends an event. */
+    if (asyncJob == VIR_ASYNC_JOB_MIGRATION_OUT &&
+        cfg->migrationHostBandwidth > 0 &&
+        priv->driver->migrationScheduler &&
+        qemuMigrationSchedulerIsActive(priv->driver->migrationScheduler, vm))
+        rebalance = 1;
+
     while ((rv = qemuMigrationAnyCompleted(vm, asyncJob, dconn, flags)) != 1) {
         if (rv < 0)
             return rv;
 
-        if (qemuDomainObjWait(vm) < 0) {
+        if (rebalance) {
+            unsigned long long now;
+
+            if (virTimeMillisNow(&now) < 0)
+                return -2;
+
+            if (now >= rebalance) {
+                qemuMigrationSrcScheduleRebalance(vm);
+                rebalance = now + QEMU_MIGRATION_SCHEDULER_INTERVAL;
+            }
+
+            rv = virDomainObjWaitUntil(vm, rebalance);
+            if (rv >= 0 && priv->beingDestroyed) {
+                virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                               _("domain is not running"));
+                rv = -1;
+            }
+        } else {
+            rv = qemuDomainObjWait(vm);
+        }
+
+        if (rv < 0) {
             if (qemuDomainObjIsActive(vm))
                 jobData->status = VIR_DOMAIN_JOB_STATUS_FAILED;
             return -2;
@@ -2597,7 +2804,7 @@ qemuMigrationSrcBeginPhaseBlockDirtyBitmaps(qemuMigrationCookie *mig,
 
     g_autoptr(GHashTable) blockNamedNodeData = NULL;
 
-    if (!(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, vm->job->asyncJob)))
+    if (!(blockNamedNodeData = qemuBlockGetNamedNodeDataCached(vm, vm->job->asyncJob)))
         return -1;
 
     for (i = 0; i < vm->def->ndisks; i++) {
@@ -3097,6 +3304,16 @@ qemuMigrationSrcBegin(virConnectPtr conn,
 }
 
 
+/* Socket used by QEMU for tunnelled migration with multiple channels. */
+static char *
+qemuMigrationTunnelSocketPath(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    return g_strdup_printf("%s/migrate-tunnel.sock", priv->libDir);
+}
+
+
 /* Prepare is the first step, and it runs on the destination host.
  */
 
@@ -3297,6 +3514,7 @@ qemuMigrationDstPrepareActive(virQEMUDriver *driver,
     unsigned int startFlags;
     bool relabel = false;
     bool tunnel = !!st;
+    g_autofree char *tunnelPath = NULL;
     int ret = -1;
     int rv;
 
@@ -3311,6 +3529,17 @@ qemuMigrationDstPrepareActive(virQEMUDriver *driver,
                                        !!(flags & VIR_MIGRATE_NON_SHARED_INC)) < 0)
         goto error;
 
+    /* Multiple channels need QEMU to listen on a socket, each stream
+     * will be connected to it. */
+    if (tunnel && flags & VIR_MIGRATE_PARALLEL) {
+        tunnelPath = qemuMigrationTunnelSocketPath(vm);
+        tunnel = false;
+
+        /* Only the client starting the migration may add channels to it */
+        g_clear_object(&jobPriv->migIdentity);
+        jobPriv->migIdentity = virIdentityGetCurrent();
+    }
+
     if (tunnel &&
         virPipe(dataFD) < 0)
         goto error;
@@ -3322,6 +3551,11 @@ qemuMigrationDstPrepareActive(virQEMUDriver *driver,
         goto error;
     stopProcess = true;
 
+    if (tunnelPath) {
+        protocol = "unix";
+        listenAddress = tunnelPath;
+    }
+
     if (!(incoming = qemuMigrationDstPrepare(driver, vm, tunnel, protocol,
                                              listenAddress, port,
                                              &dataFD[0])))
@@ -3346,6 +3580,8 @@ qemuMigrationDstPrepareActive(virQEMUDriver *driver,
     }
     relabel = true;
 
+    qemuProcessStartupRecord(vm);
+
     if (tunnel) {
         if (virFDStreamOpen(st, dataFD[1]) < 0) {
             virReportSystemError(errno, "%s",
@@ -3420,6 +3656,12 @@ qemuMigrationDstPrepareActive(virQEMUDriver *driver,
                             migParams, flags) < 0)
         goto error;
 
+    /* The first channel of a multi-channel tunnel, the others are added
+     * by qemuMigrationDstAddTunnelChannel. */
+    if (tunnelPath &&
+        virFDStreamConnectUNIX(st, tunnelPath, false) < 0)
+        goto error;
+
     if (qemuProcessFinishStartup(driver, vm, VIR_ASYNC_JOB_MIGRATION_IN,
                                  false, VIR_DOMAIN_PAUSED_MIGRATION) < 0)
         goto error;
@@ -3849,6 +4091,88 @@ qemuMigrationDstPrepareTunnel(virQEMUDriver *driver,
 }
 
 
+/*
+ * Checks whether @a and @b belong to the same client. The process ID
+ * is ignored since each channel may be opened by a separate process,
+ * e.g., a netcat started over SSH.
+ */
+static bool
+qemuMigrationDstIdentityMatches(virIdentity *a,
+                                virIdentity *b)
+{
+    const char *astr;
+    const char *bstr;
+    uid_t auid;
+    uid_t buid;
+    int arc;
+    int brc;
+
+    if (!a || !b)
+        return a == b;
+
+    if ((arc = virIdentityGetUNIXUserID(a, &auid)) < 0 ||
+        (brc = virIdentityGetUNIXUserID(b, &buid)) < 0 ||
+        arc != brc || (arc == 1 && auid != buid))
+        return false;
+
+    astr = bstr = NULL;
+    if (virIdentityGetSASLUserName(a, &astr) < 0 ||
+        virIdentityGetSASLUserName(b, &bstr) < 0 ||
+        STRNEQ_NULLABLE(astr, bstr))
+        return false;
+
+    astr = bstr = NULL;
+    if (virIdentityGetX509DName(a, &astr) < 0 ||
+        virIdentityGetX509DName(b, &bstr) < 0 ||
+        STRNEQ_NULLABLE(astr, bstr))
+        return false;
+
+    return true;
+}
+
+
+/*
+ * Connects @st to the incoming migration of @vm as another channel of
+ * a tunnelled migration with VIR_MIGRATE_PARALLEL. The channel has to be
+ * added by the same client which started the migration.
+ */
+int
+qemuMigrationDstAddTunnelChannel(virDomainObj *vm,
+                                 virStreamPtr st)
+{
+    qemuDomainJobPrivate *jobPriv;
+    g_autoptr(virIdentity) ident = NULL;
+    g_autofree char *path = NULL;
+
+    VIR_DEBUG("vm=%s, st=%p", vm->def->name, st);
+
+    if (!qemuMigrationJobIsActive(vm, VIR_ASYNC_JOB_MIGRATION_IN))
+        return -1;
+
+    if ((vm->job->apiFlags & (VIR_MIGRATE_TUNNELLED | VIR_MIGRATE_PARALLEL)) !=
+        (VIR_MIGRATE_TUNNELLED | VIR_MIGRATE_PARALLEL)) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("domain '%1$s' is not processing parallel tunnelled migration"),
+                       vm->def->name);
+        return -1;
+    }
+
+    jobPriv = vm->job->privateData;
+    ident = virIdentityGetCurrent();
+
+    if (!qemuMigrationDstIdentityMatches(jobPriv->migIdentity, ident)) {
+        virReportError(VIR_ERR_OPERATION_DENIED,
+                       _("incoming migration of domain '%1$s' was started by another client"),
+                       vm->def->name);
+        return -1;
+    }
+
+    path = qemuMigrationTunnelSocketPath(vm);
+
+    return virFDStreamConnectUNIX(st, path, false);
+}
+
+
 static virURI *
 qemuMigrationAnyParseURI(const char *uri, bool *wellFormed)
 {
@@ -4311,8 +4635,14 @@ struct _qemuMigrationSpec {
     } dest;
 
     enum qemuMigrationForwardType fwdType;
-    union {
+    struct {
         virStreamPtr stream;
+        /* Tunnelled migration with multiple channels: QEMU connects to
+         * @sock once for every channel. The first connection is forwarded
+         * through @stream, each of the other ones through a new stream
+         * on a new connection to @dconnuri. */
+        virNetSocket *sock;
+        const char *dconnuri;
     } fwd;
 };
 
@@ -4502,6 +4832,270 @@ qemuMigrationSrcStopTunnel(qemuMigrationIOThread *io, bool error)
     return rv;
 }
 
+
+struct _qemuMigrationTunnelChannels {
+    virThread thread;
+    virNetSocket *sock;
+    virStreamPtr st;
+    char *dconnuri;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int keepAliveInterval;
+    unsigned int keepAliveCount;
+    /* connections and streams opened for all channels but the first one */
+    virConnectPtr *conns;
+    size_t nconns;
+    virStreamPtr *streams;
+    size_t nstreams;
+    qemuMigrationIOThread **io;
+    size_t nio;
+    virError err;
+    int wakeupRecvFD;
+    int wakeupSendFD;
+};
+
+
+/*
+ * Opens a new connection to the destination and a stream attached to the
+ * incoming migration there as another channel. Every channel uses its own
+ * connection so that channels don't share the lock and the TLS session of
+ * a single client connection on the source. The destination daemon handles
+ * I/O of all its clients in its event loop though, so the channels don't
+ * increase the throughput of the tunnel.
+ */
+static virStreamPtr
+qemuMigrationSrcTunnelChannelOpen(qemuMigrationTunnelChannels *data)
+{
+    virConnectPtr conn;
+    virDomainPtr ddomain;
+    virStreamPtr st;
+    int rc;
+
+    if (!(conn = virConnectOpenAuth(data->dconnuri, &virConnectAuthConfig, 0)))
+        return NULL;
+    VIR_APPEND_ELEMENT(data->conns, data->nconns, conn);
+
+    if (!conn->driver->domainMigrateAddTunnelChannel) {
+        virReportUnsupportedError();
+        return NULL;
+    }
+
+    if (virConnectSetKeepAlive(conn, data->keepAliveInterval,
+                               data->keepAliveCount) < 0)
+        return NULL;
+
+    if (!(ddomain = conn->driver->domainLookupByUUID(conn, data->uuid)))
+        return NULL;
+
+    if (!(st = virStreamNew(conn, 0))) {
+        virObjectUnref(ddomain);
+        return NULL;
+    }
+    VIR_APPEND_ELEMENT_COPY(data->streams, data->nstreams, st);
+
+    rc = conn->driver->domainMigrateAddTunnelChannel(ddomain, st, 0);
+    virObjectUnref(ddomain);
+
+    if (rc < 0)
+        return NULL;
+
+    return st;
+}
+
+
+/*
+ * Accepts connections from QEMU until asked to stop and starts a tunnel
+ * for each of them. The order in which QEMU opens its channels doesn't
+ * matter as the destination QEMU recognizes them by their content.
+ *
+ * On failure the listening socket is closed so that QEMU fails to open
+ * the remaining channels and the migration fails rather than waits for
+ * channels which would never be accepted.
+ */
+static void
+qemuMigrationSrcTunnelChannelsFunc(void *arg)
+{
+    qemuMigrationTunnelChannels *data = arg;
+    struct pollfd fds[2];
+
+    fds[0].fd = virNetSocketGetFD(data->sock);
+    fds[1].fd = data->wakeupRecvFD;
+
+    for (;;) {
+        g_autoptr(virNetSocket) client = NULL;
+        qemuMigrationIOThread *io;
+        virStreamPtr st = data->st;
+        int fd;
+
+        fds[0].events = fds[1].events = POLLIN;
+        fds[0].revents = fds[1].revents = 0;
+
+        if (poll(fds, G_N_ELEMENTS(fds), -1) < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            virReportSystemError(errno, "%s",
+                                 _("poll failed in migration tunnel"));
+            goto error;
+        }
+
+        if (fds[1].revents) {
+            VIR_DEBUG("Migration tunnel stopped accepting channels");
+            return;
+        }
+
+        if (virNetSocketAccept(data->sock, &client) < 0)
+            goto error;
+
+        if (!client)
+            continue;
+
+        if (data->nio > 0 &&
+            !(st = qemuMigrationSrcTunnelChannelOpen(data)))
+            goto error;
+
+        if ((fd = virNetSocketDupFD(client, true)) < 0 ||
+            !(io = qemuMigrationSrcStartTunnel(st, fd))) {
+            virErrorPtr err;
+
+            VIR_FORCE_CLOSE(fd);
+
+            /* The destination would wait for data on the stream we just
+             * added, the first stream is aborted by the migration code. */
+            if (st != data->st) {
+                virErrorPreserveLast(&err);
+                virStreamAbort(st);
+                virErrorRestore(&err);
+            }
+            goto error;
+        }
+
+        VIR_DEBUG("Started migration tunnel channel %zu", data->nio);
+        VIR_APPEND_ELEMENT(data->io, data->nio, io);
+    }
+
+ error:
+    virCopyLastError(&data->err);
+    virResetLastError();
+    virNetSocketClose(data->sock);
+}
+
+
+/**
+ * qemuMigrationSrcStartTunnelChannels:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @sock: listening socket QEMU connects to for every migration channel
+ * @st: stream for the first channel
+ * @dconnuri: URI of the destination for opening connections for other channels
+ *
+ * Starts a thread which forwards every connection QEMU opens to @sock to
+ * the destination.
+ */
+qemuMigrationTunnelChannels *
+qemuMigrationSrcStartTunnelChannels(virQEMUDriver *driver,
+                                    virDomainObj *vm,
+                                    virNetSocket *sock,
+                                    virStreamPtr st,
+                                    const char *dconnuri)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuMigrationTunnelChannels *data = NULL;
+    int wakeupFD[2] = { -1, -1 };
+
+    if (virPipe(wakeupFD) < 0)
+        return NULL;
+
+    data = g_new0(qemuMigrationTunnelChannels, 1);
+
+    data->sock = virObjectRef(sock);
+    data->st = st;
+    data->dconnuri = g_strdup(dconnuri);
+    memcpy(data->uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+    data->keepAliveInterval = cfg->keepAliveInterval;
+    data->keepAliveCount = cfg->keepAliveCount;
+    data->wakeupRecvFD = wakeupFD[0];
+    data->wakeupSendFD = wakeupFD[1];
+
+    if (virThreadCreateFull(&data->thread, true,
+                            qemuMigrationSrcTunnelChannelsFunc,
+                            "qemu-mig-accept",
+                            false,
+                            data) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create migration thread"));
+        goto error;
+    }
+
+    return data;
+
+ error:
+    VIR_FORCE_CLOSE(wakeupFD[0]);
+    VIR_FORCE_CLOSE(wakeupFD[1]);
+    virObjectUnref(data->sock);
+    g_free(data->dconnuri);
+    g_free(data);
+    return NULL;
+}
+
+
+/**
+ * qemuMigrationSrcStopTunnelChannels:
+ * @data: channels started by qemuMigrationSrcStartTunnelChannels
+ * @error: whether migration failed
+ *
+ * Stops accepting new channels and stops all channels. Errors of the
+ * channels are reported unless @error is true.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMigrationSrcStopTunnelChannels(qemuMigrationTunnelChannels *data,
+                                   bool error)
+{
+    char stop = 1;
+    size_t i;
+    int rv = 0;
+
+    /* The thread would still use @data if we can't stop it */
+    if (safewrite(data->wakeupSendFD, &stop, 1) != 1) {
+        virReportSystemError(errno, "%s",
+                             _("failed to wakeup migration tunnel"));
+        return -1;
+    }
+
+    virThreadJoin(&data->thread);
+
+    /* Abort the remaining channels once one of them failed to keep its
+     * error. */
+    for (i = 0; i < data->nio; i++) {
+        if (qemuMigrationSrcStopTunnel(data->io[i], error || rv < 0) < 0)
+            rv = -1;
+    }
+
+    if (data->err.code != VIR_ERR_OK) {
+        if (!error && rv == 0) {
+            virSetError(&data->err);
+            rv = -1;
+        }
+        virResetError(&data->err);
+    }
+
+    for (i = 0; i < data->nstreams; i++)
+        virObjectUnref(data->streams[i]);
+    g_free(data->streams);
+    for (i = 0; i < data->nconns; i++)
+        virObjectUnref(data->conns[i]);
+    g_free(data->conns);
+    g_free(data->io);
+
+    VIR_FORCE_CLOSE(data->wakeupSendFD);
+    VIR_FORCE_CLOSE(data->wakeupRecvFD);
+    virObjectUnref(data->sock);
+    g_free(data->dconnuri);
+    g_free(data);
+    return rv;
+}
+
+
 static int
 qemuMigrationSrcConnect(virQEMUDriver *driver,
                         virDomainObj *vm,
@@ -4636,7 +5230,7 @@ qemuMigrationSrcRunPrepareBlockDirtyBitmapsMerge(virDomainObj *vm,
     GSList *nextdisk;
     int rc;
 
-    if (!(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, VIR_ASYNC_JOB_MIGRATION_OUT)))
+    if (!(blockNamedNodeData = qemuBlockGetNamedNodeDataCached(vm, VIR_ASYNC_JOB_MIGRATION_OUT)))
         return -1;
 
     for (nextdisk = mig->blockDirtyBitmaps; nextdisk; nextdisk = nextdisk->next) {
@@ -4922,6 +5516,7 @@ qemuMigrationSrcRun(virQEMUDriver *driver,
     g_autoptr(qemuMigrationCookie) mig = NULL;
     g_autofree char *tlsAlias = NULL;
     qemuMigrationIOThread *iothread = NULL;
+    qemuMigrationTunnelChannels *channels = NULL;
     VIR_AUTOCLOSE fd = -1;
     unsigned long restore_max_bandwidth = priv->migMaxBandwidth;
     virErrorPtr orig_err = NULL;
@@ -4993,6 +5588,9 @@ qemuMigrationSrcRun(virQEMUDriver *driver,
     if (qemuMigrationSrcGraphicsRelocate(vm, mig, graphicsuri) < 0)
         VIR_WARN("unable to provide data for graphics client relocation");
 
+    if (qemuMigrationSrcSchedule(vm, dconn) < 0)
+        goto error;
+
     if (mig->blockDirtyBitmaps &&
         qemuMigrationSrcRunPrepareBlockDirtyBitmaps(vm, mig, migParams, flags) < 0)
         goto error;
@@ -5112,12 +5710,20 @@ qemuMigrationSrcRun(virQEMUDriver *driver,
     cancel = true;
 
     if (spec->fwdType != MIGRATION_FWD_DIRECT) {
-        if (!(iothread = qemuMigrationSrcStartTunnel(spec->fwd.stream, fd)))
-            goto error;
-        /* If we've created a tunnel, then the 'fd' will be closed in the
-         * qemuMigrationIOFunc as data->sock.
-         */
-        fd = -1;
+        if (spec->fwd.sock) {
+            if (!(channels = qemuMigrationSrcStartTunnelChannels(driver, vm,
+                                                                 spec->fwd.sock,
+                                                                 spec->fwd.stream,
+                                                                 spec->fwd.dconnuri)))
+                goto error;
+        } else {
+            if (!(iothread = qemuMigrationSrcStartTunnel(spec->fwd.stream, fd)))
+                goto error;
+            /* If we've created a tunnel, then the 'fd' will be closed in the
+             * qemuMigrationIOFunc as data->sock.
+             */
+            fd = -1;
+        }
     }
 
     waitFlags = QEMU_MIGRATION_COMPLETED_PRE_SWITCHOVER;
@@ -5189,6 +5795,10 @@ qemuMigrationSrcRun(virQEMUDriver *driver,
             goto error;
     }
 
+    if (channels &&
+        qemuMigrationSrcStopTunnelChannels(g_steal_pointer(&channels), false) < 0)
+        goto error;
+
     if (vm->job->completed) {
         vm->job->completed->stopped = vm->job->current->stopped;
         qemuDomainJobDataUpdateTime(vm->job->completed);
@@ -5209,6 +5819,8 @@ qemuMigrationSrcRun(virQEMUDriver *driver,
     ret = 0;
 
  cleanup:
+    if (driver->migrationScheduler)
+        qemuMigrationSchedulerRemove(driver->migrationScheduler, vm);
     priv->signalIOError = false;
     priv->migMaxBandwidth = restore_max_bandwidth;
     virErrorRestore(&orig_err);
@@ -5252,6 +5864,9 @@ qemuMigrationSrcRun(virQEMUDriver *driver,
     if (iothread)
         qemuMigrationSrcStopTunnel(iothread, true);
 
+    if (channels)
+        qemuMigrationSrcStopTunnelChannels(channels, true);
+
     goto cleanup;
 
  exit_monitor:
@@ -5434,12 +6049,14 @@ qemuMigrationSrcPerformTunnel(virQEMUDriver *driver,
                               unsigned int flags,
                               unsigned long bandwidth,
                               virConnectPtr dconn,
+                              const char *dconnuri,
                               const char *graphicsuri,
                               const char **migrate_disks,
                               qemuMigrationParams *migParams)
 {
     int ret = -1;
-    qemuMigrationSpec spec;
+    qemuMigrationSpec spec = { 0 };
+    g_autofree char *tunnelPath = NULL;
     int fds[2] = { -1, -1 };
 
     VIR_DEBUG("driver=%p, vm=%p, st=%p, cookiein=%s, cookieinlen=%d, "
@@ -5452,23 +6069,37 @@ qemuMigrationSrcPerformTunnel(virQEMUDriver *driver,
     spec.fwdType = MIGRATION_FWD_STREAM;
     spec.fwd.stream = st;
 
-
     spec.destType = MIGRATION_DEST_FD;
     spec.dest.fd.qemu = -1;
     spec.dest.fd.local = -1;
 
-    if (virPipe(fds) < 0)
-        goto cleanup;
+    if (flags & VIR_MIGRATE_PARALLEL) {
+        /* QEMU needs to connect to a socket for opening multifd channels,
+         * each connection is forwarded through its own stream. */
+        tunnelPath = qemuMigrationTunnelSocketPath(vm);
 
-    spec.dest.fd.qemu = fds[1];
-    spec.dest.fd.local = fds[0];
+        if (virNetSocketNewListenUNIX(tunnelPath, 0700, 0, 0,
+                                      &spec.fwd.sock) < 0 ||
+            virNetSocketListen(spec.fwd.sock, 0) < 0)
+            goto cleanup;
 
-    if (spec.dest.fd.qemu == -1 ||
-        qemuSecuritySetImageFDLabel(driver->securityManager, vm->def,
-                                    spec.dest.fd.qemu) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("cannot create pipe for tunnelled migration"));
-        goto cleanup;
+        spec.fwd.dconnuri = dconnuri;
+        spec.destType = MIGRATION_DEST_SOCKET;
+        spec.dest.socket.path = tunnelPath;
+    } else {
+        if (virPipe(fds) < 0)
+            goto cleanup;
+
+        spec.dest.fd.qemu = fds[1];
+        spec.dest.fd.local = fds[0];
+
+        if (spec.dest.fd.qemu == -1 ||
+            qemuSecuritySetImageFDLabel(driver->securityManager, vm->def,
+                                        spec.dest.fd.qemu) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("cannot create pipe for tunnelled migration"));
+            goto cleanup;
+        }
     }
 
     /* Migration with NBD is not supported with _TUNNELLED, thus
@@ -5479,8 +6110,11 @@ qemuMigrationSrcPerformTunnel(virQEMUDriver *driver,
                               migParams, NULL);
 
  cleanup:
-    VIR_FORCE_CLOSE(spec.dest.fd.qemu);
-    VIR_FORCE_CLOSE(spec.dest.fd.local);
+    if (spec.destType == MIGRATION_DEST_FD) {
+        VIR_FORCE_CLOSE(spec.dest.fd.qemu);
+        VIR_FORCE_CLOSE(spec.dest.fd.local);
+    }
+    virObjectUnref(spec.fwd.sock);
 
     return ret;
 }
@@ -5616,7 +6250,7 @@ qemuMigrationSrcPerformPeer2Peer2(virQEMUDriver *driver,
     if (flags & VIR_MIGRATE_TUNNELLED)
         ret = qemuMigrationSrcPerformTunnel(driver, vm, st, NULL,
                                             NULL, 0, NULL, NULL,
-                                            flags, bandwidth, dconn,
+                                            flags, bandwidth, dconn, dconnuri,
                                             NULL, NULL, migParams);
     else
         ret = qemuMigrationSrcPerformNative(driver, vm, NULL, uri_out,
@@ -5892,8 +6526,8 @@ qemuMigrationSrcPerformPeer2Peer3(virQEMUDriver *driver,
             ret = qemuMigrationSrcPerformTunnel(driver, vm, st, persist_xml,
                                                 cookiein, cookieinlen,
                                                 &cookieout, &cookieoutlen,
-                                                flags, bandwidth, dconn, graphicsuri,
-                                                migrate_disks,
+                                                flags, bandwidth, dconn, dconnuri,
+                                                graphicsuri, migrate_disks,
                                                 migParams);
         } else {
             ret = qemuMigrationSrcPerformNative(driver, vm, persist_xml, uri,
@@ -6089,6 +6723,7 @@ qemuMigrationSrcPerformPeer2Peer(virQEMUDriver *driver,
     virErrorPtr orig_err = NULL;
     bool offline = !!(flags & VIR_MIGRATE_OFFLINE);
     int dstOffline = 0;
+    int dstTunnelChannels = 0;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     int useParams;
     int rc;
@@ -6166,6 +6801,12 @@ qemuMigrationSrcPerformPeer2Peer(virQEMUDriver *driver,
         if (dstOffline < 0)
             goto cleanup;
     }
+    if (flags & VIR_MIGRATE_TUNNELLED && flags & VIR_MIGRATE_PARALLEL) {
+        dstTunnelChannels = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
+                                                     VIR_DRV_FEATURE_MIGRATION_TUNNEL_CHANNELS);
+        if (dstTunnelChannels < 0)
+            goto cleanup;
+    }
     if (qemuDomainObjExitRemote(vm, !offline) < 0)
         goto cleanup;
 
@@ -6189,6 +6830,13 @@ qemuMigrationSrcPerformPeer2Peer(virQEMUDriver *driver,
         goto cleanup;
     }
 
+    if (flags & VIR_MIGRATE_TUNNELLED && flags & VIR_MIGRATE_PARALLEL &&
+        !dstTunnelChannels) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("parallel tunnelled migration is not supported by the destination host"));
+        goto cleanup;
+    }
+
     /* Change protection is only required on the source side (us), and
      * only for v3 migration when begin and perform are separate jobs.
      * But peer-2-peer is already a single job, and we still want to
@@ -6869,6 +7517,11 @@ qemuMigrationDstFinishFresh(virQEMUDriver *driver,
     }
 
     if (jobData) {
+        qemuDomainObjPrivate *priv = vm->privateData;
+        qemuDomainJobDataPrivate *privJob = jobData->privateData;
+
+        privJob->startup = priv->startup;
+
         vm->job->completed = g_steal_pointer(&jobData);
         vm->job->completed->status = VIR_DOMAIN_JOB_STATUS_COMPLETED;
         qemuDomainJobSetStatsType(vm->job->completed,
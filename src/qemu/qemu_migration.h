@@ -149,6 +149,10 @@ qemuMigrationDstPrepareTunnel(virQEMUDriver *driver,
                               qemuMigrationParams *migParams,
                               unsigned int flags);
 
+int
+qemuMigrationDstAddTunnelChannel(virDomainObj *vm,
+                                 virStreamPtr st);
+
 int
 qemuMigrationDstPrepareDirect(virQEMUDriver *driver,
                               virConnectPtr dconn,
@@ -1125,6 +1125,40 @@ qemuMigrationParamsApply(virDomainObj *vm,
 }
 
 
+/**
+ * qemuMigrationParamsSetMaxBandwidth:
+ * @vm: domain object
+ * @asyncJob: migration job
+ * @bandwidth: new bandwidth limit in MiB/s
+ *
+ * Changes the bandwidth limit of a migration which is already running.
+ * Unlike qemuMigrationParamsApply() capabilities are not touched as
+ * QEMU doesn't allow changing them once migration started.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+qemuMigrationParamsSetMaxBandwidth(virDomainObj *vm,
+                                   int asyncJob,
+                                   unsigned long long bandwidth)
+{
+    g_autoptr(qemuMigrationParams) migParams = qemuMigrationParamsNew();
+    int ret;
+
+    if (qemuMigrationParamsSetULL(migParams, QEMU_MIGRATION_PARAM_MAX_BANDWIDTH,
+                                  bandwidth * 1024 * 1024) < 0)
+        return -1;
+
+    if (qemuDomainObjEnterMonitorAsync(vm, asyncJob) < 0)
+        return -1;
+
+    ret = qemuMigrationParamsApplyValues(vm, migParams, false);
+
+    qemuDomainObjExitMonitor(vm);
+
+    return ret;
+}
+
 /**
  * qemuMigrationParamsSetString:
  * @migrParams: migration parameter object
@@ -114,6 +114,11 @@ qemuMigrationParamsApply(virDomainObj *vm,
                          qemuMigrationParams *migParams,
                          unsigned int apiFlags);
 
+int
+qemuMigrationParamsSetMaxBandwidth(virDomainObj *vm,
+                                   int asyncJob,
+                                   unsigned long long bandwidth);
+
 int
 qemuMigrationParamsEnableTLS(virQEMUDriver *driver,
                              virDomainObj *vm,
@@ -0,0 +1,335 @@
+/*
+ * qemu_migration_sched.c: QEMU outgoing migration scheduler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "qemu_migration_sched.h"
+#include "virerror.h"
+#include "virlog.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_migration_sched");
+
+/*
+ * The scheduler limits the number of outgoing migrations running at the
+ * same time and splits a host wide bandwidth budget among them. Migrations
+ * which cannot start immediately are queued. Queued migrations of domains
+ * with lower dirty rate are started first, since they are expected to
+ * converge faster and free their slot sooner; migrations with the same
+ * dirty rate (including unknown rate reported as 0) are started in the
+ * order in which they were queued.
+ *
+ * Every entry holds a reference on its domain object, which is used for
+ * waking up the thread waiting on the domain condition once the migration
+ * is allowed to start. The domain object is never locked by the scheduler.
+ */
+
+typedef struct _qemuMigrationSchedulerEntry qemuMigrationSchedulerEntry;
+struct _qemuMigrationSchedulerEntry {
+    virDomainObj *vm;
+    unsigned long long seq;
+    unsigned long long dirtyRate;   /* MiB/s */
+    unsigned long long bandwidth;   /* requested bandwidth in MiB/s, 0 = any */
+    bool active;
+};
+
+struct _qemuMigrationScheduler {
+    virMutex lock;
+    unsigned int maxActive;         /* 0 = unlimited */
+    unsigned long long bandwidth;   /* MiB/s, 0 = unlimited */
+
+    unsigned long long seq;
+    unsigned int nactive;
+    GPtrArray *entries;             /* qemuMigrationSchedulerEntry */
+};
+
+
+static void
+qemuMigrationSchedulerEntryFree(void *opaque)
+{
+    qemuMigrationSchedulerEntry *entry = opaque;
+
+    virObjectUnref(entry->vm);
+    g_free(entry);
+}
+
+
+qemuMigrationScheduler *
+qemuMigrationSchedulerNew(unsigned int maxActive,
+                          unsigned long long bandwidth)
+{
+    g_autofree qemuMigrationScheduler *sched = g_new0(qemuMigrationScheduler, 1);
+
+    if (virMutexInit(&sched->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to init migration scheduler mutex"));
+        return NULL;
+    }
+
+    sched->maxActive = maxActive;
+    sched->bandwidth = bandwidth;
+    sched->entries = g_ptr_array_new_with_free_func(qemuMigrationSchedulerEntryFree);
+
+    return g_steal_pointer(&sched);
+}
+
+
+void
+qemuMigrationSchedulerFree(qemuMigrationScheduler *sched)
+{
+    if (!sched)
+        return;
+
+    g_ptr_array_unref(sched->entries);
+    virMutexDestroy(&sched->lock);
+    g_free(sched);
+}
+
+
+static qemuMigrationSchedulerEntry *
+qemuMigrationSchedulerFindLocked(qemuMigrationScheduler *sched,
+                                 virDomainObj *vm,
+                                 unsigned int *idx)
+{
+    unsigned int i;
+
+    for (i = 0; i < sched->entries->len; i++) {
+        qemuMigrationSchedulerEntry *entry = g_ptr_array_index(sched->entries, i);
+
+        if (entry->vm == vm) {
+            if (idx)
+                *idx = i;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Returns true if queued @a should be started before queued @b. */
+static bool
+qemuMigrationSchedulerEntryBefore(qemuMigrationSchedulerEntry *a,
+                                  qemuMigrationSchedulerEntry *b)
+{
+    if (a->dirtyRate != b->dirtyRate)
+        return a->dirtyRate < b->dirtyRate;
+
+    return a->seq < b->seq;
+}
+
+
+static void
+qemuMigrationSchedulerAdmitLocked(qemuMigrationScheduler *sched)
+{
+    while (sched->maxActive == 0 || sched->nactive < sched->maxActive) {
+        qemuMigrationSchedulerEntry *next = NULL;
+        unsigned int i;
+
+        for (i = 0; i < sched->entries->len; i++) {
+            qemuMigrationSchedulerEntry *entry = g_ptr_array_index(sched->entries, i);
+
+            if (entry->active)
+                continue;
+
+            if (!next || qemuMigrationSchedulerEntryBefore(entry, next))
+                next = entry;
+        }
+
+        if (!next)
+            return;
+
+        VIR_DEBUG("Starting outgoing migration of domain %s",
+                  next->vm->def->name);
+
+        next->active = true;
+        sched->nactive++;
+        virDomainObjBroadcast(next->vm);
+    }
+}
+
+
+/**
+ * qemuMigrationSchedulerEnqueue:
+ * @sched: migration scheduler
+ * @vm: domain to be migrated
+ * @dirtyRate: last known dirty rate of @vm in MiB/s or 0 if unknown
+ * @bandwidth: bandwidth requested for the migration in MiB/s, 0 if unlimited
+ *
+ * Registers an outgoing migration of @vm. Once the migration is allowed to
+ * start, the domain condition of @vm is signalled and
+ * qemuMigrationSchedulerIsActive() starts returning true. The migration
+ * has to be unregistered using qemuMigrationSchedulerRemove() once it
+ * finishes.
+ *
+ * Returns true if the migration can start immediately, false if it was
+ * queued.
+ */
+bool
+qemuMigrationSchedulerEnqueue(qemuMigrationScheduler *sched,
+                              virDomainObj *vm,
+                              unsigned long long dirtyRate,
+                              unsigned long long bandwidth)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&sched->lock);
+    qemuMigrationSchedulerEntry *entry;
+
+    if (!(entry = qemuMigrationSchedulerFindLocked(sched, vm, NULL))) {
+        entry = g_new0(qemuMigrationSchedulerEntry, 1);
+        entry->vm = virObjectRef(vm);
+        entry->seq = sched->seq++;
+        g_ptr_array_add(sched->entries, entry);
+    }
+
+    entry->dirtyRate = dirtyRate;
+    entry->bandwidth = bandwidth;
+
+    qemuMigrationSchedulerAdmitLocked(sched);
+
+    return entry->active;
+}
+
+
+bool
+qemuMigrationSchedulerIsActive(qemuMigrationScheduler *sched,
+                               virDomainObj *vm)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&sched->lock);
+    qemuMigrationSchedulerEntry *entry;
+
+    if (!(entry = qemuMigrationSchedulerFindLocked(sched, vm, NULL)))
+        return false;
+
+    return entry->active;
+}
+
+
+/**
+ * qemuMigrationSchedulerGetPosition:
+ * @sched: migration scheduler
+ * @vm: domain object
+ *
+ * Returns the position (starting from 1) of a queued migration of @vm,
+ * i.e., the number of queued migrations which will be started before it
+ * plus one, or 0 if @vm is not waiting in the queue.
+ */
+unsigned int
+qemuMigrationSchedulerGetPosition(qemuMigrationScheduler *sched,
+                                  virDomainObj *vm)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&sched->lock);
+    qemuMigrationSchedulerEntry *entry;
+    unsigned int position = 1;
+    unsigned int i;
+
+    if (!(entry = qemuMigrationSchedulerFindLocked(sched, vm, NULL)) ||
+        entry->active)
+        return 0;
+
+    for (i = 0; i < sched->entries->len; i++) {
+        qemuMigrationSchedulerEntry *other = g_ptr_array_index(sched->entries, i);
+
+        if (!other->active &&
+            qemuMigrationSchedulerEntryBefore(other, entry))
+            position++;
+    }
+
+    return position;
+}
+
+
+/**
+ * qemuMigrationSchedulerGetBandwidth:
+ * @sched: migration scheduler
+ * @vm: domain object
+ * @dirtyRate: current dirty rate of @vm in MiB/s
+ *
+ * Records @dirtyRate of an active migration of @vm and computes its share
+ * of the host bandwidth budget. Half of the budget is split evenly among all
+ * active migrations and the other half proportionally to their dirty rates
+ * so that migrations which dirty memory faster get more bandwidth to be able
+ * to converge. The share never exceeds the bandwidth requested for the
+ * migration.
+ *
+ * Returns the bandwidth in MiB/s the migration of @vm should use, or the
+ * requested bandwidth (0 meaning unlimited) if there is no budget or @vm
+ * is not an active migration.
+ */
+unsigned long long
+qemuMigrationSchedulerGetBandwidth(qemuMigrationScheduler *sched,
+                                   virDomainObj *vm,
+                                   unsigned long long dirtyRate)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&sched->lock);
+    qemuMigrationSchedulerEntry *entry;
+    unsigned long long totalDirtyRate = 0;
+    unsigned long long share;
+    unsigned int i;
+
+    if (!(entry = qemuMigrationSchedulerFindLocked(sched, vm, NULL)))
+        return 0;
+
+    if (!entry->active || sched->bandwidth == 0)
+        return entry->bandwidth;
+
+    entry->dirtyRate = dirtyRate;
+
+    for (i = 0; i < sched->entries->len; i++) {
+        qemuMigrationSchedulerEntry *other = g_ptr_array_index(sched->entries, i);
+
+        if (other->active)
+            totalDirtyRate += other->dirtyRate;
+    }
+
+    if (totalDirtyRate > 0) {
+        share = sched->bandwidth / (2 * sched->nactive) +
+                sched->bandwidth / 2 * entry->dirtyRate / totalDirtyRate;
+    } else {
+        share = sched->bandwidth / sched->nactive;
+    }
+
+    share = MAX(share, 1);
+
+    if (entry->bandwidth > 0)
+        share = MIN(share, entry->bandwidth);
+
+    return share;
+}
+
+
+void
+qemuMigrationSchedulerRemove(qemuMigrationScheduler *sched,
+                             virDomainObj *vm)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&sched->lock);
+    qemuMigrationSchedulerEntry *entry;
+    unsigned int idx;
+
+    if (!(entry = qemuMigrationSchedulerFindLocked(sched, vm, &idx)))
+        return;
+
+    if (entry->active)
+        sched->nactive--;
+
+    g_ptr_array_remove_index(sched->entries, idx);
+
+    qemuMigrationSchedulerAdmitLocked(sched);
+}
@@ -0,0 +1,56 @@
+/*
+ * qemu_migration_sched.h: QEMU outgoing migration scheduler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "domain_conf.h"
+
+typedef struct _qemuMigrationScheduler qemuMigrationScheduler;
+
+qemuMigrationScheduler *
+qemuMigrationSchedulerNew(unsigned int maxActive,
+                          unsigned long long bandwidth);
+
+void
+qemuMigrationSchedulerFree(qemuMigrationScheduler *sched);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(qemuMigrationScheduler, qemuMigrationSchedulerFree);
+
+bool
+qemuMigrationSchedulerEnqueue(qemuMigrationScheduler *sched,
+                              virDomainObj *vm,
+                              unsigned long long dirtyRate,
+                              unsigned long long bandwidth);
+
+bool
+qemuMigrationSchedulerIsActive(qemuMigrationScheduler *sched,
+                               virDomainObj *vm);
+
+unsigned int
+qemuMigrationSchedulerGetPosition(qemuMigrationScheduler *sched,
+                                  virDomainObj *vm);
+
+unsigned long long
+qemuMigrationSchedulerGetBandwidth(qemuMigrationScheduler *sched,
+                                   virDomainObj *vm,
+                                   unsigned long long dirtyRate);
+
+void
+qemuMigrationSchedulerRemove(qemuMigrationScheduler *sched,
+                             virDomainObj *vm);
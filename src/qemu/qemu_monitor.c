@@ -221,6 +221,7 @@ qemuMonitorDispose(void *obj)
     g_free(mon->buffer);
     g_free(mon->balloonpath);
     g_free(mon->domainName);
+    g_clear_pointer(&mon->prefetched, g_hash_table_unref);
 }
 
 
@@ -268,8 +269,11 @@ qemuMonitorIOProcess(qemuMonitor *mon)
     qemuMonitorMessage *msg = NULL;
 
     /* See if there's a message & whether its ready for its reply
-     * ie whether its completed writing all its data */
-    if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
+     * ie whether its completed writing all its data. Replies to
+     * pipelined commands may arrive while the rest is still being
+     * written. */
+    if (mon->msg &&
+        (mon->msg->txOffset == mon->msg->txLength || mon->msg->rxObjects))
         msg = mon->msg;
 
 
@@ -4575,3 +4579,57 @@ qemuMonitorBlockdevSetActive(qemuMonitor *mon,
 
     return qemuMonitorJSONBlockdevSetActive(mon, nodename, active);
 }
+
+
+/**
+ * qemuMonitorPrefetch:
+ * @mon: monitor object
+ * @flags: bitwise-OR of qemuMonitorPrefetchFlags
+ *
+ * Sends the queries selected by @flags to QEMU at once instead of one
+ * after another and keeps the replies. The following calls issuing the
+ * very same query are served from the kept reply without talking to
+ * QEMU, each reply being used only once. Replies which were not used
+ * are dropped by qemuMonitorPrefetchClear which must be called before
+ * the caller gives up its job.
+ *
+ * Returns 0 on success, -1 on error. Callers are free to ignore errors
+ * as the queries are simply issued again later.
+ */
+int
+qemuMonitorPrefetch(qemuMonitor *mon,
+                    unsigned int flags)
+{
+    QEMU_CHECK_MONITOR(mon);
+    VIR_DEBUG("flags=0x%x", flags);
+
+    return qemuMonitorJSONPrefetch(mon, flags);
+}
+
+
+void
+qemuMonitorPrefetchClear(qemuMonitor *mon)
+{
+    if (!mon)
+        return;
+
+    qemuMonitorJSONPrefetchClear(mon);
+}
+
+
+/**
+ * qemuMonitorGetBlockGeneration:
+ * @mon: monitor object
+ *
+ * Returns a counter which changes whenever a command was sent to QEMU or an
+ * event was received from QEMU which might have modified the block node graph
+ * or the dirty bitmaps. Data about block nodes queried at a given value of the
+ * counter describes the current topology as long as the counter keeps the
+ * value. Volatile statistics such as the allocation of images or the dirty
+ * count of bitmaps are not covered.
+ */
+unsigned int
+qemuMonitorGetBlockGeneration(qemuMonitor *mon)
+{
+    return g_atomic_int_get(&mon->blockGeneration);
+}
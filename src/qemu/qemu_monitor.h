@@ -1912,3 +1912,20 @@ int
 qemuMonitorBlockdevSetActive(qemuMonitor *mon,
                              const char *nodename,
                              bool active);
+
+typedef enum {
+    QEMU_MONITOR_PREFETCH_BLOCKSTATS = 1 << 0, /* query-blockstats */
+    QEMU_MONITOR_PREFETCH_IOTHREADS = 1 << 1, /* query-iothreads */
+    QEMU_MONITOR_PREFETCH_CPUS = 1 << 2, /* query-cpus-fast */
+    QEMU_MONITOR_PREFETCH_VCPU_STATS = 1 << 3, /* query-stats for vCPUs */
+} qemuMonitorPrefetchFlags;
+
+int
+qemuMonitorPrefetch(qemuMonitor *mon,
+                    unsigned int flags);
+
+void
+qemuMonitorPrefetchClear(qemuMonitor *mon);
+
+unsigned int
+qemuMonitorGetBlockGeneration(qemuMonitor *mon);
@@ -173,6 +173,14 @@ qemuMonitorJSONIOProcessEvent(qemuMonitor *mon,
         ignore_value(virJSONValueObjectGetNumberUint(timestamp, "microseconds",
                                                      &micros));
     }
+    /* QEMU doesn't announce changes of dirty bitmaps, but they are merged,
+     * removed or start being recorded into new images only by commands or
+     * on completion of jobs */
+    if (STRPREFIX(type, "BLOCK_JOB_") ||
+        STREQ(type, "JOB_STATUS_CHANGE") ||
+        STREQ(type, "MIGRATION"))
+        g_atomic_int_inc(&mon->blockGeneration);
+
     qemuMonitorEmitEvent(mon, type, seconds, micros, details);
 
     handler = bsearch(type, eventHandlers, G_N_ELEMENTS(eventHandlers),
@@ -214,7 +222,27 @@ qemuMonitorJSONIOProcessLine(qemuMonitor *mon,
                virJSONValueObjectHasKey(obj, "return")) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
-        if (msg) {
+        if (msg && msg->rxObjects) {
+            const char *id = virJSONValueObjectGetString(obj, "id");
+
+            if (msg->nrxReceived >= msg->nrxObjects) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Unexpected JSON reply '%1$s'"), line);
+                return -1;
+            }
+
+            if (id && STRNEQ(id, msg->rxIDs[msg->nrxReceived])) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("JSON reply '%1$s' doesn't match command '%2$s'"),
+                               line, msg->rxIDs[msg->nrxReceived]);
+                return -1;
+            }
+
+            msg->rxObjects[msg->nrxReceived++] = g_steal_pointer(&obj);
+            if (msg->nrxReceived == msg->nrxObjects)
+                msg->finished = 1;
+            return 0;
+        } else if (msg) {
             msg->rxObject = g_steal_pointer(&obj);
             msg->finished = 1;
             return 0;
@@ -260,6 +288,20 @@ qemuMonitorJSONIOProcess(qemuMonitor *mon,
 }
 
 
+/* Returns true if @cmd only reads state of the VM and thus can't modify
+ * the block node graph or dirty bitmaps. */
+static bool
+qemuMonitorJSONCommandIsQuery(virJSONValue *cmd)
+{
+    const char *name = virJSONValueObjectGetString(cmd, "execute");
+
+    return name &&
+        (STRPREFIX(name, "query-") ||
+         STREQ(name, "qom-get") ||
+         STREQ(name, "qom-list"));
+}
+
+
 static int
 qemuMonitorJSONCommandWithFd(qemuMonitor *mon,
                              virJSONValue *cmd,
@@ -272,6 +314,24 @@ qemuMonitorJSONCommandWithFd(qemuMonitor *mon,
 
     *reply = NULL;
 
+    if (mon->prefetched && scm_fd == -1) {
+        g_autofree char *key = virJSONValueToString(cmd, false);
+        gpointer origkey;
+        gpointer prefetched;
+
+        if (key &&
+            g_hash_table_steal_extended(mon->prefetched, key,
+                                        &origkey, &prefetched)) {
+            VIR_DEBUG("Using prefetched reply for %s", key);
+            g_free(origkey);
+            *reply = prefetched;
+            return 0;
+        }
+    }
+
+    if (!qemuMonitorJSONCommandIsQuery(cmd))
+        g_atomic_int_inc(&mon->blockGeneration);
+
     if (virJSONValueObjectHasKey(cmd, "execute")) {
         g_autofree char *id = qemuMonitorNextCommandID(mon);
 
@@ -315,6 +375,74 @@ qemuMonitorJSONCommand(qemuMonitor *mon,
 }
 
 
+/**
+ * qemuMonitorJSONCommandPipeline:
+ * @mon: monitor object
+ * @cmds: commands to execute
+ * @ncmds: number of commands in @cmds
+ * @replies: filled with @ncmds replies
+ *
+ * Sends all @cmds at once and waits for all the replies, saving a round
+ * trip through the monitor for every command but the first one. As with
+ * qemuMonitorJSONCommand the replies still need to be checked for errors
+ * by the caller; on success the caller is responsible for freeing
+ * @replies.
+ */
+static int
+qemuMonitorJSONCommandPipeline(qemuMonitor *mon,
+                               virJSONValue **cmds,
+                               size_t ncmds,
+                               virJSONValue ***replies)
+{
+    qemuMonitorMessage msg = { 0 };
+    g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
+    g_auto(GStrv) ids = g_new0(char *, ncmds + 1);
+    virJSONValue **rx = g_new0(virJSONValue *, ncmds);
+    size_t i;
+    int ret = -1;
+
+    *replies = NULL;
+
+    for (i = 0; i < ncmds; i++) {
+        if (!qemuMonitorJSONCommandIsQuery(cmds[i]))
+            g_atomic_int_inc(&mon->blockGeneration);
+
+        ids[i] = qemuMonitorNextCommandID(mon);
+
+        if (virJSONValueObjectAppendString(cmds[i], "id", ids[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to append command 'id' string"));
+            goto cleanup;
+        }
+
+        if (virJSONValueToBuffer(cmds[i], &cmdbuf, false) < 0)
+            goto cleanup;
+        virBufferAddLit(&cmdbuf, "\r\n");
+    }
+
+    msg.txLength = virBufferUse(&cmdbuf);
+    msg.txBuffer = virBufferCurrentContent(&cmdbuf);
+    msg.txFD = -1;
+    msg.rxIDs = ids;
+    msg.rxObjects = (void **) rx;
+    msg.nrxObjects = ncmds;
+
+    if (qemuMonitorSend(mon, &msg) < 0)
+        goto cleanup;
+
+    *replies = g_steal_pointer(&rx);
+    ret = 0;
+
+ cleanup:
+    if (rx) {
+        for (i = 0; i < ncmds; i++)
+            virJSONValueFree(rx[i]);
+        g_free(rx);
+    }
+    return ret;
+}
+
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -8933,3 +9061,94 @@ qemuMonitorJSONBlockdevSetActive(qemuMonitor *mon,
 
     return qemuMonitorJSONCheckError(cmd, reply);
 }
+
+
+#define QEMU_MONITOR_PREFETCH_MAX_COMMANDS 5
+
+/* Commands issued by qemuMonitorJSONGetAllBlockStatsInfo and friends,
+ * they have to be built exactly the same way for the replies to be
+ * picked up. */
+static int
+qemuMonitorJSONPrefetchCommands(unsigned int flags,
+                                virJSONValue **cmds,
+                                size_t *ncmds)
+{
+    if (flags & QEMU_MONITOR_PREFETCH_BLOCKSTATS) {
+        if (!(cmds[(*ncmds)++] = qemuMonitorJSONMakeCommand("query-blockstats",
+                                                            "B:query-nodes", false,
+                                                            NULL)) ||
+            !(cmds[(*ncmds)++] = qemuMonitorJSONMakeCommand("query-blockstats",
+                                                            "B:query-nodes", true,
+                                                            NULL)))
+            return -1;
+    }
+
+    if (flags & QEMU_MONITOR_PREFETCH_IOTHREADS &&
+        !(cmds[(*ncmds)++] = qemuMonitorJSONMakeCommand("query-iothreads", NULL)))
+        return -1;
+
+    if (flags & QEMU_MONITOR_PREFETCH_CPUS &&
+        !(cmds[(*ncmds)++] = qemuMonitorJSONMakeCommand("query-cpus-fast", NULL)))
+        return -1;
+
+    if (flags & QEMU_MONITOR_PREFETCH_VCPU_STATS &&
+        !(cmds[(*ncmds)++] = qemuMonitorJSONMakeCommand("query-stats",
+                                                        "s:target", "vcpu",
+                                                        NULL)))
+        return -1;
+
+    return 0;
+}
+
+
+int
+qemuMonitorJSONPrefetch(qemuMonitor *mon,
+                        unsigned int flags)
+{
+    virJSONValue *cmds[QEMU_MONITOR_PREFETCH_MAX_COMMANDS] = { NULL };
+    g_auto(GStrv) keys = NULL;
+    virJSONValue **replies = NULL;
+    size_t ncmds = 0;
+    size_t i;
+    int ret = -1;
+
+    if (qemuMonitorJSONPrefetchCommands(flags, cmds, &ncmds) < 0)
+        goto cleanup;
+
+    if (ncmds == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    /* The commands get an ID once sent, which is not present when
+     * the reply is looked up. */
+    keys = g_new0(char *, ncmds + 1);
+    for (i = 0; i < ncmds; i++) {
+        if (!(keys[i] = virJSONValueToString(cmds[i], false)))
+            goto cleanup;
+    }
+
+    if (qemuMonitorJSONCommandPipeline(mon, cmds, ncmds, &replies) < 0)
+        goto cleanup;
+
+    if (!mon->prefetched)
+        mon->prefetched = virHashNew(virJSONValueHashFree);
+
+    for (i = 0; i < ncmds; i++)
+        g_hash_table_insert(mon->prefetched, g_steal_pointer(&keys[i]), replies[i]);
+
+    g_free(replies);
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncmds; i++)
+        virJSONValueFree(cmds[i]);
+    return ret;
+}
+
+
+void
+qemuMonitorJSONPrefetchClear(qemuMonitor *mon)
+{
+    g_clear_pointer(&mon->prefetched, g_hash_table_unref);
+}
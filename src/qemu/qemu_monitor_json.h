@@ -809,3 +809,10 @@ int
 qemuMonitorJSONBlockdevSetActive(qemuMonitor *mon,
                                  const char *nodename,
                                  bool active);
+
+int
+qemuMonitorJSONPrefetch(qemuMonitor *mon,
+                        unsigned int flags);
+
+void
+qemuMonitorJSONPrefetchClear(qemuMonitor *mon);
@@ -37,6 +37,13 @@ struct _qemuMonitorMessage {
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
 
+    /* Used instead of rxObject when several commands are sent at once.
+     * QEMU replies in order, @rxIDs holds the expected command IDs */
+    char **rxIDs;
+    void **rxObjects;
+    size_t nrxObjects;
+    size_t nrxReceived;
+
     /* True if rxObject is ready, or a fatal error occurred on the monitor channel */
     bool finished;
 };
@@ -90,6 +97,15 @@ struct _qemuMonitor {
 
     /* use the backing-mask-protocol flag of block-commit/stream */
     bool blockjobMaskProtocol;
+
+    /* Replies of pipelined queries keyed by the command (without ID)
+     * which are yet to be picked up, see qemuMonitorPrefetch */
+    GHashTable *prefetched;
+
+    /* Changed whenever a command or event might have modified the block
+     * node graph or dirty bitmaps, see qemuMonitorGetBlockGeneration.
+     * Atomic access only */
+    int blockGeneration;
 };
 
 
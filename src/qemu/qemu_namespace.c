@@ -21,9 +21,6 @@
 
 #include <config.h>
 
-#ifdef __linux__
-# include <sys/sysmacros.h>
-#endif
 #if defined(WITH_SYS_MOUNT_H)
 # include <sys/mount.h>
 #endif
@@ -32,6 +29,8 @@
 #endif
 
 #include "qemu_namespace.h"
+#define LIBVIRT_QEMU_NAMESPACEPRIV_H_ALLOW
+#include "qemu_namespacepriv.h"
 #include "qemu_domain.h"
 #include "qemu_cgroup.h"
 #include "qemu_security.h"
@@ -40,6 +39,10 @@
 #include "virlog.h"
 #include "virdevmapper.h"
 #include "virglibutil.h"
+#include "virjson.h"
+#include "virsocket.h"
+#include "vircommand.h"
+#include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -684,9 +687,10 @@ qemuDomainSetupLaunchSecurity(virDomainObj *vm,
 
 
 static int
-qemuNamespaceMknodPaths(virDomainObj *vm,
-                        GSList *paths,
-                        bool *created);
+qemuNamespaceMknodPathsFull(virDomainObj *vm,
+                            GSList *paths,
+                            bool useHelper,
+                            bool *created);
 
 
 int
@@ -736,7 +740,9 @@ qemuDomainBuildNamespace(virQEMUDriverConfig *cfg,
     if (qemuDomainSetupLaunchSecurity(vm, &paths) < 0)
         return -1;
 
-    if (qemuNamespaceMknodPaths(vm, paths, NULL) < 0)
+    /* This is a single batch done while the domain is starting,
+     * forking once is cheaper than executing the helper. */
+    if (qemuNamespaceMknodPathsFull(vm, paths, false, NULL) < 0)
         return -1;
 
     return 0;
@@ -916,10 +922,31 @@ qemuDomainDisableNamespace(virDomainObj *vm,
 }
 
 
+static void
+qemuNamespaceHelperStop(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (priv->namespaceHelperPID < 0)
+        return;
+
+    VIR_DEBUG("Stopping namespace helper %lld of domain %s",
+              (long long) priv->namespaceHelperPID, vm->def->name);
+
+    /* Closing the socket makes the helper exit on its own,
+     * virProcessAbort() then just reaps it. */
+    VIR_FORCE_CLOSE(priv->namespaceHelperFD);
+    virProcessAbort(priv->namespaceHelperPID);
+    priv->namespaceHelperPID = -1;
+}
+
+
 void
 qemuDomainDestroyNamespace(virQEMUDriver *driver G_GNUC_UNUSED,
                            virDomainObj *vm)
 {
+    qemuNamespaceHelperStop(vm);
+
     if (qemuDomainNamespaceEnabled(vm, QEMU_DOMAIN_NS_MOUNT))
         qemuDomainDisableNamespace(vm, QEMU_DOMAIN_NS_MOUNT);
 }
@@ -954,39 +981,6 @@ qemuDomainNamespaceAvailable(qemuDomainNamespace ns G_GNUC_UNUSED)
 }
 
 
-typedef struct _qemuNamespaceMknodItem qemuNamespaceMknodItem;
-struct _qemuNamespaceMknodItem {
-    char *file;
-    char *target;
-    bool bindmounted;
-    GStatBuf sb;
-    void *acl;
-    char *tcon;
-};
-
-typedef struct _qemuNamespaceMknodData qemuNamespaceMknodData;
-struct _qemuNamespaceMknodData {
-    virQEMUDriver *driver;
-    virDomainObj *vm;
-    qemuNamespaceMknodItem *items;
-    size_t nitems;
-};
-
-
-static void
-qemuNamespaceMknodItemClear(qemuNamespaceMknodItem *item)
-{
-    VIR_FREE(item->file);
-    VIR_FREE(item->target);
-    virFileFreeACLs(&item->acl);
-#ifdef WITH_SELINUX
-    freecon(item->tcon);
-#endif
-}
-
-
-G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(qemuNamespaceMknodItem, qemuNamespaceMknodItemClear);
-
 static void
 qemuNamespaceMknodDataClear(qemuNamespaceMknodData *data)
 {
@@ -1004,196 +998,211 @@ qemuNamespaceMknodDataClear(qemuNamespaceMknodData *data)
 
 /* Our way of creating devices is highly linux specific */
 #if defined(__linux__)
-static int
-qemuNamespaceMknodOne(qemuNamespaceMknodItem *data)
+static bool
+qemuNamespaceMknodItemNeedsBindMount(mode_t st_mode)
 {
-    int ret = -1;
-    bool delDevice = false;
-    bool isLink = S_ISLNK(data->sb.st_mode);
-    bool isDev = S_ISCHR(data->sb.st_mode) || S_ISBLK(data->sb.st_mode);
-    bool isReg = S_ISREG(data->sb.st_mode) || S_ISFIFO(data->sb.st_mode) || S_ISSOCK(data->sb.st_mode);
-    bool isDir = S_ISDIR(data->sb.st_mode);
-    bool existed = false;
+    /* A block device S_ISBLK() or a chardev S_ISCHR() is intentionally not
+     * handled.  We want to mknod() it instead of passing in through bind
+     * mounting. */
+    return S_ISREG(st_mode) || S_ISFIFO(st_mode) ||
+           S_ISSOCK(st_mode) || S_ISDIR(st_mode);
+}
 
-    if (virFileExists(data->file))
-        existed = true;
 
-    if (virFileMakeParentPath(data->file) < 0) {
-        virReportSystemError(errno,
-                             _("Unable to create %1$s"), data->file);
-        goto cleanup;
-    }
+static int
+qemuNamespaceMknodHelper(pid_t pid G_GNUC_UNUSED,
+                         void *opaque)
+{
+    qemuNamespaceMknodData *data = opaque;
+    int ret;
 
-    if (isLink) {
-        g_autofree char *target = NULL;
+    qemuSecurityPostFork(data->driver->securityManager);
 
-        if ((target = g_file_read_link(data->file, NULL)) &&
-            STREQ(target, data->target)) {
-            VIR_DEBUG("Skipping symlink %s -> %s which exists and points to correct target",
-                      data->file, data->target);
-        } else {
-            VIR_DEBUG("Creating symlink %s -> %s", data->file, data->target);
-            existed = false;
-
-            /* First, unlink the symlink target. Symlinks change and
-             * therefore we have no guarantees that pre-existing
-             * symlink is still valid. */
-            if (unlink(data->file) < 0 &&
-                errno != ENOENT) {
-                virReportSystemError(errno,
-                                     _("Unable to remove symlink %1$s"),
-                                     data->file);
-                goto cleanup;
-            }
+    ret = qemuNamespaceMknodItems(data->items, data->nitems);
 
-            if (symlink(data->target, data->file) < 0) {
-                virReportSystemError(errno,
-                                     _("Unable to create symlink %1$s (pointing to %2$s)"),
-                                     data->file, data->target);
-                goto cleanup;
-            } else {
-                delDevice = true;
-            }
-        }
-    } else if (isDev) {
-        GStatBuf sb;
+    qemuNamespaceMknodDataClear(data);
+    return ret;
+}
 
-        if (g_lstat(data->file, &sb) >= 0 &&
-            sb.st_rdev == data->sb.st_rdev) {
-            VIR_DEBUG("Skipping dev %s (%d,%d) which exists and has correct MAJ:MIN",
-                       data->file, major(data->sb.st_rdev), minor(data->sb.st_rdev));
-        } else {
-            VIR_DEBUG("Creating dev %s (%d,%d)",
-                      data->file, major(data->sb.st_rdev), minor(data->sb.st_rdev));
-            existed = false;
-            unlink(data->file);
-            if (mknod(data->file, data->sb.st_mode, data->sb.st_rdev) < 0) {
-                virReportSystemError(errno,
-                                     _("Unable to create device %1$s"),
-                                     data->file);
-                goto cleanup;
-            } else {
-                delDevice = true;
-            }
-        }
-    } else if (isReg || isDir) {
-        /* We are not cleaning up disks on virDomainDetachDevice
-         * because disk might be still in use by different disk
-         * as its backing chain. This might however clash here.
-         * Therefore do the cleanup here. */
-        if (umount(data->file) < 0 &&
-            errno != ENOENT && errno != EINVAL) {
-            virReportSystemError(errno,
-                                 _("Unable to umount %1$s"),
-                                 data->file);
-            goto cleanup;
-        }
-        if ((isReg && virFileTouch(data->file, data->sb.st_mode) < 0) ||
-            (isDir && g_mkdir_with_parents(data->file, data->sb.st_mode) < 0))
-            goto cleanup;
-        delDevice = true;
-        /* Just create the file here so that code below sets
-         * proper owner and mode. Move the mount only after that. */
-    } else {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
-                       _("unsupported device type %1$s 0%2$o"),
-                       data->file, data->sb.st_mode);
-        goto cleanup;
-    }
 
-    if (!existed) {
-        if (lchown(data->file, data->sb.st_uid, data->sb.st_gid) < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to chown device %1$s"),
-                                 data->file);
-            goto cleanup;
-        }
+/*
+ * Forking the daemon for every single mknod/unlink done in the mount
+ * namespace of a running domain gets expensive with large daemons and
+ * frequent hotplug. Therefore, on the first hotplug the small
+ * libvirt_qemu_nshelper binary is executed. It enters the namespace
+ * and serves requests until the domain is stopped. Each request must
+ * be answered within QEMU_NAMESPACE_HELPER_TIMEOUT seconds, as callers
+ * hold the domain object lock. A helper that timed out is killed and
+ * the request fails; in all other cases where the helper can't be used
+ * (it failed to start, died, or sent garbage) it is stopped and callers
+ * fall back to forking per operation.
+ */
+#define QEMU_NAMESPACE_HELPER_TIMEOUT 30
 
-        /* Symlinks don't have mode */
-        if (!isLink &&
-            chmod(data->file, data->sb.st_mode) < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to set permissions for device %1$s"),
-                                 data->file);
-            goto cleanup;
-        }
 
-        if (data->acl &&
-            virFileSetACLs(data->file, data->acl) < 0 &&
-            errno != ENOTSUP) {
-            virReportSystemError(errno,
-                                 _("Unable to set ACLs on %1$s"), data->file);
-            goto cleanup;
-        }
+static int
+qemuNamespaceHelperStart(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *helper = NULL;
+    g_autofree char *path = NULL;
+    struct timeval tv = { .tv_sec = QEMU_NAMESPACE_HELPER_TIMEOUT };
+    int nsfd = -1;
+    int pair[2] = { -1, -1 };
+    pid_t child;
+
+    if (!(helper = virFileFindResource("libvirt_qemu_nshelper",
+                                       abs_top_builddir "/src/qemu",
+                                       LIBEXECDIR)))
+        return -1;
 
-# ifdef WITH_SELINUX
-        if (data->tcon &&
-            lsetfilecon_raw(data->file, (const char *)data->tcon) < 0) {
-            VIR_WARNINGS_NO_WLOGICALOP_EQUAL_EXPR
-            if (errno != EOPNOTSUPP && errno != ENOTSUP) {
-            VIR_WARNINGS_RESET
-                virReportSystemError(errno,
-                                     _("Unable to set SELinux label on %1$s"),
-                                     data->file);
-                goto cleanup;
-            }
-        }
-# endif
+    path = g_strdup_printf("/proc/%lld/ns/mnt", (long long) vm->pid);
+
+    if ((nsfd = open(path, O_RDONLY)) < 0) {
+        virReportSystemError(errno, _("Unable to open %1$s"), path);
+        return -1;
     }
 
-    /* Finish mount process started earlier. */
-    if ((isReg || isDir) &&
-        virFileMoveMount(data->target, data->file) < 0)
-        goto cleanup;
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create socket pair"));
+        VIR_FORCE_CLOSE(nsfd);
+        return -1;
+    }
 
-    ret = existed;
- cleanup:
-    if (ret < 0 && delDevice) {
-        if (isDir)
-            virFileDeleteTree(data->file);
-        else
-            unlink(data->file);
+    if (setsockopt(pair[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 ||
+        setsockopt(pair[0], SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set namespace helper socket timeout"));
+        VIR_FORCE_CLOSE(nsfd);
+        goto error;
     }
-    return ret;
+
+    cmd = virCommandNew(helper);
+    virCommandAddArgFormat(cmd, "%d", nsfd);
+    virCommandAddArgFormat(cmd, "%d", pair[1]);
+    virCommandPassFD(cmd, nsfd, VIR_COMMAND_PASS_FD_CLOSE_PARENT);
+    virCommandPassFD(cmd, pair[1], VIR_COMMAND_PASS_FD_CLOSE_PARENT);
+    pair[1] = -1;
+
+    if (virCommandRunAsync(cmd, &child) < 0)
+        goto error;
+
+    VIR_DEBUG("Started namespace helper %lld for domain %s",
+              (long long) child, vm->def->name);
+
+    priv->namespaceHelperPID = child;
+    priv->namespaceHelperFD = pair[0];
+    return 0;
+
+ error:
+    VIR_FORCE_CLOSE(pair[0]);
+    VIR_FORCE_CLOSE(pair[1]);
+    return -1;
 }
 
 
-static bool
-qemuNamespaceMknodItemNeedsBindMount(mode_t st_mode)
+/**
+ * qemuNamespaceHelperCall:
+ * @vm: domain object
+ * @request: request to execute
+ *
+ * Execute @request in the namespace helper of @vm, starting the helper
+ * if needed.
+ *
+ * Returns: the value returned by the helper on success,
+ *          -1 if the helper reported an error or didn't reply in time
+ *             (which is then raised),
+ *          -2 if the helper can't be used and the caller should fall
+ *             back to forking (no error is raised).
+ */
+static int
+qemuNamespaceHelperCall(virDomainObj *vm,
+                        virJSONValue *request)
 {
-    /* A block device S_ISBLK() or a chardev S_ISCHR() is intentionally not
-     * handled.  We want to mknod() it instead of passing in through bind
-     * mounting. */
-    return S_ISREG(st_mode) || S_ISFIFO(st_mode) ||
-           S_ISSOCK(st_mode) || S_ISDIR(st_mode);
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virJSONValue) reply = NULL;
+    int ret;
+
+    if (priv->namespaceHelperFD < 0 &&
+        qemuNamespaceHelperStart(vm) < 0)
+        goto fallback;
+
+    if (qemuNamespaceHelperSend(priv->namespaceHelperFD, request) < 0 ||
+        !(reply = qemuNamespaceHelperRecv(priv->namespaceHelperFD))) {
+        /* Forking would most likely get stuck the same way */
+        if (virGetLastErrorCode() == VIR_ERR_OPERATION_TIMEOUT) {
+            virErrorPtr err;
+
+            virErrorPreserveLast(&err);
+            qemuNamespaceHelperStop(vm);
+            virErrorRestore(&err);
+            return -1;
+        }
+        goto fallback;
+    }
+
+    if ((ret = qemuNamespaceHelperParseReply(reply)) == -2)
+        goto fallback;
+
+    return ret;
+
+ fallback:
+    VIR_WARN("Namespace helper of domain %s is unusable, falling back to fork: %s",
+             vm->def->name, virGetLastErrorMessage());
+    virResetLastError();
+    qemuNamespaceHelperStop(vm);
+    return -2;
 }
 
 
 static int
-qemuNamespaceMknodHelper(pid_t pid G_GNUC_UNUSED,
-                         void *opaque)
+qemuNamespaceHelperMknod(virDomainObj *vm,
+                         qemuNamespaceMknodData *data)
 {
-    qemuNamespaceMknodData *data = opaque;
+    g_autoptr(virJSONValue) items = virJSONValueNewArray();
+    g_autoptr(virJSONValue) request = NULL;
     size_t i;
-    int ret = -1;
-    bool exists = false;
-
-    qemuSecurityPostFork(data->driver->securityManager);
 
     for (i = 0; i < data->nitems; i++) {
-        int rc = 0;
+        g_autoptr(virJSONValue) item = NULL;
 
-        if ((rc = qemuNamespaceMknodOne(&data->items[i])) < 0)
-            goto cleanup;
+        if (!(item = qemuNamespaceMknodItemFormat(&data->items[i])) ||
+            virJSONValueArrayAppend(items, &item) < 0)
+            return -1;
+    }
+
+    if (virJSONValueObjectAdd(&request,
+                              "s:execute", "mknod",
+                              "a:items", &items,
+                              NULL) < 0)
+        return -1;
 
-        if (rc > 0)
-            exists = true;
+    return qemuNamespaceHelperCall(vm, request);
+}
+
+
+static int
+qemuNamespaceHelperUnlink(virDomainObj *vm,
+                          GSList *paths)
+{
+    g_autoptr(virJSONValue) array = virJSONValueNewArray();
+    g_autoptr(virJSONValue) request = NULL;
+    GSList *next;
+
+    for (next = paths; next; next = next->next) {
+        if (virJSONValueArrayAppendString(array, next->data) < 0)
+            return -1;
     }
 
-    ret = exists;
- cleanup:
-    qemuNamespaceMknodDataClear(data);
-    return ret;
+    if (virJSONValueObjectAdd(&request,
+                              "s:execute", "unlink",
+                              "a:paths", &array,
+                              NULL) < 0)
+        return -1;
+
+    return qemuNamespaceHelperCall(vm, request);
 }
 
 
@@ -1336,9 +1345,10 @@ qemuNamespacePrepareOneItem(qemuNamespaceMknodData *data,
 
 
 static int
-qemuNamespaceMknodPaths(virDomainObj *vm,
-                        GSList *paths,
-                        bool *created)
+qemuNamespaceMknodPathsFull(virDomainObj *vm,
+                            GSList *paths,
+                            bool useHelper,
+                            bool *created)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     virQEMUDriver *driver = priv->driver;
@@ -1379,12 +1389,21 @@ qemuNamespaceMknodPaths(virDomainObj *vm,
         }
     }
 
-    if (qemuSecurityPreFork(driver->securityManager) < 0)
-        goto cleanup;
+    if (useHelper)
+        ret = qemuNamespaceHelperMknod(vm, &data);
+    else
+        ret = -2;
 
-    ret = virProcessRunInMountNamespace(vm->pid, qemuNamespaceMknodHelper,
-                                        &data);
-    qemuSecurityPostFork(driver->securityManager);
+    if (ret == -2) {
+        if (qemuSecurityPreFork(driver->securityManager) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+
+        ret = virProcessRunInMountNamespace(vm->pid, qemuNamespaceMknodHelper,
+                                            &data);
+        qemuSecurityPostFork(driver->securityManager);
+    }
 
     if (ret == 0 && created != NULL)
         *created = true;
@@ -1405,9 +1424,10 @@ qemuNamespaceMknodPaths(virDomainObj *vm,
 
 
 static int
-qemuNamespaceMknodPaths(virDomainObj *vm G_GNUC_UNUSED,
-                        GSList *paths G_GNUC_UNUSED,
-                        bool *created G_GNUC_UNUSED)
+qemuNamespaceMknodPathsFull(virDomainObj *vm G_GNUC_UNUSED,
+                            GSList *paths G_GNUC_UNUSED,
+                            bool useHelper G_GNUC_UNUSED,
+                            bool *created G_GNUC_UNUSED)
 {
     virReportSystemError(ENOSYS, "%s",
                          _("Namespaces are not supported on this platform"));
@@ -1415,9 +1435,26 @@ qemuNamespaceMknodPaths(virDomainObj *vm G_GNUC_UNUSED,
 }
 
 
+static int
+qemuNamespaceHelperUnlink(virDomainObj *vm G_GNUC_UNUSED,
+                          GSList *paths G_GNUC_UNUSED)
+{
+    return -2;
+}
+
+
 #endif /* !defined(__linux__) */
 
 
+static int
+qemuNamespaceMknodPaths(virDomainObj *vm,
+                        GSList *paths,
+                        bool *created)
+{
+    return qemuNamespaceMknodPathsFull(vm, paths, true, created);
+}
+
+
 static int
 qemuNamespaceUnlinkHelper(pid_t pid G_GNUC_UNUSED,
                           void *opaque)
@@ -1426,14 +1463,8 @@ qemuNamespaceUnlinkHelper(pid_t pid G_GNUC_UNUSED,
     GSList *next;
 
     for (next = paths; next; next = next->next) {
-        const char *path = next->data;
-
-        VIR_DEBUG("Unlinking %s", path);
-        if (unlink(path) < 0 && errno != ENOENT) {
-            virReportSystemError(errno,
-                                 _("Unable to remove device %1$s"), path);
+        if (qemuNamespaceUnlinkOne(next->data) < 0)
             return -1;
-        }
     }
 
     return 0;
@@ -1490,11 +1521,16 @@ qemuNamespaceUnlinkPaths(virDomainObj *vm,
         }
     }
 
-    if (unlinkPaths &&
-        virProcessRunInMountNamespace(vm->pid,
-                                      qemuNamespaceUnlinkHelper,
-                                      unlinkPaths) < 0)
-        return -1;
+    if (unlinkPaths) {
+        int rc = qemuNamespaceHelperUnlink(vm, unlinkPaths);
+
+        if (rc == -2)
+            rc = virProcessRunInMountNamespace(vm->pid,
+                                               qemuNamespaceUnlinkHelper,
+                                               unlinkPaths);
+        if (rc < 0)
+            return -1;
+    }
 
     return 0;
 }
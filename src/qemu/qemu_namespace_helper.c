@@ -0,0 +1,547 @@
+/*
+ * qemu_namespace_helper.c: QEMU namespace helper protocol and operations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#ifdef __linux__
+# include <sys/sysmacros.h>
+#endif
+#if defined(WITH_SYS_MOUNT_H)
+# include <sys/mount.h>
+#endif
+#ifdef WITH_SELINUX
+# include <selinux/selinux.h>
+#endif
+
+#include "qemu_namespace_helper.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_namespace_helper");
+
+
+void
+qemuNamespaceMknodItemClear(qemuNamespaceMknodItem *item)
+{
+    VIR_FREE(item->file);
+    VIR_FREE(item->target);
+    virFileFreeACLs(&item->acl);
+#ifdef WITH_SELINUX
+    freecon(item->tcon);
+#endif
+}
+
+
+int
+qemuNamespaceUnlinkOne(const char *path)
+{
+    VIR_DEBUG("Unlinking %s", path);
+    if (unlink(path) < 0 && errno != ENOENT) {
+        virReportSystemError(errno,
+                             _("Unable to remove device %1$s"), path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Our way of creating devices is highly linux specific */
+#if defined(__linux__)
+static int
+qemuNamespaceMknodOne(qemuNamespaceMknodItem *data)
+{
+    int ret = -1;
+    bool delDevice = false;
+    bool isLink = S_ISLNK(data->sb.st_mode);
+    bool isDev = S_ISCHR(data->sb.st_mode) || S_ISBLK(data->sb.st_mode);
+    bool isReg = S_ISREG(data->sb.st_mode) || S_ISFIFO(data->sb.st_mode) || S_ISSOCK(data->sb.st_mode);
+    bool isDir = S_ISDIR(data->sb.st_mode);
+    bool existed = false;
+
+    if (virFileExists(data->file))
+        existed = true;
+
+    if (virFileMakeParentPath(data->file) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to create %1$s"), data->file);
+        goto cleanup;
+    }
+
+    if (isLink) {
+        g_autofree char *target = NULL;
+
+        if ((target = g_file_read_link(data->file, NULL)) &&
+            STREQ(target, data->target)) {
+            VIR_DEBUG("Skipping symlink %s -> %s which exists and points to correct target",
+                      data->file, data->target);
+        } else {
+            VIR_DEBUG("Creating symlink %s -> %s", data->file, data->target);
+            existed = false;
+
+            /* First, unlink the symlink target. Symlinks change and
+             * therefore we have no guarantees that pre-existing
+             * symlink is still valid. */
+            if (unlink(data->file) < 0 &&
+                errno != ENOENT) {
+                virReportSystemError(errno,
+                                     _("Unable to remove symlink %1$s"),
+                                     data->file);
+                goto cleanup;
+            }
+
+            if (symlink(data->target, data->file) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to create symlink %1$s (pointing to %2$s)"),
+                                     data->file, data->target);
+                goto cleanup;
+            } else {
+                delDevice = true;
+            }
+        }
+    } else if (isDev) {
+        GStatBuf sb;
+
+        if (g_lstat(data->file, &sb) >= 0 &&
+            sb.st_rdev == data->sb.st_rdev) {
+            VIR_DEBUG("Skipping dev %s (%d,%d) which exists and has correct MAJ:MIN",
+                       data->file, major(data->sb.st_rdev), minor(data->sb.st_rdev));
+        } else {
+            VIR_DEBUG("Creating dev %s (%d,%d)",
+                      data->file, major(data->sb.st_rdev), minor(data->sb.st_rdev));
+            existed = false;
+            unlink(data->file);
+            if (mknod(data->file, data->sb.st_mode, data->sb.st_rdev) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to create device %1$s"),
+                                     data->file);
+                goto cleanup;
+            } else {
+                delDevice = true;
+            }
+        }
+    } else if (isReg || isDir) {
+        /* We are not cleaning up disks on virDomainDetachDevice
+         * because disk might be still in use by different disk
+         * as its backing chain. This might however clash here.
+         * Therefore do the cleanup here. */
+        if (umount(data->file) < 0 &&
+            errno != ENOENT && errno != EINVAL) {
+            virReportSystemError(errno,
+                                 _("Unable to umount %1$s"),
+                                 data->file);
+            goto cleanup;
+        }
+        if ((isReg && virFileTouch(data->file, data->sb.st_mode) < 0) ||
+            (isDir && g_mkdir_with_parents(data->file, data->sb.st_mode) < 0))
+            goto cleanup;
+        delDevice = true;
+        /* Just create the file here so that code below sets
+         * proper owner and mode. Move the mount only after that. */
+    } else {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("unsupported device type %1$s 0%2$o"),
+                       data->file, data->sb.st_mode);
+        goto cleanup;
+    }
+
+    if (!existed) {
+        if (lchown(data->file, data->sb.st_uid, data->sb.st_gid) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to chown device %1$s"),
+                                 data->file);
+            goto cleanup;
+        }
+
+        /* Symlinks don't have mode */
+        if (!isLink &&
+            chmod(data->file, data->sb.st_mode) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to set permissions for device %1$s"),
+                                 data->file);
+            goto cleanup;
+        }
+
+        if (data->acl &&
+            virFileSetACLs(data->file, data->acl) < 0 &&
+            errno != ENOTSUP) {
+            virReportSystemError(errno,
+                                 _("Unable to set ACLs on %1$s"), data->file);
+            goto cleanup;
+        }
+
+# ifdef WITH_SELINUX
+        if (data->tcon &&
+            lsetfilecon_raw(data->file, (const char *)data->tcon) < 0) {
+            VIR_WARNINGS_NO_WLOGICALOP_EQUAL_EXPR
+            if (errno != EOPNOTSUPP && errno != ENOTSUP) {
+            VIR_WARNINGS_RESET
+                virReportSystemError(errno,
+                                     _("Unable to set SELinux label on %1$s"),
+                                     data->file);
+                goto cleanup;
+            }
+        }
+# endif
+    }
+
+    /* Finish mount process started earlier. */
+    if ((isReg || isDir) &&
+        virFileMoveMount(data->target, data->file) < 0)
+        goto cleanup;
+
+    ret = existed;
+ cleanup:
+    if (ret < 0 && delDevice) {
+        if (isDir)
+            virFileDeleteTree(data->file);
+        else
+            unlink(data->file);
+    }
+    return ret;
+}
+
+
+int
+qemuNamespaceMknodItems(qemuNamespaceMknodItem *items,
+                        size_t nitems)
+{
+    size_t i;
+    bool exists = false;
+
+    for (i = 0; i < nitems; i++) {
+        int rc = 0;
+
+        if ((rc = qemuNamespaceMknodOne(&items[i])) < 0)
+            return -1;
+
+        if (rc > 0)
+            exists = true;
+    }
+
+    return exists;
+}
+
+
+/*
+ * Requests and replies are exchanged between the daemon and
+ * libvirt_qemu_nshelper as length prefixed JSON documents over a
+ * socketpair. The daemon's end of the socket has a send and receive
+ * timeout set, in which case the I/O fails with EAGAIN and
+ * VIR_ERR_OPERATION_TIMEOUT is reported.
+ */
+#define QEMU_NAMESPACE_HELPER_MAX_MSG (16 * 1024 * 1024)
+
+
+int
+qemuNamespaceHelperSend(int fd,
+                        virJSONValue *msg)
+{
+    g_autofree char *str = NULL;
+    uint32_t len;
+
+    if (!(str = virJSONValueToString(msg, false)))
+        return -1;
+
+    len = strlen(str);
+
+    if (safewrite(fd, &len, sizeof(len)) < 0 ||
+        safewrite(fd, str, len) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("timed out writing to namespace helper"));
+        else
+            virReportSystemError(errno, "%s",
+                                 _("Unable to write to namespace helper"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+virJSONValue *
+qemuNamespaceHelperRecv(int fd)
+{
+    g_autofree char *str = NULL;
+    uint32_t len;
+    ssize_t got;
+
+    if ((got = saferead(fd, &len, sizeof(len))) != (ssize_t) sizeof(len))
+        goto error;
+
+    if (len > QEMU_NAMESPACE_HELPER_MAX_MSG) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("namespace helper message too large: %1$u bytes"),
+                       len);
+        return NULL;
+    }
+
+    str = g_new0(char, len + 1);
+    if ((got = saferead(fd, str, len)) != (ssize_t) len)
+        goto error;
+
+    return virJSONValueFromString(str);
+
+ error:
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                       _("timed out waiting for namespace helper"));
+    else if (got < 0)
+        virReportSystemError(errno, "%s",
+                             _("Unable to read from namespace helper"));
+    else
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("namespace helper closed connection"));
+    return NULL;
+}
+
+
+virJSONValue *
+qemuNamespaceMknodItemFormat(qemuNamespaceMknodItem *item)
+{
+    g_autoptr(virJSONValue) ret = NULL;
+    g_autofree char *acl = NULL;
+
+    if (item->acl &&
+        !(acl = virFileFormatACLs(item->acl))) {
+        virReportSystemError(errno,
+                             _("Unable to format ACLs of %1$s"), item->file);
+        return NULL;
+    }
+
+    if (virJSONValueObjectAdd(&ret,
+                              "s:file", item->file,
+                              "S:target", item->target,
+                              "u:mode", (unsigned int) item->sb.st_mode,
+                              "U:rdev", (unsigned long long) item->sb.st_rdev,
+                              "u:uid", (unsigned int) item->sb.st_uid,
+                              "u:gid", (unsigned int) item->sb.st_gid,
+                              "S:acl", acl,
+                              "S:tcon", item->tcon,
+                              NULL) < 0)
+        return NULL;
+
+    return g_steal_pointer(&ret);
+}
+
+
+int
+qemuNamespaceMknodItemParse(virJSONValue *json,
+                            qemuNamespaceMknodItem *item)
+{
+    const char *file = virJSONValueObjectGetString(json, "file");
+    const char *acl = virJSONValueObjectGetString(json, "acl");
+    unsigned int mode;
+    unsigned long long rdev;
+    unsigned int uid;
+    unsigned int gid;
+
+    if (!file ||
+        virJSONValueObjectGetNumberUint(json, "mode", &mode) < 0 ||
+        virJSONValueObjectGetNumberUlong(json, "rdev", &rdev) < 0 ||
+        virJSONValueObjectGetNumberUint(json, "uid", &uid) < 0 ||
+        virJSONValueObjectGetNumberUint(json, "gid", &gid) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed namespace helper request"));
+        return -1;
+    }
+
+    item->file = g_strdup(file);
+    item->target = g_strdup(virJSONValueObjectGetString(json, "target"));
+    item->sb.st_mode = mode;
+    item->sb.st_rdev = rdev;
+    item->sb.st_uid = uid;
+    item->sb.st_gid = gid;
+
+    if (acl &&
+        virFileParseACLs(acl, &item->acl) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to parse ACLs of %1$s"), file);
+        return -1;
+    }
+
+# ifdef WITH_SELINUX
+    item->tcon = g_strdup(virJSONValueObjectGetString(json, "tcon"));
+# endif
+
+    return 0;
+}
+
+
+static int
+qemuNamespaceHelperDispatchMknod(virJSONValue *array)
+{
+    size_t nitems = virJSONValueArraySize(array);
+    qemuNamespaceMknodItem *items = g_new0(qemuNamespaceMknodItem, nitems);
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < nitems; i++) {
+        if (qemuNamespaceMknodItemParse(virJSONValueArrayGet(array, i),
+                                        &items[i]) < 0)
+            goto cleanup;
+    }
+
+    ret = qemuNamespaceMknodItems(items, nitems);
+
+ cleanup:
+    for (i = 0; i < nitems; i++)
+        qemuNamespaceMknodItemClear(&items[i]);
+    g_free(items);
+    return ret;
+}
+
+
+static int
+qemuNamespaceHelperDispatchUnlink(virJSONValue *paths)
+{
+    size_t i;
+
+    for (i = 0; i < virJSONValueArraySize(paths); i++) {
+        const char *path = virJSONValueGetString(virJSONValueArrayGet(paths, i));
+
+        if (!path) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("malformed namespace helper request"));
+            return -1;
+        }
+
+        if (qemuNamespaceUnlinkOne(path) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuNamespaceHelperDispatch(virJSONValue *request)
+{
+    const char *cmd = virJSONValueObjectGetString(request, "execute");
+    virJSONValue *args;
+
+    if (STREQ_NULLABLE(cmd, "mknod") &&
+        (args = virJSONValueObjectGetArray(request, "items")))
+        return qemuNamespaceHelperDispatchMknod(args);
+
+    if (STREQ_NULLABLE(cmd, "unlink") &&
+        (args = virJSONValueObjectGetArray(request, "paths")))
+        return qemuNamespaceHelperDispatchUnlink(args);
+
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("unknown namespace helper request '%1$s'"),
+                   NULLSTR(cmd));
+    return -1;
+}
+
+
+virJSONValue *
+qemuNamespaceHelperFormatReply(int rc)
+{
+    g_autoptr(virJSONValue) reply = NULL;
+    g_autoptr(virJSONValue) error = NULL;
+    virErrorPtr err;
+
+    if (rc >= 0) {
+        if (virJSONValueObjectAdd(&reply, "i:return", rc, NULL) < 0)
+            return NULL;
+
+        return g_steal_pointer(&reply);
+    }
+
+    err = virGetLastError();
+    if (virJSONValueObjectAdd(&error,
+                              "i:code", err ? err->code : VIR_ERR_INTERNAL_ERROR,
+                              "i:domain", err ? err->domain : VIR_FROM_THIS,
+                              "s:message", err && err->message ? err->message : _("unknown error"),
+                              NULL) < 0 ||
+        virJSONValueObjectAdd(&reply, "a:error", &error, NULL) < 0)
+        return NULL;
+
+    return g_steal_pointer(&reply);
+}
+
+
+void
+qemuNamespaceHelperRun(int fd)
+{
+    while (true) {
+        g_autoptr(virJSONValue) request = NULL;
+        g_autoptr(virJSONValue) reply = NULL;
+        int rc;
+
+        if (!(request = qemuNamespaceHelperRecv(fd)))
+            break;
+
+        rc = qemuNamespaceHelperDispatch(request);
+
+        if (!(reply = qemuNamespaceHelperFormatReply(rc)))
+            break;
+        virResetLastError();
+
+        if (qemuNamespaceHelperSend(fd, reply) < 0)
+            break;
+    }
+}
+
+
+/**
+ * qemuNamespaceHelperParseReply:
+ * @reply: reply formatted by qemuNamespaceHelperFormatReply()
+ *
+ * Returns: the value returned by the helper on success,
+ *          -1 if the helper reported an error (which is then raised),
+ *          -2 if @reply is malformed (with error reported).
+ */
+int
+qemuNamespaceHelperParseReply(virJSONValue *reply)
+{
+    virJSONValue *error;
+    int ret;
+
+    if ((error = virJSONValueObjectGetObject(reply, "error"))) {
+        int code = VIR_ERR_INTERNAL_ERROR;
+        int domain = VIR_FROM_THIS;
+
+        ignore_value(virJSONValueObjectGetNumberInt(error, "code", &code));
+        ignore_value(virJSONValueObjectGetNumberInt(error, "domain", &domain));
+
+        virRaiseErrorFull(__FILE__, __FUNCTION__, __LINE__,
+                          domain, code, VIR_ERR_ERROR,
+                          NULL, NULL, NULL, -1, -1,
+                          "%s", NULLSTR(virJSONValueObjectGetString(error, "message")));
+        return -1;
+    }
+
+    if (virJSONValueObjectGetNumberInt(reply, "return", &ret) < 0 ||
+        ret < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed reply from namespace helper"));
+        return -2;
+    }
+
+    return ret;
+}
+
+#endif /* defined(__linux__) */
@@ -0,0 +1,71 @@
+/*
+ * qemu_namespace_helper.h: QEMU namespace helper protocol and operations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virjson.h"
+
+/* This file is compiled into both the QEMU driver and the
+ * libvirt_qemu_nshelper binary, so it must not depend on
+ * anything but src/util. */
+
+typedef struct _qemuNamespaceMknodItem qemuNamespaceMknodItem;
+struct _qemuNamespaceMknodItem {
+    char *file;
+    char *target;
+    bool bindmounted;
+    GStatBuf sb;
+    void *acl;
+    char *tcon;
+};
+
+void
+qemuNamespaceMknodItemClear(qemuNamespaceMknodItem *item);
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(qemuNamespaceMknodItem, qemuNamespaceMknodItemClear);
+
+int
+qemuNamespaceUnlinkOne(const char *path);
+
+int
+qemuNamespaceMknodItems(qemuNamespaceMknodItem *items,
+                        size_t nitems);
+
+int
+qemuNamespaceHelperSend(int fd,
+                        virJSONValue *msg);
+
+virJSONValue *
+qemuNamespaceHelperRecv(int fd);
+
+virJSONValue *
+qemuNamespaceMknodItemFormat(qemuNamespaceMknodItem *item);
+
+int
+qemuNamespaceMknodItemParse(virJSONValue *json,
+                            qemuNamespaceMknodItem *item);
+
+virJSONValue *
+qemuNamespaceHelperFormatReply(int rc);
+
+int
+qemuNamespaceHelperParseReply(virJSONValue *reply);
+
+void
+qemuNamespaceHelperRun(int fd);
@@ -0,0 +1,34 @@
+/*
+ * qemu_namespacepriv.h: private declarations for QEMU namespace helper
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_QEMU_NAMESPACEPRIV_H_ALLOW
+# error "qemu_namespacepriv.h may only be included by qemu_namespace.c or test suites"
+#endif /* LIBVIRT_QEMU_NAMESPACEPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_conf.h"
+#include "qemu_namespace_helper.h"
+
+typedef struct _qemuNamespaceMknodData qemuNamespaceMknodData;
+struct _qemuNamespaceMknodData {
+    virQEMUDriver *driver;
+    virDomainObj *vm;
+    qemuNamespaceMknodItem *items;
+    size_t nitems;
+};
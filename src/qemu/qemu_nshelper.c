@@ -0,0 +1,83 @@
+/*
+ * qemu_nshelper.c: Helper serving mknod/unlink requests in the mount
+ *                  namespace of a QEMU domain
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The QEMU driver executes this helper on the first hotplug that needs
+ * to create or remove a path in the mount namespace of a domain. The
+ * helper enters the namespace given as an FD and then serves requests
+ * sent over a socket until the daemon closes it.
+ */
+
+#include <config.h>
+
+#include "qemu_namespace_helper.h"
+#include "virerror.h"
+#include "virgettext.h"
+#include "virprocess.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+static const char *program_name;
+
+G_GNUC_NORETURN static void
+usage(int status)
+{
+    if (status) {
+        fprintf(stderr, _("%1$s: try --help for more details"), program_name);
+    } else {
+        printf(_("Usage: %1$s NSFD SOCKETFD"), program_name);
+    }
+    exit(status);
+}
+
+int
+main(int argc, char **argv)
+{
+    int nsfd = -1;
+    int sockfd = -1;
+
+    program_name = argv[0];
+
+    if (virGettextInitialize() < 0 ||
+        virErrorInitialize() < 0) {
+        fprintf(stderr, _("%1$s: initialization failed"), program_name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc > 1 && STREQ(argv[1], "--help"))
+        usage(EXIT_SUCCESS);
+    if (argc != 3)
+        usage(EXIT_FAILURE);
+
+    if (virStrToLong_i(argv[1], NULL, 10, &nsfd) < 0 || nsfd < 0 ||
+        virStrToLong_i(argv[2], NULL, 10, &sockfd) < 0 || sockfd < 0) {
+        fprintf(stderr, _("%1$s: malformed fd"), program_name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (virProcessSetNamespaces(1, &nsfd) < 0) {
+        fprintf(stderr, _("%1$s: failed to enter namespace: %2$s"),
+                program_name, virGetLastErrorMessage());
+        exit(EXIT_FAILURE);
+    }
+    VIR_FORCE_CLOSE(nsfd);
+
+    qemuNamespaceHelperRun(sockfd);
+
+    return 0;
+}
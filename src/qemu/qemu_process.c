@@ -99,6 +99,7 @@
 #include "virvsock.h"
 #include "viridentity.h"
 #include "virthreadjob.h"
+#include "virmetrics.h"
 #include "virutil.h"
 #include "storage_source.h"
 #include "backup_conf.h"
@@ -274,7 +275,8 @@ qemuConnectAgent(virQEMUDriver *driver, virDomainObj *vm)
  * @data: additional data for the event processor (the pointer is stolen and it
  *        will be properly freed
  *
- * Submits @eventType to be processed by the asynchronous event handling thread.
+ * Submits @eventType to be processed by the asynchronous event handling
+ * worker pool. Events of @vm are processed in the order they are submitted.
  */
 static void
 qemuProcessEventSubmit(virDomainObj *vm,
@@ -284,7 +286,6 @@ qemuProcessEventSubmit(virDomainObj *vm,
                        void *data)
 {
     struct qemuProcessEvent *event = g_new0(struct qemuProcessEvent, 1);
-    virQEMUDriver *driver = QEMU_DOMAIN_PRIVATE(vm)->driver;
 
     event->vm = virObjectRef(vm);
     event->eventType = eventType;
@@ -292,10 +293,7 @@ qemuProcessEventSubmit(virDomainObj *vm,
     event->status = status;
     event->data = data;
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, event) < 0) {
-        virObjectUnref(event->vm);
-        qemuProcessEventFree(event);
-    }
+    qemuDomainEventQueuePush(vm, event);
 }
 
 
@@ -4956,6 +4954,116 @@ qemuLogOperation(virDomainObj *vm,
 }
 
 
+/* Records how long preparing disks and setting security labels took into
+ * the domain log. The messages are written after the log position was
+ * marked for reading errors of QEMU, so the mark is moved past them. */
+static void
+qemuProcessLogPrepareTime(virDomainObj *vm,
+                          domainLogContext *logCtxt)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    unsigned long long labelTime;
+    g_autofree char *timestamp = NULL;
+
+    if (!(timestamp = virTimeStringNow()))
+        return;
+
+    labelTime = priv->startup.phases[QEMU_DOMAIN_STARTUP_PHASE_SECURITY_LABELS] / 1000;
+
+    if (domainLogContextWrite(logCtxt,
+                              "%s: prepared %zu disks in %llu ms, "
+                              "set security labels in %llu ms\n",
+                              timestamp, vm->def->ndisks,
+                              priv->prepareStorageTime, labelTime) < 0)
+        return;
+
+    domainLogContextMarkPosition(logCtxt);
+}
+
+
+/* Starts measuring time spent in a phase of starting the domain. */
+static void
+qemuProcessStartupPhaseBegin(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    priv->startupPhaseStart = g_get_monotonic_time();
+}
+
+
+/* Accounts the time since the last phase began or ended to @phase and
+ * starts measuring the following phase. */
+static void
+qemuProcessStartupPhaseEnd(virDomainObj *vm,
+                           qemuDomainStartupPhase phase)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    unsigned long long now = g_get_monotonic_time();
+
+    priv->startup.phases[phase] += now - priv->startupPhaseStart;
+    priv->startupPhaseStart = now;
+}
+
+
+/**
+ * qemuProcessStartupRecord:
+ * @vm: domain object
+ *
+ * Marks the time spent in individual phases of starting @vm as complete and
+ * adds it to the qemu.startup.* histograms. Phases which didn't happen
+ * during the start are not recorded.
+ */
+void
+qemuProcessStartupRecord(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    unsigned long long total = 0;
+    size_t i;
+
+    priv->startup.set = true;
+
+    for (i = 0; i < QEMU_DOMAIN_STARTUP_PHASE_LAST; i++) {
+        const char *phase = qemuDomainStartupPhaseTypeToString(i);
+
+        if (priv->startup.phases[i] == 0)
+            continue;
+
+        VIR_DEBUG("Domain %s startup phase '%s' took %llu us",
+                  vm->def->name, phase, priv->startup.phases[i]);
+
+        virMetricsHistogramAdd(virMetricsHistogramGet("qemu.startup.%s", phase),
+                               priv->startup.phases[i]);
+        total += priv->startup.phases[i];
+    }
+
+    virMetricsHistogramAdd(virMetricsHistogramGet("qemu.startup.total"), total);
+}
+
+
+/* Reports the startup phases of @vm as a completed job, which can be
+ * queried using virDomainGetJobStats. */
+static void
+qemuProcessStartupSetCompletedJob(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuDomainJobDataPrivate *privData;
+
+    if (!vm->job->current)
+        return;
+
+    qemuDomainJobDataUpdateTime(vm->job->current);
+
+    g_clear_pointer(&vm->job->completed, virDomainJobDataFree);
+    vm->job->completed = virDomainJobDataCopy(vm->job->current);
+    vm->job->completed->status = VIR_DOMAIN_JOB_STATUS_COMPLETED;
+    qemuDomainJobSetStatsType(vm->job->completed,
+                              QEMU_DOMAIN_JOB_STATS_TYPE_STARTUP);
+
+    privData = vm->job->completed->privateData;
+    privData->startup = priv->startup;
+}
+
+
 void
 qemuProcessIncomingDefFree(qemuProcessIncomingDef *inc)
 {
@@ -5848,6 +5956,9 @@ qemuProcessInit(virQEMUDriver *driver,
         return -1;
     }
 
+    memset(&priv->startup, 0, sizeof(priv->startup));
+    qemuProcessStartupPhaseBegin(vm);
+
     /* in case when the post parse callback failed we need to re-run it on the
      * old config prior we start the VM */
     if (vm->def->postParseFailed) {
@@ -5862,6 +5973,8 @@ qemuProcessInit(virQEMUDriver *driver,
     if (qemuProcessPrepareQEMUCaps(vm, driver->qemuCapsCache) < 0)
         return -1;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_CAPABILITIES);
+
     qemuDomainUpdateCPU(vm, updatedCPU, &origCPU);
 
     if (qemuProcessStartValidate(driver, vm, priv->qemuCaps, flags) < 0)
@@ -5899,6 +6012,8 @@ qemuProcessInit(virQEMUDriver *driver,
         priv->origCPU = g_steal_pointer(&origCPU);
     }
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_INIT);
+
     return 0;
 
  stop:
@@ -6575,33 +6690,72 @@ qemuProcessUpdateGuestCPU(virDomainDef *def,
 }
 
 
+/* Size of huge pages backing @def in KiB or 0 if it isn't backed by huge
+ * pages. If different sizes are used for guest NUMA nodes the first one is
+ * used for placement. */
+static unsigned long long
+qemuProcessGetPlacementHugepageSize(virQEMUDriverConfig *cfg,
+                                    virDomainDef *def)
+{
+    virHugeTLBFS *deflt;
+
+    if (def->mem.nhugepages == 0)
+        return 0;
+
+    if (def->mem.hugepages[0].size != 0)
+        return def->mem.hugepages[0].size;
+
+    if (!(deflt = virFileGetDefaultHugepage(cfg->hugetlbfs, cfg->nhugetlbfs)))
+        return 0;
+
+    return deflt->size;
+}
+
+
 static int
 qemuProcessPrepareDomainNUMAPlacement(virDomainObj *vm)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(priv->driver);
     g_autofree char *nodeset = NULL;
     g_autoptr(virBitmap) numadNodeset = NULL;
     g_autoptr(virBitmap) hostMemoryNodeset = NULL;
     g_autoptr(virCapsHostNUMA) caps = NULL;
 
-    /* Get the advisory nodeset from numad if 'placement' of
-     * either <vcpu> or <numatune> is 'auto'.
+    /* Get the advisory nodeset from numad or the built-in placement
+     * engine if 'placement' of either <vcpu> or <numatune> is 'auto'.
      */
     if (!virDomainDefNeedsPlacementAdvice(vm->def))
         return 0;
 
-    nodeset = virNumaGetAutoPlacementAdvice(virDomainDefGetVcpus(vm->def),
-                                            virDomainDefGetMemoryTotal(vm->def));
+    if (cfg->numaPlacementBuiltin) {
+        char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if (!nodeset)
-        return -1;
+        virUUIDFormat(vm->def->uuid, uuidstr);
 
-    if (!(hostMemoryNodeset = virNumaGetHostMemoryNodeset()))
-        return -1;
+        if (!(numadNodeset = virNumaPlacementPlace(priv->driver->numaPlacement,
+                                                   uuidstr,
+                                                   virDomainDefGetVcpus(vm->def),
+                                                   virDomainDefGetMemoryTotal(vm->def),
+                                                   qemuProcessGetPlacementHugepageSize(cfg, vm->def))))
+            return -1;
+
+        nodeset = virBitmapFormat(numadNodeset);
+        VIR_DEBUG("Nodeset chosen by built-in placement: %s", nodeset);
+    } else {
+        nodeset = virNumaGetAutoPlacementAdvice(virDomainDefGetVcpus(vm->def),
+                                                virDomainDefGetMemoryTotal(vm->def));
+
+        if (!nodeset)
+            return -1;
 
-    VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
+        VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
 
-    if (virBitmapParse(nodeset, &numadNodeset, VIR_DOMAIN_CPUMASK_LEN) < 0)
+        if (virBitmapParse(nodeset, &numadNodeset, VIR_DOMAIN_CPUMASK_LEN) < 0)
+            return -1;
+    }
+
+    if (!(hostMemoryNodeset = virNumaGetHostMemoryNodeset()))
         return -1;
 
     if (!(caps = virCapabilitiesHostNUMANewHost()))
@@ -6930,6 +7084,8 @@ qemuProcessPrepareDomain(virQEMUDriver *driver,
     qemuDomainObjPrivate *priv = vm->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
+    qemuProcessStartupPhaseBegin(vm);
+
     priv->machineName = qemuDomainGetMachineName(vm);
     if (!priv->machineName)
         return -1;
@@ -7065,6 +7221,8 @@ qemuProcessPrepareDomain(virQEMUDriver *driver,
         }
     }
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_PREPARE_DOMAIN);
+
     return 0;
 }
 
@@ -7268,50 +7426,114 @@ qemuProcessPrepareHostStorageDisk(virDomainObj *vm,
 }
 
 
+/* Maximum number of disks whose backing chains are probed in parallel */
+#define QEMU_PROCESS_DISK_PROBE_WORKERS 8
+
+typedef struct _qemuProcessDiskProbeData qemuProcessDiskProbeData;
+struct _qemuProcessDiskProbeData {
+    virQEMUDriver *driver;
+    virDomainObj *vm;
+    bool cold_boot;
+
+    /* indexed by disk */
+    qemuDomainDiskChainProbe *probes;
+    bool *failed;
+    virErrorPtr *errors;
+};
+
+
+static void
+qemuProcessPrepareHostStorageProbe(size_t idx,
+                                   void *opaque)
+{
+    qemuProcessDiskProbeData *data = opaque;
+    virDomainDiskDef *disk = data->vm->def->disks[idx];
+
+    if (virStorageSourceIsEmpty(disk->src))
+        return;
+
+    /* backing chain needs to be redetected if we aren't using blockdev */
+    if (qemuDiskBusIsSD(disk->bus))
+        virStorageSourceBackingStoreClear(disk->src);
+
+    /*
+     * Go to applying startup policy for optional disk with nonexistent
+     * source file immediately as determining chain will surely fail
+     * and we don't want noisy error notice in logs for this case.
+     */
+    if (qemuDomainDiskIsMissingLocalOptional(disk) && data->cold_boot) {
+        VIR_INFO("optional disk '%s' source file is missing, "
+                 "skip checking disk chain", disk->dst);
+        data->failed[idx] = true;
+        return;
+    }
+
+    if (qemuDomainDetermineDiskChainProbe(data->driver, data->vm, disk, NULL,
+                                          &data->probes[idx]) < 0) {
+        data->failed[idx] = true;
+        virErrorPreserveLast(&data->errors[idx]);
+    }
+}
+
+
 static int
 qemuProcessPrepareHostStorage(virQEMUDriver *driver,
                               virDomainObj *vm,
                               unsigned int flags)
 {
+    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuProcessDiskProbeData data = { .driver = driver, .vm = vm };
+    size_t ndisks = vm->def->ndisks;
+    unsigned long long then = g_get_monotonic_time();
     size_t i;
-    bool cold_boot = flags & VIR_QEMU_PROCESS_START_COLD;
+    int ret = -1;
 
-    for (i = vm->def->ndisks; i > 0; i--) {
+    data.cold_boot = flags & VIR_QEMU_PROCESS_START_COLD;
+    data.probes = g_new0(qemuDomainDiskChainProbe, ndisks);
+    data.failed = g_new0(bool, ndisks);
+    data.errors = g_new0(virErrorPtr, ndisks);
+
+    /* Probing the images of a disk doesn't depend on other disks and is
+     * dominated by waiting for storage, especially on network filesystems,
+     * so all disks are probed in parallel. The rest modifies the domain
+     * definition and is done in the order of disks. */
+    virThreadPoolRunParallel("qemu-disk-probe", QEMU_PROCESS_DISK_PROBE_WORKERS,
+                             ndisks, qemuProcessPrepareHostStorageProbe, &data);
+
+    for (i = ndisks; i > 0; i--) {
         size_t idx = i - 1;
         virDomainDiskDef *disk = vm->def->disks[idx];
 
-        if (virStorageSourceIsEmpty(disk->src))
+        if (!data.failed[idx] &&
+            qemuDomainDetermineDiskChainFinish(driver, vm, disk, NULL,
+                                               &data.probes[idx]) >= 0)
             continue;
 
-        /* backing chain needs to be redetected if we aren't using blockdev */
-        if (qemuDiskBusIsSD(disk->bus))
-            virStorageSourceBackingStoreClear(disk->src);
+        virErrorRestore(&data.errors[idx]);
 
-        /*
-         * Go to applying startup policy for optional disk with nonexistent
-         * source file immediately as determining chain will surely fail
-         * and we don't want noisy error notice in logs for this case.
-         */
-        if (qemuDomainDiskIsMissingLocalOptional(disk) && cold_boot)
-            VIR_INFO("optional disk '%s' source file is missing, "
-                     "skip checking disk chain", disk->dst);
-        else if (qemuDomainDetermineDiskChain(driver, vm, disk, NULL) >= 0)
+        if (qemuDomainCheckDiskStartupPolicy(driver, vm, idx, data.cold_boot) >= 0)
             continue;
 
-        if (qemuDomainCheckDiskStartupPolicy(driver, vm, idx, cold_boot) >= 0)
-            continue;
-
-        return -1;
+        goto cleanup;
     }
 
     for (i = 0; i < vm->def->ndisks; i++) {
         virDomainDiskDef *disk = vm->def->disks[i];
 
         if (qemuProcessPrepareHostStorageDisk(vm, disk) < 0)
-            return -1;
+            goto cleanup;
     }
 
-    return 0;
+    priv->prepareStorageTime = (g_get_monotonic_time() - then) / 1000;
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ndisks; i++)
+        virFreeError(data.errors[i]);
+    g_free(data.errors);
+    g_free(data.failed);
+    g_free(data.probes);
+    return ret;
 }
 
 
@@ -7604,6 +7826,8 @@ qemuProcessPrepareHost(virQEMUDriver *driver,
     qemuDomainObjPrivate *priv = vm->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
+    qemuProcessStartupPhaseBegin(vm);
+
     /*
      * Create all per-domain directories in order to make sure domain
      * with any possible seclabels can access it.
@@ -7689,6 +7913,8 @@ qemuProcessPrepareHost(virQEMUDriver *driver,
     if (qemuProcessPreparePstore(vm) < 0)
         return -1;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_PREPARE_HOST);
+
     return 0;
 }
 
@@ -8048,6 +8274,8 @@ qemuProcessLaunch(virConnectPtr conn,
 
     cfg = virQEMUDriverGetConfig(driver);
 
+    qemuProcessStartupPhaseBegin(vm);
+
     if (flags & VIR_QEMU_PROCESS_START_AUTODESTROY) {
         if (!conn) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -8162,6 +8390,9 @@ qemuProcessLaunch(virConnectPtr conn,
 
     if (qemuSecurityPreFork(driver->securityManager) < 0)
         goto cleanup;
+
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_LAUNCH);
+
     rv = virCommandRun(cmd, NULL);
     qemuSecurityPostFork(driver->securityManager);
 
@@ -8193,14 +8424,20 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
     }
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_EXEC);
+
     VIR_DEBUG("Building domain mount namespace (if required)");
     if (qemuDomainBuildNamespace(cfg, vm) < 0)
         goto cleanup;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_NAMESPACE);
+
     VIR_DEBUG("Setting up domain cgroup (if required)");
     if (qemuSetupCgroup(vm, nnicindexes, nicindexes) < 0)
         goto cleanup;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_CGROUPS);
+
     VIR_DEBUG("Setting up domain perf (if required)");
     if (qemuProcessEnablePerf(vm) < 0)
         goto cleanup;
@@ -8231,6 +8468,8 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuProcessAllowPostCopyMigration(vm) < 0)
         goto cleanup;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_PROCESS_SETUP);
+
     VIR_DEBUG("Setting domain security labels");
     if (qemuSecuritySetAllLabel(driver,
                                 vm,
@@ -8238,6 +8477,9 @@ qemuProcessLaunch(virConnectPtr conn,
                                 incoming != NULL) < 0)
         goto cleanup;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_SECURITY_LABELS);
+    qemuProcessLogPrepareTime(vm, logCtxt);
+
     /* Security manager labeled all devices, therefore
      * if any operation from now on fails, we need to ask the caller to
      * restore labels.
@@ -8275,6 +8517,8 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuProcessWaitForMonitor(driver, vm, asyncJob, logCtxt) < 0)
         goto cleanup;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_MONITOR);
+
     if (qemuConnectAgent(driver, vm) < 0)
         goto cleanup;
 
@@ -8373,6 +8617,8 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuProcessDeleteThreadContextHelper(vm, asyncJob) < 0)
         goto cleanup;
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_DEVICE_SETUP);
+
     ret = 0;
 
  cleanup:
@@ -8573,9 +8819,13 @@ qemuProcessStart(virConnectPtr conn,
     }
     relabel = true;
 
+    qemuProcessStartupPhaseBegin(vm);
+
     if (incoming) {
         if (qemuMigrationDstRun(vm, incoming->uri, asyncJob, migParams, 0) < 0)
             goto stop;
+
+        qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_LOAD_STATE);
     } else {
         /* Refresh state of devices from QEMU. During migration this happens
          * in qemuMigrationDstFinish to ensure that state information is fully
@@ -8597,6 +8847,12 @@ qemuProcessStart(virConnectPtr conn,
         qemuMonitorSetDomainLog(priv->mon, NULL, NULL, NULL);
     }
 
+    qemuProcessStartupPhaseEnd(vm, QEMU_DOMAIN_STARTUP_PHASE_FINISH);
+    qemuProcessStartupRecord(vm);
+
+    if (asyncJob == VIR_ASYNC_JOB_START)
+        qemuProcessStartupSetCompletedJob(vm);
+
     ret = 0;
 
  cleanup:
@@ -8978,6 +9234,7 @@ qemuProcessStop(virDomainObj *vm,
     size_t i;
     g_autofree char *timestamp = NULL;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
 
     VIR_DEBUG("Shutting down vm=%p name=%s id=%d pid=%lld, "
               "reason=%s, asyncJob=%s, flags=0x%x",
@@ -9112,6 +9369,10 @@ qemuProcessStop(virDomainObj *vm,
     /* Its namespace is also gone then. */
     qemuDomainDestroyNamespace(driver, vm);
 
+    /* And so is its NUMA placement. */
+    virUUIDFormat(vm->def->uuid, uuidstr);
+    virNumaPlacementRemove(driver->numaPlacement, uuidstr);
+
     virFileDeleteTree(priv->libDir);
     virFileDeleteTree(priv->channelTargetDir);
 
@@ -9557,18 +9818,62 @@ qemuProcessReloadMachineTypes(virDomainObj *vm)
 }
 
 
-struct qemuProcessReconnectData {
-    virDomainObj *obj;
-    virIdentity *identity;
+struct _qemuProcessReconnectData {
+    virDomainJobObj oldjob;
+    bool jobStarted;
+    unsigned long long queued; /* monotonic time the reconnect was queued */
+    GList *link; /* in driver->reconnectQueue, protected by driver->lock */
 };
+
+
+/* Progress of reconnecting to running domains after the daemon started */
+static unsigned int qemuProcessReconnectTotal;
+static unsigned int qemuProcessReconnectDone;
+
+
+static void
+qemuProcessReconnectGetParams(virTypedParamList *list)
+{
+    unsigned int total = g_atomic_int_get(&qemuProcessReconnectTotal);
+    unsigned int done = g_atomic_int_get(&qemuProcessReconnectDone);
+
+    virTypedParamListAddUInt(list, total, "qemu.reconnect.domains");
+    virTypedParamListAddUInt(list, done, "qemu.reconnect.done");
+}
+
+
+static int
+qemuProcessReconnectMetricsOnceInit(void)
+{
+    virMetricsRegisterSource(qemuProcessReconnectGetParams);
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(qemuProcessReconnectMetrics);
+
+
+static void
+qemuProcessReconnectDataFree(qemuProcessReconnectData *data)
+{
+    if (!data)
+        return;
+
+    virDomainObjClearJob(&data->oldjob);
+    g_free(data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(qemuProcessReconnectData, qemuProcessReconnectDataFree);
+
+
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
  *
- * This function also inherits a locked and ref'd domain object.
+ * This function inherits a ref'd, but unlocked domain object on which
+ * qemuProcessReconnectHelper already entered a job (unless
+ * priv->reconnect->jobStarted is false).
  *
  * This function needs to:
- * 1. Enter job
  * 1. just before monitor reconnect do lightweight MonitorEnter
  *    (increase VM refcount and unlock VM)
  * 2. reconnect to monitor
@@ -9580,35 +9885,36 @@ struct qemuProcessReconnectData {
  * monitor lock, which does not exists in this early phase.
  */
 static void
-qemuProcessReconnect(void *opaque)
+qemuProcessReconnect(virDomainObj *obj,
+                     virQEMUDriver *driver)
 {
-    g_autofree struct qemuProcessReconnectData *data = opaque;
-    virDomainObj *obj = data->obj;
     qemuDomainObjPrivate *priv = obj->privateData;
-    virQEMUDriver *driver = priv->driver;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
-    g_auto(virDomainJobObj) oldjob = {
-      .cb = NULL,
-    };
+    g_autoptr(qemuProcessReconnectData) data = NULL;
+    virDomainJobObj *oldjob;
     int state;
     int reason;
     size_t i;
     unsigned int stopFlags = 0;
-    bool jobStarted = false;
+    bool jobStarted;
     bool tryMonReconn = false;
+    unsigned long long started = g_get_monotonic_time();
+    unsigned long long monitorDone = 0;
+    unsigned long long refreshDone = 0;
 
-    virIdentitySetCurrent(data->identity);
-    g_clear_object(&data->identity);
+    virObjectLock(obj);
+
+    data = g_steal_pointer(&priv->reconnect);
+    oldjob = &data->oldjob;
+    jobStarted = data->jobStarted;
 
-    virDomainObjPreserveJob(obj->job, &oldjob);
-    if (oldjob.asyncJob == VIR_ASYNC_JOB_MIGRATION_IN)
+    if (oldjob->asyncJob == VIR_ASYNC_JOB_MIGRATION_IN)
         stopFlags |= VIR_QEMU_PROCESS_STOP_MIGRATED;
-    if (oldjob.asyncJob == VIR_ASYNC_JOB_BACKUP && priv->backup)
-        priv->backup->apiFlags = oldjob.apiFlags;
+    if (oldjob->asyncJob == VIR_ASYNC_JOB_BACKUP && priv->backup)
+        priv->backup->apiFlags = oldjob->apiFlags;
 
-    if (virDomainObjBeginJob(obj, VIR_JOB_MODIFY) < 0)
+    if (!jobStarted)
         goto error;
-    jobStarted = true;
 
     /* XXX If we ever gonna change pid file pattern, come up with
      * some intelligence here to deal with old paths. */
@@ -9629,6 +9935,16 @@ qemuProcessReconnect(void *opaque)
     if (qemuHostdevUpdateActiveDomainDevices(driver, obj->def) < 0)
         goto error;
 
+    if (priv->autoNodeset) {
+        char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+        virUUIDFormat(obj->def->uuid, uuidstr);
+        virNumaPlacementAdd(driver->numaPlacement, uuidstr,
+                            virDomainDefGetVcpus(obj->def),
+                            virDomainDefGetMemoryTotal(obj->def),
+                            priv->autoNodeset);
+    }
+
     if (qemuDomainObjStartWorker(obj) < 0)
         goto error;
 
@@ -9643,6 +9959,8 @@ qemuProcessReconnect(void *opaque)
     if (qemuConnectMonitor(driver, obj, VIR_ASYNC_JOB_NONE, NULL, true) < 0)
         goto error;
 
+    monitorDone = g_get_monotonic_time();
+
     priv->machineName = qemuDomainGetMachineName(obj);
     if (!priv->machineName)
         goto error;
@@ -9770,7 +10088,7 @@ qemuProcessReconnect(void *opaque)
     if (qemuProcessRefreshBalloonState(obj, VIR_ASYNC_JOB_NONE) < 0)
         goto error;
 
-    if (qemuProcessRecoverJob(driver, obj, &oldjob, &stopFlags) < 0)
+    if (qemuProcessRecoverJob(driver, obj, oldjob, &stopFlags) < 0)
         goto error;
 
     if (qemuBlockJobRefreshJobs(obj) < 0)
@@ -9813,10 +10131,25 @@ qemuProcessReconnect(void *opaque)
         if (qemuNbdkitStorageSourceManageProcess(obj->def->os.loader->nvram, obj) < 0)
             goto error;
 
+    refreshDone = g_get_monotonic_time();
+
     /* update domain state XML with possibly updated state in virDomainObj */
     if (virDomainObjSave(obj, driver->xmlopt, cfg->stateDir) < 0)
         goto error;
 
+    VIR_INFO("Reconnected to domain '%s' (queued=%llums monitor=%llums "
+             "refresh=%llums save=%llums)",
+             obj->def->name,
+             (started - data->queued) / 1000,
+             (monitorDone - started) / 1000,
+             (refreshDone - monitorDone) / 1000,
+             (g_get_monotonic_time() - refreshDone) / 1000);
+
+    virMetricsHistogramAdd(virMetricsHistogramGet("qemu.reconnect.queue_wait"),
+                           started - data->queued);
+    virMetricsHistogramAdd(virMetricsHistogramGet("qemu.reconnect.exec"),
+                           g_get_monotonic_time() - started);
+
     /* Run an hook to allow admins to do some magic */
     if (virHookPresent(VIR_HOOK_DRIVER_QEMU)) {
         g_autofree char *xml = qemuDomainDefFormatXML(driver,
@@ -9843,7 +10176,6 @@ qemuProcessReconnect(void *opaque)
     if (!virDomainObjIsActive(obj))
         qemuDomainRemoveInactive(obj, 0, false);
     virDomainObjEndAPI(&obj);
-    virIdentitySetCurrent(NULL);
     return;
 
  error:
@@ -9877,61 +10209,265 @@ qemuProcessReconnect(void *opaque)
 
 static int
 qemuProcessReconnectHelper(virDomainObj *obj,
-                           void *opaque G_GNUC_UNUSED)
+                           void *opaque)
 {
-    virThread thread;
-    struct qemuProcessReconnectData *data;
-    g_autofree char *name = NULL;
+    virQEMUDriver *driver = opaque;
+    qemuDomainObjPrivate *priv = obj->privateData;
+    qemuProcessReconnectData *data;
 
     /* If the VM was inactive, we don't need to reconnect */
     if (obj->pid == 0)
         return 0;
 
-    data = g_new0(struct qemuProcessReconnectData, 1);
+    data = g_new0(qemuProcessReconnectData, 1);
 
-    data->obj = obj;
-    data->identity = virIdentityGetCurrent();
-
-    /* this lock and reference will be eventually transferred to the thread
-     * that handles the reconnect */
+    /* this reference will be eventually transferred to the worker that
+     * handles the reconnect */
     virObjectLock(obj);
     virObjectRef(obj);
 
-    name = g_strdup_printf("init-%s", obj->def->name);
+    /* Enter the job right away so that nothing can touch the domain until
+     * a reconnect worker gets to it. The domain is then left unlocked in
+     * the queue, which is safe even though the job is held for a long
+     * time: APIs which want to modify the domain or undefine it need a job
+     * and wait for it, the monitor is not connected yet so no events can
+     * arrive, and the job is ended by the worker rather than by this
+     * thread, which is fine as virDomainObjEndJob doesn't check the job
+     * owner. */
+    virDomainObjPreserveJob(obj->job, &data->oldjob);
+    data->jobStarted = virDomainObjBeginJob(obj, VIR_JOB_MODIFY) == 0;
+    data->queued = g_get_monotonic_time();
+    priv->reconnect = data;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        /* Interrupted async jobs (e.g. migration) are time sensitive, make
+         * sure they get recovered before the rest of the domains */
+        data->link = g_list_alloc();
+        data->link->data = obj;
+
+        if (data->oldjob.asyncJob != VIR_ASYNC_JOB_NONE)
+            g_queue_push_head_link(driver->reconnectQueue, data->link);
+        else
+            g_queue_push_tail_link(driver->reconnectQueue, data->link);
+    }
+
+    virObjectUnlock(obj);
+    return 0;
+}
 
-    if (virThreadCreateFull(&thread, false, qemuProcessReconnect,
-                            name, false, data) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Could not create thread. QEMU initialization might be incomplete"));
-        /* We can't spawn a thread and thus connect to monitor. Kill qemu.
-         * It's safe to call qemuProcessStop without a job here since there
-         * is no thread that could be doing anything else with the same domain
-         * object.
-         */
-        qemuProcessStop(obj, VIR_DOMAIN_SHUTOFF_FAILED,
-                        VIR_ASYNC_JOB_NONE, 0);
-        qemuDomainRemoveInactiveLocked(obj);
 
-        virDomainObjEndAPI(&obj);
-        g_clear_object(&data->identity);
-        VIR_FREE(data);
-        return -1;
+struct qemuProcessReconnectAllData {
+    virQEMUDriver *driver;
+    virIdentity *identity;
+    size_t workers;
+    size_t ndomains;
+};
+
+
+/* Pops the domain at the head of the reconnect queue. Must be called with
+ * driver->lock held. */
+static virDomainObj *
+qemuProcessReconnectQueuePop(virQEMUDriver *driver)
+{
+    virDomainObj *obj = g_queue_pop_head(driver->reconnectQueue);
+
+    /* priv->reconnect is only freed after the domain leaves the queue */
+    if (obj)
+        QEMU_DOMAIN_PRIVATE(obj)->reconnect->link = NULL;
+
+    return obj;
+}
+
+
+/* Reconnects to the domain at the head of the reconnect queue. @idx is
+ * ignored as the queue is reordered when clients ask about domains which
+ * were not reconnected yet. */
+static void
+qemuProcessReconnectNext(size_t idx G_GNUC_UNUSED,
+                         void *opaque)
+{
+    struct qemuProcessReconnectAllData *all = opaque;
+    virQEMUDriver *driver = all->driver;
+    virDomainObj *obj = NULL;
+
+    if (g_atomic_int_get(&driver->reconnectStop))
+        return;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        obj = qemuProcessReconnectQueuePop(driver);
     }
 
-    return 0;
+    if (!obj)
+        return;
+
+    virIdentitySetCurrent(all->identity);
+    qemuProcessReconnect(obj, driver);
+    virIdentitySetCurrent(NULL);
+
+    g_atomic_int_inc(&qemuProcessReconnectDone);
+}
+
+
+static void
+qemuProcessReconnectThread(void *opaque)
+{
+    struct qemuProcessReconnectAllData *all = opaque;
+
+    virThreadPoolRunParallel("qemu-reconnect", all->workers, all->ndomains,
+                             qemuProcessReconnectNext, all);
+
+    if (g_atomic_int_get(&all->driver->reconnectStop))
+        VIR_INFO("Reconnecting to running domains was interrupted");
+    else
+        VIR_INFO("Reconnected to all running domains");
+
+    g_clear_object(&all->identity);
+    g_free(all);
 }
 
+
 /**
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. At most cfg->maxReconnectWorkers domains are reconnected
+ * in parallel by a background thread, which exits once all domains
+ * are reconnected.
  */
 void
 qemuProcessReconnectAll(virQEMUDriver *driver)
 {
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    struct qemuProcessReconnectAllData *all;
+    size_t workers = cfg->maxReconnectWorkers;
+
+    if (workers == 0) {
+        int ncpus = virHostCPUGetCount();
+
+        if (ncpus < 0)
+            virResetLastError();
+        workers = MAX(ncpus, 1);
+    }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        driver->reconnectQueue = g_queue_new();
+    }
+
     virDomainObjListForEach(driver->domains, true,
-                            qemuProcessReconnectHelper, NULL);
+                            qemuProcessReconnectHelper, driver);
+
+    all = g_new0(struct qemuProcessReconnectAllData, 1);
+    all->driver = driver;
+    all->identity = virIdentityGetCurrent();
+    all->workers = workers;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        all->ndomains = g_queue_get_length(driver->reconnectQueue);
+    }
+
+    if (qemuProcessReconnectMetricsInitialize() < 0)
+        virResetLastError();
+    g_atomic_int_set(&qemuProcessReconnectTotal, all->ndomains);
+    g_atomic_int_set(&qemuProcessReconnectDone, 0);
+
+    if (all->ndomains == 0) {
+        g_clear_object(&all->identity);
+        g_free(all);
+        return;
+    }
+
+    VIR_DEBUG("Reconnecting to %zu running domains using %zu workers",
+              all->ndomains, workers);
+
+    if (virThreadCreateFull(&driver->reconnectThread, true,
+                            qemuProcessReconnectThread,
+                            "qemu-reconnect", false, all) < 0) {
+        VIR_WARN("Unable to create reconnect thread: %s", g_strerror(errno));
+        /* Reconnect synchronously rather than leaving domains behind */
+        qemuProcessReconnectThread(all);
+        return;
+    }
+
+    driver->reconnectThreadActive = true;
+}
+
+
+/**
+ * qemuProcessReconnectPrioritize:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ *
+ * If @vm still waits for a reconnect worker after the daemon started, move
+ * it to the head of the queue so that a client asking about the domain
+ * doesn't have to wait until all other domains are reconnected. The
+ * reconnect job blocks the client until the reconnect is done.
+ */
+void
+qemuProcessReconnectPrioritize(virQEMUDriver *driver,
+                               virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    GList *link;
+
+    if (!priv->reconnect)
+        return;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        if ((link = priv->reconnect->link) &&
+            link != g_queue_peek_head_link(driver->reconnectQueue)) {
+            VIR_DEBUG("Reconnecting to domain '%s' first", vm->def->name);
+            g_queue_unlink(driver->reconnectQueue, link);
+            g_queue_push_head_link(driver->reconnectQueue, link);
+        }
+    }
+}
+
+
+/**
+ * qemuProcessReconnectCancel:
+ * @driver: qemu driver
+ *
+ * Stops reconnecting to domains, waits for reconnects which are already
+ * running and releases references held by domains which are still queued.
+ * The QEMU processes of such domains are left running and the daemon
+ * reconnects to them the next time it starts.
+ */
+void
+qemuProcessReconnectCancel(virQEMUDriver *driver)
+{
+    virDomainObj *obj;
+
+    g_atomic_int_set(&driver->reconnectStop, 1);
+
+    if (driver->reconnectThreadActive) {
+        virThreadJoin(&driver->reconnectThread);
+        driver->reconnectThreadActive = false;
+    }
+
+    if (!driver->reconnectQueue)
+        return;
+
+    while (true) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+            obj = qemuProcessReconnectQueuePop(driver);
+        }
+
+        if (!obj)
+            break;
+
+        virObjectLock(obj);
+        VIR_DEBUG("Cancelling reconnect to domain '%s'", obj->def->name);
+        /* The reconnect job is intentionally kept: ending it would let
+         * threads waiting for a job use a domain without a monitor, they
+         * fail with a timeout instead. */
+        g_clear_pointer(&QEMU_DOMAIN_PRIVATE(obj)->reconnect,
+                        qemuProcessReconnectDataFree);
+        virDomainObjEndAPI(&obj);
+    }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        g_clear_pointer(&driver->reconnectQueue, g_queue_free);
+    }
 }
 
 
@@ -47,6 +47,9 @@ int qemuProcessDestroyMemoryBackingPath(virDomainObj *vm,
                                         virDomainMemoryDef *mem);
 
 void qemuProcessReconnectAll(virQEMUDriver *driver);
+void qemuProcessReconnectPrioritize(virQEMUDriver *driver,
+                                    virDomainObj *vm);
+void qemuProcessReconnectCancel(virQEMUDriver *driver);
 
 typedef struct _qemuProcessIncomingDef qemuProcessIncomingDef;
 struct _qemuProcessIncomingDef {
@@ -157,6 +160,8 @@ int qemuProcessLaunch(virConnectPtr conn,
                       virNetDevVPortProfileOp vmop,
                       unsigned int flags);
 
+void qemuProcessStartupRecord(virDomainObj *vm);
+
 int qemuProcessFinishStartup(virQEMUDriver *driver,
                              virDomainObj *vm,
                              virDomainAsyncJob asyncJob,
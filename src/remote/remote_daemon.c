@@ -47,6 +47,7 @@
 #include "remote_daemon_dispatch.h"
 #include "virhook.h"
 #include "viraudit.h"
+#include "virmetrics.h"
 #include "virstring.h"
 #include "viraccessmanager.h"
 #include "virutil.h"
@@ -1112,6 +1113,8 @@ int main(int argc, char **argv) {
     }
     virAuditLog(config->audit_logging > 0);
 
+    virMetricsSetEnabled(config->metrics);
+
     /* setup the hooks if any */
     if (virHookInitialize() < 0) {
         ret = VIR_DAEMON_ERR_HOOKS;
@@ -56,6 +56,8 @@ struct daemonClientPrivate {
     daemonClientEventCallback **secretEventCallbacks;
     size_t nsecretEventCallbacks;
     bool closeRegistered;
+    /* Client accepts stream packets larger than the legacy payload size */
+    bool largeStreamPayload;
 
 #if WITH_SASL
     virNetSASLSession *sasl;
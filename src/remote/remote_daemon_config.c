@@ -162,6 +162,8 @@ daemonConfigNew(bool privileged G_GNUC_UNUSED)
 
     data->ovs_timeout = VIR_NETDEV_OVS_DEFAULT_TIMEOUT;
 
+    data->metrics = false;
+
     return data;
 }
 
@@ -380,6 +382,9 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueUInt(conf, "ovs_timeout", &data->ovs_timeout) < 0)
         return -1;
 
+    if (virConfGetValueBool(conf, "metrics", &data->metrics) < 0)
+        return -1;
+
     return 0;
 }
 
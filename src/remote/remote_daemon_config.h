@@ -96,6 +96,8 @@ struct daemonConfig {
     unsigned int admin_keepalive_count;
 
     unsigned int ovs_timeout;
+
+    bool metrics;
 };
 
 
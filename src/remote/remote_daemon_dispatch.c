@@ -5041,8 +5041,20 @@ static int remoteDispatchConnectSupportsFeature(virNetServer *server G_GNUC_UNUS
     case VIR_DRV_FEATURE_FD_PASSING:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
         supported = 1;
         break;
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD: {
+        daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+
+        /* Only clients which asked for it get large stream packets, older
+         * ones may not be able to cope with them. */
+        VIR_WITH_MUTEX_LOCK_GUARD(&priv->lock) {
+            priv->largeStreamPayload = true;
+        }
+        supported = 1;
+        break;
+    }
     case VIR_DRV_FEATURE_MIGRATION_V1:
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_MIGRATION_V2:
@@ -5054,6 +5066,7 @@ static int remoteDispatchConnectSupportsFeature(virNetServer *server G_GNUC_UNUS
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     case VIR_DRV_FEATURE_MIGRATION_OFFLINE:
     case VIR_DRV_FEATURE_MIGRATION_PARAMS:
+    case VIR_DRV_FEATURE_MIGRATION_TUNNEL_CHANNELS:
     case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
     default:
         if ((supported = virConnectSupportsFeature(conn, args->feature)) < 0)
@@ -6784,6 +6797,50 @@ remoteDispatchNetworkGetDHCPLeases(virNetServer *server G_GNUC_UNUSED,
 }
 
 
+static int
+remoteGetAllDomainStats(virNetServerClient *client,
+                        remote_nonnull_domain *remoteDoms,
+                        unsigned int ndoms,
+                        unsigned int stats,
+                        unsigned int flags,
+                        virDomainStatsRecordPtr **retStats)
+{
+    virDomainPtr *doms = NULL;
+    int nrecords = -1;
+    size_t i;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        return -1;
+
+    if (ndoms) {
+        doms = g_new0(virDomainPtr, ndoms + 1);
+
+        for (i = 0; i < ndoms; i++) {
+            if (!(doms[i] = get_nonnull_domain(conn, remoteDoms[i])))
+                goto cleanup;
+        }
+
+        nrecords = virDomainListGetStats(doms, stats, retStats, flags);
+    } else {
+        nrecords = virConnectGetAllDomainStats(conn, stats, retStats, flags);
+    }
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of domain stats records is %1$d, which exceeds max limit: %2$d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        virDomainStatsRecordListFree(*retStats);
+        *retStats = NULL;
+        nrecords = -1;
+    }
+
+ cleanup:
+    virObjectListFree(doms);
+    return nrecords;
+}
+
+
 static int
 remoteDispatchConnectGetAllDomainStats(virNetServer *server G_GNUC_UNUSED,
                                        virNetServerClient *client,
@@ -6796,41 +6853,16 @@ remoteDispatchConnectGetAllDomainStats(virNetServer *server G_GNUC_UNUSED,
     size_t i;
     virDomainStatsRecordPtr *retStats = NULL;
     int nrecords = 0;
-    virDomainPtr *doms = NULL;
-    virConnectPtr conn = remoteGetHypervisorConn(client);
 
-    if (!conn)
+    if ((nrecords = remoteGetAllDomainStats(client,
+                                            args->doms.doms_val,
+                                            args->doms.doms_len,
+                                            args->stats,
+                                            args->flags,
+                                            &retStats)) < 0)
         goto cleanup;
 
-    if (args->doms.doms_len) {
-        doms = g_new0(virDomainPtr, args->doms.doms_len + 1);
-
-        for (i = 0; i < args->doms.doms_len; i++) {
-            if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
-                goto cleanup;
-        }
-
-        if ((nrecords = virDomainListGetStats(doms,
-                                              args->stats,
-                                              &retStats,
-                                              args->flags)) < 0)
-            goto cleanup;
-    } else {
-        if ((nrecords = virConnectGetAllDomainStats(conn,
-                                                    args->stats,
-                                                    &retStats,
-                                                    args->flags)) < 0)
-            goto cleanup;
-    }
-
     if (nrecords) {
-        if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Number of domain stats records is %1$d, which exceeds max limit: %2$d"),
-                           nrecords, REMOTE_DOMAIN_LIST_MAX);
-            goto cleanup;
-        }
-
         ret->retStats.retStats_val = g_new0(remote_domain_stats_record, nrecords);
         ret->retStats.retStats_len = nrecords;
 
@@ -6862,7 +6894,99 @@ remoteDispatchConnectGetAllDomainStats(virNetServer *server G_GNUC_UNUSED,
     }
 
     virDomainStatsRecordListFree(retStats);
-    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+/* Same as remoteDispatchConnectGetAllDomainStats, but every field name is
+ * sent only once in a dictionary shared by all records which then refer
+ * to it by index. */
+static int
+remoteDispatchConnectGetAllDomainStatsCompact(virNetServer *server G_GNUC_UNUSED,
+                                              virNetServerClient *client,
+                                              virNetMessage *msg G_GNUC_UNUSED,
+                                              struct virNetMessageError *rerr,
+                                              remote_connect_get_all_domain_stats_compact_args *args,
+                                              remote_connect_get_all_domain_stats_compact_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    int j;
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+    g_autoptr(GHashTable) keys = g_hash_table_new(g_str_hash, g_str_equal);
+    size_t keys_alloc = 0;
+
+    if ((nrecords = remoteGetAllDomainStats(client,
+                                            args->doms.doms_val,
+                                            args->doms.doms_len,
+                                            args->stats,
+                                            args->flags,
+                                            &retStats)) < 0)
+        goto cleanup;
+
+    if (nrecords) {
+        ret->retStats.retStats_val = g_new0(remote_domain_stats_compact_record, nrecords);
+        ret->retStats.retStats_len = nrecords;
+    }
+
+    for (i = 0; i < nrecords; i++) {
+        virDomainStatsRecordPtr src = retStats[i];
+        remote_domain_stats_compact_record *dst = ret->retStats.retStats_val + i;
+
+        make_nonnull_domain(&dst->dom, src->dom);
+
+        if (src->nparams > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+            virReportError(VIR_ERR_RPC,
+                           _("too many parameters '%1$d' for limit '%2$d'"),
+                           src->nparams, REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+            goto cleanup;
+        }
+
+        dst->keys.keys_val = g_new0(unsigned int, src->nparams);
+        dst->values.values_val = g_new0(remote_typed_param_value, src->nparams);
+
+        for (j = 0; j < src->nparams; j++) {
+            virTypedParameterPtr param = src->params + j;
+            virTypedParameterRemoteValue *value;
+            size_t key;
+
+            /* Keys are stored off by one so that NULL means not found */
+            if ((key = GPOINTER_TO_SIZE(g_hash_table_lookup(keys, param->field))) == 0) {
+                if (ret->keys.keys_len == REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+                    virReportError(VIR_ERR_RPC,
+                                   _("too many domain stats fields for limit '%1$d'"),
+                                   REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+                    goto cleanup;
+                }
+
+                VIR_RESIZE_N(ret->keys.keys_val, keys_alloc, ret->keys.keys_len, 1);
+                ret->keys.keys_val[ret->keys.keys_len] = g_strdup(param->field);
+                key = ++ret->keys.keys_len;
+                g_hash_table_insert(keys, ret->keys.keys_val[key - 1],
+                                    GSIZE_TO_POINTER(key));
+            }
+
+            value = (virTypedParameterRemoteValue *) &dst->values.values_val[dst->values.values_len];
+            if (virTypedParamSerializeValue(param, value) < 0)
+                goto cleanup;
+
+            dst->keys.keys_val[dst->keys.keys_len++] = key - 1;
+            dst->values.values_len++;
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret,
+                 (char *) ret);
+    }
+
+    virDomainStatsRecordListFree(retStats);
 
     return rv;
 }
@@ -32,6 +32,10 @@
 
 VIR_LOG_INIT("daemon.stream");
 
+/* How many outgoing data packets can be queued for a client which
+ * negotiated large stream packets, before we stop reading more data */
+#define DAEMON_STREAM_TX_WINDOW 4
+
 struct daemonClientStream {
     daemonClientPrivate *priv;
     int refs;
@@ -49,6 +53,9 @@ struct daemonClientStream {
 
     virNetMessage *rx;
     bool tx;
+    unsigned int txQueued; /* Outgoing packets not yet fully sent */
+    bool largePayload; /* Client accepts large stream packets */
+    char *txBuffer; /* Reused for reading data to be sent */
 
     bool allowSkip;
     size_t dataLen; /* How much data is there remaining until we see a hole */
@@ -99,9 +106,10 @@ daemonStreamMessageFinished(virNetMessage *msg,
                             void *opaque)
 {
     daemonClientStream *stream = opaque;
-    VIR_DEBUG("stream=%p proc=%d serial=%u",
-              stream, msg->header.proc, msg->header.serial);
+    VIR_DEBUG("stream=%p proc=%d serial=%u queued=%u",
+              stream, msg->header.proc, msg->header.serial, stream->txQueued);
 
+    stream->txQueued--;
     stream->tx = true;
     daemonStreamUpdateEvents(stream);
 
@@ -200,6 +208,7 @@ daemonStreamEvent(virStreamPtr st, int events, void *opaque)
         virNetMessage *msg;
         events &= ~(VIR_STREAM_EVENT_HANGUP);
         stream->tx = false;
+        stream->txQueued++;
         stream->recvEOF = true;
         if (!(msg = virNetMessageNew(false))) {
             daemonRemoveClientStream(client, stream);
@@ -367,6 +376,10 @@ daemonCreateClientStream(virNetServerClient *client,
     stream->st = st;
     stream->allowSkip = allowSkip;
 
+    VIR_WITH_MUTEX_LOCK_GUARD(&priv->lock) {
+        stream->largePayload = priv->largeStreamPayload;
+    }
+
     return stream;
 }
 
@@ -393,6 +406,7 @@ int daemonFreeClientStream(virNetServerClient *client,
               client, stream->procedure, stream->serial);
 
     virObjectUnref(stream->prog);
+    g_free(stream->txBuffer);
 
     msg = stream->rx;
     while (msg) {
@@ -824,13 +838,14 @@ daemonStreamHandleRead(virNetServerClient *client,
     virNetMessageError rerr = { 0 };
     char *buffer;
     size_t bufferLen = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    unsigned int txWindow = 1;
     int ret = -1;
     int rv;
     int inData = 0;
     long long length = 0;
 
-    VIR_DEBUG("client=%p, stream=%p tx=%d closed=%d",
-              client, stream, stream->tx, stream->closed);
+    VIR_DEBUG("client=%p, stream=%p tx=%d queued=%u closed=%d",
+              client, stream, stream->tx, stream->txQueued, stream->closed);
 
     /* We might have had an event pending before we shut
      * down the stream, so if we're marked as closed,
@@ -844,7 +859,17 @@ daemonStreamHandleRead(virNetServerClient *client,
     if (!stream->tx)
         return 0;
 
-    buffer = g_new0(char, bufferLen);
+    if (stream->largePayload) {
+        bufferLen = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
+        txWindow = DAEMON_STREAM_TX_WINDOW;
+    }
+
+    /* Data is copied into the message when it's encoded, so the same
+     * buffer can be used for all packets of the stream. It's never sent
+     * beyond what was read into it, hence no need to zero it. */
+    if (!stream->txBuffer)
+        stream->txBuffer = g_new(char, bufferLen);
+    buffer = stream->txBuffer;
 
     if (!(msg = virNetMessageNew(false)))
         goto cleanup;
@@ -872,6 +897,7 @@ daemonStreamHandleRead(virNetServerClient *client,
         } else {
             if (!inData && length) {
                 stream->tx = false;
+                stream->txQueued++;
                 msg->cb = daemonStreamMessageFinished;
                 msg->opaque = stream;
                 stream->refs++;
@@ -920,7 +946,11 @@ daemonStreamHandleRead(virNetServerClient *client,
         if (stream->allowSkip)
             stream->dataLen -= rv;
 
-        stream->tx = false;
+        /* Keep reading while the client is still draining previously
+         * queued packets, unless it has too many of them already */
+        stream->txQueued++;
+        if (rv == 0 || stream->txQueued >= txWindow)
+            stream->tx = false;
         if (rv == 0)
             stream->recvEOF = true;
 
@@ -940,7 +970,6 @@ daemonStreamHandleRead(virNetServerClient *client,
  done:
     ret = 0;
  cleanup:
-    VIR_FREE(buffer);
     virNetMessageFree(msg);
     return ret;
 }
@@ -94,6 +94,8 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    bool serverLargeStreamPayload; /* Does server support large stream packets */
+    bool serverCompactDomainStats; /* Does server support compact domain stats */
 
     virObjectEventState *eventState;
     virConnectCloseCallbackData *closeCallback;
@@ -1298,6 +1300,20 @@ doRemoteOpen(virConnectPtr conn,
                  "by the remote side.");
     }
 
+    priv->serverLargeStreamPayload = remoteConnectSupportsFeatureUnlocked(conn,
+                                        priv, VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD);
+    if (!priv->serverLargeStreamPayload) {
+        VIR_INFO("Using legacy stream packet size since large stream "
+                 "packets are not supported by the server");
+    }
+
+    priv->serverCompactDomainStats = remoteConnectSupportsFeatureUnlocked(conn,
+                                        priv, VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS);
+    if (!priv->serverCompactDomainStats) {
+        VIR_INFO("Using legacy domain stats encoding since compact "
+                 "domain stats are not supported by the server");
+    }
+
     return VIR_DRV_OPEN_SUCCESS;
 
  error:
@@ -6926,6 +6942,103 @@ remoteNetworkGetDHCPLeases(virNetworkPtr net,
 }
 
 
+static int
+remoteConnectGetAllDomainStatsCompact(virConnectPtr conn,
+                                      struct private_data *priv,
+                                      virDomainPtr *doms,
+                                      unsigned int ndoms,
+                                      unsigned int stats,
+                                      virDomainStatsRecordPtr **retStats,
+                                      unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    size_t j;
+    remote_connect_get_all_domain_stats_compact_args args = {0};
+    g_auto(remote_connect_get_all_domain_stats_compact_ret) ret = {0};
+    virDomainStatsRecordPtr *tmpret = NULL;
+
+    if (ndoms) {
+        args.doms.doms_val = g_new0(remote_nonnull_domain, ndoms);
+
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    }
+    args.doms.doms_len = ndoms;
+
+    args.stats = stats;
+    args.flags = flags;
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret, (char *)&ret) == -1) {
+        goto cleanup;
+    }
+
+    if (ret.retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stats entries is %1$d, which exceeds max limit: %2$d"),
+                       ret.retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    *retStats = NULL;
+
+    tmpret = g_new0(virDomainStatsRecordPtr, ret.retStats.retStats_len + 1);
+
+    for (i = 0; i < ret.retStats.retStats_len; i++) {
+        remote_domain_stats_compact_record *rec = ret.retStats.retStats_val + i;
+        virDomainStatsRecordPtr elem;
+
+        elem = tmpret[i] = g_new0(virDomainStatsRecord, 1);
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        if (rec->keys.keys_len != rec->values.values_len) {
+            virReportError(VIR_ERR_RPC, "%s",
+                           _("mismatched number of domain stats keys and values"));
+            goto cleanup;
+        }
+
+        elem->params = g_new0(virTypedParameter, rec->values.values_len);
+
+        for (j = 0; j < rec->values.values_len; j++) {
+            virTypedParameterPtr param = elem->params + j;
+            unsigned int key = rec->keys.keys_val[j];
+
+            if (key >= ret.keys.keys_len) {
+                virReportError(VIR_ERR_RPC,
+                               _("invalid domain stats field index '%1$u'"), key);
+                goto cleanup;
+            }
+
+            if (virStrcpyStatic(param->field, ret.keys.keys_val[key]) < 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("parameter %1$s too big for destination"),
+                               ret.keys.keys_val[key]);
+                goto cleanup;
+            }
+
+            if (virTypedParamDeserializeValue((virTypedParameterRemoteValue *) &rec->values.values_val[j],
+                                              param) < 0)
+                goto cleanup;
+
+            elem->nparams++;
+        }
+    }
+
+    *retStats = g_steal_pointer(&tmpret);
+    rv = ret.retStats.retStats_len;
+
+ cleanup:
+    virDomainStatsRecordListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+
+    return rv;
+}
+
+
 static int
 remoteConnectGetAllDomainStats(virConnectPtr conn,
                                virDomainPtr *doms,
@@ -6943,6 +7056,10 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
     virDomainStatsRecordPtr *tmpret = NULL;
     VIR_LOCK_GUARD lock = remoteDriverLock(priv);
 
+    if (priv->serverCompactDomainStats)
+        return remoteConnectGetAllDomainStatsCompact(conn, priv, doms, ndoms,
+                                                     stats, retStats, flags);
+
     if (ndoms) {
         args.doms.doms_val = g_new0(remote_nonnull_domain, ndoms);
 
@@ -7935,6 +8052,7 @@ static virHypervisorDriver hypervisor_driver = {
     .domainGraphicsReload = remoteDomainGraphicsReload, /* 10.2.0 */
     .domainSetThrottleGroup = remoteDomainSetThrottleGroup, /* 11.2.0 */
     .domainDelThrottleGroup = remoteDomainDelThrottleGroup, /* 11.2.0 */
+    .domainMigrateAddTunnelChannel = remoteDomainMigrateAddTunnelChannel, /* 11.9.0 */
 };
 
 static virNetworkDriver network_driver = {
@@ -8032,6 +8150,7 @@ static virStorageDriver storage_driver = {
     .storageVolDelete = remoteStorageVolDelete, /* 0.4.1 */
     .storageVolWipe = remoteStorageVolWipe, /* 0.8.0 */
     .storageVolWipePattern = remoteStorageVolWipePattern, /* 0.9.10 */
+    .storageVolWipeAbort = remoteStorageVolWipeAbort, /* 11.9.0 */
     .storageVolGetInfo = remoteStorageVolGetInfo, /* 0.4.1 */
     .storageVolGetInfoFlags = remoteStorageVolGetInfoFlags, /* 3.0.0 */
     .storageVolGetXMLDesc = remoteStorageVolGetXMLDesc, /* 0.4.1 */
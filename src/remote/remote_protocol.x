@@ -2054,6 +2054,11 @@ struct remote_storage_vol_wipe_pattern_args {
     unsigned int flags;
 };
 
+struct remote_storage_vol_wipe_abort_args {
+    remote_nonnull_storage_vol vol;
+    unsigned int flags;
+};
+
 struct remote_storage_vol_get_xml_desc_args {
     remote_nonnull_storage_vol vol;
     unsigned int flags;
@@ -3266,6 +3271,11 @@ struct remote_domain_migrate_confirm3_params_args {
     int cancelled;
 };
 
+struct remote_domain_migrate_add_tunnel_channel_args {
+    remote_nonnull_domain dom;
+    unsigned int flags;
+};
+
 /* The device removed event is the last event where we have to support
  * dual forms for back-compat to older clients; all future events can
  * use just the modern form with callbackID.  */
@@ -3509,6 +3519,25 @@ struct remote_connect_get_all_domain_stats_ret {
     remote_domain_stats_record retStats<REMOTE_DOMAIN_LIST_MAX>;
 };
 
+/* Each value belongs to the field with the name found at index keys[i]
+ * in the shared key dictionary of remote_connect_get_all_domain_stats_compact_ret */
+struct remote_domain_stats_compact_record {
+    remote_nonnull_domain dom;
+    unsigned int keys<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+    remote_typed_param_value values<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+struct remote_connect_get_all_domain_stats_compact_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int stats;
+    unsigned int flags;
+};
+
+struct remote_connect_get_all_domain_stats_compact_ret {
+    remote_nonnull_string keys<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+    remote_domain_stats_compact_record retStats<REMOTE_DOMAIN_LIST_MAX>;
+};
+
 struct remote_domain_fsinfo {
     remote_nonnull_string mountpoint;
     remote_nonnull_string name;
@@ -7119,5 +7148,25 @@ enum remote_procedure {
      * @generate: both
      * @acl: none
      */
-    REMOTE_PROC_DOMAIN_EVENT_NIC_MAC_CHANGE = 453
+    REMOTE_PROC_DOMAIN_EVENT_NIC_MAC_CHANGE = 453,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT = 454,
+
+    /**
+     * @generate: both
+     * @writestream: 1
+     * @acl: domain:migrate
+     */
+    REMOTE_PROC_DOMAIN_MIGRATE_ADD_TUNNEL_CHANNEL = 455,
+
+    /**
+     * @generate: both
+     * @acl: storage_vol:format
+     */
+    REMOTE_PROC_STORAGE_VOL_WIPE_ABORT = 456
 };
@@ -1267,7 +1267,7 @@ elsif ($mode eq "server") {
 
     print "virNetServerProgramProc ${structprefix}Procs[] = {\n";
     for ($id = 0 ; $id <= $#calls ; $id++) {
-        my ($comment, $name, $argtype, $arglen, $argfilter, $retlen, $retfilter, $priority);
+        my ($comment, $name, $argtype, $arglen, $argfilter, $retlen, $retfilter, $priority, $procname);
 
         if (defined $calls[$id] && !$calls[$id]->{msg}) {
             $comment = "/* Method $calls[$id]->{ProcName} => $id */";
@@ -1278,6 +1278,7 @@ elsif ($mode eq "server") {
             $retlen = $rettype ne "void" ? "sizeof($rettype)" : "0";
             $argfilter = $argtype ne "void" ? "xdr_$argtype" : "xdr_void";
             $retfilter = $rettype ne "void" ? "xdr_$rettype" : "xdr_void";
+            $procname = "\"${structprefix}$calls[$id]->{ProcName}\"";
         } else {
             if ($calls[$id]->{msg}) {
                 $comment = "/* Async event $calls[$id]->{ProcName} => $id */";
@@ -1288,11 +1289,12 @@ elsif ($mode eq "server") {
             $arglen = $retlen = 0;
             $argfilter = "xdr_void";
             $retfilter = "xdr_void";
+            $procname = "NULL";
         }
 
     $priority = defined $calls[$id]->{priority} ? $calls[$id]->{priority} : 0;
 
-        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority\n},\n";
+        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority,\n   $procname\n},\n";
     }
     print "};\n";
     print "size_t ${structprefix}NProcs = G_N_ELEMENTS(${structprefix}Procs);\n";
@@ -1836,6 +1838,18 @@ elsif ($mode eq "client") {
             print "        rv = 1;\n";
             print "        goto cleanup;\n";
             print "    }\n";
+            # SPECIAL: large stream payloads were negotiated when opening
+            print "\n";
+            print "    if (feature == VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD) {\n";
+            print "        rv = priv->serverLargeStreamPayload;\n";
+            print "        goto cleanup;\n";
+            print "    }\n";
+            # SPECIAL: compact domain stats were negotiated when opening
+            print "\n";
+            print "    if (feature == VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS) {\n";
+            print "        rv = priv->serverCompactDomainStats;\n";
+            print "        goto cleanup;\n";
+            print "    }\n";
         }
 
         foreach my $args_check (@args_check_list) {
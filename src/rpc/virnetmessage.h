@@ -43,6 +43,10 @@ struct _virNetMessage {
     int *fds;
     size_t donefds;
 
+    /* Monotonic time in microseconds when the message was queued for
+     * a worker thread, 0 if not recorded */
+    unsigned long long queued;
+
     virNetMessage *next;
 };
 
@@ -37,6 +37,13 @@ const VIR_NET_MESSAGE_INITIAL = 65536;
  */
 const VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX = 262120;
 
+/*
+ * Payload size of stream data packets once both sides have agreed
+ * on using large stream packets. Old peers only ever see packets of
+ * at most VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX.
+ */
+const VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX = 4194304;
+
 /* Maximum total message size (serialised). */
 const VIR_NET_MESSAGE_MAX = 33554432;
 
@@ -25,6 +25,7 @@
 #include "virlog.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virmetrics.h"
 #include "virthread.h"
 #include "virthreadpool.h"
 #include "virutil.h"
@@ -219,6 +220,9 @@ virNetServerDispatchNewMessage(virNetServerClient *client,
         job->client = virObjectRef(client);
         job->msg = msg;
 
+        if (virMetricsIsEnabled())
+            msg->queued = g_get_monotonic_time();
+
         if (prog) {
             job->prog = virObjectRef(prog);
             priority = virNetServerProgramGetPriority(prog, msg->header.proc);
@@ -779,6 +783,26 @@ virNetServerAddProgram(virNetServer *srv,
 }
 
 
+/**
+ * virNetServerGetMetrics:
+ * @srv: server
+ * @list: typed parameter list to fill
+ *
+ * Appends the RPC latency histograms of the programs served by @srv to
+ * @list.
+ */
+void
+virNetServerGetMetrics(virNetServer *srv,
+                       virTypedParamList *list)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
+    size_t i;
+
+    for (i = 0; i < srv->nprograms; i++)
+        virNetServerProgramGetMetrics(srv->programs[i], list);
+}
+
+
 int
 virNetServerSetTLSContext(virNetServer *srv,
                           virNetTLSContext *tls)
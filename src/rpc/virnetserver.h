@@ -87,6 +87,9 @@ int virNetServerAddServiceUNIX(virNetServer *srv,
 void virNetServerAddProgram(virNetServer *srv,
                             virNetServerProgram *prog);
 
+void virNetServerGetMetrics(virNetServer *srv,
+                            virTypedParamList *list);
+
 int virNetServerSetTLSContext(virNetServer *srv,
                               virNetTLSContext *tls);
 
@@ -29,11 +29,29 @@
 #include "virlog.h"
 #include "virfile.h"
 #include "virthread.h"
+#include "virenum.h"
+#include "virmetrics.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netserverprogram");
 
+typedef enum {
+    VIR_NET_SERVER_PROGRAM_METRIC_QUEUE_WAIT,
+    VIR_NET_SERVER_PROGRAM_METRIC_EXEC,
+    VIR_NET_SERVER_PROGRAM_METRIC_SERIALIZE,
+
+    VIR_NET_SERVER_PROGRAM_METRIC_LAST
+} virNetServerProgramMetric;
+
+VIR_ENUM_DECL(virNetServerProgramMetric);
+VIR_ENUM_IMPL(virNetServerProgramMetric,
+              VIR_NET_SERVER_PROGRAM_METRIC_LAST,
+              "queue_wait",
+              "exec",
+              "serialize",
+);
+
 struct _virNetServerProgram {
     virObject parent;
 
@@ -41,6 +59,10 @@ struct _virNetServerProgram {
     unsigned version;
     virNetServerProgramProc *procs;
     size_t nprocs;
+
+    /* Latency histograms of procedures indexed by procedure number and
+     * virNetServerProgramMetric, created on first use */
+    virMetricsHistogram **metrics;
 };
 
 
@@ -75,6 +97,8 @@ virNetServerProgram *virNetServerProgramNew(unsigned program,
     prog->version = version;
     prog->procs = procs;
     prog->nprocs = nprocs;
+    prog->metrics = g_new0(virMetricsHistogram *,
+                           nprocs * VIR_NET_SERVER_PROGRAM_METRIC_LAST);
 
     VIR_DEBUG("prog=%p", prog);
 
@@ -122,6 +146,62 @@ static virNetServerProgramProc *virNetServerProgramGetProc(virNetServerProgram *
     return proc;
 }
 
+/*
+ * Records @value microseconds spent by @procedure of @prog in the
+ * histogram "rpc.PROCNAME.METRIC". The histograms belong to @prog so that
+ * they are reported only by the server the program was added to.
+ */
+static void
+virNetServerProgramAddMetric(virNetServerProgram *prog,
+                             int procedure,
+                             virNetServerProgramMetric metric,
+                             unsigned long long value)
+{
+    size_t idx = procedure * VIR_NET_SERVER_PROGRAM_METRIC_LAST + metric;
+    virMetricsHistogram *hist = g_atomic_pointer_get(&prog->metrics[idx]);
+
+    if (!hist) {
+        g_autoptr(virMetricsHistogram) newHist = NULL;
+
+        newHist = virMetricsHistogramNew("rpc.%s.%s",
+                                         prog->procs[procedure].name,
+                                         virNetServerProgramMetricTypeToString(metric));
+
+        /* another worker might have created it meanwhile */
+        if (g_atomic_pointer_compare_and_exchange(&prog->metrics[idx],
+                                                  NULL, newHist))
+            hist = g_steal_pointer(&newHist);
+        else
+            hist = g_atomic_pointer_get(&prog->metrics[idx]);
+    }
+
+    virMetricsHistogramAdd(hist, value);
+}
+
+
+/**
+ * virNetServerProgramGetMetrics:
+ * @prog: the program
+ * @list: typed parameter list to fill
+ *
+ * Appends the latency histograms of all procedures of @prog which were
+ * called since metrics were enabled to @list.
+ */
+void
+virNetServerProgramGetMetrics(virNetServerProgram *prog,
+                              virTypedParamList *list)
+{
+    size_t i;
+
+    for (i = 0; i < prog->nprocs * VIR_NET_SERVER_PROGRAM_METRIC_LAST; i++) {
+        virMetricsHistogram *hist = g_atomic_pointer_get(&prog->metrics[i]);
+
+        if (hist)
+            virMetricsHistogramGetParams(hist, list);
+    }
+}
+
+
 unsigned int
 virNetServerProgramGetPriority(virNetServerProgram *prog,
                                int procedure)
@@ -369,6 +449,10 @@ virNetServerProgramDispatchCall(virNetServerProgram *prog,
     virNetMessageError rerr = { 0 };
     size_t i;
     g_autoptr(virIdentity) identity = NULL;
+    bool metrics = virMetricsIsEnabled();
+    unsigned long long start = 0;
+    unsigned long long decoded = 0;
+    unsigned long long executed = 0;
 
     if (msg->header.status != VIR_NET_OK) {
         virReportError(VIR_ERR_RPC,
@@ -398,12 +482,24 @@ virNetServerProgramDispatchCall(virNetServerProgram *prog,
         goto error;
     }
 
+    if (metrics) {
+        start = g_get_monotonic_time();
+        if (msg->queued)
+            virNetServerProgramAddMetric(prog, msg->header.proc,
+                                         VIR_NET_SERVER_PROGRAM_METRIC_QUEUE_WAIT,
+                                         start - msg->queued);
+    }
+    msg->queued = 0;
+
     arg = g_new0(char, dispatcher->arg_len);
     ret = g_new0(char, dispatcher->ret_len);
 
     if (virNetMessageDecodePayload(msg, dispatcher->arg_filter, arg) < 0)
         goto error;
 
+    if (metrics)
+        decoded = g_get_monotonic_time();
+
     if (!(identity = virNetServerClientGetIdentity(client)))
         goto error;
 
@@ -422,6 +518,13 @@ virNetServerProgramDispatchCall(virNetServerProgram *prog,
      */
     rv = (dispatcher->func)(server, client, msg, &rerr, arg, ret);
 
+    if (metrics) {
+        executed = g_get_monotonic_time();
+        virNetServerProgramAddMetric(prog, msg->header.proc,
+                                     VIR_NET_SERVER_PROGRAM_METRIC_EXEC,
+                                     executed - decoded);
+    }
+
     if (virIdentitySetCurrent(NULL) < 0)
         goto error;
 
@@ -463,6 +566,14 @@ virNetServerProgramDispatchCall(virNetServerProgram *prog,
     if (virNetMessageEncodePayload(msg, dispatcher->ret_filter, ret) < 0)
         goto error;
 
+    /* Both decoding of the arguments and encoding of the reply count as
+     * serialization */
+    if (metrics)
+        virNetServerProgramAddMetric(prog, msg->header.proc,
+                                     VIR_NET_SERVER_PROGRAM_METRIC_SERIALIZE,
+                                     (decoded - start) +
+                                     (g_get_monotonic_time() - executed));
+
     xdr_free(dispatcher->arg_filter, arg);
     xdr_free(dispatcher->ret_filter, ret);
 
@@ -554,6 +665,12 @@ int virNetServerProgramSendStreamHole(virNetServerProgram *prog,
 }
 
 
-void virNetServerProgramDispose(void *obj G_GNUC_UNUSED)
+void virNetServerProgramDispose(void *obj)
 {
+    virNetServerProgram *prog = obj;
+    size_t i;
+
+    for (i = 0; i < prog->nprocs * VIR_NET_SERVER_PROGRAM_METRIC_LAST; i++)
+        virMetricsHistogramFree(prog->metrics[i]);
+    g_free(prog->metrics);
 }
@@ -23,6 +23,7 @@
 
 #include "virnetmessage.h"
 #include "virnetserverclient.h"
+#include "virtypedparam.h"
 
 typedef struct _virNetDaemon virNetDaemon;
 
@@ -47,6 +48,7 @@ struct _virNetServerProgramProc {
     xdrproc_t ret_filter;
     bool needAuth;
     unsigned int priority;
+    const char *name;
 };
 
 virNetServerProgram *virNetServerProgramNew(unsigned program,
@@ -60,6 +62,9 @@ int virNetServerProgramGetVersion(virNetServerProgram *prog);
 unsigned int virNetServerProgramGetPriority(virNetServerProgram *prog,
                                             int procedure);
 
+void virNetServerProgramGetMetrics(virNetServerProgram *prog,
+                                   virTypedParamList *list);
+
 int virNetServerProgramMatches(virNetServerProgram *prog,
                                virNetMessage *msg);
 
@@ -196,6 +196,52 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManager *mgr,
                                                   const virStorageSource *src,
                                                   const char *path,
                                                   bool recall);
+static int
+virSecurityDACTransactionApplyItem(size_t idx,
+                                   void *opaque)
+{
+    virSecurityDACChownList *list = opaque;
+    virSecurityDACChownItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid,
+                                          remember);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path,
+                                                  remember);
+}
+
+
+static int
+virSecurityDACTransactionRollbackItem(size_t idx,
+                                      void *opaque)
+{
+    virSecurityDACChownList *list = opaque;
+    virSecurityDACChownItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        virSecurityDACRestoreFileLabelInternal(list->manager,
+                                               item->src,
+                                               item->path,
+                                               remember);
+    } else {
+        VIR_WARN("Ignoring failed restore attempt on %s",
+                 NULLSTR(item->src ? item->src->path : item->path));
+    }
+
+    return 0;
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -204,7 +250,8 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManager *mgr,
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
  * the list. Depending on security manager configuration it might lock paths
- * we will relabel.
+ * we will relabel. Paths are relabelled in parallel, see
+ * virSecurityManagerTransactionApply.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -216,6 +263,7 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityDACChownList *list = opaque;
     virSecurityManagerMetadataLockState *state;
     g_autofree const char **paths = NULL;
+    g_autofree const char **itempaths = NULL;
     size_t npaths = 0;
     size_t i;
     int rv = 0;
@@ -252,42 +300,15 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    for (i = 0; i < list->nItems; i++) {
-        virSecurityDACChownItem *item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid,
-                                            remember);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path,
-                                                        remember);
-        }
-
-        if (rv < 0)
-            break;
-    }
-
-    for (; rv < 0 && i > 0; i--) {
-        virSecurityDACChownItem *item = list->items[i - 1];
-        const bool remember = item->remember && list->lock;
+    itempaths = g_new0(const char *, list->nItems);
+    for (i = 0; i < list->nItems; i++)
+        itempaths[i] = list->items[i]->path;
 
-        if (!item->restore) {
-            virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                   item->src,
-                                                   item->path,
-                                                   remember);
-        } else {
-            VIR_WARN("Ignoring failed restore attempt on %s",
-                     NULLSTR(item->src ? item->src->path : item->path));
-        }
-    }
+    rv = virSecurityManagerTransactionApply(itempaths, list->nItems,
+                                            VIR_SECURITY_MANAGER_TRANSACTION_WORKERS,
+                                            virSecurityDACTransactionApplyItem,
+                                            virSecurityDACTransactionRollbackItem,
+                                            list);
 
     if (list->lock)
         virSecurityManagerMetadataUnlock(list->manager, &state);
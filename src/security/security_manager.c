@@ -21,6 +21,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #include "security_driver.h"
@@ -31,7 +32,9 @@
 #include "virobject.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virmetrics.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
@@ -48,6 +51,21 @@ struct _virSecurityManager {
 
 static virClass *virSecurityManagerClass;
 
+/*
+ * Metadata locks are taken in processes forked to relabel files, so the
+ * time spent waiting for them is passed back in memory shared with those
+ * processes. It is set up for the outermost transaction of a thread and
+ * found by virSecurityManagerMetadataLock() via a thread local variable,
+ * which survives fork().
+ */
+typedef struct _virSecurityManagerMetadataWait virSecurityManagerMetadataWait;
+struct _virSecurityManagerMetadataWait {
+    bool locked;
+    unsigned long long waited; /* microseconds */
+};
+
+static virThreadLocal virSecurityManagerMetadataWaitLocal;
+
 
 static
 void virSecurityManagerDispose(void *obj)
@@ -66,12 +84,71 @@ virSecurityManagerOnceInit(void)
     if (!VIR_CLASS_NEW(virSecurityManager, virClassForObjectLockable()))
         return -1;
 
+    if (virThreadLocalInit(&virSecurityManagerMetadataWaitLocal, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize thread local variable"));
+        return -1;
+    }
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virSecurityManager);
 
 
+/*
+ * Prepares recording of the time the calling thread spends waiting for
+ * metadata locks unless metrics are disabled or an outer transaction of
+ * the thread records it already.
+ */
+static virSecurityManagerMetadataWait *
+virSecurityManagerMetadataWaitBegin(void)
+{
+    virSecurityManagerMetadataWait *wait;
+
+    if (!virMetricsIsEnabled() ||
+        virThreadLocalGet(&virSecurityManagerMetadataWaitLocal))
+        return NULL;
+
+    wait = mmap(NULL, sizeof(*wait), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (wait == MAP_FAILED) {
+        VIR_DEBUG("Unable to map memory for metadata lock wait time: %s",
+                  g_strerror(errno));
+        return NULL;
+    }
+
+    if (virThreadLocalSet(&virSecurityManagerMetadataWaitLocal, wait) < 0) {
+        munmap(wait, sizeof(*wait));
+        return NULL;
+    }
+
+    return wait;
+}
+
+
+/*
+ * Records the time waited for metadata locks since the matching
+ * virSecurityManagerMetadataWaitBegin() in the
+ * "security.metadata_lock_wait" histogram if any locks were taken.
+ */
+static void
+virSecurityManagerMetadataWaitEnd(virSecurityManagerMetadataWait *wait)
+{
+    if (!wait)
+        return;
+
+    ignore_value(virThreadLocalSet(&virSecurityManagerMetadataWaitLocal, NULL));
+
+    if (wait->locked) {
+        virMetricsHistogramAdd(virMetricsHistogramGet("security.metadata_lock_wait"),
+                               wait->waited);
+    }
+
+    munmap(wait, sizeof(*wait));
+}
+
+
 static virSecurityManager *
 virSecurityManagerNewDriver(virSecurityDriver *drv,
                             const char *virtDriver,
@@ -296,11 +373,20 @@ virSecurityManagerTransactionCommit(virSecurityManager *mgr,
                                     bool lockMetadataException)
 {
     VIR_LOCK_GUARD lockguard = virObjectLockGuard(mgr);
+    virSecurityManagerMetadataWait *wait = NULL;
+    int ret;
 
     if (!mgr->drv->transactionCommit)
         return 0;
 
-    return mgr->drv->transactionCommit(mgr, pid, lock, lockMetadataException);
+    if (lock)
+        wait = virSecurityManagerMetadataWaitBegin();
+
+    ret = mgr->drv->transactionCommit(mgr, pid, lock, lockMetadataException);
+
+    virSecurityManagerMetadataWaitEnd(wait);
+
+    return ret;
 }
 
 
@@ -464,12 +550,20 @@ virSecurityManagerMoveImageMetadata(virSecurityManager *mgr,
                                     virStorageSource *dst)
 {
     VIR_LOCK_GUARD lock = virObjectLockGuard(mgr);
+    virSecurityManagerMetadataWait *wait = NULL;
+    int ret;
 
     if (!mgr->drv->domainMoveImageMetadata)
         return 0;
 
-    return mgr->drv->domainMoveImageMetadata(mgr, sharedFilesystems,
-                                             pid, src, dst);
+    wait = virSecurityManagerMetadataWaitBegin();
+
+    ret = mgr->drv->domainMoveImageMetadata(mgr, sharedFilesystems,
+                                            pid, src, dst);
+
+    virSecurityManagerMetadataWaitEnd(wait);
+
+    return ret;
 }
 
 
@@ -1312,6 +1406,70 @@ cmpstringp(const void *p1,
 #define METADATA_OFFSET 1
 #define METADATA_LEN 1
 
+/* How long to wait for a path locked by somebody else, in microseconds. The
+ * delay between attempts grows exponentially up to the maximum so that
+ * short waits stay short while long ones don't burn CPU. */
+#define METADATA_LOCK_TIMEOUT (10 * G_USEC_PER_SEC)
+#define METADATA_LOCK_DELAY_MIN 1000
+#define METADATA_LOCK_DELAY_MAX (100 * 1000)
+
+
+/**
+ * virSecurityManagerMetadataLockBackoff:
+ * @waited: microseconds spent waiting for a contended lock so far
+ * @delay: delay before the previous attempt, 0 if there was none
+ *
+ * Returns how many microseconds to sleep before the next attempt to take
+ * a contended metadata lock, or 0 if the caller should give up.
+ */
+unsigned long long
+virSecurityManagerMetadataLockBackoff(unsigned long long waited,
+                                      unsigned long long delay)
+{
+    if (waited >= METADATA_LOCK_TIMEOUT)
+        return 0;
+
+    if (delay == 0)
+        return METADATA_LOCK_DELAY_MIN;
+
+    return MIN(delay * 2, METADATA_LOCK_DELAY_MAX);
+}
+
+
+static int
+virSecurityManagerMetadataLockFD(int fd,
+                                 const char *path,
+                                 unsigned long long *waited)
+{
+    unsigned long long start = g_get_monotonic_time();
+    unsigned long long delay = 0;
+
+    while (virFileLock(fd, false, METADATA_OFFSET, METADATA_LEN, false) < 0) {
+        int err = errno;
+        unsigned long long next = 0;
+
+        if (err == EACCES || err == EAGAIN)
+            next = virSecurityManagerMetadataLockBackoff(g_get_monotonic_time() - start,
+                                                         delay);
+
+        if (next == 0) {
+            virReportSystemError(err,
+                                 _("unable to lock %1$s for metadata change"),
+                                 path);
+            return -1;
+        }
+
+        delay = next;
+        g_usleep(delay);
+    }
+
+    if (delay > 0)
+        *waited += g_get_monotonic_time() - start;
+
+    return 0;
+}
+
+
 /**
  * virSecurityManagerMetadataLock:
  * @mgr: security manager object
@@ -1341,6 +1499,10 @@ virSecurityManagerMetadataLock(virSecurityManager *mgr G_GNUC_UNUSED,
     size_t nfds = 0;
     int *fds = NULL;
     const char **locked_paths = NULL;
+    g_autoptr(GHashTable) locked_files = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                               g_free, NULL);
+    unsigned long long waited = 0;
+    virSecurityManagerMetadataWait *wait;
     virSecurityManagerMetadataLockState *ret = NULL;
 
     fds = g_new0(int, npaths);
@@ -1352,17 +1514,15 @@ virSecurityManagerMetadataLock(virSecurityManager *mgr G_GNUC_UNUSED,
      * in reversed order a deadlock might occur.  But if we sort
      * the paths alphabetically then both processes will try lock
      * paths in the same order and thus no deadlock can occur.
-     * Lastly, it makes searching for duplicate paths below
-     * simpler. */
+     * Lastly, it puts duplicate paths next to each other. */
     if (paths) {
         g_qsort_with_data(paths, npaths, sizeof(*paths), cmpstringp, NULL);
     }
 
     for (i = 0; i < npaths; i++) {
         const char *p = paths[i];
+        g_autofree char *file = NULL;
         struct stat sb;
-        size_t j;
-        int retries = 10 * 1000;
         int fd;
 
         if (!p)
@@ -1373,12 +1533,7 @@ virSecurityManagerMetadataLock(virSecurityManager *mgr G_GNUC_UNUSED,
          * we would deadlock with ourselves trying to lock it the
          * second time. After all, we've locked it when iterating
          * over it the first time. */
-        for (j = 0; j < i; j++) {
-            if (STREQ_NULLABLE(p, paths[j]))
-                break;
-        }
-
-        if (i != j)
+        if (i > 0 && STREQ_NULLABLE(p, paths[i - 1]))
             continue;
 
         /* Any attempt to lock a lock file is likely to go very
@@ -1400,6 +1555,15 @@ virSecurityManagerMetadataLock(virSecurityManager *mgr G_GNUC_UNUSED,
             continue;
         }
 
+        /* Different paths may lead to the same file, e.g. via symlinks.
+         * Locking it twice would be pointless and closing either FD would
+         * release the lock for both. */
+        file = g_strdup_printf("%llu:%llu",
+                               (unsigned long long) sb.st_dev,
+                               (unsigned long long) sb.st_ino);
+        if (g_hash_table_contains(locked_files, file))
+            continue;
+
         if ((fd = open(p, O_RDWR)) < 0) {
             if (errno == EROFS) {
                 /* There is nothing we can do for RO filesystem. */
@@ -1425,30 +1589,25 @@ virSecurityManagerMetadataLock(virSecurityManager *mgr G_GNUC_UNUSED,
             goto cleanup;
         }
 
-        do {
-            if (virFileLock(fd, false,
-                            METADATA_OFFSET, METADATA_LEN, false) < 0) {
-                if (retries && (errno == EACCES || errno == EAGAIN)) {
-                    /* File is locked. Try again. */
-                    retries--;
-                    g_usleep(1000);
-                    continue;
-                } else {
-                    virReportSystemError(errno,
-                                         _("unable to lock %1$s for metadata change"),
-                                         p);
-                    VIR_FORCE_CLOSE(fd);
-                    goto cleanup;
-                }
-            }
-
-            break;
-        } while (1);
+        if (virSecurityManagerMetadataLockFD(fd, p, &waited) < 0) {
+            VIR_FORCE_CLOSE(fd);
+            goto cleanup;
+        }
 
+        g_hash_table_add(locked_files, g_steal_pointer(&file));
         locked_paths[nfds] = p;
         VIR_APPEND_ELEMENT_COPY_INPLACE(fds, nfds, fd);
     }
 
+    if (waited > 0)
+        VIR_DEBUG("Waited %llu ms to lock metadata of %zu paths",
+                  waited / 1000, nfds);
+
+    if ((wait = virThreadLocalGet(&virSecurityManagerMetadataWaitLocal))) {
+        wait->locked = true;
+        wait->waited += waited;
+    }
+
     ret = g_new0(virSecurityManagerMetadataLockState, 1);
 
     ret->paths = g_steal_pointer(&locked_paths);
@@ -1495,3 +1654,145 @@ virSecurityManagerMetadataUnlock(virSecurityManager *mgr G_GNUC_UNUSED,
     VIR_FREE((*state)->paths);
     VIR_FREE(*state);
 }
+
+
+typedef struct _virSecurityManagerTransaction virSecurityManagerTransaction;
+struct _virSecurityManagerTransaction {
+    size_t nitems;
+    size_t *groups; /* first item of each group of items on the same file */
+    size_t *next;   /* next item in the group, @nitems terminates it */
+    virSecurityManagerTransactionFunc apply;
+    void *opaque;
+
+    bool *done;
+    virErrorPtr *errors;
+    int failed;     /* atomic */
+};
+
+
+static void
+virSecurityManagerTransactionWorker(size_t idx,
+                                    void *opaque)
+{
+    virSecurityManagerTransaction *tr = opaque;
+    size_t i;
+
+    for (i = tr->groups[idx]; i < tr->nitems; i = tr->next[i]) {
+        if (g_atomic_int_get(&tr->failed))
+            return;
+
+        if (tr->apply(i, tr->opaque) < 0) {
+            virErrorPreserveLast(&tr->errors[i]);
+            g_atomic_int_set(&tr->failed, 1);
+            return;
+        }
+
+        tr->done[i] = true;
+    }
+}
+
+
+/**
+ * virSecurityManagerTransactionApply:
+ * @paths: paths the items of a transaction operate on, may contain NULL
+ * @nitems: number of items in @paths
+ * @maxWorkers: maximum number of items processed in parallel
+ * @apply: callback applying an item
+ * @rollback: callback reverting an applied item
+ * @opaque: data passed to @apply and @rollback
+ *
+ * Applies all items of a relabelling transaction. Items operating on
+ * different files are applied by up to @maxWorkers threads in parallel,
+ * items on the same file (including all items with NULL path) are applied
+ * one after another in the order of @paths. Files are identified by their
+ * device and inode numbers so that symlinks and hard links to a file are
+ * not relabelled in parallel with the file itself, paths which can't be
+ * stat'ed are compared as strings. Once an item fails no more
+ * items are started and all items which were applied are reverted in
+ * reverse order of @paths, regardless of the order they were applied in.
+ *
+ * Returns: 0 on success,
+ *         -1 on failure with the error of the first failed item reported.
+ */
+int
+virSecurityManagerTransactionApply(const char **paths,
+                                   size_t nitems,
+                                   size_t maxWorkers,
+                                   virSecurityManagerTransactionFunc apply,
+                                   virSecurityManagerTransactionFunc rollback,
+                                   void *opaque)
+{
+    virSecurityManagerTransaction tr = { .nitems = nitems, .apply = apply,
+                                         .opaque = opaque };
+    g_autoptr(GHashTable) last = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                       g_free, NULL);
+    size_t lastNull = 0;
+    size_t ngroups = 0;
+    size_t i;
+    int ret = 0;
+
+    tr.groups = g_new0(size_t, nitems);
+    tr.next = g_new0(size_t, nitems);
+    tr.done = g_new0(bool, nitems);
+    tr.errors = g_new0(virErrorPtr, nitems);
+
+    /* Last item on each path is stored in @last incremented by one */
+    for (i = 0; i < nitems; i++) {
+        g_autofree char *key = NULL;
+        struct stat sb;
+        size_t prev;
+
+        if (paths[i]) {
+            if (stat(paths[i], &sb) == 0)
+                key = g_strdup_printf("%llu:%llu",
+                                      (unsigned long long) sb.st_dev,
+                                      (unsigned long long) sb.st_ino);
+            else
+                key = g_strdup_printf("path:%s", paths[i]);
+
+            prev = GPOINTER_TO_SIZE(g_hash_table_lookup(last, key));
+        } else {
+            prev = lastNull;
+        }
+
+        tr.next[i] = nitems;
+
+        if (prev > 0)
+            tr.next[prev - 1] = i;
+        else
+            tr.groups[ngroups++] = i;
+
+        if (key)
+            g_hash_table_insert(last, g_steal_pointer(&key),
+                                GSIZE_TO_POINTER(i + 1));
+        else
+            lastNull = i + 1;
+    }
+
+    virThreadPoolRunParallel("sec-relabel", maxWorkers, ngroups,
+                             virSecurityManagerTransactionWorker, &tr);
+
+    if (tr.failed) {
+        for (i = nitems; i > 0; i--) {
+            if (tr.done[i - 1])
+                rollback(i - 1, opaque);
+        }
+
+        for (i = 0; i < nitems; i++) {
+            if (tr.errors[i]) {
+                virErrorRestore(&tr.errors[i]);
+                break;
+            }
+        }
+
+        ret = -1;
+    }
+
+    for (i = 0; i < nitems; i++)
+        virFreeError(tr.errors[i]);
+    g_free(tr.errors);
+    g_free(tr.done);
+    g_free(tr.next);
+    g_free(tr.groups);
+    return ret;
+}
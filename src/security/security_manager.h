@@ -251,6 +251,10 @@ struct _virSecurityManagerMetadataLockState {
 };
 
 
+unsigned long long
+virSecurityManagerMetadataLockBackoff(unsigned long long waited,
+                                      unsigned long long delay);
+
 virSecurityManagerMetadataLockState *
 virSecurityManagerMetadataLock(virSecurityManager *mgr,
                                char *const *sharedFilesystems,
@@ -261,3 +265,17 @@ virSecurityManagerMetadataLock(virSecurityManager *mgr,
 void
 virSecurityManagerMetadataUnlock(virSecurityManager *mgr,
                                  virSecurityManagerMetadataLockState **state);
+
+/* Maximum number of items of a transaction applied in parallel */
+#define VIR_SECURITY_MANAGER_TRANSACTION_WORKERS 8
+
+typedef int (*virSecurityManagerTransactionFunc)(size_t idx,
+                                                 void *opaque);
+
+int
+virSecurityManagerTransactionApply(const char **paths,
+                                   size_t nitems,
+                                   size_t maxWorkers,
+                                   virSecurityManagerTransactionFunc apply,
+                                   virSecurityManagerTransactionFunc rollback,
+                                   void *opaque);
@@ -267,6 +267,47 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManager *mgr,
                                               bool recall);
 
 
+static int
+virSecuritySELinuxTransactionApplyItem(size_t idx,
+                                       void *opaque)
+{
+    virSecuritySELinuxContextList *list = opaque;
+    virSecuritySELinuxContextItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecuritySELinuxSetFilecon(list->manager,
+                                            item->path,
+                                            item->tcon,
+                                            remember);
+    }
+
+    return virSecuritySELinuxRestoreFileLabel(list->manager,
+                                              item->path,
+                                              remember);
+}
+
+
+static int
+virSecuritySELinuxTransactionRollbackItem(size_t idx,
+                                          void *opaque)
+{
+    virSecuritySELinuxContextList *list = opaque;
+    virSecuritySELinuxContextItem *item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        virSecuritySELinuxRestoreFileLabel(list->manager,
+                                           item->path,
+                                           remember);
+    } else {
+        VIR_WARN("Ignoring failed restore attempt on %s", item->path);
+    }
+
+    return 0;
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -274,7 +315,8 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManager *mgr,
  *
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
- * the list.
+ * the list. Paths are relabelled in parallel, see
+ * virSecurityManagerTransactionApply.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -286,6 +328,8 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecuritySELinuxContextList *list = opaque;
     virSecurityManagerMetadataLockState *state;
     g_autofree const char **paths = NULL;
+    g_autofree const char **itempaths = NULL;
+    size_t maxWorkers = VIR_SECURITY_MANAGER_TRANSACTION_WORKERS;
     size_t npaths = 0;
     size_t i;
     int rv;
@@ -322,38 +366,19 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
         }
     }
 
-    rv = 0;
+    itempaths = g_new0(const char *, list->nItems);
     for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItem *item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecuritySELinuxSetFilecon(list->manager,
-                                              item->path,
-                                              item->tcon,
-                                              remember);
-        } else {
-            rv = virSecuritySELinuxRestoreFileLabel(list->manager,
-                                                    item->path,
-                                                    remember);
-        }
+        itempaths[i] = list->items[i]->path;
 
-        if (rv < 0)
-            break;
+        /* Looking up default labels isn't guaranteed to be thread safe */
+        if (list->items[i]->restore)
+            maxWorkers = 1;
     }
 
-    for (; rv < 0 && i > 0; i--) {
-        virSecuritySELinuxContextItem *item = list->items[i - 1];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            virSecuritySELinuxRestoreFileLabel(list->manager,
-                                               item->path,
-                                               remember);
-        } else {
-            VIR_WARN("Ignoring failed restore attempt on %s", item->path);
-        }
-    }
+    rv = virSecurityManagerTransactionApply(itempaths, list->nItems, maxWorkers,
+                                            virSecuritySELinuxTransactionApplyItem,
+                                            virSecuritySELinuxTransactionRollbackItem,
+                                            list);
 
     if (list->lock)
         virSecurityManagerMetadataUnlock(list->manager, &state);
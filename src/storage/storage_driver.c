@@ -2592,6 +2592,9 @@ storageVolWipePattern(virStorageVolPtr vol,
         goto cleanup;
     }
 
+    if (!(voldef->wipeJob = virStorageVolWipeJobNew()))
+        goto cleanup;
+
     virStoragePoolObjIncrAsyncjobs(obj);
     voldef->in_use++;
     virObjectUnlock(obj);
@@ -2601,6 +2604,7 @@ storageVolWipePattern(virStorageVolPtr vol,
     virObjectLock(obj);
     voldef->in_use--;
     virStoragePoolObjDecrAsyncjobs(obj);
+    g_clear_pointer(&voldef->wipeJob, virStorageVolWipeJobFree);
 
     if (rc < 0)
         goto cleanup;
@@ -2633,6 +2637,39 @@ storageVolWipe(virStorageVolPtr vol,
 }
 
 
+static int
+storageVolWipeAbort(virStorageVolPtr vol,
+                    unsigned int flags)
+{
+    virStoragePoolObj *obj = NULL;
+    virStorageVolDef *voldef = NULL;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!(voldef = virStorageVolDefFromVol(vol, &obj, NULL)))
+        return -1;
+
+    if (virStorageVolWipeAbortEnsureACL(vol->conn,
+                                        virStoragePoolObjGetDef(obj),
+                                        voldef) < 0)
+        goto cleanup;
+
+    if (!voldef->wipeJob) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("volume '%1$s' is not being wiped"),
+                       voldef->name);
+        goto cleanup;
+    }
+
+    ret = virStorageVolWipeJobAbort(voldef->wipeJob);
+
+ cleanup:
+    virStoragePoolObjEndAPI(&obj);
+    return ret;
+}
+
+
 static int
 storageVolGetInfoFlags(virStorageVolPtr vol,
                        virStorageVolInfoPtr info,
@@ -2865,6 +2902,7 @@ static virStorageDriver storageDriver = {
     .storageVolDelete = storageVolDelete, /* 0.4.0 */
     .storageVolWipe = storageVolWipe, /* 0.8.0 */
     .storageVolWipePattern = storageVolWipePattern, /* 0.9.10 */
+    .storageVolWipeAbort = storageVolWipeAbort, /* 11.9.0 */
     .storageVolGetInfo = storageVolGetInfo, /* 0.4.0 */
     .storageVolGetInfoFlags = storageVolGetInfoFlags, /* 3.0.0 */
     .storageVolGetXMLDesc = storageVolGetXMLDesc, /* 0.4.0 */
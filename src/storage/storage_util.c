@@ -52,6 +52,8 @@
 #include "virstoragefile.h"
 #include "storage_file_probe.h"
 #include "storage_util.h"
+#define LIBVIRT_STORAGE_UTILPRIV_H_ALLOW
+#include "storage_utilpriv.h"
 #include "storage_source.h"
 #include "storage_source_conf.h"
 #include "virlog.h"
@@ -63,6 +65,8 @@
 #include "virfdstream.h"
 #include "virutil.h"
 #include "virsecureerase.h"
+#include "virthread.h"
+#include "virmetrics.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -114,13 +118,127 @@ reflinkCloneFile(int dest_fd G_GNUC_UNUSED,
 #endif
 
 
-static int ATTRIBUTE_NONNULL(2)
-virStorageBackendCopyToFD(virStorageVolDef *vol,
-                          virStorageVolDef *inputvol,
-                          int fd,
-                          unsigned long long *total,
-                          bool want_sparse,
-                          bool reflink_copy)
+/*
+ * Copy @total bytes from @inputfd to @fd using copy_file_range(), which
+ * avoids bouncing the data through userspace and lets file systems which
+ * support it share or offload the copy. If @want_sparse is true, holes in the
+ * input are skipped using SEEK_DATA/SEEK_HOLE.
+ *
+ * Returns 0 on success, 1 if copy_file_range() is not usable for the pair of
+ * files and nothing was copied yet, -1 on error.
+ */
+#if WITH_COPY_FILE_RANGE && defined(SEEK_DATA) && defined(SEEK_HOLE)
+static int
+storageBackendCopyRangeToFD(virStorageVolDef *vol,
+                            virStorageVolDef *inputvol,
+                            int inputfd,
+                            int fd,
+                            unsigned long long *total,
+                            bool want_sparse)
+{
+    off_t end = *total;
+    off_t data = 0;
+    bool copied = false;
+
+    while (data < end) {
+        off_t hole = end;
+
+        if (want_sparse) {
+            if ((data = lseek(inputfd, data, SEEK_DATA)) < 0) {
+                /* there's only a hole left till the end of the file */
+                if (errno == ENXIO)
+                    break;
+
+                virReportSystemError(errno,
+                                     _("cannot seek to data in file '%1$s'"),
+                                     inputvol->target.path);
+                return -1;
+            }
+
+            if (data >= end)
+                break;
+
+            if ((hole = lseek(inputfd, data, SEEK_HOLE)) < 0) {
+                virReportSystemError(errno,
+                                     _("cannot seek to hole in file '%1$s'"),
+                                     inputvol->target.path);
+                return -1;
+            }
+
+            hole = MIN(hole, end);
+        }
+
+        while (data < hole) {
+            off_t inoff = data;
+            off_t outoff = data;
+            ssize_t rc;
+
+            rc = copy_file_range(inputfd, &inoff, fd, &outoff, hole - data, 0);
+
+            if (rc < 0) {
+                if (!copied &&
+                    (errno == ENOSYS || errno == EXDEV ||
+                     errno == EINVAL || errno == EOPNOTSUPP)) {
+                    VIR_DEBUG("copy_file_range not usable: %s", g_strerror(errno));
+                    if (lseek(inputfd, 0, SEEK_SET) < 0) {
+                        virReportSystemError(errno,
+                                             _("cannot seek in file '%1$s'"),
+                                             inputvol->target.path);
+                        return -1;
+                    }
+                    return 1;
+                }
+
+                virReportSystemError(errno,
+                                     _("failed to copy data from '%1$s' to '%2$s'"),
+                                     inputvol->target.path, vol->target.path);
+                return -1;
+            }
+
+            /* the input is shorter than expected */
+            if (rc == 0) {
+                end = data;
+                break;
+            }
+
+            data += rc;
+            copied = true;
+        }
+    }
+
+    /* Leave both files positioned as if the data was read and written */
+    if (lseek(inputfd, end, SEEK_SET) < 0 ||
+        lseek(fd, end, SEEK_SET) < 0) {
+        virReportSystemError(errno,
+                             _("cannot seek in file '%1$s'"),
+                             vol->target.path);
+        return -1;
+    }
+
+    *total -= end;
+    return 0;
+}
+#else /* !WITH_COPY_FILE_RANGE || !defined(SEEK_DATA) || !defined(SEEK_HOLE) */
+static int
+storageBackendCopyRangeToFD(virStorageVolDef *vol G_GNUC_UNUSED,
+                            virStorageVolDef *inputvol G_GNUC_UNUSED,
+                            int inputfd G_GNUC_UNUSED,
+                            int fd G_GNUC_UNUSED,
+                            unsigned long long *total G_GNUC_UNUSED,
+                            bool want_sparse G_GNUC_UNUSED)
+{
+    return 1;
+}
+#endif /* !WITH_COPY_FILE_RANGE || !defined(SEEK_DATA) || !defined(SEEK_HOLE) */
+
+
+static int
+storageBackendCopyLoopToFD(virStorageVolDef *vol,
+                           virStorageVolDef *inputvol,
+                           int inputfd,
+                           int fd,
+                           unsigned long long *total,
+                           bool want_sparse)
 {
     int amtread = -1;
     size_t rbytes = READ_BLOCK_SIZE_DEFAULT;
@@ -129,14 +247,6 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
     struct stat st;
     g_autofree char *zerobuf = NULL;
     g_autofree char *buf = NULL;
-    VIR_AUTOCLOSE inputfd = -1;
-
-    if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
-        virReportSystemError(errno,
-                             _("could not open input path '%1$s'"),
-                             inputvol->target.path);
-        return -1;
-    }
 
 #ifdef __linux__
     if (ioctl(fd, BLKBSZGET, &wbytes) < 0)
@@ -151,18 +261,6 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
 
     buf = g_new0(char, rbytes);
 
-    if (reflink_copy) {
-        if (reflinkCloneFile(fd, inputfd) < 0) {
-            virReportSystemError(errno,
-                                 _("failed to clone files from '%1$s'"),
-                                 inputvol->target.path);
-            return -1;
-        } else {
-            VIR_DEBUG("btrfs clone finished.");
-            return 0;
-        }
-    }
-
     while (amtread != 0) {
         int amtleft;
 
@@ -201,6 +299,76 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
         } while ((amtleft -= interval) > 0);
     }
 
+    return 0;
+}
+
+
+/*
+ * Copy the contents of @inputvol to @fd. The fastest usable method is
+ * picked: a reflink clone if requested by @reflink_copy, copy_file_range()
+ * if both volumes are regular files and @sparse_output allows the file
+ * system to share extents or leave holes in @fd, and a read/write loop
+ * otherwise. The time spent copying is recorded in the
+ * storage.copy.METHOD histogram of the method used.
+ */
+int
+virStorageBackendCopyToFD(virStorageVolDef *vol,
+                          virStorageVolDef *inputvol,
+                          int fd,
+                          unsigned long long *total,
+                          bool want_sparse,
+                          bool sparse_output,
+                          bool reflink_copy)
+{
+    struct stat inputst;
+    struct stat st;
+    int rc = 1;
+    const char *method = "copy_file_range";
+    unsigned long long start = g_get_monotonic_time();
+    VIR_AUTOCLOSE inputfd = -1;
+
+    if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
+        virReportSystemError(errno,
+                             _("could not open input path '%1$s'"),
+                             inputvol->target.path);
+        return -1;
+    }
+
+    if (reflink_copy) {
+        if (reflinkCloneFile(fd, inputfd) < 0) {
+            virReportSystemError(errno,
+                                 _("failed to clone files from '%1$s'"),
+                                 inputvol->target.path);
+            return -1;
+        } else {
+            VIR_DEBUG("btrfs clone finished.");
+            virMetricsHistogramAdd(virMetricsHistogramGet("storage.copy.reflink"),
+                                   g_get_monotonic_time() - start);
+            return 0;
+        }
+    }
+
+    /* copy_file_range() may share extents with the input or keep its
+     * holes, which would defeat preallocation of the output */
+    if (sparse_output &&
+        fstat(inputfd, &inputst) == 0 && S_ISREG(inputst.st_mode) &&
+        fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if ((rc = storageBackendCopyRangeToFD(vol, inputvol, inputfd, fd,
+                                              total, want_sparse)) < 0)
+            return -1;
+    }
+
+    if (rc != 0) {
+        if (storageBackendCopyLoopToFD(vol, inputvol, inputfd, fd,
+                                       total, want_sparse) < 0)
+            return -1;
+
+        method = "read_write";
+    }
+
+    VIR_DEBUG("copied '%s' to '%s' using %s",
+              inputvol->target.path, vol->target.path, method);
+
     if (virFileDataSync(fd) < 0) {
         virReportSystemError(errno, _("cannot sync data to file '%1$s'"),
                              vol->target.path);
@@ -214,6 +382,8 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
         return -1;
     }
 
+    virMetricsHistogramAdd(virMetricsHistogramGet("storage.copy.%s", method),
+                           g_get_monotonic_time() - start);
     return 0;
 }
 
@@ -255,7 +425,7 @@ storageBackendCreateBlockFrom(virStoragePoolObj *pool G_GNUC_UNUSED,
 
     if (inputvol) {
         if (virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                      false, reflink_copy) < 0)
+                                      false, false, reflink_copy) < 0)
             return -1;
     }
 
@@ -301,13 +471,16 @@ createRawFile(int fd, virStorageVolDef *vol,
               bool reflink_copy)
 {
     bool need_alloc = true;
+    bool sparse = false;
     unsigned long long pos = 0;
 
     /* If the new allocation is lower than the capacity of the original file,
      * the cloned volume will be sparse */
     if (inputvol &&
-        vol->target.allocation < inputvol->target.capacity)
+        vol->target.allocation < inputvol->target.capacity) {
         need_alloc = false;
+        sparse = true;
+    }
 
     /* Seek to the final size, so the capacity is available upfront
      * for progress reporting */
@@ -345,7 +518,7 @@ createRawFile(int fd, virStorageVolDef *vol,
          * allocation (allocation < capacity) or we have already
          * been able to allocate the required space. */
         if (virStorageBackendCopyToFD(vol, inputvol, fd, &remain,
-                                      !need_alloc, reflink_copy) < 0)
+                                      !need_alloc, sparse, reflink_copy) < 0)
             return -1;
 
         /* If the new allocation is greater than the original capacity,
@@ -2383,12 +2556,13 @@ virStorageBackendVolResizeLocal(virStoragePoolObj *pool,
                                 unsigned int flags)
 {
     bool pre_allocate = flags & VIR_STORAGE_VOL_RESIZE_ALLOCATE;
+    int ret;
 
     virCheckFlags(VIR_STORAGE_VOL_RESIZE_ALLOCATE |
                   VIR_STORAGE_VOL_RESIZE_SHRINK, -1);
 
     if (vol->target.format == VIR_STORAGE_FILE_RAW && !vol->target.encryption) {
-        return virFileResize(vol->target.path, capacity, pre_allocate);
+        ret = virFileResize(vol->target.path, capacity, pre_allocate);
     } else if (vol->target.format == VIR_STORAGE_FILE_RAW && vol->target.encryption) {
         if (pre_allocate) {
             virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
@@ -2396,9 +2570,9 @@ virStorageBackendVolResizeLocal(virStoragePoolObj *pool,
             return -1;
         }
 
-        return storageBackendResizeQemuImg(pool, vol, capacity);
+        ret = storageBackendResizeQemuImg(pool, vol, capacity);
     } else if (vol->target.format == VIR_STORAGE_FILE_PLOOP) {
-        return storagePloopResize(vol, capacity);
+        ret = storagePloopResize(vol, capacity);
     } else {
         if (pre_allocate) {
             virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
@@ -2406,8 +2580,11 @@ virStorageBackendVolResizeLocal(virStoragePoolObj *pool,
             return -1;
         }
 
-        return storageBackendResizeQemuImg(pool, vol, capacity);
+        ret = storageBackendResizeQemuImg(pool, vol, capacity);
     }
+
+    virStorageSourceHeaderCacheInvalidate(&vol->target);
+    return ret;
 }
 
 
@@ -2551,18 +2728,346 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/* Minimal amount of data written at once when zeroing a volume manually */
+#define VIR_STORAGE_WIPE_CHUNK_SIZE (1024 * 1024)
+/* Alignment of O_DIRECT writes, large enough for any logical block size */
+#define VIR_STORAGE_WIPE_ALIGN (64 * 1024)
+/* Maximum number of concurrent writes when zeroing a volume manually */
+#define VIR_STORAGE_WIPE_WORKERS 4
+/* Amount of data zeroed by a single BLKZEROOUT call, so that progress can
+ * be reported and the wipe can be aborted in between */
+#define VIR_STORAGE_WIPE_OFFLOAD_CHUNK_SIZE (1024 * 1024 * 1024ULL)
+
+
+static int
+storageBackendWipeLocalAborted(const char *path)
+{
+    virReportError(VIR_ERR_OPERATION_ABORTED,
+                   _("wiping of volume with path '%1$s' was aborted"),
+                   path);
+    return -1;
+}
+
+/*
+ * Let the kernel zero the block device range, which can be offloaded to
+ * the device (e.g. via WRITE ZEROES) instead of us pushing the zeroes
+ * through the page cache.
+ *
+ * The range is zeroed in parts of VIR_STORAGE_WIPE_OFFLOAD_CHUNK_SIZE
+ * which are accounted to @job, if given.
+ *
+ * Returns 0 if the range was zeroed, 1 if the caller has to write the
+ * zeroes itself and -1 on error.
+ */
+#if defined(__linux__) && defined(BLKZEROOUT)
+int
+storageBackendWipeLocalOffload(const char *path,
+                               int fd,
+                               off_t start,
+                               unsigned long long len,
+                               virStorageVolWipeJob *job)
+{
+    struct stat st;
+    unsigned long long offset = 0;
+
+    if (fstat(fd, &st) < 0 || !S_ISBLK(st.st_mode))
+        return 1;
+
+    /* the ioctl requires ranges aligned to the logical sector size */
+    if (start % 512 != 0 || len % 512 != 0)
+        return 1;
+
+    while (offset < len) {
+        uint64_t range[2] = { start + offset,
+                              MIN(len - offset, VIR_STORAGE_WIPE_OFFLOAD_CHUNK_SIZE) };
+
+        if (ioctl(fd, BLKZEROOUT, range) < 0) {
+            if (offset == 0 &&
+                (errno == ENOTTY || errno == EOPNOTSUPP || errno == EINVAL)) {
+                VIR_DEBUG("BLKZEROOUT not usable on '%s': %s",
+                          path, g_strerror(errno));
+                return 1;
+            }
+
+            virReportSystemError(errno,
+                                 _("Failed to zero %1$llu bytes of volume with path '%2$s'"),
+                                 (unsigned long long)range[1], path);
+            return -1;
+        }
+
+        offset += range[1];
+
+        if (job && !virStorageVolWipeJobUpdate(job, range[1]))
+            return storageBackendWipeLocalAborted(path);
+    }
+
+    VIR_DEBUG("Zeroed %llu bytes of volume with path '%s' using BLKZEROOUT",
+              len, path);
+    return 0;
+}
+#else /* !__linux__ || !BLKZEROOUT */
+int
+storageBackendWipeLocalOffload(const char *path G_GNUC_UNUSED,
+                               int fd G_GNUC_UNUSED,
+                               off_t start G_GNUC_UNUSED,
+                               unsigned long long len G_GNUC_UNUSED,
+                               virStorageVolWipeJob *job G_GNUC_UNUSED)
+{
+    return 1;
+}
+#endif /* !__linux__ || !BLKZEROOUT */
+
+
+struct storageBackendWipeWriteData {
+    int fd;
+    const char *buf;
+    size_t chunk;
+    off_t start;
+    unsigned long long len;
+    virStorageVolWipeJob *job;
+
+    virMutex lock;
+    unsigned long long next; /* offset of the first chunk nobody writes yet */
+    unsigned long long done;
+    unsigned long long reported;
+    int err;                 /* errno of the first failed write */
+    unsigned long long errOffset;
+};
+
+
+static int
+storageBackendWipeLocalPwrite(int fd,
+                              const char *buf,
+                              size_t len,
+                              off_t offset)
+{
+    while (len > 0) {
+        ssize_t written = pwrite(fd, buf, len, offset);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        if (written == 0) {
+            errno = ENOSPC;
+            return -1;
+        }
+
+        buf += written;
+        len -= written;
+        offset += written;
+    }
+
+    return 0;
+}
+
+
+/* Writes chunks of zeroes until the whole range is claimed by workers or
+ * any of the workers fails. Runs in several threads at once. */
+static void
+storageBackendWipeLocalWriteWorker(void *opaque)
+{
+    struct storageBackendWipeWriteData *data = opaque;
+
+    for (;;) {
+        unsigned long long offset;
+        size_t len;
+
+        virMutexLock(&data->lock);
+        if (data->err != 0 || data->next >= data->len) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        offset = data->next;
+        len = MIN(data->chunk, data->len - offset);
+        data->next += len;
+        virMutexUnlock(&data->lock);
+
+        if (storageBackendWipeLocalPwrite(data->fd, data->buf, len,
+                                          data->start + offset) < 0) {
+            int err = errno;
+
+            virMutexLock(&data->lock);
+            if (data->err == 0) {
+                data->err = err;
+                data->errOffset = offset;
+            }
+            virMutexUnlock(&data->lock);
+            return;
+        }
+
+        if (data->job && !virStorageVolWipeJobUpdate(data->job, len)) {
+            virMutexLock(&data->lock);
+            if (data->err == 0) {
+                data->err = ECANCELED;
+                data->errOffset = offset;
+            }
+            virMutexUnlock(&data->lock);
+            return;
+        }
+
+        virMutexLock(&data->lock);
+        data->done += len;
+        /* report progress roughly every 10% */
+        if (data->done - data->reported >= data->len / 10) {
+            data->reported = data->done;
+            VIR_DEBUG("Wiped %llu of %llu bytes at offset %jd",
+                      data->done, data->len, (intmax_t)data->start);
+        }
+        virMutexUnlock(&data->lock);
+    }
+}
+
+
+/* Zeroes @len bytes of @fd from @start using up to
+ * VIR_STORAGE_WIPE_WORKERS concurrent writes of @chunk bytes of @buf.
+ * Returns 0 on success or the errno of the first failed write, with
+ * the offset relative to @start stored in @errOffset. ECANCELED is
+ * returned if @job was aborted. */
 static int
+storageBackendWipeLocalWriteRange(int fd,
+                                  const char *buf,
+                                  size_t chunk,
+                                  off_t start,
+                                  unsigned long long len,
+                                  virStorageVolWipeJob *job,
+                                  unsigned long long *errOffset)
+{
+    struct storageBackendWipeWriteData data = {
+        .fd = fd, .buf = buf, .chunk = chunk, .start = start, .len = len,
+        .job = job,
+    };
+    virThread threads[VIR_STORAGE_WIPE_WORKERS - 1];
+    size_t nthreads = 0;
+    size_t i;
+
+    if (virMutexInit(&data.lock) < 0)
+        return errno ? errno : ENOMEM;
+
+    /* The calling thread is one of the workers, so failing to create
+     * additional threads only makes the wipe slower */
+    for (i = 0; i < G_N_ELEMENTS(threads) && (i + 1) * chunk < len; i++) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                storageBackendWipeLocalWriteWorker,
+                                "storage-wipe", false, &data) < 0) {
+            VIR_DEBUG("Unable to create wipe thread: %s", g_strerror(errno));
+            break;
+        }
+        nthreads++;
+    }
+
+    storageBackendWipeLocalWriteWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virMutexDestroy(&data.lock);
+
+    *errOffset = data.errOffset;
+    return data.err;
+}
+
+
+/*
+ * Writes zeroes to @wipe_len bytes of the volume starting at @start.
+ *
+ * Large aligned part of the range is written through a separate O_DIRECT
+ * file descriptor so that the zeroes don't go through (and evict) the page
+ * cache, with several writes in flight to keep the device busy. If the
+ * volume can't be opened or written with O_DIRECT, e.g. on tmpfs, the
+ * buffered @fd is used instead. The unaligned tail is always written
+ * through @fd. Written data is accounted to @job, if given.
+ */
+int
+storageBackendWipeLocalWrite(const char *path,
+                             int fd,
+                             off_t start,
+                             unsigned long long wipe_len,
+                             size_t writebuf_length,
+                             virStorageVolWipeJob *job)
+{
+    g_autofree void *base = NULL;
+    char *writebuf = NULL;
+    unsigned long long direct_len = 0;
+    unsigned long long errOffset = 0;
+    VIR_AUTOCLOSE directfd = -1;
+    int err = 0;
+
+    /* Writing in small chunks (e.g. st_blksize) makes wiping of large
+     * volumes take ages */
+    writebuf_length = MAX(writebuf_length, VIR_STORAGE_WIPE_CHUNK_SIZE);
+    writebuf_length = VIR_ROUND_UP(writebuf_length, VIR_STORAGE_WIPE_ALIGN);
+
+#if WITH_POSIX_MEMALIGN
+    if (posix_memalign(&base, VIR_STORAGE_WIPE_ALIGN, writebuf_length))
+        abort();
+    memset(base, 0, writebuf_length);
+    writebuf = base;
+#else
+    base = g_new0(char, writebuf_length + VIR_STORAGE_WIPE_ALIGN - 1);
+    writebuf = (char *) VIR_ROUND_UP((intptr_t) base, VIR_STORAGE_WIPE_ALIGN);
+#endif
+
+#ifdef O_DIRECT
+    if (start % VIR_STORAGE_WIPE_ALIGN == 0)
+        direct_len = wipe_len - wipe_len % VIR_STORAGE_WIPE_ALIGN;
+
+    if (direct_len > 0 &&
+        (directfd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC)) < 0) {
+        VIR_DEBUG("Unable to open '%s' with O_DIRECT: %s",
+                  path, g_strerror(errno));
+        direct_len = 0;
+    }
+
+    if (direct_len > 0) {
+        err = storageBackendWipeLocalWriteRange(directfd, writebuf,
+                                                writebuf_length, start,
+                                                direct_len, job, &errOffset);
+        if (err == EINVAL) {
+            VIR_DEBUG("O_DIRECT writes to '%s' not supported", path);
+            direct_len = 0;
+            err = 0;
+            /* everything is written again through @fd */
+            if (job)
+                virStorageVolWipeJobStart(job, wipe_len);
+        }
+    }
+#endif /* O_DIRECT */
+
+    if (err == 0 && wipe_len > direct_len) {
+        err = storageBackendWipeLocalWriteRange(fd, writebuf, writebuf_length,
+                                                start + direct_len,
+                                                wipe_len - direct_len,
+                                                job, &errOffset);
+        errOffset += direct_len;
+    }
+
+    if (err == ECANCELED)
+        return storageBackendWipeLocalAborted(path);
+
+    if (err != 0) {
+        virReportSystemError(err,
+                             _("Failed to write zeroes at offset %1$llu of storage volume with path '%2$s'"),
+                             (unsigned long long)start + errOffset, path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int
 storageBackendWipeLocal(const char *path,
                         int fd,
                         unsigned long long wipe_len,
                         size_t writebuf_length,
-                        bool zero_end)
+                        bool zero_end,
+                        virStorageVolWipeJob *job)
 {
-    unsigned long long remaining = 0;
     off_t size;
-    g_autofree char *writebuf = NULL;
-
-    writebuf = g_new0(char, writebuf_length);
+    int rc;
 
     if (!zero_end) {
         if ((size = lseek(fd, 0, SEEK_SET)) < 0) {
@@ -2582,21 +3087,16 @@ storageBackendWipeLocal(const char *path,
 
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t)size, wipe_len);
 
-    remaining = wipe_len;
-    while (remaining > 0) {
-        size_t write_size = MIN(writebuf_length, remaining);
-        int written = safewrite(fd, writebuf, write_size);
+    if (job)
+        virStorageVolWipeJobStart(job, wipe_len);
 
-        if (written < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to write %1$zu bytes to storage volume with path '%2$s'"),
-                                 write_size, path);
-
-            return -1;
-        }
+    if ((rc = storageBackendWipeLocalOffload(path, fd, size, wipe_len, job)) < 0)
+        return -1;
 
-        remaining -= written;
-    }
+    if (rc > 0 &&
+        storageBackendWipeLocalWrite(path, fd, size, wipe_len,
+                                     writebuf_length, job) < 0)
+        return -1;
 
     if (virFileDataSync(fd) < 0) {
         virReportSystemError(errno,
@@ -2615,7 +3115,8 @@ static int
 storageBackendVolWipeLocalFile(const char *path,
                                unsigned int algorithm,
                                unsigned long long allocation,
-                               bool zero_end)
+                               bool zero_end,
+                               virStorageVolWipeJob *job)
 {
     const char *alg_char = NULL;
     struct stat st;
@@ -2689,7 +3190,7 @@ storageBackendVolWipeLocalFile(const char *path,
         return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
 
     return storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
-                                   zero_end);
+                                   zero_end, job);
 }
 
 
@@ -2714,7 +3215,8 @@ storageBackendVolWipePloop(virStorageVolDef *vol,
     disk_desc = g_strdup_printf("%s/DiskDescriptor.xml", vol->target.path);
 
     if (storageBackendVolWipeLocalFile(target_path, algorithm,
-                                       vol->target.allocation, false) < 0)
+                                       vol->target.allocation, false,
+                                       vol->wipeJob) < 0)
         return -1;
 
     if (virFileRemove(disk_desc, 0, 0) < 0) {
@@ -2755,9 +3257,11 @@ virStorageBackendVolWipeLocal(virStoragePoolObj *pool G_GNUC_UNUSED,
         ret = storageBackendVolWipePloop(vol, algorithm);
     } else {
         ret = storageBackendVolWipeLocalFile(vol->target.path, algorithm,
-                                             vol->target.allocation, false);
+                                             vol->target.allocation, false,
+                                             vol->wipeJob);
     }
 
+    virStorageSourceHeaderCacheInvalidate(&vol->target);
     return ret;
 }
 
@@ -3983,11 +4487,11 @@ virStorageBackendZeroPartitionTable(const char *path,
                                     unsigned long long size)
 {
     if (storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
-                                       size, false) < 0)
+                                       size, false, NULL) < 0)
         return -1;
 
     return storageBackendVolWipeLocalFile(path, VIR_STORAGE_VOL_WIPE_ALG_ZERO,
-                                          size, true);
+                                          size, true, NULL);
 }
 
 
@@ -0,0 +1,59 @@
+/*
+ * storage_utilpriv.h: private declarations for storage backend utilities
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_STORAGE_UTILPRIV_H_ALLOW
+# error "storage_utilpriv.h may only be included by storage_util.c or test suites"
+#endif /* LIBVIRT_STORAGE_UTILPRIV_H_ALLOW */
+
+#pragma once
+
+#include "internal.h"
+#include "storage_conf.h"
+
+int
+storageBackendWipeLocalOffload(const char *path,
+                               int fd,
+                               off_t start,
+                               unsigned long long len,
+                               virStorageVolWipeJob *job);
+
+int
+storageBackendWipeLocalWrite(const char *path,
+                             int fd,
+                             off_t start,
+                             unsigned long long wipe_len,
+                             size_t writebuf_length,
+                             virStorageVolWipeJob *job);
+
+int
+storageBackendWipeLocal(const char *path,
+                        int fd,
+                        unsigned long long wipe_len,
+                        size_t writebuf_length,
+                        bool zero_end,
+                        virStorageVolWipeJob *job);
+
+int
+virStorageBackendCopyToFD(virStorageVolDef *vol,
+                          virStorageVolDef *inputvol,
+                          int fd,
+                          unsigned long long *total,
+                          bool want_sparse,
+                          bool sparse_output,
+                          bool reflink_copy)
+    ATTRIBUTE_NONNULL(2);
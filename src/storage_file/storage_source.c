@@ -22,6 +22,7 @@
 #include <config.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "internal.h"
@@ -33,8 +34,10 @@
 #include "virerror.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virmetrics.h"
 #include "virobject.h"
 #include "virstoragefile.h"
+#include "virthread.h"
 #include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
@@ -42,6 +45,40 @@
 VIR_LOG_INIT("storage_source");
 
 
+/* Host-wide cache of image headers read while probing backing chains. Local
+ * files are identified by device and inode and an entry can only be used by
+ * the uid:gid which read the header. An entry is valid only as long as the
+ * size, modification and change time of the file don't change; the latter
+ * also changes with ownership, mode and ACLs. Least recently used entries
+ * are evicted when the cache is full. */
+#define VIR_STORAGE_SOURCE_HEADER_CACHE_MAX 256
+
+/* Headers of files changed less than this many microseconds before they
+ * were read are not cached. A later write could happen within the same
+ * timestamp granularity and be missed otherwise, e.g. when the image is
+ * modified by a different daemon which can't invalidate our cache. */
+#define VIR_STORAGE_SOURCE_HEADER_CACHE_RACY_US (1000 * 1000)
+
+typedef struct _virStorageSourceHeaderCacheEntry virStorageSourceHeaderCacheEntry;
+struct _virStorageSourceHeaderCacheEntry {
+    char *key;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+    char *buf;
+    size_t len;
+    GList *link; /* in virStorageSourceHeaderCacheLRU */
+};
+
+static virMutex virStorageSourceHeaderCacheLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *virStorageSourceHeaderCache;
+static GQueue virStorageSourceHeaderCacheLRU = G_QUEUE_INIT;
+static unsigned long long virStorageSourceHeaderCacheHits;
+static unsigned long long virStorageSourceHeaderCacheMisses;
+
+
 static bool
 virStorageSourceBackinStoreStringIsFile(const char *backing)
 {
@@ -1097,6 +1134,8 @@ virStorageSourceCreate(virStorageSource *src)
 
     ret = drv->backend->storageFileCreate(src);
 
+    virStorageSourceHeaderCacheInvalidate(src);
+
     VIR_DEBUG("created storage file %p: ret=%d, errno=%d",
               src, ret, errno);
 
@@ -1132,6 +1171,8 @@ virStorageSourceUnlink(virStorageSource *src)
         return -2;
     }
 
+    virStorageSourceHeaderCacheInvalidate(src);
+
     ret = drv->backend->storageFileUnlink(src);
 
     VIR_DEBUG("unlinked storage file %p: ret=%d, errno=%d",
@@ -1331,6 +1372,230 @@ virStorageSourceReportBrokenChain(int errcode,
 }
 
 
+static void
+virStorageSourceHeaderCacheEntryFree(void *opaque)
+{
+    virStorageSourceHeaderCacheEntry *entry = opaque;
+
+    g_queue_delete_link(&virStorageSourceHeaderCacheLRU, entry->link);
+    g_free(entry->key);
+    g_free(entry->buf);
+    g_free(entry);
+}
+
+
+static char *
+virStorageSourceHeaderCacheKey(const struct stat *st,
+                               uid_t uid,
+                               gid_t gid)
+{
+    return g_strdup_printf("%llu:%llu:%lld:%lld",
+                           (unsigned long long) st->st_dev,
+                           (unsigned long long) st->st_ino,
+                           (long long) uid, (long long) gid);
+}
+
+
+static struct timespec
+virStorageSourceHeaderCacheMtime(const struct stat *st)
+{
+#ifdef __APPLE__
+    return st->st_mtimespec;
+#else
+    return st->st_mtim;
+#endif
+}
+
+
+static struct timespec
+virStorageSourceHeaderCacheCtime(const struct stat *st)
+{
+#ifdef __APPLE__
+    return st->st_ctimespec;
+#else
+    return st->st_ctim;
+#endif
+}
+
+
+static bool
+virStorageSourceHeaderCacheTimeEqual(struct timespec a,
+                                     struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+
+/* Fills @st for sources whose headers can be cached and returns true. */
+static bool
+virStorageSourceHeaderCacheStat(virStorageSource *src,
+                                struct stat *st)
+{
+    if (virStorageSourceGetActualType(src) != VIR_STORAGE_TYPE_FILE)
+        return false;
+
+    if (virStorageSourceStat(src, st) < 0)
+        return false;
+
+    return S_ISREG(st->st_mode);
+}
+
+
+static bool
+virStorageSourceHeaderCacheLookup(const struct stat *st,
+                                  uid_t uid,
+                                  gid_t gid,
+                                  char **buf,
+                                  size_t *len)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virStorageSourceHeaderCacheLock);
+    g_autofree char *key = virStorageSourceHeaderCacheKey(st, uid, gid);
+    virStorageSourceHeaderCacheEntry *entry = NULL;
+
+    if (virStorageSourceHeaderCache)
+        entry = g_hash_table_lookup(virStorageSourceHeaderCache, key);
+
+    if (!entry ||
+        entry->size != st->st_size ||
+        !virStorageSourceHeaderCacheTimeEqual(entry->mtime,
+                                              virStorageSourceHeaderCacheMtime(st)) ||
+        !virStorageSourceHeaderCacheTimeEqual(entry->ctime,
+                                              virStorageSourceHeaderCacheCtime(st))) {
+        virStorageSourceHeaderCacheMisses++;
+        return false;
+    }
+
+    virStorageSourceHeaderCacheHits++;
+
+    g_queue_unlink(&virStorageSourceHeaderCacheLRU, entry->link);
+    g_queue_push_head_link(&virStorageSourceHeaderCacheLRU, entry->link);
+
+    *buf = g_new0(char, entry->len + 1);
+    memcpy(*buf, entry->buf, entry->len);
+    *len = entry->len;
+    return true;
+}
+
+
+static void
+virStorageSourceHeaderCacheGetParams(virTypedParamList *list)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virStorageSourceHeaderCacheLock);
+
+    virTypedParamListAddULLong(list, virStorageSourceHeaderCacheHits,
+                               "storage.header_cache.hits");
+    virTypedParamListAddULLong(list, virStorageSourceHeaderCacheMisses,
+                               "storage.header_cache.misses");
+    virTypedParamListAddULLong(list, virStorageSourceHeaderCacheLRU.length,
+                               "storage.header_cache.entries");
+}
+
+
+static void
+virStorageSourceHeaderCacheStore(const struct stat *st,
+                                 uid_t uid,
+                                 gid_t gid,
+                                 const char *buf,
+                                 size_t len)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virStorageSourceHeaderCacheLock);
+    struct timespec ctime = virStorageSourceHeaderCacheCtime(st);
+    virStorageSourceHeaderCacheEntry *entry;
+
+    if (ctime.tv_sec * 1000000LL + ctime.tv_nsec / 1000 +
+        VIR_STORAGE_SOURCE_HEADER_CACHE_RACY_US >= g_get_real_time())
+        return;
+
+    if (!virStorageSourceHeaderCache) {
+        virStorageSourceHeaderCache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                                            virStorageSourceHeaderCacheEntryFree);
+        virMetricsRegisterSource(virStorageSourceHeaderCacheGetParams);
+    }
+
+    entry = g_new0(virStorageSourceHeaderCacheEntry, 1);
+    entry->key = virStorageSourceHeaderCacheKey(st, uid, gid);
+    g_hash_table_remove(virStorageSourceHeaderCache, entry->key);
+
+    if (virStorageSourceHeaderCacheLRU.length >= VIR_STORAGE_SOURCE_HEADER_CACHE_MAX) {
+        virStorageSourceHeaderCacheEntry *oldest = g_queue_peek_tail(&virStorageSourceHeaderCacheLRU);
+
+        g_hash_table_remove(virStorageSourceHeaderCache, oldest->key);
+    }
+
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = virStorageSourceHeaderCacheMtime(st);
+    entry->ctime = ctime;
+    entry->buf = g_new0(char, len + 1);
+    memcpy(entry->buf, buf, len);
+    entry->len = len;
+
+    g_queue_push_head(&virStorageSourceHeaderCacheLRU, entry);
+    entry->link = virStorageSourceHeaderCacheLRU.head;
+
+    g_hash_table_insert(virStorageSourceHeaderCache, entry->key, entry);
+}
+
+
+static gboolean
+virStorageSourceHeaderCacheEntryIsFile(void *key G_GNUC_UNUSED,
+                                       void *value,
+                                       void *opaque)
+{
+    virStorageSourceHeaderCacheEntry *entry = value;
+    const struct stat *st = opaque;
+
+    return entry->dev == st->st_dev && entry->ino == st->st_ino;
+}
+
+
+/**
+ * virStorageSourceHeaderCacheInvalidate:
+ * @src: storage source
+ *
+ * Drops the cached headers of the local file @src points to. Should be
+ * called whenever libvirt itself modifies the image to free the memory
+ * early, changes are detected from the file's timestamps otherwise.
+ */
+void
+virStorageSourceHeaderCacheInvalidate(virStorageSource *src)
+{
+    struct stat st;
+
+    if (virStorageSourceGetActualType(src) != VIR_STORAGE_TYPE_FILE ||
+        !src->path ||
+        stat(src->path, &st) < 0)
+        return;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virStorageSourceHeaderCacheLock) {
+        if (virStorageSourceHeaderCache)
+            g_hash_table_foreach_remove(virStorageSourceHeaderCache,
+                                        virStorageSourceHeaderCacheEntryIsFile,
+                                        &st);
+    }
+}
+
+
+/**
+ * virStorageSourceHeaderCacheGetStats:
+ * @hits: filled with the number of headers served from the cache
+ * @misses: filled with the number of headers which had to be read
+ *
+ * The same numbers are reported by virMetricsGetParams() as
+ * "storage.header_cache.hits" and "storage.header_cache.misses".
+ */
+void
+virStorageSourceHeaderCacheGetStats(unsigned long long *hits,
+                                    unsigned long long *misses)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virStorageSourceHeaderCacheLock);
+
+    *hits = virStorageSourceHeaderCacheHits;
+    *misses = virStorageSourceHeaderCacheMisses;
+}
+
+
 static int
 virStorageSourceGetMetadataRecurseReadHeader(virStorageSource *src,
                                              virStorageSource *parent,
@@ -1341,6 +1606,8 @@ virStorageSourceGetMetadataRecurseReadHeader(virStorageSource *src,
 {
     int ret = -1;
     ssize_t len;
+    struct stat st;
+    bool cacheable;
 
     if (virStorageSourceIsFD(src)) {
         if (!src->fdtuple) {
@@ -1365,9 +1632,23 @@ virStorageSourceGetMetadataRecurseReadHeader(virStorageSource *src,
         goto cleanup;
     }
 
+    cacheable = virStorageSourceHeaderCacheStat(src, &st);
+
+    /* The header may only be reused by the same uid:gid which read it
+     * before, the daemon can read files @uid can't. */
+    if (cacheable &&
+        virStorageSourceHeaderCacheLookup(&st, uid, gid, buf, headerLen)) {
+        VIR_DEBUG("using cached header of '%s'", src->path);
+        ret = 0;
+        goto cleanup;
+    }
+
     if ((len = virStorageSourceRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
         goto cleanup;
 
+    if (cacheable)
+        virStorageSourceHeaderCacheStore(&st, uid, gid, *buf, len);
+
     *headerLen = len;
     ret = 0;
 
@@ -136,6 +136,15 @@ virStorageSourceGetMetadata(virStorageSource *src,
                             bool report_broken)
     ATTRIBUTE_NONNULL(1);
 
+void
+virStorageSourceHeaderCacheInvalidate(virStorageSource *src)
+    ATTRIBUTE_NONNULL(1);
+
+void
+virStorageSourceHeaderCacheGetStats(unsigned long long *hits,
+                                    unsigned long long *misses)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 int
 virStorageSourceFetchRelativeBackingPath(virStorageSource *src,
                                          char **relPath)
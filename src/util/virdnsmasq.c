@@ -37,6 +37,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
@@ -46,6 +47,8 @@ VIR_LOG_INIT("util.dnsmasq");
 #define DNSMASQ "dnsmasq"
 #define DNSMASQ_HOSTSFILE_SUFFIX "hostsfile"
 #define DNSMASQ_ADDNHOSTSFILE_SUFFIX "addnhosts"
+#define DNSMASQ_HOSTSDIR_SUFFIX "hostsdir"
+#define DNSMASQ_ADDNHOSTSDIR_SUFFIX "addnhostsdir"
 
 #define DNSMASQ_MIN_MAJOR 2
 #define DNSMASQ_MIN_MINOR 67
@@ -54,6 +57,7 @@ static void
 dhcphostFreeContent(dnsmasqDhcpHost *host)
 {
     g_free(host->host);
+    g_free(host->ip);
 }
 
 static void
@@ -82,6 +86,7 @@ addnhostsFree(dnsmasqAddnHostsfile *addnhostsfile)
     }
 
     g_free(addnhostsfile->path);
+    g_free(addnhostsfile->dir);
 
     g_free(addnhostsfile);
 }
@@ -147,6 +152,13 @@ addnhostsNew(const char *name,
     if (!(addnhostsfile->path = virBufferContentAndReset(&buf)))
         goto error;
 
+    virBufferAsprintf(&buf, "%s", config_dir);
+    virBufferEscapeString(&buf, "/%s", name);
+    virBufferAsprintf(&buf, ".%s", DNSMASQ_ADDNHOSTSDIR_SUFFIX);
+
+    if (!(addnhostsfile->dir = virBufferContentAndReset(&buf)))
+        goto error;
+
     return addnhostsfile;
 
  error:
@@ -253,6 +265,15 @@ genericFileDelete(char *path)
     return 0;
 }
 
+static int
+genericDirDelete(const char *path)
+{
+    if (!virFileIsDir(path))
+        return 0;
+
+    return virFileDeleteTree(path);
+}
+
 static void
 hostsfileFree(dnsmasqHostsfile *hostsfile)
 {
@@ -268,6 +289,7 @@ hostsfileFree(dnsmasqHostsfile *hostsfile)
     }
 
     g_free(hostsfile->path);
+    g_free(hostsfile->dir);
 
     g_free(hostsfile);
 }
@@ -316,6 +338,8 @@ hostsfileAdd(dnsmasqHostsfile *hostsfile,
     if (!(hostsfile->hosts[hostsfile->nhosts].host = virBufferContentAndReset(&buf)))
         return -1;
 
+    hostsfile->hosts[hostsfile->nhosts].ip = g_steal_pointer(&ipstr);
+
     hostsfile->nhosts++;
 
     return 0;
@@ -339,6 +363,13 @@ hostsfileNew(const char *name,
 
     if (!(hostsfile->path = virBufferContentAndReset(&buf)))
         goto error;
+
+    virBufferAsprintf(&buf, "%s", config_dir);
+    virBufferEscapeString(&buf, "/%s", name);
+    virBufferAsprintf(&buf, ".%s", DNSMASQ_HOSTSDIR_SUFFIX);
+
+    if (!(hostsfile->dir = virBufferContentAndReset(&buf)))
+        goto error;
     return hostsfile;
 
  error:
@@ -408,6 +439,219 @@ hostsfileSave(dnsmasqHostsfile *hostsfile)
     return 0;
 }
 
+/* Files whose names start with a dot are ignored by dnsmasq when it
+ * watches a hosts directory, which makes them suitable for preparing new
+ * contents of a host's file before renaming it. */
+static int
+hostsdirWriteFile(const char *dir,
+                  const char *name,
+                  const char *content)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s", dir, name);
+    g_autofree char *tmp = g_strdup_printf("%s/.%s.new", dir, name);
+
+    if (virFileWriteStr(tmp, content, 0644) < 0) {
+        virReportSystemError(errno, _("cannot write config file '%1$s'"), tmp);
+        unlink(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, path) < 0) {
+        virReportSystemError(errno, _("cannot rename config file '%1$s'"), tmp);
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Reads files in @dir into a new hash table. Only needed when there is no
+ * record of what was saved before, e.g. after the daemon restarted. */
+static GHashTable *
+hostsdirRead(const char *dir)
+{
+    g_autoptr(GHashTable) files = virHashNew(g_free);
+    g_autoptr(DIR) dirp = NULL;
+    struct dirent *ent;
+    int rc;
+
+    if ((rc = virDirOpenIfExists(&dirp, dir)) < 0)
+        return NULL;
+
+    if (rc == 0)
+        return g_steal_pointer(&files);
+
+    while ((rc = virDirRead(dirp, &ent, dir)) > 0) {
+        g_autofree char *path = g_strdup_printf("%s/%s", dir, ent->d_name);
+        char *content = NULL;
+
+        /* leftovers of interrupted writes */
+        if (ent->d_name[0] == '.') {
+            unlink(path);
+            continue;
+        }
+
+        if (virFileReadAll(path, 1024 * 1024, &content) < 0)
+            return NULL;
+
+        g_hash_table_insert(files, g_strdup(ent->d_name), content);
+    }
+
+    if (rc < 0)
+        return NULL;
+
+    return g_steal_pointer(&files);
+}
+
+
+/**
+ * hostsdirSync:
+ * @dir: path to the hosts directory
+ * @saved: files saved to @dir before, replaced with @files on success
+ * @files: hash table mapping file names to their contents
+ * @changed: set to true if an existing file was modified or removed
+ *
+ * Updates @dir to contain exactly @files. Only files whose contents differ
+ * from @saved are written so that dnsmasq re-reads just the affected
+ * hosts. If @saved is NULL, it is read from @dir first.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+hostsdirSync(const char *dir,
+             GHashTable **saved,
+             GHashTable *files,
+             bool *changed)
+{
+    GHashTableIter iter;
+    const char *name;
+    const char *content;
+
+    if (g_mkdir_with_parents(dir, 0777) < 0) {
+        virReportSystemError(errno, _("cannot create config directory '%1$s'"),
+                             dir);
+        return -1;
+    }
+
+    if (!*saved && !(*saved = hostsdirRead(dir)))
+        return -1;
+
+    g_hash_table_iter_init(&iter, files);
+    while (g_hash_table_iter_next(&iter, (void **) &name, (void **) &content)) {
+        const char *old = g_hash_table_lookup(*saved, name);
+
+        if (old) {
+            if (STREQ(old, content))
+                continue;
+
+            *changed = true;
+        }
+
+        if (hostsdirWriteFile(dir, name, content) < 0)
+            goto error;
+    }
+
+    g_hash_table_iter_init(&iter, *saved);
+    while (g_hash_table_iter_next(&iter, (void **) &name, NULL)) {
+        g_autofree char *path = NULL;
+
+        if (g_hash_table_contains(files, name))
+            continue;
+
+        path = g_strdup_printf("%s/%s", dir, name);
+
+        if (unlink(path) < 0 && errno != ENOENT) {
+            virReportSystemError(errno, _("cannot remove config file '%1$s'"),
+                                 path);
+            goto error;
+        }
+
+        *changed = true;
+    }
+
+    g_hash_table_unref(*saved);
+    *saved = g_hash_table_ref(files);
+    return 0;
+
+ error:
+    /* We no longer know what is in the directory */
+    g_clear_pointer(saved, g_hash_table_unref);
+    return -1;
+}
+
+
+static int
+hostsfileSaveDir(dnsmasqHostsfile *hostsfile,
+                 GHashTable **saved,
+                 bool *changed)
+{
+    g_autoptr(GHashTable) files = virHashNew(g_free);
+    size_t i;
+
+    for (i = 0; i < hostsfile->nhosts; i++) {
+        g_autofree char *name = g_strdup(hostsfile->hosts[i].ip);
+        size_t n = 1;
+
+        /* dnsmasq allows several entries for a single address */
+        while (g_hash_table_contains(files, name)) {
+            g_free(name);
+            name = g_strdup_printf("%s-%zu", hostsfile->hosts[i].ip, ++n);
+        }
+
+        g_hash_table_insert(files, g_steal_pointer(&name),
+                            g_strdup_printf("%s\n", hostsfile->hosts[i].host));
+    }
+
+    return hostsdirSync(hostsfile->dir, saved, files, changed);
+}
+
+
+static int
+addnhostsSaveDir(dnsmasqAddnHostsfile *addnhostsfile,
+                 GHashTable **saved)
+{
+    g_autoptr(GHashTable) files = virHashNew(g_free);
+    bool changed = false;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < addnhostsfile->nhosts; i++) {
+        g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+        virBufferAsprintf(&buf, "%s\t", addnhostsfile->hosts[i].ip);
+        for (j = 0; j < addnhostsfile->hosts[i].nhostnames; j++)
+            virBufferAsprintf(&buf, "%s\t", addnhostsfile->hosts[i].hostnames[j]);
+        virBufferAddChar(&buf, '\n');
+
+        g_hash_table_insert(files, g_strdup(addnhostsfile->hosts[i].ip),
+                            virBufferContentAndReset(&buf));
+    }
+
+    /* dnsmasq notices modified and removed files in hostsdir itself */
+    return hostsdirSync(addnhostsfile->dir, saved, files, &changed);
+}
+
+
+/**
+ * dnsmasqHostsdirCacheFree:
+ * @cache: pointer to the cache of hosts directories
+ *
+ * Free the cached contents of hosts directories
+ */
+void
+dnsmasqHostsdirCacheFree(dnsmasqHostsdirCache *cache)
+{
+    if (!cache)
+        return;
+
+    g_clear_pointer(&cache->hosts, g_hash_table_unref);
+    g_clear_pointer(&cache->addnhosts, g_hash_table_unref);
+
+    g_free(cache);
+}
+
+
 /**
  * dnsmasqContextNew:
  *
@@ -456,6 +700,8 @@ dnsmasqContextFree(dnsmasqContext *ctx)
     if (ctx->addnhostsfile)
         addnhostsFree(ctx->addnhostsfile);
 
+    dnsmasqHostsdirCacheFree(ctx->hostsdirCache);
+
     g_free(ctx);
 }
 
@@ -498,33 +744,80 @@ dnsmasqAddHost(dnsmasqContext *ctx,
 }
 
 /**
- * dnsmasqSave:
+ * dnsmasqSaveChanges:
  * @ctx: pointer to the dnsmasq context for each network
+ * @reload: set to true if dnsmasq has to be reloaded to notice the changes
  *
- * Saves all the configurations associated with a context to disk.
+ * Saves all the configurations associated with a context to disk. With
+ * @ctx->hostsdirs only files of hosts which differ from @ctx->hostsdirCache
+ * are written and a running dnsmasq reads added hosts automatically. Hosts
+ * which were modified or removed from the DHCP configuration still require
+ * a reload. @ctx->hostsdirCache is updated to describe the new contents.
  */
 int
-dnsmasqSave(const dnsmasqContext *ctx)
+dnsmasqSaveChanges(dnsmasqContext *ctx,
+                   bool *reload)
 {
     int ret = 0;
 
+    *reload = !ctx->hostsdirs;
+
     if (g_mkdir_with_parents(ctx->config_dir, 0777) < 0) {
         virReportSystemError(errno, _("cannot create config directory '%1$s'"),
                              ctx->config_dir);
         return -1;
     }
 
-    if (ctx->hostsfile)
+    if (ctx->hostsdirs) {
+        if (!ctx->hostsdirCache)
+            ctx->hostsdirCache = g_new0(dnsmasqHostsdirCache, 1);
+
+        if (ctx->hostsfile) {
+            ret = hostsfileSaveDir(ctx->hostsfile,
+                                   &ctx->hostsdirCache->hosts, reload);
+            if (ret == 0)
+                ret = genericFileDelete(ctx->hostsfile->path);
+        }
+        if (ret == 0 && ctx->addnhostsfile) {
+            ret = addnhostsSaveDir(ctx->addnhostsfile,
+                                   &ctx->hostsdirCache->addnhosts);
+            if (ret == 0)
+                ret = genericFileDelete(ctx->addnhostsfile->path);
+        }
+
+        return ret;
+    }
+
+    if (ctx->hostsfile) {
         ret = hostsfileSave(ctx->hostsfile);
-    if (ret == 0) {
-        if (ctx->addnhostsfile)
-            ret = addnhostsSave(ctx->addnhostsfile);
+        if (ret == 0)
+            ret = genericDirDelete(ctx->hostsfile->dir);
+    }
+    if (ret == 0 && ctx->addnhostsfile) {
+        ret = addnhostsSave(ctx->addnhostsfile);
+        if (ret == 0)
+            ret = genericDirDelete(ctx->addnhostsfile->dir);
     }
 
     return ret;
 }
 
 
+/**
+ * dnsmasqSave:
+ * @ctx: pointer to the dnsmasq context for each network
+ *
+ * Saves all the configurations associated with a context to disk.
+ */
+int
+dnsmasqSave(dnsmasqContext *ctx)
+{
+    bool reload;
+
+    return dnsmasqSaveChanges(ctx, &reload);
+}
+
+
 /**
  * dnsmasqDelete:
  * @ctx: pointer to the dnsmasq context for each network
@@ -536,10 +829,16 @@ dnsmasqDelete(const dnsmasqContext *ctx)
 {
     int ret = 0;
 
-    if (ctx->hostsfile)
+    if (ctx->hostsfile) {
         ret = genericFileDelete(ctx->hostsfile->path);
-    if (ctx->addnhostsfile)
+        if (genericDirDelete(ctx->hostsfile->dir) < 0)
+            ret = -1;
+    }
+    if (ctx->addnhostsfile) {
         ret = genericFileDelete(ctx->addnhostsfile->path);
+        if (genericDirDelete(ctx->addnhostsfile->dir) < 0)
+            ret = -1;
+    }
 
     return ret;
 }
@@ -573,6 +872,7 @@ dnsmasqReload(pid_t pid G_GNUC_UNUSED)
 struct _dnsmasqCaps {
     virObject parent;
     char *binaryPath;
+    unsigned long long version;
 };
 
 static virClass *dnsmasqCapsClass;
@@ -626,6 +926,7 @@ dnsmasqCapsSetFromBuffer(dnsmasqCaps *caps, const char *buf)
     VIR_INFO("dnsmasq version is %d.%d",
              (int)version / 1000000,
              (int)(version % 1000000) / 1000);
+    caps->version = version;
     return 0;
 
  error:
@@ -686,6 +987,24 @@ dnsmasqCapsGetBinaryPath(dnsmasqCaps *caps)
     return caps->binaryPath;
 }
 
+bool
+dnsmasqCapsGet(dnsmasqCaps *caps,
+               dnsmasqCapsFlags flag)
+{
+    if (!caps)
+        return false;
+
+    switch (flag) {
+    case DNSMASQ_CAPS_HOSTSDIR:
+        return caps->version >= 2073000;
+
+    case DNSMASQ_CAPS_LAST:
+        break;
+    }
+
+    return false;
+}
+
 /** dnsmasqDhcpHostsToString:
  *
  *   Turns a vector of dnsmasqDhcpHost into the string that is ought to be
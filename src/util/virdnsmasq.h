@@ -33,6 +33,7 @@ typedef struct
      * "01:23:45:67:89:0a,foo,10.0.0.3".
      */
     char *host;
+    char *ip;   /* Names the host's file in the hosts directory. */
 
 } dnsmasqDhcpHost;
 
@@ -42,6 +43,7 @@ typedef struct
     dnsmasqDhcpHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;   /* Absolute path of dnsmasq's dhcp-hostsdir. */
 } dnsmasqHostsfile;
 
 typedef struct
@@ -58,20 +60,44 @@ typedef struct
     dnsmasqAddnHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;   /* Absolute path of dnsmasq's hostsdir. */
 } dnsmasqAddnHostsfile;
 
+/* Contents of the files in hosts directories as they were last saved,
+ * indexed by file name. A NULL table is read from the directory. */
+typedef struct
+{
+    GHashTable *hosts;      /* dhcp-hostsdir */
+    GHashTable *addnhosts;  /* hostsdir */
+} dnsmasqHostsdirCache;
+
 typedef struct
 {
     char                 *config_dir;
     dnsmasqHostsfile     *hostsfile;
     dnsmasqAddnHostsfile *addnhostsfile;
+    /* Store each host in its own file in a directory rather than all of
+     * them in a single file. */
+    bool                  hostsdirs;
+    /* Compared with the hosts when saving them into directories and
+     * updated afterwards. Created by saving if NULL. */
+    dnsmasqHostsdirCache *hostsdirCache;
 } dnsmasqContext;
 
+typedef enum {
+    DNSMASQ_CAPS_HOSTSDIR,      /* dhcp-hostsdir= and hostsdir= options */
+
+    DNSMASQ_CAPS_LAST
+} dnsmasqCapsFlags;
+
 typedef struct _dnsmasqCaps dnsmasqCaps;
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(dnsmasqCaps, virObjectUnref);
 
 
+void             dnsmasqHostsdirCacheFree(dnsmasqHostsdirCache *cache);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(dnsmasqHostsdirCache, dnsmasqHostsdirCacheFree);
+
 dnsmasqContext * dnsmasqContextNew(const char *network_name,
                                    const char *config_dir);
 void             dnsmasqContextFree(dnsmasqContext *ctx);
@@ -87,11 +113,14 @@ int              dnsmasqAddDhcpHost(dnsmasqContext *ctx,
 int              dnsmasqAddHost(dnsmasqContext *ctx,
                                 virSocketAddr *ip,
                                 const char *name);
-int              dnsmasqSave(const dnsmasqContext *ctx);
+int              dnsmasqSave(dnsmasqContext *ctx);
+int              dnsmasqSaveChanges(dnsmasqContext *ctx,
+                                    bool *reload);
 int              dnsmasqDelete(const dnsmasqContext *ctx);
 int              dnsmasqReload(pid_t pid);
 
 dnsmasqCaps *dnsmasqCapsNewFromBinary(void);
 const char *dnsmasqCapsGetBinaryPath(dnsmasqCaps *caps);
+bool dnsmasqCapsGet(dnsmasqCaps *caps, dnsmasqCapsFlags flag);
 char *dnsmasqDhcpHostsToString(dnsmasqDhcpHost *hosts,
                                unsigned int nhosts);
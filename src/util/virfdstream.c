@@ -45,6 +45,11 @@
 
 VIR_LOG_INIT("fdstream");
 
+/* How much data the I/O thread reads at once. It matches the payload of
+ * large stream packets (VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX), so that one
+ * read can fill a whole packet. Smaller reads are served from it too. */
+#define VIR_FDSTREAM_THREAD_BUFFER_SIZE (4 * 1024 * 1024)
+
 #ifndef WIN32
 typedef enum {
     VIR_FDSTREAM_MSG_TYPE_DATA,
@@ -482,7 +487,7 @@ virFDStreamThreadDoRead(virFDStreamData *fdst,
             buflen > *dataLen)
             buflen = *dataLen;
 
-        buf = g_new0(char, buflen);
+        buf = g_new(char, buflen);
 
         if ((got = saferead(fdin, buf, buflen)) < 0) {
             virReportSystemError(errno,
@@ -613,7 +618,7 @@ virFDStreamThread(void *opaque)
     char *fdoutname = data->fdoutname;
     virFDStreamData *fdst = st->privateData;
     bool doRead = fdst->threadDoRead;
-    size_t buflen = 256 * 1024;
+    size_t buflen = VIR_FDSTREAM_THREAD_BUFFER_SIZE;
     size_t total = 0;
     size_t dataLen = 0;
 
@@ -4036,6 +4036,58 @@ virFileFreeACLs(void **acl)
     g_clear_pointer(acl, acl_free);
 }
 
+
+/**
+ * virFileFormatACLs:
+ * @acl: ACLs as obtained by virFileGetACLs()
+ *
+ * Serialize @acl into a base64 encoded string which can be
+ * passed to another process and turned back into ACLs by
+ * virFileParseACLs().
+ *
+ * Returns: the string on success,
+ *          NULL on failure (with errno set).
+ */
+char *
+virFileFormatACLs(void *acl)
+{
+    g_autofree char *buf = NULL;
+    ssize_t size;
+
+    if ((size = acl_size(acl)) < 0)
+        return NULL;
+
+    buf = g_new0(char, size);
+    if (acl_copy_ext(buf, acl, size) < 0)
+        return NULL;
+
+    return g_base64_encode((const guchar *) buf, size);
+}
+
+
+int
+virFileParseACLs(const char *str,
+                 void **acl)
+{
+    g_autofree guchar *buf = NULL;
+    gsize size;
+
+    buf = g_base64_decode(str, &size);
+
+    /* acl_copy_int() trusts the buffer, check that it is at least
+     * shaped like what acl_copy_ext() produces: a 4 byte header
+     * followed by 8 byte entries. */
+    if (size < 4 || (size - 4) % 8 != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!(*acl = acl_copy_int(buf)))
+        return -1;
+
+    return 0;
+}
+
 #else /* !defined(WITH_LIBACL) */
 
 int
@@ -4062,6 +4114,23 @@ virFileFreeACLs(void **acl)
     *acl = NULL;
 }
 
+
+char *
+virFileFormatACLs(void *acl G_GNUC_UNUSED)
+{
+    errno = ENOTSUP;
+    return NULL;
+}
+
+
+int
+virFileParseACLs(const char *str G_GNUC_UNUSED,
+                 void **acl G_GNUC_UNUSED)
+{
+    errno = ENOTSUP;
+    return -1;
+}
+
 #endif /* !defined(WITH_LIBACL) */
 
 int
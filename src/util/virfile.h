@@ -342,6 +342,11 @@ int virFileSetACLs(const char *file,
 
 void virFileFreeACLs(void **acl);
 
+char *virFileFormatACLs(void *acl);
+
+int virFileParseACLs(const char *str,
+                     void **acl);
+
 int virFileCopyACLs(const char *src,
                     const char *dst);
 
@@ -56,6 +56,7 @@ struct _virJSONObjectPair {
 struct _virJSONObject {
     size_t npairs;
     virJSONObjectPair *pairs;
+    GHashTable *index; /* key -> value, for objects with many members */
 };
 
 struct _virJSONArray {
@@ -73,21 +74,24 @@ struct _virJSONValue {
         char *number; /* int/float/etc format is context defined so we can't parse it here :-( */
         int boolean;
     } data;
+
+    /* Storage for the string or number of values created by the parser or
+     * by virJSONValueCopy(), allocated together with the value itself */
+    char inlinedata[];
 };
 
+/* Objects with at least this many members get a hash table index so that
+ * looking up keys in large QMP replies doesn't require a linear scan. */
+#define VIR_JSON_OBJECT_INDEX_MIN_PAIRS 16
 
-typedef struct _virJSONParserState virJSONParserState;
-struct _virJSONParserState {
-    virJSONValue *value;
-    char *key;
-};
+/* Same nesting limit as the default one of json-c which was used before */
+#define VIR_JSON_PARSER_MAX_DEPTH 32
 
 typedef struct _virJSONParser virJSONParser;
 struct _virJSONParser {
-    virJSONValue *head;
-    virJSONParserState *state;
-    size_t nstate;
-    int wrap;
+    const char *str;
+    const char *cur;
+    size_t depth;
 };
 
 
@@ -380,6 +384,7 @@ virJSONValueFree(virJSONValue *value)
 
     switch ((virJSONType) value->type) {
     case VIR_JSON_TYPE_OBJECT:
+        g_clear_pointer(&value->data.object.index, g_hash_table_unref);
         for (i = 0; i < value->data.object.npairs; i++) {
             g_free(value->data.object.pairs[i].key);
             virJSONValueFree(value->data.object.pairs[i].value);
@@ -392,10 +397,12 @@ virJSONValueFree(virJSONValue *value)
         g_free(value->data.array.values);
         break;
     case VIR_JSON_TYPE_STRING:
-        g_free(value->data.string);
+        if (value->data.string != value->inlinedata)
+            g_free(value->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        g_free(value->data.number);
+        if (value->data.number != value->inlinedata)
+            g_free(value->data.number);
         break;
     case VIR_JSON_TYPE_BOOLEAN:
     case VIR_JSON_TYPE_NULL:
@@ -451,6 +458,35 @@ virJSONValueNewNumber(char *data)
 }
 
 
+/**
+ * virJSONValueNewInline:
+ * @type: VIR_JSON_TYPE_STRING or VIR_JSON_TYPE_NUMBER
+ * @data: string or textual representation of the number
+ * @len: length of @data
+ *
+ * Creates a new virJSONValue holding a copy of @data. Unlike with
+ * virJSONValueNewString() the copy lives in the same allocation as the
+ * value, which halves the number of allocations needed for large trees.
+ */
+static virJSONValue *
+virJSONValueNewInline(virJSONType type,
+                      const char *data,
+                      size_t len)
+{
+    virJSONValue *val = g_malloc0(sizeof(*val) + len + 1);
+
+    val->type = type;
+    memcpy(val->inlinedata, data, len);
+
+    if (type == VIR_JSON_TYPE_STRING)
+        val->data.string = val->inlinedata;
+    else
+        val->data.number = val->inlinedata;
+
+    return val;
+}
+
+
 virJSONValue *
 virJSONValueNewNumberInt(int data)
 {
@@ -538,6 +574,52 @@ virJSONValueNewObject(void)
 }
 
 
+static void
+virJSONObjectIndexBuild(virJSONObject *object)
+{
+    size_t i;
+
+    if (object->index || object->npairs < VIR_JSON_OBJECT_INDEX_MIN_PAIRS)
+        return;
+
+    object->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (i = 0; i < object->npairs; i++)
+        g_hash_table_insert(object->index, object->pairs[i].key,
+                            object->pairs[i].value);
+}
+
+
+/* Record @pair which was just added to @object in its index */
+static void
+virJSONObjectIndexAdd(virJSONObject *object,
+                      virJSONObjectPair *pair)
+{
+    if (object->index)
+        g_hash_table_insert(object->index, pair->key, pair->value);
+    else
+        virJSONObjectIndexBuild(object);
+}
+
+
+static virJSONObjectPair *
+virJSONObjectFind(virJSONObject *object,
+                  const char *key)
+{
+    size_t i;
+
+    if (object->index && !g_hash_table_contains(object->index, key))
+        return NULL;
+
+    for (i = 0; i < object->npairs; i++) {
+        if (STREQ(object->pairs[i].key, key))
+            return object->pairs + i;
+    }
+
+    return NULL;
+}
+
+
 static int
 virJSONValueObjectInsert(virJSONValue *object,
                          const char *key,
@@ -545,6 +627,7 @@ virJSONValueObjectInsert(virJSONValue *object,
                          bool prepend)
 {
     virJSONObjectPair pair = { NULL, *value };
+    virJSONObjectPair *added = NULL;
     int ret = -1;
 
     if (object->type != VIR_JSON_TYPE_OBJECT) {
@@ -563,14 +646,18 @@ virJSONValueObjectInsert(virJSONValue *object,
     if (prepend) {
         ret = VIR_INSERT_ELEMENT(object->data.object.pairs, 0,
                                  object->data.object.npairs, pair);
+        added = object->data.object.pairs;
     } else {
         VIR_APPEND_ELEMENT(object->data.object.pairs,
                            object->data.object.npairs, pair);
+        added = object->data.object.pairs + object->data.object.npairs - 1;
         ret = 0;
     }
 
-    if (ret == 0)
+    if (ret == 0) {
+        virJSONObjectIndexAdd(&object->data.object, added);
         *value = NULL;
+    }
 
     VIR_FREE(pair.key);
     return ret;
@@ -783,17 +870,13 @@ bool
 virJSONValueObjectHasKey(virJSONValue *object,
                          const char *key)
 {
-    size_t i;
-
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return false;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return true;
-    }
+    if (object->data.object.index)
+        return g_hash_table_contains(object->data.object.index, key);
 
-    return false;
+    return !!virJSONObjectFind(&object->data.object, key);
 }
 
 
@@ -801,17 +884,18 @@ virJSONValue *
 virJSONValueObjectGet(virJSONValue *object,
                       const char *key)
 {
-    size_t i;
+    virJSONObjectPair *pair;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return object->data.object.pairs[i].value;
-    }
+    if (object->data.object.index)
+        return g_hash_table_lookup(object->data.object.index, key);
 
-    return NULL;
+    if (!(pair = virJSONObjectFind(&object->data.object, key)))
+        return NULL;
+
+    return pair->value;
 }
 
 
@@ -893,6 +977,9 @@ virJSONValueObjectRemoveKey(virJSONValue *object,
             if (value) {
                 *value = g_steal_pointer(&object->data.object.pairs[i].value);
             }
+            if (object->data.object.index)
+                g_hash_table_remove(object->data.object.index,
+                                    object->data.object.pairs[i].key);
             VIR_FREE(object->data.object.pairs[i].key);
             virJSONValueFree(object->data.object.pairs[i].value);
             VIR_DELETE_ELEMENT(object->data.object.pairs, i,
@@ -1357,6 +1444,8 @@ virJSONValueCopy(const virJSONValue *in)
             out->data.object.pairs[i].key = g_strdup(in->data.object.pairs[i].key);
             out->data.object.pairs[i].value = virJSONValueCopy(in->data.object.pairs[i].value);
         }
+
+        virJSONObjectIndexBuild(&out->data.object);
         break;
     case VIR_JSON_TYPE_ARRAY:
         out = virJSONValueNewArray();
@@ -1371,10 +1460,12 @@ virJSONValueCopy(const virJSONValue *in)
 
     /* No need to error out in the following cases */
     case VIR_JSON_TYPE_STRING:
-        out = virJSONValueNewString(g_strdup(in->data.string));
+        out = virJSONValueNewInline(VIR_JSON_TYPE_STRING, in->data.string,
+                                    strlen(in->data.string));
         break;
     case VIR_JSON_TYPE_NUMBER:
-        out = virJSONValueNewNumber(g_strdup(in->data.number));
+        out = virJSONValueNewInline(VIR_JSON_TYPE_NUMBER, in->data.number,
+                                    strlen(in->data.number));
         break;
     case VIR_JSON_TYPE_BOOLEAN:
         out = virJSONValueNewBoolean(in->data.boolean);
@@ -1388,108 +1479,486 @@ virJSONValueCopy(const virJSONValue *in)
 }
 
 
-#if WITH_JSON_C
-static virJSONValue *
-virJSONValueFromJsonC(json_object *jobj)
+static void
+virJSONParserReportError(virJSONParser *parser,
+                         const char *msg)
 {
-    enum json_type type = json_object_get_type(jobj);
-    virJSONValue *ret = NULL;
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("failed to parse JSON: %1$s at offset %2$zu"),
+                   msg, (size_t) (parser->cur - parser->str));
+}
 
-    switch (type) {
-    case json_type_null:
-        ret = virJSONValueNewNull();
-        break;
-    case json_type_boolean:
-        ret = virJSONValueNewBoolean(json_object_get_boolean(jobj));
-        break;
-    case json_type_double:
-    case json_type_int: {
-        ret = virJSONValueNewNumber(g_strdup(json_object_get_string(jobj)));
-        break;
+
+static void
+virJSONParserSkipWhitespace(virJSONParser *parser)
+{
+    while (*parser->cur == ' ' || *parser->cur == '\t' ||
+           *parser->cur == '\n' || *parser->cur == '\r')
+        parser->cur++;
+}
+
+
+static int
+virJSONParserParseHex4(virJSONParser *parser,
+                       const char *str,
+                       gunichar *ch)
+{
+    size_t i;
+
+    *ch = 0;
+
+    for (i = 0; i < 4; i++) {
+        int digit = g_ascii_xdigit_value(str[i]);
+
+        if (digit < 0) {
+            virJSONParserReportError(parser, _("invalid unicode escape"));
+            return -1;
+        }
+
+        *ch = (*ch << 4) | digit;
     }
-    case json_type_object: {
-        json_object_iter iter;
 
-        ret = virJSONValueNewObject();
+    return 0;
+}
 
-        json_object_object_foreachC(jobj, iter) {
-            virJSONValue *cur = virJSONValueFromJsonC(iter.val);
 
-            if (virJSONValueObjectAppend(ret, iter.key, &cur) < 0) {
-                g_free(ret);
-                return NULL;
+/* Parses the unicode escape sequence whose 'u' @parser points to and leaves
+ * @parser pointing at its last character. Surrogate pairs are combined,
+ * unpaired surrogates are replaced by U+FFFD. */
+static int
+virJSONParserParseUnicodeEscape(virJSONParser *parser,
+                                GString *str)
+{
+    gunichar ch;
+    gunichar low;
+
+    if (virJSONParserParseHex4(parser, parser->cur + 1, &ch) < 0)
+        return -1;
+    parser->cur += 4;
+
+    if (ch >= 0xD800 && ch <= 0xDBFF) {
+        if (parser->cur[1] == '\\' && parser->cur[2] == 'u') {
+            if (virJSONParserParseHex4(parser, parser->cur + 3, &low) < 0)
+                return -1;
+
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+                parser->cur += 6;
+            } else {
+                ch = 0xFFFD;
             }
+        } else {
+            ch = 0xFFFD;
         }
-        break;
+    } else if (ch >= 0xDC00 && ch <= 0xDFFF) {
+        ch = 0xFFFD;
+    }
+
+    g_string_append_unichar(str, ch);
+    return 0;
+}
+
+
+/*
+ * Parses the string @parser points to. If it contains no escape sequences
+ * @unescaped and @len are set to point to it within the document and NULL is
+ * returned, otherwise @unescaped is set to NULL and the unescaped string is
+ * returned. On error both are NULL.
+ */
+static GString *
+virJSONParserParseStringRaw(virJSONParser *parser,
+                            const char **unescaped,
+                            size_t *len)
+{
+    g_autoptr(GString) str = NULL;
+    const char *start = ++parser->cur;
+
+    *unescaped = NULL;
+
+    /* Fast path for strings without escape sequences */
+    while (*parser->cur != '"' && *parser->cur != '\\' &&
+           (unsigned char) *parser->cur >= 0x20)
+        parser->cur++;
+
+    if (*parser->cur == '"') {
+        *unescaped = start;
+        *len = parser->cur - start;
+        parser->cur++;
+        return NULL;
     }
-    case json_type_array: {
-        size_t len;
-        size_t i;
 
-        ret = virJSONValueNewArray();
-        len = json_object_array_length(jobj);
+    str = g_string_new_len(start, parser->cur - start);
 
-        for (i = 0; i < len; i++) {
-            virJSONValue *cur = NULL;
-            json_object *val = NULL;
+    while (*parser->cur != '"') {
+        if (*parser->cur == '\0') {
+            virJSONParserReportError(parser, _("unterminated string"));
+            return NULL;
+        }
 
-            val = json_object_array_get_idx(jobj, i);
+        if ((unsigned char) *parser->cur < 0x20) {
+            virJSONParserReportError(parser, _("control character in string"));
+            return NULL;
+        }
 
-            cur = virJSONValueFromJsonC(val);
+        if (*parser->cur != '\\') {
+            g_string_append_c(str, *parser->cur++);
+            continue;
+        }
 
-            if (!cur) {
-                g_free(ret);
+        switch (*++parser->cur) {
+        case '"':
+        case '\\':
+        case '/':
+            g_string_append_c(str, *parser->cur);
+            break;
+        case 'b':
+            g_string_append_c(str, '\b');
+            break;
+        case 'f':
+            g_string_append_c(str, '\f');
+            break;
+        case 'n':
+            g_string_append_c(str, '\n');
+            break;
+        case 'r':
+            g_string_append_c(str, '\r');
+            break;
+        case 't':
+            g_string_append_c(str, '\t');
+            break;
+        case 'u':
+            if (virJSONParserParseUnicodeEscape(parser, str) < 0)
                 return NULL;
-            }
+            break;
+        default:
+            virJSONParserReportError(parser, _("invalid escape sequence"));
+            return NULL;
+        }
 
-            virJSONValueArrayAppend(ret, &cur);
+        parser->cur++;
+    }
+
+    parser->cur++;
+    return g_steal_pointer(&str);
+}
+
+
+static char *
+virJSONParserParseString(virJSONParser *parser)
+{
+    const char *unescaped;
+    size_t len;
+    GString *str;
+
+    if (!(str = virJSONParserParseStringRaw(parser, &unescaped, &len))) {
+        if (!unescaped)
+            return NULL;
+        return g_strndup(unescaped, len);
+    }
+
+    return g_string_free(str, FALSE);
+}
+
+
+static virJSONValue *
+virJSONParserParseStringValue(virJSONParser *parser)
+{
+    g_autoptr(GString) str = NULL;
+    const char *unescaped;
+    size_t len;
+
+    if (!(str = virJSONParserParseStringRaw(parser, &unescaped, &len))) {
+        if (!unescaped)
+            return NULL;
+        return virJSONValueNewInline(VIR_JSON_TYPE_STRING, unescaped, len);
+    }
+
+    return virJSONValueNewInline(VIR_JSON_TYPE_STRING, str->str, str->len);
+}
+
+
+/* Numbers are validated according to the JSON grammar and stored verbatim */
+static virJSONValue *
+virJSONParserParseNumber(virJSONParser *parser)
+{
+    const char *start = parser->cur;
+
+    if (*parser->cur == '-')
+        parser->cur++;
+
+    if (*parser->cur == '0') {
+        parser->cur++;
+    } else if (g_ascii_isdigit(*parser->cur)) {
+        while (g_ascii_isdigit(*parser->cur))
+            parser->cur++;
+    } else {
+        goto error;
+    }
+
+    if (*parser->cur == '.') {
+        parser->cur++;
+        if (!g_ascii_isdigit(*parser->cur))
+            goto error;
+        while (g_ascii_isdigit(*parser->cur))
+            parser->cur++;
+    }
+
+    if (*parser->cur == 'e' || *parser->cur == 'E') {
+        parser->cur++;
+        if (*parser->cur == '+' || *parser->cur == '-')
+            parser->cur++;
+        if (!g_ascii_isdigit(*parser->cur))
+            goto error;
+        while (g_ascii_isdigit(*parser->cur))
+            parser->cur++;
+    }
+
+    return virJSONValueNewInline(VIR_JSON_TYPE_NUMBER, start,
+                                 parser->cur - start);
+
+ error:
+    virJSONParserReportError(parser, _("invalid number"));
+    return NULL;
+}
+
+
+static virJSONValue *
+virJSONParserParseKeyword(virJSONParser *parser)
+{
+    if (STRPREFIX(parser->cur, "true")) {
+        parser->cur += strlen("true");
+        return virJSONValueNewBoolean(true);
+    }
+
+    if (STRPREFIX(parser->cur, "false")) {
+        parser->cur += strlen("false");
+        return virJSONValueNewBoolean(false);
+    }
+
+    if (STRPREFIX(parser->cur, "null")) {
+        parser->cur += strlen("null");
+        return virJSONValueNewNull();
+    }
+
+    virJSONParserReportError(parser, _("unexpected character"));
+    return NULL;
+}
+
+
+static virJSONValue *
+virJSONParserParseValue(virJSONParser *parser);
+
+
+/* Adds a member parsed from the document to @object. If the key is
+ * already present its value is replaced as json-c used to do. */
+static void
+virJSONParserObjectSet(virJSONObject *object,
+                       size_t *nalloc,
+                       char **key,
+                       virJSONValue **value)
+{
+    virJSONObjectPair *dup;
+
+    if ((dup = virJSONObjectFind(object, *key))) {
+        virJSONValueFree(dup->value);
+        dup->value = g_steal_pointer(value);
+        if (object->index)
+            g_hash_table_insert(object->index, dup->key, dup->value);
+        g_clear_pointer(key, g_free);
+        return;
+    }
+
+    VIR_RESIZE_N(object->pairs, *nalloc, object->npairs, 1);
+    object->pairs[object->npairs].key = g_steal_pointer(key);
+    object->pairs[object->npairs].value = g_steal_pointer(value);
+    object->npairs++;
+
+    virJSONObjectIndexAdd(object, object->pairs + object->npairs - 1);
+}
+
+
+static virJSONValue *
+virJSONParserParseObject(virJSONParser *parser)
+{
+    g_autoptr(virJSONValue) object = virJSONValueNewObject();
+    size_t nalloc = 0;
+
+    if (++parser->depth > VIR_JSON_PARSER_MAX_DEPTH) {
+        virJSONParserReportError(parser, _("nesting too deep"));
+        return NULL;
+    }
+
+    parser->cur++;
+    virJSONParserSkipWhitespace(parser);
+
+    if (*parser->cur == '}') {
+        parser->cur++;
+        parser->depth--;
+        return g_steal_pointer(&object);
+    }
+
+    while (true) {
+        g_autofree char *key = NULL;
+        g_autoptr(virJSONValue) value = NULL;
+
+        virJSONParserSkipWhitespace(parser);
+
+        if (*parser->cur != '"') {
+            virJSONParserReportError(parser, _("expected object key"));
+            return NULL;
         }
-        break;
+
+        if (!(key = virJSONParserParseString(parser)))
+            return NULL;
+
+        virJSONParserSkipWhitespace(parser);
+
+        if (*parser->cur != ':') {
+            virJSONParserReportError(parser, _("expected ':'"));
+            return NULL;
+        }
+        parser->cur++;
+
+        if (!(value = virJSONParserParseValue(parser)))
+            return NULL;
+
+        virJSONParserObjectSet(&object->data.object, &nalloc, &key, &value);
+
+        virJSONParserSkipWhitespace(parser);
+
+        if (*parser->cur == '}')
+            break;
+
+        if (*parser->cur != ',') {
+            virJSONParserReportError(parser, _("expected ',' or '}'"));
+            return NULL;
+        }
+        parser->cur++;
     }
-    case json_type_string:
-        ret = virJSONValueNewString(g_strdup(json_object_get_string(jobj)));
-        break;
+
+    /* Drop the unused space left by growing the array geometrically */
+    if (nalloc > object->data.object.npairs)
+        VIR_REALLOC_N(object->data.object.pairs, object->data.object.npairs);
+
+    parser->cur++;
+    parser->depth--;
+    return g_steal_pointer(&object);
+}
+
+
+static virJSONValue *
+virJSONParserParseArray(virJSONParser *parser)
+{
+    g_autoptr(virJSONValue) array = virJSONValueNewArray();
+    virJSONArray *arr = &array->data.array;
+    size_t nalloc = 0;
+
+    if (++parser->depth > VIR_JSON_PARSER_MAX_DEPTH) {
+        virJSONParserReportError(parser, _("nesting too deep"));
+        return NULL;
     }
 
-    return ret;
+    parser->cur++;
+    virJSONParserSkipWhitespace(parser);
+
+    if (*parser->cur == ']') {
+        parser->cur++;
+        parser->depth--;
+        return g_steal_pointer(&array);
+    }
+
+    while (true) {
+        g_autoptr(virJSONValue) value = NULL;
+
+        if (!(value = virJSONParserParseValue(parser)))
+            return NULL;
+
+        VIR_RESIZE_N(arr->values, nalloc, arr->nvalues, 1);
+        arr->values[arr->nvalues++] = g_steal_pointer(&value);
+
+        virJSONParserSkipWhitespace(parser);
+
+        if (*parser->cur == ']')
+            break;
+
+        if (*parser->cur != ',') {
+            virJSONParserReportError(parser, _("expected ',' or ']'"));
+            return NULL;
+        }
+        parser->cur++;
+    }
+
+    if (nalloc > arr->nvalues)
+        VIR_REALLOC_N(arr->values, arr->nvalues);
+
+    parser->cur++;
+    parser->depth--;
+    return g_steal_pointer(&array);
 }
 
 
+static virJSONValue *
+virJSONParserParseValue(virJSONParser *parser)
+{
+    virJSONParserSkipWhitespace(parser);
+
+    switch (*parser->cur) {
+    case '{':
+        return virJSONParserParseObject(parser);
+    case '[':
+        return virJSONParserParseArray(parser);
+    case '"':
+        return virJSONParserParseStringValue(parser);
+    case '\0':
+        virJSONParserReportError(parser, _("unexpected end of data"));
+        return NULL;
+    default:
+        if (*parser->cur == '-' || g_ascii_isdigit(*parser->cur))
+            return virJSONParserParseNumber(parser);
+        return virJSONParserParseKeyword(parser);
+    }
+}
+
+
+/**
+ * virJSONValueFromString:
+ * @jsonstring: JSON document
+ *
+ * Parses @jsonstring into a tree of virJSONValue in a single pass. Numbers
+ * are kept in their textual form and converted only when requested by the
+ * caller.
+ *
+ * Returns the parsed value or NULL on error.
+ */
 virJSONValue *
 virJSONValueFromString(const char *jsonstring)
 {
-    json_object *jobj = NULL;
-    virJSONValue *ret = NULL;
-    json_tokener *tok = NULL;
-    enum json_tokener_error jerr;
-    int jsonflags = JSON_TOKENER_STRICT | JSON_TOKENER_VALIDATE_UTF8;
+    virJSONParser parser = { .str = jsonstring, .cur = jsonstring };
+    g_autoptr(virJSONValue) ret = NULL;
 
     VIR_DEBUG("string=%s", jsonstring);
 
-    tok = json_tokener_new();
-    if (!tok) {
+    if (!g_utf8_validate(jsonstring, -1, NULL)) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("failed to create JSON tokener"));
+                       _("failed to parse JSON: invalid UTF-8"));
         return NULL;
     }
-    json_tokener_set_flags(tok, jsonflags);
-    jobj = json_tokener_parse_ex(tok, jsonstring, strlen(jsonstring));
-    jerr = json_tokener_get_error(tok);
-    if (jerr != json_tokener_success) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("failed to parse JSON: %1$s"),
-                       json_tokener_error_desc(jerr));
-        goto cleanup;
+
+    if (!(ret = virJSONParserParseValue(&parser)))
+        return NULL;
+
+    virJSONParserSkipWhitespace(&parser);
+
+    if (*parser.cur != '\0') {
+        virJSONParserReportError(&parser, _("trailing garbage"));
+        return NULL;
     }
-    ret = virJSONValueFromJsonC(jobj);
 
- cleanup:
-    json_object_put(jobj);
-    if (tok)
-        json_tokener_free(tok);
-    return ret;
+    return g_steal_pointer(&ret);
 }
 
+
+#if WITH_JSON_C
 static json_object *
 virJSONValueToJsonC(virJSONValue *object)
 {
@@ -1569,15 +2038,6 @@ virJSONValueToBuffer(virJSONValue *object,
 
 
 #else
-virJSONValue *
-virJSONValueFromString(const char *jsonstring G_GNUC_UNUSED)
-{
-    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                   _("No JSON parser implementation is available"));
-    return NULL;
-}
-
-
 int
 virJSONValueToBuffer(virJSONValue *object G_GNUC_UNUSED,
                      virBuffer *buf G_GNUC_UNUSED,
@@ -1781,6 +2241,8 @@ virJSONValueObjectDeflattenArrays(virJSONValue *json)
         arraymembers[keynum] = pair->value;
     }
 
+    g_clear_pointer(&obj->index, g_hash_table_unref);
+
     for (i = 0; i < obj->npairs; i++)
         g_free(obj->pairs[i].key);
 
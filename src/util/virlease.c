@@ -23,15 +23,21 @@
 #include <config.h>
 
 #include "virlease.h"
+#include "virleaseindex.h"
 
+#include <fcntl.h>
 #include <time.h>
 
 #include "virfile.h"
+#include "virlog.h"
+#include "virsocketaddr.h"
 #include "virstring.h"
 #include "virerror.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 
+VIR_LOG_INIT("util.lease");
+
 /**
  * VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX:
  *
@@ -39,6 +45,10 @@
  */
 #define VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX (32 * 1024 * 1024)
 
+/* The layout is shared with the NSS module */
+G_STATIC_ASSERT(sizeof(virLeaseIndexHeader) == 24);
+G_STATIC_ASSERT(sizeof(virLeaseIndexEntry) == 40);
+
 
 int
 virLeaseReadCustomLeaseFile(virJSONValue *leases_array_new,
@@ -255,3 +265,359 @@ virLeaseNew(virJSONValue **lease_ret,
     *lease_ret = g_steal_pointer(&lease_new);
     return 0;
 }
+
+
+/**
+ * virLeaseIndexFileName:
+ * @dnsmasqStateDir: directory holding the lease files
+ *
+ * Returns path of the index of leases of all networks whose lease files
+ * are in @dnsmasqStateDir.
+ */
+char *
+virLeaseIndexFileName(const char *dnsmasqStateDir)
+{
+    return g_strdup_printf("%s/" VIR_LEASE_INDEX_FILE, dnsmasqStateDir);
+}
+
+
+typedef struct _virLeaseIndexData virLeaseIndexData;
+struct _virLeaseIndexData {
+    virLeaseIndexHeader hdr;
+    uint32_t *buckets;
+    GArray *entries;
+    GString *strings;
+    /* MAC address -> GArray of indexes of entries with the address */
+    GHashTable *macs;
+};
+
+
+static int
+virLeaseIndexAppend(virLeaseIndexData *data,
+                    virLeaseIndexKeyType type,
+                    const char *key,
+                    const virLeaseIndexEntry *addr)
+{
+    virLeaseIndexEntry entry = *addr;
+
+    if (data->strings->len > UINT32_MAX - strlen(key) - 1 ||
+        data->entries->len >= UINT32_MAX / 2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("too many leases to index"));
+        return -1;
+    }
+
+    entry.type = type;
+    entry.key = data->strings->len;
+    entry.next = 0;
+
+    g_string_append_len(data->strings, key, strlen(key) + 1);
+    g_array_append_val(data->entries, entry);
+
+    if (type == VIR_LEASE_INDEX_KEY_MAC) {
+        GArray *idxs = g_hash_table_lookup(data->macs, key);
+        uint32_t idx = data->entries->len - 1;
+
+        if (!idxs) {
+            idxs = g_array_new(false, false, sizeof(uint32_t));
+            g_hash_table_insert(data->macs, g_strdup(key), idxs);
+        }
+
+        g_array_append_val(idxs, idx);
+    }
+
+    return 0;
+}
+
+
+static int
+virLeaseIndexAddLeases(virLeaseIndexData *data,
+                       const char *file)
+{
+    g_autoptr(virJSONValue) leases = virJSONValueNewArray();
+    size_t i;
+
+    if (virLeaseReadCustomLeaseFile(leases, file, NULL, NULL) < 0)
+        return -1;
+
+    for (i = 0; i < virJSONValueArraySize(leases); i++) {
+        virJSONValue *lease = virJSONValueArrayGet(leases, i);
+        const char *ip = virJSONValueObjectGetString(lease, "ip-address");
+        const char *mac = virJSONValueObjectGetString(lease, "mac-address");
+        const char *hostname = virJSONValueObjectGetString(lease, "hostname");
+        virLeaseIndexEntry entry = { 0 };
+        long long expirytime;
+        virSocketAddr addr;
+
+        if (virJSONValueObjectGetNumberLong(lease, "expiry-time", &expirytime) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("missing expiry time of lease for '%1$s'"), ip);
+            return -1;
+        }
+
+        if (virSocketAddrParse(&addr, ip, AF_UNSPEC) < 0)
+            return -1;
+
+        entry.expirytime = expirytime;
+
+        if (VIR_SOCKET_ADDR_IS_FAMILY(&addr, AF_INET)) {
+            entry.family = 4;
+            memcpy(entry.addr, &addr.data.inet4.sin_addr,
+                   sizeof(addr.data.inet4.sin_addr));
+        } else {
+            entry.family = 6;
+            memcpy(entry.addr, &addr.data.inet6.sin6_addr,
+                   sizeof(addr.data.inet6.sin6_addr));
+        }
+
+        if (hostname &&
+            virLeaseIndexAppend(data, VIR_LEASE_INDEX_KEY_HOSTNAME,
+                                hostname, &entry) < 0)
+            return -1;
+
+        if (mac &&
+            virLeaseIndexAppend(data, VIR_LEASE_INDEX_KEY_MAC,
+                                mac, &entry) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Adds addresses leased to MAC addresses of each domain in MAC map @file,
+ * which requires all leases to be indexed already. */
+static int
+virLeaseIndexAddMacMap(virLeaseIndexData *data,
+                       const char *file)
+{
+    g_autofree char *str = NULL;
+    g_autoptr(virJSONValue) map = NULL;
+    size_t i;
+    size_t j;
+    size_t k;
+
+    if (virFileReadAll(file, VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX, &str) < 0)
+        return -1;
+
+    if (!*str)
+        return 0;
+
+    if (!(map = virJSONValueFromString(str)) ||
+        !virJSONValueIsArray(map)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Malformed file structure: %1$s"), file);
+        return -1;
+    }
+
+    for (i = 0; i < virJSONValueArraySize(map); i++) {
+        virJSONValue *item = virJSONValueArrayGet(map, i);
+        const char *domain = virJSONValueObjectGetString(item, "domain");
+        virJSONValue *macs = virJSONValueObjectGetArray(item, "macs");
+
+        if (!domain || !macs)
+            continue;
+
+        for (j = 0; j < virJSONValueArraySize(macs); j++) {
+            const char *mac = virJSONValueGetString(virJSONValueArrayGet(macs, j));
+            GArray *idxs;
+
+            if (!mac || !(idxs = g_hash_table_lookup(data->macs, mac)))
+                continue;
+
+            for (k = 0; k < idxs->len; k++) {
+                virLeaseIndexEntry entry;
+
+                entry = g_array_index(data->entries, virLeaseIndexEntry,
+                                      g_array_index(idxs, uint32_t, k));
+
+                if (virLeaseIndexAppend(data, VIR_LEASE_INDEX_KEY_DOMAIN,
+                                        domain, &entry) < 0)
+                    return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virLeaseIndexWrite(int fd,
+                   const char *path G_GNUC_UNUSED,
+                   const void *opaque)
+{
+    const virLeaseIndexData *data = opaque;
+
+    if (safewrite(fd, &data->hdr, sizeof(data->hdr)) < 0 ||
+        safewrite(fd, data->buckets,
+                  data->hdr.nbuckets * sizeof(*data->buckets)) < 0 ||
+        safewrite(fd, data->entries->data,
+                  data->hdr.nentries * sizeof(virLeaseIndexEntry)) < 0 ||
+        safewrite(fd, data->strings->str, data->hdr.strings) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virLeaseIndexRebuild:
+ * @dnsmasqStateDir: directory holding the lease files
+ *
+ * Writes the index (see virleaseindex.h) of leases found in all custom
+ * lease files in @dnsmasqStateDir by hostname and MAC address and of the
+ * leases of domains listed in the MAC maps in @dnsmasqStateDir by domain
+ * name. Callers are expected to hold the lock acquired by
+ * virLeaseIndexUpdateBegin.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLeaseIndexRebuild(const char *dnsmasqStateDir)
+{
+    g_autofree char *path = virLeaseIndexFileName(dnsmasqStateDir);
+    g_autofree uint32_t *buckets = NULL;
+    g_autoptr(GArray) entries = g_array_new(false, false, sizeof(virLeaseIndexEntry));
+    g_autoptr(GString) strings = g_string_new(NULL);
+    g_autoptr(GHashTable) macs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                       (GDestroyNotify) g_array_unref);
+    g_autoptr(GPtrArray) macMaps = g_ptr_array_new_with_free_func(g_free);
+    virLeaseIndexData data = { .entries = entries, .strings = strings, .macs = macs };
+    g_autoptr(DIR) dir = NULL;
+    struct dirent *ent;
+    uint32_t nbuckets = 16;
+    size_t i;
+    int rc;
+
+    if (virDirOpen(&dir, dnsmasqStateDir) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, dnsmasqStateDir)) > 0) {
+        g_autofree char *file = g_strdup_printf("%s/%s", dnsmasqStateDir,
+                                                ent->d_name);
+
+        if (virStringHasSuffix(ent->d_name, ".status")) {
+            if (virLeaseIndexAddLeases(&data, file) < 0)
+                return -1;
+        } else if (virStringHasSuffix(ent->d_name, ".macs")) {
+            g_ptr_array_add(macMaps, g_steal_pointer(&file));
+        }
+    }
+
+    if (rc < 0)
+        return -1;
+
+    for (i = 0; i < macMaps->len; i++) {
+        if (virLeaseIndexAddMacMap(&data, g_ptr_array_index(macMaps, i)) < 0)
+            return -1;
+    }
+
+    /* Keep the load factor under 0.5 */
+    while (nbuckets < 2 * entries->len)
+        nbuckets *= 2;
+
+    buckets = g_new0(uint32_t, nbuckets);
+
+    /* Chains are built backwards so that they list leases in the order
+     * they appear in the lease files */
+    for (i = entries->len; i > 0; i--) {
+        virLeaseIndexEntry *entry = &g_array_index(entries, virLeaseIndexEntry, i - 1);
+        uint32_t hash = virLeaseIndexHash(strings->str + entry->key, entry->type);
+
+        entry->next = buckets[hash & (nbuckets - 1)];
+        buckets[hash & (nbuckets - 1)] = i;
+    }
+
+    memcpy(data.hdr.magic, VIR_LEASE_INDEX_MAGIC, sizeof(data.hdr.magic));
+    data.hdr.version = VIR_LEASE_INDEX_VERSION;
+    data.hdr.nbuckets = nbuckets;
+    data.hdr.nentries = entries->len;
+    data.hdr.strings = strings->len;
+    data.buckets = buckets;
+
+    return virFileRewrite(path, 0644, -1, -1, virLeaseIndexWrite, &data);
+}
+
+
+/**
+ * virLeaseIndexUpdateBegin:
+ * @dnsmasqStateDir: directory holding the lease files
+ *
+ * Removes the index of leases in @dnsmasqStateDir and takes the lock
+ * serializing its updates. This has to be called before modifying any
+ * custom lease file or MAC map in @dnsmasqStateDir so that the index
+ * never describes leases which are gone already. The index is written
+ * again by virLeaseIndexUpdateEnd.
+ *
+ * Since the index is merely an optimization for the NSS modules, which
+ * parse the lease files if it is missing, failure to take the lock is not
+ * fatal and only means that the index isn't written again.
+ *
+ * Returns the file descriptor holding the lock, -1 if it wasn't taken.
+ */
+int
+virLeaseIndexUpdateBegin(const char *dnsmasqStateDir)
+{
+    g_autofree char *path = virLeaseIndexFileName(dnsmasqStateDir);
+    g_autofree char *lockPath = g_strdup_printf("%s.lock", path);
+    int fd;
+    int rc;
+
+    /* Readers must not see an index which is about to become stale */
+    if (unlink(path) < 0 && errno != ENOENT)
+        VIR_WARN("Unable to remove lease index '%s': %s",
+                 path, g_strerror(errno));
+
+    if ((fd = open(lockPath, O_RDWR | O_CREAT, 0600)) < 0) {
+        VIR_WARN("Unable to open '%s': %s", lockPath, g_strerror(errno));
+        return -1;
+    }
+
+    if ((rc = virFileLock(fd, false, 0, 1, true)) < 0) {
+        VIR_WARN("Unable to lock '%s': %s", lockPath, g_strerror(-rc));
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    /* Someone else might have written the index before we got the lock */
+    unlink(path);
+
+    return fd;
+}
+
+
+/**
+ * virLeaseIndexUpdateEnd:
+ * @dnsmasqStateDir: directory holding the lease files
+ * @lockfd: file descriptor returned by virLeaseIndexUpdateBegin
+ *
+ * Writes the index of leases in @dnsmasqStateDir again and releases the
+ * lock taken by virLeaseIndexUpdateBegin. Failure to write the index is
+ * not fatal and only leaves the index removed.
+ */
+void
+virLeaseIndexUpdateEnd(const char *dnsmasqStateDir,
+                       int lockfd)
+{
+    g_autofree char *path = virLeaseIndexFileName(dnsmasqStateDir);
+    virErrorPtr orig_err;
+
+    if (lockfd < 0) {
+        /* Someone else might have written the index in the meantime */
+        unlink(path);
+        return;
+    }
+
+    virErrorPreserveLast(&orig_err);
+
+    if (virLeaseIndexRebuild(dnsmasqStateDir) < 0) {
+        VIR_WARN("Unable to update lease index '%s': %s",
+                 path, virGetLastErrorMessage());
+        virResetLastError();
+        unlink(path);
+    }
+
+    virErrorRestore(&orig_err);
+    VIR_FORCE_CLOSE(lockfd);
+}
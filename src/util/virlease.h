@@ -40,3 +40,12 @@ int virLeaseNew(virJSONValue **lease_ret,
                 const char *hostname,
                 const char *iaid,
                 const char *server_duid);
+
+char *virLeaseIndexFileName(const char *dnsmasqStateDir);
+
+int virLeaseIndexRebuild(const char *dnsmasqStateDir);
+
+int virLeaseIndexUpdateBegin(const char *dnsmasqStateDir);
+
+void virLeaseIndexUpdateEnd(const char *dnsmasqStateDir,
+                            int lockfd);
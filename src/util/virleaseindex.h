@@ -0,0 +1,109 @@
+/*
+ * virleaseindex.h: on-disk index of DHCP leases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* This header is shared with the NSS module which links with neither
+ * glib nor libvirt, so it must stay self contained. */
+#include <stdint.h>
+#include <stddef.h>
+
+#define VIR_LEASE_INDEX_MAGIC "LVLEASE"
+#define VIR_LEASE_INDEX_VERSION 2
+#define VIR_LEASE_INDEX_FILE "leases.idx"
+
+/*
+ * The index is stored as leases.idx in the dnsmasq state directory and
+ * covers the custom lease files ($bridge.status) and MAC maps
+ * ($bridge.macs) of all networks, so that the NSS modules can look up
+ * addresses by hostname, MAC address or domain name with a single hash
+ * lookup instead of parsing the JSON files of every network.
+ *
+ * Whoever modifies a lease file or a MAC map removes the index first and
+ * writes a new one afterwards, all while holding the lock on
+ * leases.idx.lock. Readers therefore may trust any index they find and
+ * fall back to parsing the JSON files if there is none.
+ *
+ * The file consists of the header, @nbuckets bucket heads (uint32 each),
+ * @nentries entries and a string table of @strings bytes holding NUL
+ * terminated keys. Bucket heads and the @next member of entries hold an
+ * entry index plus one, zero terminating the chain. All numbers are in
+ * host byte order.
+ */
+typedef struct _virLeaseIndexHeader virLeaseIndexHeader;
+struct _virLeaseIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nbuckets;          /* power of two */
+    uint32_t nentries;
+    uint32_t strings;
+};
+
+typedef enum {
+    VIR_LEASE_INDEX_KEY_HOSTNAME = 1,   /* compared case insensitively */
+    VIR_LEASE_INDEX_KEY_MAC,
+    VIR_LEASE_INDEX_KEY_DOMAIN,         /* from MAC maps, compared case
+                                         * insensitively */
+} virLeaseIndexKeyType;
+
+typedef struct _virLeaseIndexEntry virLeaseIndexEntry;
+struct _virLeaseIndexEntry {
+    int64_t expirytime;
+    uint32_t next;
+    uint32_t key;               /* offset into the string table */
+    uint8_t type;               /* virLeaseIndexKeyType */
+    uint8_t family;             /* 4 or 6 */
+    uint8_t reserved[6];
+    uint8_t addr[16];
+};
+
+
+/* FNV-1a of @key, hostnames and domain names are folded to lower case. */
+static inline uint32_t
+virLeaseIndexHash(const char *key,
+                  virLeaseIndexKeyType type)
+{
+    uint32_t hash = 2166136261U;
+
+    for (; *key; key++) {
+        unsigned char c = *key;
+
+        if (type != VIR_LEASE_INDEX_KEY_MAC && c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        hash ^= c;
+        hash *= 16777619U;
+    }
+
+    return hash ^ type;
+}
+
+
+static inline size_t
+virLeaseIndexEntriesOffset(const virLeaseIndexHeader *hdr)
+{
+    return sizeof(*hdr) + (size_t) hdr->nbuckets * sizeof(uint32_t);
+}
+
+
+static inline size_t
+virLeaseIndexStringsOffset(const virLeaseIndexHeader *hdr)
+{
+    return virLeaseIndexEntriesOffset(hdr) +
+        (size_t) hdr->nentries * sizeof(virLeaseIndexEntry);
+}
@@ -0,0 +1,274 @@
+/*
+ * virmetrics.c: process wide latency histograms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virmetrics.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/*
+ * Histograms are registered by name on first use and live until the
+ * process exits, so callers may keep pointers to them. Histograms which
+ * belong to an object rather than to the whole process, such as the RPC
+ * histograms of a server, are created with virMetricsHistogramNew()
+ * instead and reported by their owner. Modules keeping
+ * their own counters can register a source which reports them along
+ * with the histograms. Reading all of them is meant for the admin
+ * interface of the daemon.
+ */
+
+struct _virMetricsHistogram {
+    char *name;
+
+    virMutex lock;
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned long long buckets[VIR_METRICS_HISTOGRAM_BUCKETS];
+};
+
+static virMutex virMetricsLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *virMetricsHistograms;
+static GSList *virMetricsSources;
+static int virMetricsEnabled;
+
+
+/**
+ * virMetricsSetEnabled:
+ * @enabled: whether to collect metrics
+ *
+ * Turns on or off collection of metrics which are recorded on hot paths,
+ * such as latencies of individual RPC calls, and which callers therefore
+ * have to check with virMetricsIsEnabled() first. Disabled by default.
+ */
+void
+virMetricsSetEnabled(bool enabled)
+{
+    g_atomic_int_set(&virMetricsEnabled, enabled);
+}
+
+
+bool
+virMetricsIsEnabled(void)
+{
+    return g_atomic_int_get(&virMetricsEnabled);
+}
+
+
+static virMetricsHistogram *
+virMetricsHistogramNewInternal(char *name)
+{
+    virMetricsHistogram *hist = g_new0(virMetricsHistogram, 1);
+
+    ignore_value(virMutexInit(&hist->lock));
+    hist->name = name;
+
+    return hist;
+}
+
+
+/**
+ * virMetricsHistogramGet:
+ * @namefmt: printf-style format of the histogram name
+ *
+ * Returns the histogram called @namefmt, creating it if it doesn't exist
+ * yet. The returned pointer is valid for the lifetime of the process.
+ */
+virMetricsHistogram *
+virMetricsHistogramGet(const char *namefmt, ...)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virMetricsLock);
+    g_autofree char *name = NULL;
+    virMetricsHistogram *hist;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    name = g_strdup_vprintf(namefmt, ap);
+    va_end(ap);
+
+    if (!virMetricsHistograms)
+        virMetricsHistograms = g_hash_table_new(g_str_hash, g_str_equal);
+
+    if ((hist = g_hash_table_lookup(virMetricsHistograms, name)))
+        return hist;
+
+    hist = virMetricsHistogramNewInternal(g_steal_pointer(&name));
+
+    g_hash_table_insert(virMetricsHistograms, hist->name, hist);
+
+    return hist;
+}
+
+
+/**
+ * virMetricsHistogramNew:
+ * @namefmt: printf-style format of the histogram name
+ *
+ * Creates a histogram called @namefmt which is not reported by
+ * virMetricsGetParams(). The caller reports it using
+ * virMetricsHistogramGetParams() and frees it with
+ * virMetricsHistogramFree().
+ */
+virMetricsHistogram *
+virMetricsHistogramNew(const char *namefmt, ...)
+{
+    va_list ap;
+    char *name;
+
+    va_start(ap, namefmt);
+    name = g_strdup_vprintf(namefmt, ap);
+    va_end(ap);
+
+    return virMetricsHistogramNewInternal(name);
+}
+
+
+void
+virMetricsHistogramFree(virMetricsHistogram *hist)
+{
+    if (!hist)
+        return;
+
+    virMutexDestroy(&hist->lock);
+    g_free(hist->name);
+    g_free(hist);
+}
+
+
+static size_t
+virMetricsHistogramBucket(unsigned long long value)
+{
+    size_t bucket = 0;
+
+    while (value && bucket < VIR_METRICS_HISTOGRAM_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+
+void
+virMetricsHistogramAdd(virMetricsHistogram *hist,
+                       unsigned long long value)
+{
+    size_t bucket = virMetricsHistogramBucket(value);
+    VIR_LOCK_GUARD lock = virLockGuardLock(&hist->lock);
+
+    hist->count++;
+    hist->sum += value;
+    hist->max = MAX(hist->max, value);
+    hist->buckets[bucket]++;
+}
+
+
+/**
+ * virMetricsHistogramGetParams:
+ * @hist: histogram
+ * @list: typed parameter list to fill
+ *
+ * Appends the parameters of @hist to @list in the format described at
+ * virMetricsGetParams().
+ */
+void
+virMetricsHistogramGetParams(virMetricsHistogram *hist,
+                             virTypedParamList *list)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&hist->lock);
+    size_t i;
+
+    virTypedParamListAddULLong(list, hist->count, "%s.count", hist->name);
+    virTypedParamListAddULLong(list, hist->sum, "%s.sum", hist->name);
+    virTypedParamListAddULLong(list, hist->max, "%s.max", hist->name);
+
+    for (i = 0; i < VIR_METRICS_HISTOGRAM_BUCKETS; i++) {
+        if (hist->buckets[i] == 0)
+            continue;
+
+        if (i == VIR_METRICS_HISTOGRAM_BUCKETS - 1) {
+            virTypedParamListAddULLong(list, hist->buckets[i],
+                                       "%s.bucket.inf", hist->name);
+        } else {
+            virTypedParamListAddULLong(list, hist->buckets[i],
+                                       "%s.bucket.%llu", hist->name, 1ULL << i);
+        }
+    }
+}
+
+
+/**
+ * virMetricsRegisterSource:
+ * @func: callback reporting metrics
+ *
+ * Registers @func to be called by virMetricsGetParams() after all
+ * histograms were reported. @func must not call any virMetrics API.
+ * Sources can't be unregistered.
+ */
+void
+virMetricsRegisterSource(virMetricsSourceFunc func)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virMetricsLock);
+
+    virMetricsSources = g_slist_append(virMetricsSources, func);
+}
+
+
+/**
+ * virMetricsGetParams:
+ * @list: typed parameter list to fill
+ *
+ * Appends all histograms sorted by name to @list, followed by whatever
+ * the registered sources report, in order of registration. For every
+ * histogram "NAME.count", "NAME.sum" and "NAME.max" are reported,
+ * followed by "NAME.bucket.BOUND" for every non-empty bucket, which
+ * counts values smaller than BOUND but not smaller than the bound of the
+ * previous bucket. Values which don't fit any bucket are counted in
+ * "NAME.bucket.inf".
+ */
+void
+virMetricsGetParams(virTypedParamList *list)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virMetricsLock);
+    g_autofree const char **names = NULL;
+    guint nnames = 0;
+    GSList *next;
+    size_t i;
+
+    if (virMetricsHistograms) {
+        names = (const char **) g_hash_table_get_keys_as_array(virMetricsHistograms,
+                                                               &nnames);
+        g_qsort_with_data(names, nnames, sizeof(*names),
+                          virStringSortCompare, NULL);
+    }
+
+    for (i = 0; i < nnames; i++) {
+        virMetricsHistogramGetParams(g_hash_table_lookup(virMetricsHistograms,
+                                                         names[i]),
+                                     list);
+    }
+
+    for (next = virMetricsSources; next; next = next->next) {
+        virMetricsSourceFunc func = next->data;
+
+        func(list);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * virmetrics.h: process wide latency histograms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virtypedparam.h"
+
+/* Bucket 0 counts zero values, bucket i counts values in
+ * [2^(i-1), 2^i) and the last bucket counts everything larger. */
+#define VIR_METRICS_HISTOGRAM_BUCKETS 32
+
+typedef struct _virMetricsHistogram virMetricsHistogram;
+
+void
+virMetricsSetEnabled(bool enabled);
+
+bool
+virMetricsIsEnabled(void);
+
+virMetricsHistogram *
+virMetricsHistogramGet(const char *namefmt, ...)
+    G_GNUC_PRINTF(1, 2);
+
+virMetricsHistogram *
+virMetricsHistogramNew(const char *namefmt, ...)
+    G_GNUC_PRINTF(1, 2);
+
+void
+virMetricsHistogramFree(virMetricsHistogram *hist);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virMetricsHistogram, virMetricsHistogramFree);
+
+void
+virMetricsHistogramAdd(virMetricsHistogram *hist,
+                       unsigned long long value);
+
+void
+virMetricsHistogramGetParams(virMetricsHistogram *hist,
+                             virTypedParamList *list);
+
+typedef void (*virMetricsSourceFunc)(virTypedParamList *list);
+
+void
+virMetricsRegisterSource(virMetricsSourceFunc func);
+
+void
+virMetricsGetParams(virTypedParamList *list);
@@ -47,6 +47,7 @@
 #include "virfile.h"
 #include "virhostmem.h"
 #include "virutil.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -77,12 +78,24 @@ virNumaGetAutoPlacementAdvice(unsigned short vcpus,
 }
 #else /* !WITH_NUMAD */
 char *
-virNumaGetAutoPlacementAdvice(unsigned short vcpus G_GNUC_UNUSED,
-                              unsigned long long balloon G_GNUC_UNUSED)
+virNumaGetAutoPlacementAdvice(unsigned short vcpus,
+                              unsigned long long balloon)
 {
-    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                   _("numad is not available on this host"));
-    return NULL;
+    g_autofree virNumaPlacementNode *nodes = NULL;
+    g_autoptr(virBitmap) nodeset = NULL;
+    size_t nnodes;
+
+    /* Without numad fall back to the built-in placement engine. As there
+     * is no knowledge of other guests here, only the current state of the
+     * host is taken into account. */
+    if (!(nodes = virNumaPlacementGetHostNodes(0, &nnodes)))
+        return NULL;
+
+    if (!(nodeset = virNumaPlacementChoose(nodes, nnodes, vcpus,
+                                           balloon, false)))
+        return NULL;
+
+    return virBitmapFormat(nodeset);
 }
 #endif /* !WITH_NUMAD */
 
@@ -1099,3 +1112,386 @@ virNumaNodesetToCPUset(virBitmap *nodeset,
 
     return 0;
 }
+
+
+/**
+ * virNumaPlacementGetHostNodes:
+ * @hugepageSize: size of huge pages backing the guest in KiB, or 0
+ * @nnodes: return location for the number of nodes
+ *
+ * Collect the state of host NUMA nodes the built-in placement engine
+ * decides on: number of CPUs, total and free memory and memory held in
+ * free huge pages of @hugepageSize. Pages of other sizes can't back the
+ * guest and are not counted. The @vcpus and @memory members are left
+ * zero for the caller to account guests which were placed already.
+ *
+ * Returns: array of nodes on success,
+ *          NULL on failure (with error reported).
+ */
+virNumaPlacementNode *
+virNumaPlacementGetHostNodes(unsigned long long hugepageSize,
+                             size_t *nnodes)
+{
+    g_autofree virNumaPlacementNode *nodes = NULL;
+    size_t n = 0;
+    int maxnode;
+    int i;
+
+    if (!virNumaIsAvailable()) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("NUMA isn't available on this host"));
+        return NULL;
+    }
+
+    if ((maxnode = virNumaGetMaxNode()) < 0)
+        return NULL;
+
+    nodes = g_new0(virNumaPlacementNode, maxnode + 1);
+
+    for (i = 0; i <= maxnode; i++) {
+        virNumaPlacementNode *node = &nodes[n];
+        g_autoptr(virBitmap) cpus = NULL;
+        g_autofree unsigned int *pageSizes = NULL;
+        g_autofree unsigned long long *pagesFree = NULL;
+        size_t npages = 0;
+        size_t j;
+        int ncpus;
+
+        if (!virNumaNodeIsAvailable(i))
+            continue;
+
+        if ((ncpus = virNumaGetNodeCPUs(i, &cpus)) < 0) {
+            if (ncpus == -2)
+                continue;
+            return NULL;
+        }
+
+        if (virNumaGetNodeMemory(i, &node->memTotal, &node->memFree) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("unable to get memory of NUMA node %1$d"), i);
+            return NULL;
+        }
+
+        node->id = i;
+        node->ncpus = ncpus;
+        node->memTotal /= 1024;
+        node->memFree /= 1024;
+
+        if (hugepageSize > 0) {
+            if (virNumaGetPages(i, &pageSizes, NULL, &pagesFree, &npages) < 0)
+                return NULL;
+
+            for (j = 0; j < npages; j++) {
+                if (pageSizes[j] == hugepageSize)
+                    node->hugeFree = hugepageSize * pagesFree[j];
+            }
+        }
+
+        n++;
+    }
+
+    *nnodes = n;
+    return g_steal_pointer(&nodes);
+}
+
+
+typedef struct _virNumaPlacementCandidate virNumaPlacementCandidate;
+struct _virNumaPlacementCandidate {
+    const virNumaPlacementNode *node;
+    unsigned long long avail;
+    unsigned long long cost;
+};
+
+
+static unsigned long long
+virNumaPlacementNodeAvail(const virNumaPlacementNode *node,
+                          bool hugepages)
+{
+    unsigned long long uncommitted = 0;
+
+    if (hugepages)
+        return node->hugeFree;
+
+    /* Guests don't touch all their memory right away, so what the kernel
+     * reports as free may still be promised to guests placed earlier. */
+    if (node->memTotal > node->memory)
+        uncommitted = node->memTotal - node->memory;
+
+    return MIN(node->memFree, uncommitted);
+}
+
+
+static int
+virNumaPlacementCandidateCompare(const void *a,
+                                 const void *b)
+{
+    const virNumaPlacementCandidate *ca = a;
+    const virNumaPlacementCandidate *cb = b;
+
+    if (ca->cost != cb->cost)
+        return ca->cost < cb->cost ? -1 : 1;
+
+    if (ca->node->id != cb->node->id)
+        return ca->node->id < cb->node->id ? -1 : 1;
+
+    return 0;
+}
+
+
+/**
+ * virNumaPlacementChoose:
+ * @nodes: state of host NUMA nodes
+ * @nnodes: number of items in @nodes
+ * @vcpus: number of vCPUs of the guest
+ * @memory: memory of the guest in KiB
+ * @hugepages: whether the guest is backed by huge pages
+ *
+ * Pick NUMA nodes for a guest. Every node with both CPUs and memory is
+ * given a cost which is the sum of its CPU load (vCPUs placed onto the
+ * node per host CPU) and memory pressure (the part of the node's memory
+ * not available to the guest), both in per mille. The cheapest node
+ * able to hold the whole guest is chosen. If there's no such node the
+ * guest is spread over the cheapest nodes until it fits, or over all of
+ * them if it doesn't fit at all. Ties are broken by the node ID so that
+ * the result depends on @nodes only.
+ *
+ * Returns: bitmap of chosen nodes on success,
+ *          NULL on failure (with error reported).
+ */
+virBitmap *
+virNumaPlacementChoose(const virNumaPlacementNode *nodes,
+                       size_t nnodes,
+                       unsigned int vcpus,
+                       unsigned long long memory,
+                       bool hugepages)
+{
+    g_autofree virNumaPlacementCandidate *cands = NULL;
+    g_autoptr(virBitmap) ret = virBitmapNew(0);
+    unsigned long long sumMemory = 0;
+    unsigned int sumCpus = 0;
+    size_t ncands = 0;
+    size_t i;
+
+    cands = g_new0(virNumaPlacementCandidate, nnodes);
+
+    for (i = 0; i < nnodes; i++) {
+        const virNumaPlacementNode *node = &nodes[i];
+        virNumaPlacementCandidate *cand = &cands[ncands];
+
+        if (node->ncpus == 0 || node->memTotal == 0)
+            continue;
+
+        cand->node = node;
+        cand->avail = virNumaPlacementNodeAvail(node, hugepages);
+        cand->cost = 1000ULL * node->vcpus / node->ncpus;
+        cand->cost += 1000ULL * (node->memTotal - MIN(cand->avail, node->memTotal)) /
+                      node->memTotal;
+
+        VIR_DEBUG("node=%u cpus=%u vcpus=%u avail=%llu cost=%llu",
+                  node->id, node->ncpus, node->vcpus, cand->avail, cand->cost);
+        ncands++;
+    }
+
+    if (ncands == 0) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("no NUMA node is usable for automatic placement"));
+        return NULL;
+    }
+
+    qsort(cands, ncands, sizeof(*cands), virNumaPlacementCandidateCompare);
+
+    for (i = 0; i < ncands; i++) {
+        if (cands[i].avail >= memory && cands[i].node->ncpus >= vcpus) {
+            virBitmapSetBitExpand(ret, cands[i].node->id);
+            return g_steal_pointer(&ret);
+        }
+    }
+
+    for (i = 0; i < ncands; i++) {
+        virBitmapSetBitExpand(ret, cands[i].node->id);
+        sumMemory += cands[i].avail;
+        sumCpus += cands[i].node->ncpus;
+
+        if (sumMemory >= memory && sumCpus >= vcpus)
+            break;
+    }
+
+    return g_steal_pointer(&ret);
+}
+
+
+typedef struct _virNumaPlacementEntry virNumaPlacementEntry;
+struct _virNumaPlacementEntry {
+    unsigned int vcpus;
+    unsigned long long memory;
+    virBitmap *nodeset;
+};
+
+struct _virNumaPlacement {
+    virMutex lock;
+    GHashTable *entries; /* key -> virNumaPlacementEntry */
+};
+
+
+static void
+virNumaPlacementEntryFree(void *opaque)
+{
+    virNumaPlacementEntry *entry = opaque;
+
+    virBitmapFree(entry->nodeset);
+    g_free(entry);
+}
+
+
+/**
+ * virNumaPlacementNew:
+ *
+ * Create a tracker of guests placed by the built-in placement engine.
+ * Guests are identified by an arbitrary string key (e.g. UUID) and
+ * their vCPUs and memory are accounted to the nodes they were placed
+ * onto, evenly split, when placing further guests.
+ *
+ * Returns: new tracker on success,
+ *          NULL on failure (with error reported).
+ */
+virNumaPlacement *
+virNumaPlacementNew(void)
+{
+    g_autofree virNumaPlacement *placement = g_new0(virNumaPlacement, 1);
+
+    if (virMutexInit(&placement->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to init NUMA placement mutex"));
+        return NULL;
+    }
+
+    placement->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                               virNumaPlacementEntryFree);
+
+    return g_steal_pointer(&placement);
+}
+
+
+void
+virNumaPlacementFree(virNumaPlacement *placement)
+{
+    if (!placement)
+        return;
+
+    g_hash_table_unref(placement->entries);
+    virMutexDestroy(&placement->lock);
+    g_free(placement);
+}
+
+
+static void
+virNumaPlacementAddLocked(virNumaPlacement *placement,
+                          const char *key,
+                          unsigned int vcpus,
+                          unsigned long long memory,
+                          virBitmap *nodeset)
+{
+    virNumaPlacementEntry *entry = g_new0(virNumaPlacementEntry, 1);
+
+    entry->vcpus = vcpus;
+    entry->memory = memory;
+    entry->nodeset = virBitmapNewCopy(nodeset);
+
+    g_hash_table_insert(placement->entries, g_strdup(key), entry);
+}
+
+
+/**
+ * virNumaPlacementPlace:
+ * @placement: tracker
+ * @key: guest identifier
+ * @vcpus: number of vCPUs of the guest
+ * @memory: memory of the guest in KiB
+ * @hugepageSize: size of huge pages backing the guest in KiB, or 0 if
+ *                the guest is not backed by huge pages
+ *
+ * Choose NUMA nodes for the guest identified by @key, taking into
+ * account the current state of the host and all other guests recorded
+ * in @placement, and record the decision. A previous record of @key is
+ * replaced.
+ *
+ * Returns: bitmap of chosen nodes on success,
+ *          NULL on failure (with error reported).
+ */
+virBitmap *
+virNumaPlacementPlace(virNumaPlacement *placement,
+                      const char *key,
+                      unsigned int vcpus,
+                      unsigned long long memory,
+                      unsigned long long hugepageSize)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&placement->lock);
+    g_autofree virNumaPlacementNode *nodes = NULL;
+    virBitmap *ret;
+    GHashTableIter iter;
+    const char *otherKey;
+    virNumaPlacementEntry *other;
+    size_t nnodes;
+    size_t i;
+
+    if (!(nodes = virNumaPlacementGetHostNodes(hugepageSize, &nnodes)))
+        return NULL;
+
+    g_hash_table_iter_init(&iter, placement->entries);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &otherKey, (gpointer *) &other)) {
+        unsigned int count = virBitmapCountBits(other->nodeset);
+
+        if (STREQ(otherKey, key) || count == 0)
+            continue;
+
+        for (i = 0; i < nnodes; i++) {
+            if (!virBitmapIsBitSet(other->nodeset, nodes[i].id))
+                continue;
+
+            nodes[i].vcpus += VIR_DIV_UP(other->vcpus, count);
+            nodes[i].memory += VIR_DIV_UP(other->memory, count);
+        }
+    }
+
+    if (!(ret = virNumaPlacementChoose(nodes, nnodes, vcpus, memory,
+                                       hugepageSize > 0)))
+        return NULL;
+
+    virNumaPlacementAddLocked(placement, key, vcpus, memory, ret);
+
+    return ret;
+}
+
+
+/**
+ * virNumaPlacementAdd:
+ * @placement: tracker
+ * @key: guest identifier
+ * @vcpus: number of vCPUs of the guest
+ * @memory: memory of the guest in KiB
+ * @nodeset: nodes the guest was placed onto
+ *
+ * Record a guest placed earlier, e.g. when reconnecting to running
+ * guests after a daemon restart.
+ */
+void
+virNumaPlacementAdd(virNumaPlacement *placement,
+                    const char *key,
+                    unsigned int vcpus,
+                    unsigned long long memory,
+                    virBitmap *nodeset)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&placement->lock);
+
+    virNumaPlacementAddLocked(placement, key, vcpus, memory, nodeset);
+}
+
+
+void
+virNumaPlacementRemove(virNumaPlacement *placement,
+                       const char *key)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&placement->lock);
+
+    g_hash_table_remove(placement->entries, key);
+}
@@ -28,6 +28,45 @@
 char *virNumaGetAutoPlacementAdvice(unsigned short vcpus,
                                     unsigned long long balloon);
 
+typedef struct _virNumaPlacementNode virNumaPlacementNode;
+struct _virNumaPlacementNode {
+    unsigned int id;
+    unsigned int ncpus;             /* number of host CPUs in the node */
+    unsigned long long memTotal;    /* KiB */
+    unsigned long long memFree;     /* KiB */
+    unsigned long long hugeFree;    /* KiB in free huge pages of the size
+                                     * requested from GetHostNodes() */
+    unsigned int vcpus;             /* vCPUs of guests placed onto the node */
+    unsigned long long memory;      /* KiB of guests placed onto the node */
+};
+
+virNumaPlacementNode *virNumaPlacementGetHostNodes(unsigned long long hugepageSize,
+                                                   size_t *nnodes);
+virBitmap *virNumaPlacementChoose(const virNumaPlacementNode *nodes,
+                                  size_t nnodes,
+                                  unsigned int vcpus,
+                                  unsigned long long memory,
+                                  bool hugepages);
+
+typedef struct _virNumaPlacement virNumaPlacement;
+
+virNumaPlacement *virNumaPlacementNew(void);
+void virNumaPlacementFree(virNumaPlacement *placement);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virNumaPlacement, virNumaPlacementFree);
+
+virBitmap *virNumaPlacementPlace(virNumaPlacement *placement,
+                                 const char *key,
+                                 unsigned int vcpus,
+                                 unsigned long long memory,
+                                 unsigned long long hugepageSize);
+void virNumaPlacementAdd(virNumaPlacement *placement,
+                         const char *key,
+                         unsigned int vcpus,
+                         unsigned long long memory,
+                         virBitmap *nodeset);
+void virNumaPlacementRemove(virNumaPlacement *placement,
+                            const char *key);
+
 int virNumaSetupMemoryPolicy(virDomainNumatuneMemMode mode,
                              virBitmap *nodeset);
 
@@ -0,0 +1,726 @@
+/*
+ * virstatsexport.c: publishing domain statistics in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#if WITH_MMAP
+# include <sys/mman.h>
+#endif
+
+#include "virstatsexport.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virtypedparam.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.statsexport");
+
+/* How many times a reader retries when racing with the writer. */
+#define VIR_STATS_EXPORT_READ_RETRIES 1000
+
+
+void
+virStatsExportRecordsFree(virStatsExportRecord *records,
+                          size_t nrecords)
+{
+    size_t i;
+
+    if (!records)
+        return;
+
+    for (i = 0; i < nrecords; i++) {
+        g_free(records[i].name);
+        virTypedParamsFree(records[i].params, records[i].nparams);
+    }
+
+    g_free(records);
+}
+
+
+#if WITH_MMAP
+
+struct _virStatsExport {
+    char *path;
+    int fd;
+    char *map;
+    size_t mapsize;
+
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+    bool running;
+    bool quit;
+    unsigned int interval;
+    virStatsExportCollectFunc collect;
+    void *opaque;
+};
+
+
+static void
+virStatsExportAppendUInt(GByteArray *buf,
+                         uint32_t val)
+{
+    g_byte_array_append(buf, (const guint8 *) &val, sizeof(val));
+}
+
+
+static void
+virStatsExportAppendString(GByteArray *buf,
+                           const char *str)
+{
+    size_t len = strlen(str);
+
+    virStatsExportAppendUInt(buf, len);
+    g_byte_array_append(buf, (const guint8 *) str, len);
+}
+
+
+static int
+virStatsExportFormatParam(GByteArray *buf,
+                          virTypedParameterPtr param)
+{
+    virStatsExportAppendString(buf, param->field);
+    virStatsExportAppendUInt(buf, param->type);
+
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        g_byte_array_append(buf, (const guint8 *) &param->value.i,
+                            sizeof(param->value.i));
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        g_byte_array_append(buf, (const guint8 *) &param->value.ui,
+                            sizeof(param->value.ui));
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        virStatsExportAppendUInt(buf, !!param->value.b);
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        g_byte_array_append(buf, (const guint8 *) &param->value.l,
+                            sizeof(param->value.l));
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        g_byte_array_append(buf, (const guint8 *) &param->value.ul,
+                            sizeof(param->value.ul));
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        g_byte_array_append(buf, (const guint8 *) &param->value.d,
+                            sizeof(param->value.d));
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        virStatsExportAppendString(buf, NULLSTR_EMPTY(param->value.s));
+        break;
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        virReportEnumRangeError(virTypedParameterType, param->type);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virStatsExportGrow(virStatsExport *exp,
+                   size_t needed)
+{
+    size_t pagesize = virGetSystemPageSize();
+    size_t size = VIR_ROUND_UP(needed + needed / 2, pagesize);
+    char *map;
+
+    if (ftruncate(exp->fd, size) < 0) {
+        virReportSystemError(errno, _("Unable to resize %1$s"), exp->path);
+        return -1;
+    }
+
+    if ((map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    exp->fd, 0)) == MAP_FAILED) {
+        virReportSystemError(errno, _("Unable to map %1$s"), exp->path);
+        return -1;
+    }
+
+    if (exp->map)
+        munmap(exp->map, exp->mapsize);
+
+    exp->map = map;
+    exp->mapsize = size;
+    return 0;
+}
+
+
+/**
+ * virStatsExportNew:
+ * @path: file to publish statistics in
+ * @group: group allowed to read the file, or (gid_t)-1
+ *
+ * Create @path (replacing an existing file) for publishing statistics.
+ * An existing file is unlinked rather than truncated so that readers
+ * which still have it mapped don't crash. The file is readable by its
+ * owner only, unless @group is given, in which case the file is owned
+ * by @group and readable by its members as well.
+ *
+ * Returns: new object on success,
+ *          NULL on failure (with error reported).
+ */
+virStatsExport *
+virStatsExportNew(const char *path,
+                  gid_t group)
+{
+    g_autoptr(virStatsExport) exp = g_new0(virStatsExport, 1);
+    virStatsExportHeader *hdr;
+
+    exp->fd = -1;
+    exp->path = g_strdup(path);
+
+    if (virMutexInit(&exp->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        return NULL;
+    }
+
+    if (virCondInit(&exp->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition"));
+        return NULL;
+    }
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        virReportSystemError(errno, _("Unable to remove %1$s"), path);
+        return NULL;
+    }
+
+    if ((exp->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                        S_IRUSR | S_IWUSR)) < 0) {
+        virReportSystemError(errno, _("Unable to create %1$s"), path);
+        return NULL;
+    }
+
+    if (group != (gid_t)-1) {
+        if (fchown(exp->fd, (uid_t)-1, group) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to change group of %1$s to %2$u"),
+                                 path, (unsigned int) group);
+            return NULL;
+        }
+
+        /* fchmod() is not affected by umask, unlike open() */
+        if (fchmod(exp->fd, S_IRUSR | S_IWUSR | S_IRGRP) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to change mode of %1$s"), path);
+            return NULL;
+        }
+    }
+
+    if (virStatsExportGrow(exp, VIR_STATS_EXPORT_HEADER_SIZE) < 0)
+        return NULL;
+
+    hdr = (virStatsExportHeader *) exp->map;
+    memcpy(hdr->magic, VIR_STATS_EXPORT_MAGIC, sizeof(hdr->magic));
+    hdr->version = VIR_STATS_EXPORT_VERSION;
+
+    return g_steal_pointer(&exp);
+}
+
+
+void
+virStatsExportFree(virStatsExport *exp)
+{
+    if (!exp)
+        return;
+
+    if (exp->running) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&exp->lock) {
+            exp->quit = true;
+            virCondSignal(&exp->cond);
+        }
+        virThreadJoin(&exp->thread);
+    }
+
+    if (exp->map)
+        munmap(exp->map, exp->mapsize);
+    if (exp->fd >= 0) {
+        unlink(exp->path);
+        VIR_FORCE_CLOSE(exp->fd);
+    }
+
+    virCondDestroy(&exp->cond);
+    virMutexDestroy(&exp->lock);
+    g_free(exp->path);
+    g_free(exp);
+}
+
+
+/**
+ * virStatsExportPublish:
+ * @exp: stats export object
+ * @records: records to publish
+ * @nrecords: number of items in @records
+ *
+ * Replace statistics published in the file by @records. Must not be
+ * called concurrently for the same @exp.
+ *
+ * Returns: 0 on success,
+ *          -1 on failure (with error reported).
+ */
+int
+virStatsExportPublish(virStatsExport *exp,
+                      virStatsExportRecord *records,
+                      size_t nrecords)
+{
+    g_autoptr(GByteArray) buf = g_byte_array_new();
+    virStatsExportHeader *hdr;
+    uint32_t seq;
+    size_t i;
+    int j;
+
+    for (i = 0; i < nrecords; i++) {
+        virStatsExportAppendString(buf, records[i].name);
+        virStatsExportAppendUInt(buf, records[i].nparams);
+
+        for (j = 0; j < records[i].nparams; j++) {
+            if (virStatsExportFormatParam(buf, &records[i].params[j]) < 0)
+                return -1;
+        }
+    }
+
+    if (VIR_STATS_EXPORT_HEADER_SIZE + buf->len > exp->mapsize &&
+        virStatsExportGrow(exp, VIR_STATS_EXPORT_HEADER_SIZE + buf->len) < 0)
+        return -1;
+
+    hdr = (virStatsExportHeader *) exp->map;
+    seq = hdr->seq;
+
+    __atomic_store_n(&hdr->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(exp->map + VIR_STATS_EXPORT_HEADER_SIZE, buf->data, buf->len);
+    hdr->length = buf->len;
+    hdr->nrecords = nrecords;
+    hdr->timestamp = g_get_real_time() / 1000;
+
+    __atomic_store_n(&hdr->seq, seq + 2, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+static void
+virStatsExportWorker(void *opaque)
+{
+    virStatsExport *exp = opaque;
+
+    while (true) {
+        virStatsExportRecord *records = NULL;
+        size_t nrecords = 0;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&exp->lock) {
+            unsigned long long now;
+
+            if (virTimeMillisNow(&now) < 0)
+                return;
+
+            now += exp->interval * 1000ULL;
+            while (!exp->quit) {
+                if (virCondWaitUntil(&exp->cond, &exp->lock, now) < 0 &&
+                    errno == ETIMEDOUT)
+                    break;
+            }
+
+            if (exp->quit)
+                return;
+        }
+
+        if (exp->collect(&records, &nrecords, exp->opaque) < 0 ||
+            virStatsExportPublish(exp, records, nrecords) < 0) {
+            VIR_WARN("Unable to publish statistics in %s: %s",
+                     exp->path, virGetLastErrorMessage());
+            virResetLastError();
+        }
+
+        virStatsExportRecordsFree(records, nrecords);
+    }
+}
+
+
+/**
+ * virStatsExportStart:
+ * @exp: stats export object
+ * @interval: seconds between updates
+ * @collect: callback gathering records to publish
+ * @opaque: data passed to @collect
+ *
+ * Start a thread which calls @collect every @interval seconds and
+ * publishes the records it returns. The thread is stopped by
+ * virStatsExportFree().
+ *
+ * Returns: 0 on success,
+ *          -1 on failure (with error reported).
+ */
+int
+virStatsExportStart(virStatsExport *exp,
+                    unsigned int interval,
+                    virStatsExportCollectFunc collect,
+                    void *opaque)
+{
+    exp->interval = interval;
+    exp->collect = collect;
+    exp->opaque = opaque;
+
+    if (virThreadCreateFull(&exp->thread, true, virStatsExportWorker,
+                            "stats-export", false, exp) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create stats export thread"));
+        return -1;
+    }
+
+    exp->running = true;
+    return 0;
+}
+
+
+static int
+virStatsExportParseBytes(const char **cur,
+                         const char *end,
+                         void *dst,
+                         size_t len)
+{
+    if ((size_t) (end - *cur) < len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("truncated statistics record"));
+        return -1;
+    }
+
+    memcpy(dst, *cur, len);
+    *cur += len;
+    return 0;
+}
+
+
+static char *
+virStatsExportParseString(const char **cur,
+                          const char *end)
+{
+    g_autofree char *ret = NULL;
+    uint32_t len;
+
+    if (virStatsExportParseBytes(cur, end, &len, sizeof(len)) < 0)
+        return NULL;
+
+    ret = g_new0(char, (size_t) len + 1);
+    if (virStatsExportParseBytes(cur, end, ret, len) < 0)
+        return NULL;
+
+    return g_steal_pointer(&ret);
+}
+
+
+static int
+virStatsExportParseParam(const char **cur,
+                         const char *end,
+                         virTypedParameterPtr param)
+{
+    g_autofree char *field = NULL;
+    uint32_t type;
+    uint32_t b;
+
+    if (!(field = virStatsExportParseString(cur, end)) ||
+        virStatsExportParseBytes(cur, end, &type, sizeof(type)) < 0)
+        return -1;
+
+    if (virStrcpyStatic(param->field, field) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("statistics field name '%1$s' too long"), field);
+        return -1;
+    }
+    param->type = type;
+
+    switch ((virTypedParameterType) type) {
+    case VIR_TYPED_PARAM_INT:
+        return virStatsExportParseBytes(cur, end, &param->value.i,
+                                        sizeof(param->value.i));
+    case VIR_TYPED_PARAM_UINT:
+        return virStatsExportParseBytes(cur, end, &param->value.ui,
+                                        sizeof(param->value.ui));
+    case VIR_TYPED_PARAM_BOOLEAN:
+        if (virStatsExportParseBytes(cur, end, &b, sizeof(b)) < 0)
+            return -1;
+        param->value.b = !!b;
+        return 0;
+    case VIR_TYPED_PARAM_LLONG:
+        return virStatsExportParseBytes(cur, end, &param->value.l,
+                                        sizeof(param->value.l));
+    case VIR_TYPED_PARAM_ULLONG:
+        return virStatsExportParseBytes(cur, end, &param->value.ul,
+                                        sizeof(param->value.ul));
+    case VIR_TYPED_PARAM_DOUBLE:
+        return virStatsExportParseBytes(cur, end, &param->value.d,
+                                        sizeof(param->value.d));
+    case VIR_TYPED_PARAM_STRING:
+        if (!(param->value.s = virStatsExportParseString(cur, end)))
+            return -1;
+        return 0;
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        virReportEnumRangeError(virTypedParameterType, type);
+        return -1;
+    }
+}
+
+
+static int
+virStatsExportParse(const char *data,
+                    size_t len,
+                    size_t nrecords,
+                    virStatsExportRecord **records)
+{
+    virStatsExportRecord *ret = NULL;
+    const char *cur = data;
+    const char *end = data + len;
+    size_t i;
+
+    ret = g_new0(virStatsExportRecord, nrecords);
+
+    for (i = 0; i < nrecords; i++) {
+        virStatsExportRecord *rec = &ret[i];
+        uint32_t nparams;
+        size_t j;
+
+        if (!(rec->name = virStatsExportParseString(&cur, end)) ||
+            virStatsExportParseBytes(&cur, end, &nparams, sizeof(nparams)) < 0)
+            goto error;
+
+        /* Each parameter takes at least 12 bytes */
+        if (nparams > (size_t) (end - cur) / 12) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("truncated statistics record"));
+            goto error;
+        }
+
+        rec->params = g_new0(virTypedParameter, nparams);
+        rec->nparams = nparams;
+
+        for (j = 0; j < nparams; j++) {
+            if (virStatsExportParseParam(&cur, end, &rec->params[j]) < 0)
+                goto error;
+        }
+    }
+
+    *records = ret;
+    return 0;
+
+ error:
+    virStatsExportRecordsFree(ret, nrecords);
+    return -1;
+}
+
+
+/**
+ * virStatsExportRead:
+ * @path: file statistics are published in
+ * @records: return location for the published records
+ * @nrecords: return location for the number of @records
+ * @timestamp: optional return location for the time of the last update
+ *             (milliseconds since epoch)
+ *
+ * Read statistics published in @path by virStatsExportPublish(). The
+ * file is only mapped for reading and no locks are taken; a consistent
+ * snapshot is copied out and decoded afterwards.
+ *
+ * Returns: 0 on success,
+ *          -1 on failure (with error reported).
+ */
+int
+virStatsExportRead(const char *path,
+                   virStatsExportRecord **records,
+                   size_t *nrecords,
+                   unsigned long long *timestamp)
+{
+    VIR_AUTOCLOSE fd = -1;
+    g_autofree char *data = NULL;
+    char *map = NULL;
+    size_t mapsize = 0;
+    uint64_t length = 0;
+    uint32_t count = 0;
+    uint64_t ts = 0;
+    size_t attempt;
+    int ret = -1;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("Unable to open %1$s"), path);
+        return -1;
+    }
+
+    for (attempt = 0; attempt < VIR_STATS_EXPORT_READ_RETRIES; attempt++) {
+        virStatsExportHeader *hdr;
+        uint32_t seq;
+
+        if (!map) {
+            struct stat sb;
+
+            if (fstat(fd, &sb) < 0) {
+                virReportSystemError(errno, _("Unable to stat %1$s"), path);
+                goto cleanup;
+            }
+
+            if (sb.st_size < VIR_STATS_EXPORT_HEADER_SIZE) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("'%1$s' is not a statistics file"), path);
+                goto cleanup;
+            }
+
+            mapsize = sb.st_size;
+            if ((map = mmap(NULL, mapsize, PROT_READ, MAP_SHARED,
+                            fd, 0)) == MAP_FAILED) {
+                map = NULL;
+                virReportSystemError(errno, _("Unable to map %1$s"), path);
+                goto cleanup;
+            }
+
+            hdr = (virStatsExportHeader *) map;
+            if (memcmp(hdr->magic, VIR_STATS_EXPORT_MAGIC,
+                       sizeof(hdr->magic)) != 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("'%1$s' is not a statistics file"), path);
+                goto cleanup;
+            }
+
+            if (hdr->version != VIR_STATS_EXPORT_VERSION) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("unsupported version %1$u of statistics file '%2$s'"),
+                               hdr->version, path);
+                goto cleanup;
+            }
+        }
+
+        hdr = (virStatsExportHeader *) map;
+
+        seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            g_usleep(10);
+            continue;
+        }
+
+        length = hdr->length;
+        count = hdr->nrecords;
+        ts = hdr->timestamp;
+
+        if (length > mapsize - VIR_STATS_EXPORT_HEADER_SIZE) {
+            /* The file grew since we mapped it */
+            munmap(map, mapsize);
+            map = NULL;
+            continue;
+        }
+
+        g_free(data);
+        data = g_new(char, length);
+        memcpy(data, map + VIR_STATS_EXPORT_HEADER_SIZE, length);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == seq)
+            break;
+    }
+
+    if (attempt == VIR_STATS_EXPORT_READ_RETRIES) {
+        virReportError(VIR_ERR_OPERATION_TIMEOUT,
+                       _("unable to get a consistent snapshot of '%1$s'"),
+                       path);
+        goto cleanup;
+    }
+
+    /* Each record takes at least 8 bytes */
+    if (count > length / 8) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("truncated statistics record"));
+        goto cleanup;
+    }
+
+    if (virStatsExportParse(data, length, count, records) < 0)
+        goto cleanup;
+
+    *nrecords = count;
+    if (timestamp)
+        *timestamp = ts;
+
+    ret = 0;
+
+ cleanup:
+    if (map)
+        munmap(map, mapsize);
+    return ret;
+}
+
+#else /* !WITH_MMAP */
+
+virStatsExport *
+virStatsExportNew(const char *path G_GNUC_UNUSED,
+                  gid_t group G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Statistics export is not supported on this platform"));
+    return NULL;
+}
+
+
+void
+virStatsExportFree(virStatsExport *exp G_GNUC_UNUSED)
+{
+}
+
+
+int
+virStatsExportStart(virStatsExport *exp G_GNUC_UNUSED,
+                    unsigned int interval G_GNUC_UNUSED,
+                    virStatsExportCollectFunc collect G_GNUC_UNUSED,
+                    void *opaque G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Statistics export is not supported on this platform"));
+    return -1;
+}
+
+
+int
+virStatsExportPublish(virStatsExport *exp G_GNUC_UNUSED,
+                      virStatsExportRecord *records G_GNUC_UNUSED,
+                      size_t nrecords G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Statistics export is not supported on this platform"));
+    return -1;
+}
+
+
+int
+virStatsExportRead(const char *path G_GNUC_UNUSED,
+                   virStatsExportRecord **records G_GNUC_UNUSED,
+                   size_t *nrecords G_GNUC_UNUSED,
+                   unsigned long long *timestamp G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Statistics export is not supported on this platform"));
+    return -1;
+}
+
+#endif /* !WITH_MMAP */
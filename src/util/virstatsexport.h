@@ -0,0 +1,99 @@
+/*
+ * virstatsexport.h: publishing domain statistics in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+
+#define VIR_STATS_EXPORT_MAGIC "LVSTATS"
+#define VIR_STATS_EXPORT_VERSION 1
+
+/* Offset of the data area within the file. */
+#define VIR_STATS_EXPORT_HEADER_SIZE 64
+
+/*
+ * The file starts with this header followed by the data area holding
+ * @nrecords records. Each record is:
+ *
+ *   uint32 name length, name (not NUL terminated), uint32 nparams,
+ *
+ * followed by @nparams parameters, each of them being:
+ *
+ *   uint32 field length, field (not NUL terminated), uint32 type,
+ *   value
+ *
+ * where value is 4 bytes for VIR_TYPED_PARAM_INT, VIR_TYPED_PARAM_UINT
+ * and VIR_TYPED_PARAM_BOOLEAN, 8 bytes for VIR_TYPED_PARAM_LLONG,
+ * VIR_TYPED_PARAM_ULLONG and VIR_TYPED_PARAM_DOUBLE, and uint32 length
+ * followed by the string for VIR_TYPED_PARAM_STRING. All numbers are in
+ * host byte order and not aligned.
+ *
+ * @seq is odd while the writer updates the file. Readers copy the data
+ * area and retry if @seq was odd or changed meanwhile. The file never
+ * shrinks so that it can be mapped safely; readers have to map it again
+ * if @length doesn't fit into their mapping.
+ *
+ * The layout is documented for readers outside of libvirt in
+ * docs/drvqemu.rst and must not change without bumping the version.
+ */
+typedef struct _virStatsExportHeader virStatsExportHeader;
+struct _virStatsExportHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t seq;
+    uint64_t length;        /* bytes of valid data */
+    uint64_t timestamp;     /* milliseconds since epoch of the last update */
+    uint32_t nrecords;
+    uint32_t reserved;
+};
+G_STATIC_ASSERT(sizeof(virStatsExportHeader) <= VIR_STATS_EXPORT_HEADER_SIZE);
+
+typedef struct _virStatsExportRecord virStatsExportRecord;
+struct _virStatsExportRecord {
+    char *name;
+    virTypedParameterPtr params;
+    int nparams;
+};
+
+void virStatsExportRecordsFree(virStatsExportRecord *records,
+                               size_t nrecords);
+
+typedef int (*virStatsExportCollectFunc)(virStatsExportRecord **records,
+                                         size_t *nrecords,
+                                         void *opaque);
+
+typedef struct _virStatsExport virStatsExport;
+
+virStatsExport *virStatsExportNew(const char *path,
+                                  gid_t group);
+void virStatsExportFree(virStatsExport *exp);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virStatsExport, virStatsExportFree);
+
+int virStatsExportStart(virStatsExport *exp,
+                        unsigned int interval,
+                        virStatsExportCollectFunc collect,
+                        void *opaque);
+
+int virStatsExportPublish(virStatsExport *exp,
+                          virStatsExportRecord *records,
+                          size_t nrecords);
+
+int virStatsExportRead(const char *path,
+                       virStatsExportRecord **records,
+                       size_t *nrecords,
+                       unsigned long long *timestamp);
@@ -26,9 +26,12 @@
 #include "viralloc.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virlog.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("util.threadpool");
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 struct _virThreadPoolJob {
     virThreadPoolJob *prev;
@@ -472,3 +475,77 @@ virThreadPoolDrain(virThreadPool *pool)
 
     virThreadPoolDrainLocked(pool);
 }
+
+
+typedef struct _virThreadPoolParallel virThreadPoolParallel;
+struct _virThreadPoolParallel {
+    virThreadPoolParallelFunc func;
+    void *opaque;
+    size_t nitems;
+    int next; /* atomic */
+};
+
+
+static void
+virThreadPoolParallelWorker(void *opaque)
+{
+    virThreadPoolParallel *par = opaque;
+    size_t idx;
+
+    while ((idx = g_atomic_int_add(&par->next, 1)) < par->nitems)
+        par->func(idx, par->opaque);
+}
+
+
+/**
+ * virThreadPoolRunParallel:
+ * @name: name of the worker threads
+ * @maxWorkers: maximum number of threads running @func at the same time
+ * @nitems: number of items to process
+ * @func: function called for each item
+ * @opaque: data passed to @func
+ *
+ * Calls @func for each index in the range [0, @nitems) and waits until all
+ * of them return. Up to @maxWorkers items are processed in parallel, the
+ * calling thread being one of the workers. Items are picked in order, but
+ * can finish in any order. If worker threads can't be created, the items
+ * are processed by the calling thread.
+ *
+ * Errors reported by @func are local to the thread which processed the
+ * item, @func is responsible for passing them to the caller, e.g. using
+ * virErrorPreserveLast().
+ */
+void
+virThreadPoolRunParallel(const char *name,
+                         size_t maxWorkers,
+                         size_t nitems,
+                         virThreadPoolParallelFunc func,
+                         void *opaque)
+{
+    virThreadPoolParallel par = { .func = func, .opaque = opaque,
+                                  .nitems = MIN(nitems, INT_MAX) };
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t i;
+
+    maxWorkers = MIN(maxWorkers, par.nitems);
+
+    if (maxWorkers > 1) {
+        threads = g_new0(virThread, maxWorkers - 1);
+
+        for (nthreads = 0; nthreads < maxWorkers - 1; nthreads++) {
+            if (virThreadCreateFull(&threads[nthreads], true,
+                                    virThreadPoolParallelWorker,
+                                    name, false, &par) < 0) {
+                VIR_WARN("Unable to create worker thread '%s': %s",
+                         name, g_strerror(errno));
+                break;
+            }
+        }
+    }
+
+    virThreadPoolParallelWorker(&par);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+}
@@ -57,3 +57,11 @@ int virThreadPoolSetParameters(virThreadPool *pool,
 
 void virThreadPoolStop(virThreadPool *pool);
 void virThreadPoolDrain(virThreadPool *pool);
+
+typedef void (*virThreadPoolParallelFunc)(size_t idx, void *opaque);
+
+void virThreadPoolRunParallel(const char *name,
+                              size_t maxWorkers,
+                              size_t nitems,
+                              virThreadPoolParallelFunc func,
+                              void *opaque) ATTRIBUTE_NONNULL(4);
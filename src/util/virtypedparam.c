@@ -556,6 +556,55 @@ virTypedParamsRemoteFree(struct _virTypedParameterRemote *remote_params_val,
 }
 
 
+/**
+ * virTypedParamDeserializeValue:
+ * @remote_value: protocol data of a single value
+ * @param: parameter to store the value in
+ *
+ * Sets type and value of @param from @remote_value. The field name of
+ * @param is left untouched.
+ *
+ * Returns 0 on success or -1 in case of an error.
+ */
+int
+virTypedParamDeserializeValue(virTypedParameterRemoteValue *remote_value,
+                              virTypedParameterPtr param)
+{
+    param->type = remote_value->type;
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        param->value.i = remote_value->remote_typed_param_value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        param->value.ui = remote_value->remote_typed_param_value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        param->value.l = remote_value->remote_typed_param_value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        param->value.ul = remote_value->remote_typed_param_value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        param->value.d = remote_value->remote_typed_param_value.d;
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        param->value.b = remote_value->remote_typed_param_value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        param->value.s = g_strdup(remote_value->remote_typed_param_value.s);
+        break;
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        virReportError(VIR_ERR_RPC, _("unknown parameter type: %1$d"),
+                       param->type);
+        param->type = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /**
  * virTypedParamsDeserialize:
  * @remote_params: protocol data to be deserialized (obtained from remote side)
@@ -627,35 +676,8 @@ virTypedParamsDeserialize(struct _virTypedParameterRemote *remote_params,
             goto cleanup;
         }
 
-        param->type = remote_param->value.type;
-        switch ((virTypedParameterType) param->type) {
-        case VIR_TYPED_PARAM_INT:
-            param->value.i = remote_param->value.remote_typed_param_value.i;
-            break;
-        case VIR_TYPED_PARAM_UINT:
-            param->value.ui = remote_param->value.remote_typed_param_value.ui;
-            break;
-        case VIR_TYPED_PARAM_LLONG:
-            param->value.l = remote_param->value.remote_typed_param_value.l;
-            break;
-        case VIR_TYPED_PARAM_ULLONG:
-            param->value.ul = remote_param->value.remote_typed_param_value.ul;
-            break;
-        case VIR_TYPED_PARAM_DOUBLE:
-            param->value.d = remote_param->value.remote_typed_param_value.d;
-            break;
-        case VIR_TYPED_PARAM_BOOLEAN:
-            param->value.b = remote_param->value.remote_typed_param_value.b;
-            break;
-        case VIR_TYPED_PARAM_STRING:
-            param->value.s = g_strdup(remote_param->value.remote_typed_param_value.s);
-            break;
-        case VIR_TYPED_PARAM_LAST:
-        default:
-            virReportError(VIR_ERR_RPC, _("unknown parameter type: %1$d"),
-                           param->type);
+        if (virTypedParamDeserializeValue(&remote_param->value, param) < 0)
             goto cleanup;
-        }
     }
 
     rv = 0;
@@ -674,6 +696,55 @@ virTypedParamsDeserialize(struct _virTypedParameterRemote *remote_params,
 }
 
 
+/**
+ * virTypedParamSerializeValue:
+ * @param: parameter to be serialized
+ * @remote_value: protocol representation of the value of @param
+ *
+ * Stores type and value of @param in @remote_value. A string value is
+ * copied and has to be freed by the caller (usually xdr_free).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamSerializeValue(virTypedParameterPtr param,
+                            virTypedParameterRemoteValue *remote_value)
+{
+    remote_value->type = param->type;
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        remote_value->remote_typed_param_value.i = param->value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        remote_value->remote_typed_param_value.ui = param->value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        remote_value->remote_typed_param_value.l = param->value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        remote_value->remote_typed_param_value.ul = param->value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        remote_value->remote_typed_param_value.d = param->value.d;
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        remote_value->remote_typed_param_value.b = param->value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        remote_value->remote_typed_param_value.s = g_strdup(param->value.s);
+        break;
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        virReportError(VIR_ERR_RPC, _("unknown parameter type: %1$d"),
+                       param->type);
+        remote_value->type = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /**
  * virTypedParamsSerialize:
  * @params: array of parameters to be serialized and later sent to remote side
@@ -733,35 +804,8 @@ virTypedParamsSerialize(virTypedParameterPtr params,
         /* This will be either freed by virNetServerDispatchCall or call(),
          * depending on the calling side, i.e. server or client */
         val->field = g_strdup(param->field);
-        val->value.type = param->type;
-        switch ((virTypedParameterType) param->type) {
-        case VIR_TYPED_PARAM_INT:
-            val->value.remote_typed_param_value.i = param->value.i;
-            break;
-        case VIR_TYPED_PARAM_UINT:
-            val->value.remote_typed_param_value.ui = param->value.ui;
-            break;
-        case VIR_TYPED_PARAM_LLONG:
-            val->value.remote_typed_param_value.l = param->value.l;
-            break;
-        case VIR_TYPED_PARAM_ULLONG:
-            val->value.remote_typed_param_value.ul = param->value.ul;
-            break;
-        case VIR_TYPED_PARAM_DOUBLE:
-            val->value.remote_typed_param_value.d = param->value.d;
-            break;
-        case VIR_TYPED_PARAM_BOOLEAN:
-            val->value.remote_typed_param_value.b = param->value.b;
-            break;
-        case VIR_TYPED_PARAM_STRING:
-            val->value.remote_typed_param_value.s = g_strdup(param->value.s);
-            break;
-        case VIR_TYPED_PARAM_LAST:
-        default:
-            virReportError(VIR_ERR_RPC, _("unknown parameter type: %1$d"),
-                           param->type);
+        if (virTypedParamSerializeValue(param, &val->value) < 0)
             goto cleanup;
-        }
         j++;
     }
 
@@ -119,6 +119,14 @@ void
 virTypedParamsRemoteFree(struct _virTypedParameterRemote *remote_params_val,
                          unsigned int remote_params_len);
 
+int
+virTypedParamDeserializeValue(virTypedParameterRemoteValue *remote_value,
+                              virTypedParameterPtr param);
+
+int
+virTypedParamSerializeValue(virTypedParameterPtr param,
+                            virTypedParameterRemoteValue *remote_value);
+
 int
 virTypedParamsDeserialize(struct _virTypedParameterRemote *remote_params,
                           unsigned int remote_params_len,
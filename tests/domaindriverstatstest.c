@@ -0,0 +1,147 @@
+/*
+ * domaindriverstatstest.c: Test filtering of domain stats by connection
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "datatypes.h"
+#include "domain_driver.h"
+#include "virtypedparam.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static const unsigned char testUUID[VIR_UUID_BUFLEN] = "0123456789abcdef";
+
+
+/*
+ * Filters a single record for @dom with fields given by @fields, which is
+ * a list of "name=value" strings, and checks only fields listed in
+ * @expected are left.
+ */
+static int
+testFilter(virDomainDriverStatsCursors *cursors,
+           virConnectPtr conn,
+           virDomainPtr dom,
+           const char **fields,
+           const char *expected)
+{
+    virDomainStatsRecordPtr records[2] = { NULL };
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actual = NULL;
+    int maxparams = 0;
+    size_t i;
+    int ret = -1;
+
+    records[0] = g_new0(virDomainStatsRecord, 1);
+    records[0]->dom = virObjectRef(dom);
+
+    for (i = 0; fields[i]; i++) {
+        g_autofree char *name = g_strdup(fields[i]);
+        char *value = strchr(name, '=');
+
+        *value++ = '\0';
+
+        if (virTypedParamsAddString(&records[0]->params, &records[0]->nparams,
+                                    &maxparams, name, value) < 0)
+            goto cleanup;
+    }
+
+    virDomainDriverStatsCursorsFilter(cursors, conn, records, 1, true);
+
+    for (i = 0; i < records[0]->nparams; i++)
+        virBufferAsprintf(&buf, "%s ", records[0]->params[i].field);
+    virBufferTrim(&buf, " ");
+
+    actual = virBufferContentAndReset(&buf);
+
+    if (STRNEQ_NULLABLE(actual, expected)) {
+        VIR_TEST_DEBUG("Expected fields '%s', got '%s'",
+                       expected, NULLSTR(actual));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainStatsRecordListFree(records);
+    return ret;
+}
+
+
+static int
+testDelta(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virDomainDriverStatsCursors) cursors = NULL;
+    g_autoptr(virConnect) conn1 = NULL;
+    g_autoptr(virConnect) conn2 = NULL;
+    g_autoptr(virDomain) dom = NULL;
+    const char *first[] = { "a=1", "b=x", "c=1", NULL };
+    const char *second[] = { "a=2", "b=x", "c=1", NULL };
+    const char *added[] = { "a=2", "b=x", "c=1", "d=1", NULL };
+    const char *removed[] = { "a=2", "b=x", NULL };
+
+    if (!(cursors = virDomainDriverStatsCursorsNew()) ||
+        !(conn1 = virGetConnect()) ||
+        !(conn2 = virGetConnect()) ||
+        !(dom = virGetDomain(conn1, "dom", testUUID, 1)))
+        return -1;
+
+    /* Everything is new on the first call ... */
+    if (testFilter(cursors, conn1, dom, first, "a b c") < 0)
+        return -1;
+
+    /* ... then only changed fields are left ... */
+    if (testFilter(cursors, conn1, dom, second, "a") < 0 ||
+        testFilter(cursors, conn1, dom, second, NULL) < 0)
+        return -1;
+
+    /* ... including new ones ... */
+    if (testFilter(cursors, conn1, dom, added, "d") < 0)
+        return -1;
+
+    /* ... unless some field disappeared. */
+    if (testFilter(cursors, conn1, dom, removed, "a b") < 0)
+        return -1;
+
+    /* Connections don't influence each other */
+    if (testFilter(cursors, conn2, dom, removed, "a b") < 0 ||
+        testFilter(cursors, conn2, dom, removed, NULL) < 0)
+        return -1;
+
+    /* Closing a connection forgets its state */
+    virDomainDriverStatsCursorsRemove(cursors, conn1);
+
+    if (testFilter(cursors, conn1, dom, removed, "a b") < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("delta", testDelta, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -33,6 +33,10 @@ VIR_LOG_INIT("tests.fdstreamtest");
 
 #define PATTERN_LEN 256
 
+/* Payload sizes defined in virnetprotocol.x */
+#define LEGACY_PAYLOAD_MAX 262120
+#define LARGE_PAYLOAD_MAX 4194304
+
 static int testFDStreamReadCommon(const char *scratchdir, bool blocking)
 {
     VIR_AUTOCLOSE fd = -1;
@@ -159,6 +163,135 @@ static int testFDStreamReadNonblock(const void *data)
 }
 
 
+struct testFDStreamRecvAllData {
+    const char *pattern;
+    size_t len;
+    size_t offset;
+    size_t maxChunk;
+};
+
+
+static int
+testFDStreamRecvAllHandler(virStreamPtr st G_GNUC_UNUSED,
+                           const char *data,
+                           size_t nbytes,
+                           void *opaque)
+{
+    struct testFDStreamRecvAllData *rdata = opaque;
+
+    if (rdata->offset + nbytes > rdata->len ||
+        memcmp(data, rdata->pattern + rdata->offset, nbytes) != 0) {
+        fprintf(stderr, "Mismatched data at offset %zu\n", rdata->offset);
+        return -1;
+    }
+
+    rdata->offset += nbytes;
+    rdata->maxChunk = MAX(rdata->maxChunk, nbytes);
+    return 0;
+}
+
+
+static int
+testFDStreamSupportsLargePayload(virConnectPtr conn G_GNUC_UNUSED,
+                                 int feature)
+{
+    return feature == VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PAYLOAD;
+}
+
+
+/* Reads a file larger than a large stream packet with virStreamRecvAll()
+ * and checks the size of chunks. With @largePayload the connection
+ * claims support for large stream packets like the remote driver does
+ * once the daemon agreed to send them. */
+static int testFDStreamRecvAllCommon(const char *scratchdir, bool largePayload)
+{
+    virHypervisorDriver driver = { 0 };
+    virHypervisorDriver *origDriver = NULL;
+    struct testFDStreamRecvAllData rdata = { 0 };
+    VIR_AUTOCLOSE fd = -1;
+    g_autofree char *file = NULL;
+    g_autofree char *pattern = NULL;
+    size_t expectChunk = LEGACY_PAYLOAD_MAX;
+    virStreamPtr st = NULL;
+    virConnectPtr conn = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (largePayload) {
+        origDriver = conn->driver;
+        driver = *origDriver;
+        driver.connectSupportsFeature = testFDStreamSupportsLargePayload;
+        conn->driver = &driver;
+        expectChunk = LARGE_PAYLOAD_MAX;
+    }
+
+    rdata.len = 3 * LARGE_PAYLOAD_MAX + PATTERN_LEN;
+    pattern = g_new0(char, rdata.len);
+    for (i = 0; i < rdata.len; i++)
+        pattern[i] = i % 251;
+    rdata.pattern = pattern;
+
+    file = g_strdup_printf("%s/large.data", scratchdir);
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, pattern, rdata.len) != (ssize_t) rdata.len ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    if (!(st = virStreamNew(conn, 0)))
+        goto cleanup;
+
+    if (virFDStreamOpenFile(st, file, 0, 0, O_RDONLY) < 0)
+        goto cleanup;
+
+    if (virStreamRecvAll(st, testFDStreamRecvAllHandler, &rdata) < 0) {
+        fprintf(stderr, "Failed to read stream: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (virStreamFinish(st) < 0)
+        goto cleanup;
+
+    if (rdata.offset != rdata.len) {
+        fprintf(stderr, "Read %zu bytes, expected %zu\n", rdata.offset, rdata.len);
+        goto cleanup;
+    }
+
+    if (rdata.maxChunk != expectChunk) {
+        fprintf(stderr, "Largest chunk was %zu bytes, expected %zu\n",
+                rdata.maxChunk, expectChunk);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    if (file != NULL)
+        unlink(file);
+    if (conn) {
+        if (origDriver)
+            conn->driver = origDriver;
+        virConnectClose(conn);
+    }
+    return ret;
+}
+
+
+static int testFDStreamRecvAllLegacy(const void *data)
+{
+    return testFDStreamRecvAllCommon(data, false);
+}
+static int testFDStreamRecvAllLarge(const void *data)
+{
+    return testFDStreamRecvAllCommon(data, true);
+}
+
+
 static int testFDStreamWriteCommon(const char *scratchdir, bool blocking)
 {
     VIR_AUTOCLOSE fd = -1;
@@ -318,6 +451,10 @@ mymain(void)
         ret = -1;
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+    if (virTestRun("Stream receive all legacy ", testFDStreamRecvAllLegacy, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Stream receive all large ", testFDStreamRecvAllLarge, scratchdir) < 0)
+        ret = -1;
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
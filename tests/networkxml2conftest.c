@@ -44,6 +44,8 @@ testCompareXMLToConfFiles(const char *inxml, const char *outconf,
     if (dctx == NULL)
         goto fail;
 
+    dctx->hostsdirs = dnsmasqCapsGet(caps, DNSMASQ_CAPS_HOSTSDIR);
+
     if (networkDnsmasqConfContents(obj, pidfile, &confactual,
                                    &hostsfileactual, dctx, caps) < 0)
         goto fail;
@@ -117,10 +119,12 @@ buildCapsCallback(const char *const*args,
                   char **output,
                   char **error G_GNUC_UNUSED,
                   int *status,
-                  void *opaque G_GNUC_UNUSED)
+                  void *opaque)
 {
+    const char *version = opaque;
+
     if (STREQ(args[0], "/usr/sbin/dnsmasq") && STREQ(args[1], "--version")) {
-        *output = g_strdup("Dnsmasq version 2.67\n");
+        *output = g_strdup_printf("Dnsmasq version %s\n", version);
         *status = EXIT_SUCCESS;
     } else {
         *status = EXIT_FAILURE;
@@ -128,12 +132,13 @@ buildCapsCallback(const char *const*args,
 }
 
 static dnsmasqCaps *
-buildCaps(void)
+buildCaps(const char *version)
 {
     g_autoptr(dnsmasqCaps) caps = NULL;
     g_autoptr(virCommandDryRunToken) dryRunToken = virCommandDryRunTokenNew();
 
-    virCommandSetDryRun(dryRunToken, NULL, true, true, buildCapsCallback, NULL);
+    virCommandSetDryRun(dryRunToken, NULL, true, true, buildCapsCallback,
+                        (void *) version);
 
     caps = dnsmasqCapsNewFromBinary();
 
@@ -146,8 +151,10 @@ mymain(void)
 {
     int ret = 0;
     g_autoptr(dnsmasqCaps) full = NULL;
+    g_autoptr(dnsmasqCaps) hostsdir = NULL;
 
-    if (!(full = buildCaps())) {
+    if (!(full = buildCaps("2.67")) ||
+        !(hostsdir = buildCaps("2.73"))) {
         fprintf(stderr, "failed to create the fake capabilities: %s",
                 virGetLastErrorMessage());
         return EXIT_FAILURE;
@@ -192,6 +199,7 @@ mymain(void)
     DO_TEST("leasetime-minutes", full);
     DO_TEST("leasetime-hours", full);
     DO_TEST("leasetime-infinite", full);
+    DO_TEST("nat-network-hostsdir", hostsdir);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,332 @@
+/*
+ * nssleaseindextest.c: Test the lease index used by the NSS modules
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_NSS
+
+# include "libvirt_nss_leases.h"
+# if defined(LIBVIRT_NSS_GUEST)
+#  include "libvirt_nss_macs.h"
+# endif
+# include "virfile.h"
+# include "virlease.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/nssleaseindexdir-XXXXXX"
+
+static const char *testFiles[] = {
+    "virbr0.status", "virbr0.macs",
+    "virbr1.status", "virbr1.macs",
+    "virbr2.status",
+};
+
+struct testLeaseIndexData {
+    const char *dir;
+    virLeaseIndexKeyType type;
+    const char *key;
+    int af;
+    time_t now;
+};
+
+
+static int
+testPrepare(const char *dir)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(testFiles); i++) {
+        g_autofree char *src = g_strdup_printf("%s/nssdata/%s",
+                                               abs_srcdir, testFiles[i]);
+        g_autofree char *dst = g_strdup_printf("%s/%s", dir, testFiles[i]);
+        g_autofree char *content = NULL;
+
+        if (virFileReadAll(src, 1024 * 1024, &content) < 0 ||
+            virFileRewriteStr(dst, 0644, content) < 0)
+            return -1;
+    }
+
+    return virLeaseIndexRebuild(dir);
+}
+
+
+/* Finds leases the way the NSS modules do without the index */
+static int
+testFindLeasesInFiles(const struct testLeaseIndexData *data,
+                      leaseAddress **addrs,
+                      size_t *naddrs,
+                      bool *found)
+{
+    const char *name = NULL;
+    char **macs = NULL;
+    size_t nmacs = 0;
+    size_t i;
+    int ret = -1;
+
+    switch (data->type) {
+    case VIR_LEASE_INDEX_KEY_HOSTNAME:
+        name = data->key;
+        break;
+
+    case VIR_LEASE_INDEX_KEY_MAC:
+        macs = g_new0(char *, 1);
+        macs[nmacs++] = g_strdup(data->key);
+        break;
+
+    case VIR_LEASE_INDEX_KEY_DOMAIN:
+# if defined(LIBVIRT_NSS_GUEST)
+        for (i = 0; i < G_N_ELEMENTS(testFiles); i++) {
+            g_autofree char *path = g_strdup_printf("%s/%s", data->dir,
+                                                    testFiles[i]);
+
+            if (virStringHasSuffix(testFiles[i], ".macs") &&
+                findMACs(path, data->key, &macs, &nmacs) < 0)
+                goto cleanup;
+        }
+
+        if (nmacs == 0) {
+            ret = 0;
+            goto cleanup;
+        }
+# endif
+        break;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(testFiles); i++) {
+        g_autofree char *path = g_strdup_printf("%s/%s", data->dir,
+                                                testFiles[i]);
+
+        if (virStringHasSuffix(testFiles[i], ".status") &&
+            findLeases(path, name, macs, nmacs, data->af, data->now,
+                       addrs, naddrs, found) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nmacs; i++)
+        free(macs[i]);
+    free(macs);
+    return ret;
+}
+
+
+static int
+testSortAddr(const void *a,
+             const void *b)
+{
+    const leaseAddress *la = a;
+    const leaseAddress *lb = b;
+
+    if (la->af != lb->af)
+        return la->af - lb->af;
+
+    return memcmp(la->addr, lb->addr, sizeof(la->addr));
+}
+
+
+/* Checks that looking up leases in the index gives the same result as
+ * parsing the lease files and MAC maps of all networks. */
+static int
+testLookup(const void *opaque)
+{
+    const struct testLeaseIndexData *data = opaque;
+    g_autofree char *indexFile = virLeaseIndexFileName(data->dir);
+    leaseAddress *indexAddrs = NULL;
+    leaseAddress *fileAddrs = NULL;
+    size_t nindexAddrs = 0;
+    size_t nfileAddrs = 0;
+    bool indexFound = false;
+    bool fileFound = false;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    rc = findLeasesInIndex(indexFile, data->type, data->key,
+                           data->af, data->now,
+                           &indexAddrs, &nindexAddrs, &indexFound);
+    if (rc != 0) {
+        VIR_TEST_DEBUG("Lookup in index failed: %d", rc);
+        goto cleanup;
+    }
+
+    if (testFindLeasesInFiles(data, &fileAddrs, &nfileAddrs, &fileFound) < 0)
+        goto cleanup;
+
+    if (indexFound != fileFound || nindexAddrs != nfileAddrs) {
+        VIR_TEST_DEBUG("Expected %zu addresses (found=%d), got %zu (found=%d)",
+                       nfileAddrs, fileFound, nindexAddrs, indexFound);
+        goto cleanup;
+    }
+
+    if (nfileAddrs > 0) {
+        qsort(indexAddrs, nindexAddrs, sizeof(*indexAddrs), testSortAddr);
+        qsort(fileAddrs, nfileAddrs, sizeof(*fileAddrs), testSortAddr);
+    }
+
+    for (i = 0; i < nfileAddrs; i++) {
+        if (testSortAddr(&indexAddrs[i], &fileAddrs[i]) != 0 ||
+            indexAddrs[i].expirytime != fileAddrs[i].expirytime) {
+            VIR_TEST_DEBUG("Address %zu differs", i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    free(indexAddrs);
+    free(fileAddrs);
+    return ret;
+}
+
+
+static int
+testLookupHostname(const char *dir,
+                   const char *hostname,
+                   bool *found)
+{
+    g_autofree char *indexFile = virLeaseIndexFileName(dir);
+    leaseAddress *addrs = NULL;
+    size_t naddrs = 0;
+    int rc;
+
+    *found = false;
+
+    rc = findLeasesInIndex(indexFile, VIR_LEASE_INDEX_KEY_HOSTNAME, hostname,
+                           AF_UNSPEC, 0, &addrs, &naddrs, found);
+    free(addrs);
+    return rc;
+}
+
+
+/* The index is removed while lease files are modified and written again
+ * once they are updated */
+static int
+testUpdate(const void *opaque)
+{
+    const char *dir = opaque;
+    g_autofree char *statusFile = g_strdup_printf("%s/virbr0.status", dir);
+    bool found;
+    int lockfd;
+
+    if (testPrepare(dir) < 0)
+        return -1;
+
+    if ((lockfd = virLeaseIndexUpdateBegin(dir)) < 0)
+        return -1;
+
+    if (testLookupHostname(dir, "fedora", &found) != 1) {
+        VIR_TEST_DEBUG("Index was used while lease files were updated");
+        VIR_FORCE_CLOSE(lockfd);
+        return -1;
+    }
+
+    if (virFileRewriteStr(statusFile, 0644, "[]") < 0) {
+        VIR_FORCE_CLOSE(lockfd);
+        return -1;
+    }
+
+    virLeaseIndexUpdateEnd(dir, lockfd);
+
+    /* fedora has leases in virbr1, gentoo had them only in virbr0 */
+    if (testLookupHostname(dir, "fedora", &found) != 0 || !found) {
+        VIR_TEST_DEBUG("Leases of other networks are missing");
+        return -1;
+    }
+
+    if (testLookupHostname(dir, "gentoo", &found) != 0 || found) {
+        VIR_TEST_DEBUG("Removed leases are still indexed");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create nssleaseindexdir");
+        abort();
+    }
+
+    if (testPrepare(scratchdir) < 0)
+        return EXIT_FAILURE;
+
+# define DO_TEST(testname, keytype, keyval, family, time) \
+    do { \
+        struct testLeaseIndexData data = { \
+            .dir = scratchdir, .type = keytype, .key = keyval, \
+            .af = family, .now = time, \
+        }; \
+        if (virTestRun(testname, testLookup, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+# define DO_TEST_HOSTNAME(testname, hostname, family, time) \
+    DO_TEST("hostname " testname, VIR_LEASE_INDEX_KEY_HOSTNAME, \
+            hostname, family, time)
+# define DO_TEST_MAC(testname, mac, family, time) \
+    DO_TEST("mac " testname, VIR_LEASE_INDEX_KEY_MAC, mac, family, time)
+# define DO_TEST_DOMAIN(testname, domain, family, time) \
+    DO_TEST("domain " testname, VIR_LEASE_INDEX_KEY_DOMAIN, \
+            domain, family, time)
+
+    DO_TEST_HOSTNAME("all networks", "fedora", AF_UNSPEC, 1800000000);
+    DO_TEST_HOSTNAME("case", "Gentoo", AF_INET, 1800000000);
+    DO_TEST_HOSTNAME("family", "gentoo", AF_INET6, 1800000000);
+    DO_TEST_HOSTNAME("expired", "fedora", AF_INET, 1900000001);
+    DO_TEST_HOSTNAME("missing", "debian", AF_UNSPEC, 1800000000);
+    DO_TEST_MAC("with hostname", "52:54:00:a4:6f:91", AF_UNSPEC, 1800000000);
+    DO_TEST_MAC("without hostname", "52:54:00:11:22:33", AF_INET, 1800000000);
+    DO_TEST_MAC("missing", "52:54:00:00:00:00", AF_UNSPEC, 1800000000);
+
+# if defined(LIBVIRT_NSS_GUEST)
+    DO_TEST_DOMAIN("all networks", "fedora", AF_UNSPEC, 1800000000);
+    DO_TEST_DOMAIN("case", "Gentoo", AF_UNSPEC, 1800000000);
+    DO_TEST_DOMAIN("without hostname", "suse", AF_INET, 1800000000);
+    DO_TEST_DOMAIN("expired", "fedora", AF_INET, 1900000001);
+    DO_TEST_DOMAIN("missing", "ubuntu", AF_UNSPEC, 1800000000);
+# endif
+
+    if (virTestRun("update", testUpdate, scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+#else
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
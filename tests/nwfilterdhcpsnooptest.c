@@ -0,0 +1,376 @@
+/*
+ * nwfilterdhcpsnooptest.c: Test DHCP snooping of nwfilter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_LIBPCAP
+
+# include <sys/stat.h>
+
+# include "virfile.h"
+# include "nwfilter/nwfilter_dhcpsnoop.h"
+# define LIBVIRT_NWFILTER_DHCPSNOOPPRIV_H_ALLOW
+# include "nwfilter/nwfilter_dhcpsnooppriv.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define TEST_UUID "6695eb01-f6a4-8304-79aa-97f2502e193f"
+# define TEST_MAC1 "52:54:00:00:00:01"
+# define TEST_MAC2 "52:54:00:00:00:02"
+# define TEST_SERVER_MAC "52:54:00:00:00:fe"
+
+
+static virNWFilterSnoopReq *
+testReqNew(int ifindex,
+           const char *ifname,
+           const char *mac)
+{
+    g_autofree char *ifkey = g_strdup_printf("%s%s", TEST_UUID, mac);
+    virNWFilterSnoopReq *req;
+
+    if (!(req = virNWFilterSnoopReqNew(ifkey)))
+        return NULL;
+
+    req->ifindex = ifindex;
+    req->threadkey = g_strdup_printf("test-%d", ifindex);
+    req->binding = g_new0(virNWFilterBindingDef, 1);
+    req->binding->portdevname = g_strdup(ifname);
+
+    if (virMacAddrParse(mac, &req->binding->mac) < 0) {
+        virNWFilterSnoopReqPut(req);
+        return NULL;
+    }
+
+    return req;
+}
+
+
+/* Hands a packet from @srcmac seen on interface @ifindex with the given
+ * packet type to the capture thread's demultiplexer */
+static void
+testDispatch(int ifindex,
+             unsigned char pkttype,
+             const char *srcmac,
+             int len)
+{
+    unsigned char packet[PCAP_PBUFSIZE] = { 0 };
+    virNWFilterSnoopEthHdr *pep = (virNWFilterSnoopEthHdr *)packet;
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_ifindex = ifindex,
+        .sll_pkttype = pkttype,
+    };
+
+    ignore_value(virMacAddrParse(srcmac, &pep->eh_src));
+
+    virNWFilterSnoopCaptureDispatch(pep, len, &sll);
+}
+
+
+static int
+testCheckJobs(virNWFilterSnoopReq *req,
+              const bool *fromVM,
+              size_t njobs)
+{
+    size_t i;
+
+    if (g_queue_get_length(&req->jobs) != njobs) {
+        VIR_TEST_DEBUG("Expected %zu packets for interface %d, got %u",
+                       njobs, req->ifindex, g_queue_get_length(&req->jobs));
+        return -1;
+    }
+
+    for (i = 0; i < njobs; i++) {
+        virNWFilterDHCPDecodeJob *job = g_queue_peek_nth(&req->jobs, i);
+
+        if (job->fromVM != fromVM[i]) {
+            VIR_TEST_DEBUG("Packet %zu of interface %d has wrong direction",
+                           i, req->ifindex);
+            return -1;
+        }
+    }
+
+    if (!req->jobScheduled) {
+        VIR_TEST_DEBUG("Interface %d wasn't scheduled", req->ifindex);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Packets are demultiplexed by the interface index and the packet type
+ * tells their direction. Packets stay queued as the decoding pool has no
+ * workers, until stopping the capture drops them along with the
+ * references held for the workers. */
+static int
+testDemultiplex(const void *opaque G_GNUC_UNUSED)
+{
+    virNWFilterSnoopReq *req1 = NULL;
+    virNWFilterSnoopReq *req2 = NULL;
+    const bool jobs1[] = { true };
+    const bool jobs2[] = { false, true };
+    int ret = -1;
+
+    if (virNWFilterSnoopDecodeStart(0) < 0)
+        return -1;
+
+    if (!(req1 = testReqNew(10, "vnet10", TEST_MAC1)) ||
+        !(req2 = testReqNew(11, "vnet11", TEST_MAC2)))
+        goto cleanup;
+
+    /* the capture thread takes over the references from creation */
+    virNWFilterSnoopReqGet(req1);
+    if (virNWFilterSnoopCaptureAdd(req1) < 0)
+        goto cleanup;
+    virNWFilterSnoopReqGet(req2);
+    if (virNWFilterSnoopCaptureAdd(req2) < 0)
+        goto cleanup;
+
+    /* from the first VM */
+    testDispatch(10, PACKET_HOST, TEST_MAC1, PCAP_PBUFSIZE);
+    /* another VM's request seen on the first VM's interface */
+    testDispatch(10, PACKET_HOST, TEST_MAC2, PCAP_PBUFSIZE);
+    /* to the second VM, from a DHCP server */
+    testDispatch(11, PACKET_OUTGOING, TEST_SERVER_MAC, PCAP_PBUFSIZE);
+    /* broadcast from the second VM */
+    testDispatch(11, PACKET_BROADCAST, TEST_MAC2, PCAP_PBUFSIZE);
+    /* interface which isn't snooped */
+    testDispatch(12, PACKET_HOST, TEST_MAC1, PCAP_PBUFSIZE);
+    /* too short to be a DHCP packet */
+    testDispatch(10, PACKET_HOST, TEST_MAC1, 20);
+
+    if (testCheckJobs(req1, jobs1, G_N_ELEMENTS(jobs1)) < 0 ||
+        testCheckJobs(req2, jobs2, G_N_ELEMENTS(jobs2)) < 0)
+        goto cleanup;
+
+    virNWFilterSnoopCaptureStop();
+
+    if (g_queue_get_length(&req1->jobs) != 0 || req1->jobScheduled ||
+        g_queue_get_length(&req2->jobs) != 0 || req2->jobScheduled) {
+        VIR_TEST_DEBUG("Queued packets weren't dropped");
+        goto cleanup;
+    }
+
+    if (g_atomic_int_get(&req1->refctr) != 1 ||
+        g_atomic_int_get(&req2->refctr) != 1) {
+        VIR_TEST_DEBUG("References to requests leaked");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virNWFilterSnoopCaptureStop();
+    virNWFilterSnoopReqPut(req1);
+    virNWFilterSnoopReqPut(req2);
+    return ret;
+}
+
+
+/* Runs the instructions of a socket filter which check the interface
+ * index, returning the verdict or UINT_MAX on unexpected instructions */
+static unsigned int
+testRunFilter(const struct sock_filter *filter,
+              size_t len,
+              int ifindex)
+{
+    uint32_t acc = 0;
+    size_t pc = 0;
+
+    while (pc < len) {
+        const struct sock_filter *insn = &filter[pc++];
+
+        switch (insn->code) {
+        case BPF_LD | BPF_W | BPF_ABS:
+            if (insn->k != (uint32_t) (SKF_AD_OFF + SKF_AD_IFINDEX))
+                return UINT_MAX;
+            acc = ifindex;
+            break;
+        case BPF_JMP | BPF_JEQ | BPF_K:
+            pc += acc == insn->k ? insn->jt : insn->jf;
+            break;
+        case BPF_JMP | BPF_JA:
+            pc += insn->k;
+            break;
+        case BPF_RET | BPF_K:
+            return insn->k;
+        default:
+            return UINT_MAX;
+        }
+    }
+
+    return UINT_MAX;
+}
+
+
+/* The socket filter passes packets of snooped interfaces on to the DHCP
+ * filter and drops everything else */
+static int
+testFilter(const void *opaque G_GNUC_UNUSED)
+{
+    const struct sock_filter dhcp = BPF_STMT(BPF_RET | BPF_K, 0xffff);
+    g_autofree struct sock_filter *filter = NULL;
+    g_autofree int *ifindexes = g_new0(int, BPF_MAXINSNS);
+    /* more than conditional jumps could skip */
+    size_t nifindexes = 300;
+    size_t len = 0;
+    size_t i;
+
+    for (i = 0; i < BPF_MAXINSNS; i++)
+        ifindexes[i] = 2 * i + 10;
+
+    if (!(filter = virNWFilterSnoopCaptureFilterBuild(&dhcp, 1, ifindexes,
+                                                      nifindexes, &len))) {
+        VIR_TEST_DEBUG("Filter wasn't built");
+        return -1;
+    }
+
+    for (i = 0; i < nifindexes; i++) {
+        if (testRunFilter(filter, len, ifindexes[i]) != dhcp.k) {
+            VIR_TEST_DEBUG("Packet on interface %d was dropped", ifindexes[i]);
+            return -1;
+        }
+
+        if (testRunFilter(filter, len, ifindexes[i] + 1) != 0) {
+            VIR_TEST_DEBUG("Packet on interface %d was accepted",
+                           ifindexes[i] + 1);
+            return -1;
+        }
+    }
+
+    /* without snooped interfaces nothing is captured */
+    g_clear_pointer(&filter, g_free);
+    if (!(filter = virNWFilterSnoopCaptureFilterBuild(&dhcp, 1, NULL, 0, &len)) ||
+        testRunFilter(filter, len, 10) != 0) {
+        VIR_TEST_DEBUG("Packet was accepted without snooped interfaces");
+        return -1;
+    }
+
+    g_clear_pointer(&filter, g_free);
+    if ((filter = virNWFilterSnoopCaptureFilterBuild(&dhcp, 1, ifindexes,
+                                                     BPF_MAXINSNS / 2, &len))) {
+        VIR_TEST_DEBUG("Filter exceeding the maximum length was built");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Leases are collected in memory and written to the lease file at once */
+static int
+testLeaseBatch(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *path = g_strdup_printf("%s/nwfilterdhcpsnooptest-XXXXXX",
+                                            g_get_tmp_dir());
+    g_autofree char *ifkey = g_strdup_printf("%s%s", TEST_UUID, TEST_MAC1);
+    g_autofree char *expect = NULL;
+    char actual[1024] = { 0 };
+    virNWFilterSnoopIPLease leases[3] = { 0 };
+    virNWFilterSnoopReq *req = NULL;
+    VIR_AUTOCLOSE fd = -1;
+    struct stat sb;
+    ssize_t len;
+    int ret = -1;
+    size_t i;
+
+    if ((fd = g_mkstemp(path)) < 0)
+        return -1;
+    unlink(path);
+
+    virNWFilterSnoopLeaseFileSetFD(dup(fd));
+
+    if (!(req = virNWFilterSnoopReqNew(ifkey)))
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(leases); i++) {
+        g_autofree char *ip = g_strdup_printf("192.168.122.%zu", 10 + i);
+
+        if (virSocketAddrParse(&leases[i].ipAddress, ip, AF_INET) < 0 ||
+            virSocketAddrParse(&leases[i].ipServer, "192.168.122.1", AF_INET) < 0)
+            goto cleanup;
+
+        leases[i].snoopReq = req;
+        leases[i].timeout = 1000 + i;
+
+        virNWFilterSnoopLeaseFileSave(&leases[i]);
+    }
+
+    if (fstat(fd, &sb) < 0 || sb.st_size != 0) {
+        VIR_TEST_DEBUG("Leases were written before the flush");
+        goto cleanup;
+    }
+
+    virNWFilterSnoopLeaseFileFlush();
+    /* nothing is queued anymore */
+    virNWFilterSnoopLeaseFileFlush();
+
+    if ((len = pread(fd, actual, sizeof(actual) - 1, 0)) < 0)
+        goto cleanup;
+
+    expect = g_strdup_printf("1000 %1$s 192.168.122.10 192.168.122.1\n"
+                             "1001 %1$s 192.168.122.11 192.168.122.1\n"
+                             "1002 %1$s 192.168.122.12 192.168.122.1\n",
+                             ifkey);
+
+    if (virTestCompareToString(expect, actual) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virNWFilterSnoopLeaseFileSetFD(-1);
+    virNWFilterSnoopReqPut(req);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virNWFilterSnoopStateInit() < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("demultiplex packets", testDemultiplex, NULL) < 0)
+        ret = -1;
+    if (virTestRun("batch lease file writes", testLeaseBatch, NULL) < 0)
+        ret = -1;
+    if (virTestRun("filter by interface", testFilter, NULL) < 0)
+        ret = -1;
+
+    virNWFilterDHCPSnoopShutdown();
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else /* !WITH_LIBPCAP */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* !WITH_LIBPCAP */
@@ -21,8 +21,10 @@
 #include "testutils.h"
 #include "testutilsqemu.h"
 #include "testutilsqemuschema.h"
+#include "qemumonitortestutils.h"
 #include "virlog.h"
 #include "qemu/qemu_block.h"
+#include "qemu/qemu_domain.h"
 #include "qemu/qemu_qapi.h"
 #include "qemu/qemu_monitor_json.h"
 #include "qemu/qemu_backup.h"
@@ -973,6 +975,156 @@ testQemuBlockBitmapBlockcommit(const void *opaque)
 }
 
 
+struct testQemuBlockBitmapCachedData {
+    const char *nodedatafile;
+    virStorageSource *chain;
+    virDomainXMLOption *xmlopt;
+};
+
+
+/* Formats the bitmap actions of block copy and all block commits possible
+ * in @chain as planned using @nodedata */
+static char *
+testQemuBlockBitmapCachedPlans(virStorageSource *chain,
+                               GHashTable *nodedata)
+{
+    g_autoptr(virStorageSource) fakemirror = virStorageSourceNew();
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    virStorageSource *top;
+    virStorageSource *base;
+    size_t i;
+
+    qemuBlockStorageSourceSetFormatNodename(fakemirror, g_strdup("mirror-format-node"));
+
+    for (i = 0; i < 2; i++) {
+        g_autoptr(virJSONValue) actions = NULL;
+
+        if (qemuBlockBitmapsHandleBlockcopy(chain, fakemirror, nodedata,
+                                            i == 0, &actions) < 0)
+            return NULL;
+
+        virBufferAsprintf(&buf, "block copy %s:\n", i == 0 ? "shallow" : "deep");
+        if (actions &&
+            virJSONValueToBuffer(actions, &buf, true) < 0)
+            return NULL;
+    }
+
+    for (top = chain; top; top = top->backingStore) {
+        for (base = top->backingStore; base; base = base->backingStore) {
+            g_autoptr(virJSONValue) actions = NULL;
+
+            if (qemuBlockBitmapsHandleCommitFinish(top, base, top == chain,
+                                                   nodedata, &actions) < 0)
+                return NULL;
+
+            virBufferAsprintf(&buf, "block commit %u-%u:\n", top->id, base->id);
+            if (actions &&
+                virJSONValueToBuffer(actions, &buf, true) < 0)
+                return NULL;
+        }
+    }
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static int
+testQemuBlockBitmapCachedQueue(qemuMonitorTest *test,
+                               virJSONValue *nodedatajson)
+{
+    g_autoptr(virJSONValue) reply = NULL;
+    g_autoptr(virJSONValue) nodes = virJSONValueCopy(nodedatajson);
+    g_autofree char *replystr = NULL;
+
+    if (virJSONValueObjectAdd(&reply, "a:return", &nodes, NULL) < 0 ||
+        !(replystr = virJSONValueToString(reply, false)))
+        return -1;
+
+    return qemuMonitorTestAddItem(test, "query-named-block-nodes", replystr);
+}
+
+
+/* Bitmap operations planned with block node data reused by
+ * qemuBlockGetNamedNodeDataCached must not differ from plans based on data
+ * freshly queried from QEMU */
+static int
+testQemuBlockBitmapCached(const void *opaque)
+{
+    const struct testQemuBlockBitmapCachedData *data = opaque;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    g_autoptr(virJSONValue) nodedatajson = NULL;
+    g_autoptr(virJSONValue) actions = virJSONValueNewArray();
+    g_autoptr(GHashTable) nodedata = NULL;
+    GHashTable *cached[3] = { NULL };
+    g_autofree char *expect = NULL;
+    virDomainObj *vm;
+    qemuDomainObjPrivate *priv;
+    int ret = -1;
+    size_t i;
+
+    if (!(nodedatajson = virTestLoadFileJSON(bitmapDetectPrefix, data->nodedatafile,
+                                             ".json", NULL)))
+        return -1;
+
+    if (!(nodedata = qemuMonitorJSONBlockGetNamedNodeDataJSON(nodedatajson)) ||
+        !(expect = testQemuBlockBitmapCachedPlans(data->chain, nodedata)))
+        return -1;
+
+    if (!(test = qemuMonitorTestNewSchema(data->xmlopt, NULL)))
+        return -1;
+
+    /* The data is queried once by the first two lookups, and again by the
+     * third one after a transaction possibly changed the bitmaps */
+    if (testQemuBlockBitmapCachedQueue(test, nodedatajson) < 0 ||
+        qemuMonitorTestAddItem(test, "transaction", "{\"return\":{}}") < 0 ||
+        testQemuBlockBitmapCachedQueue(test, nodedatajson) < 0)
+        return -1;
+
+    vm = qemuMonitorTestGetDomainObj(test);
+    priv = vm->privateData;
+    priv->mon = qemuMonitorTestGetMonitor(test);
+
+    for (i = 0; i < G_N_ELEMENTS(cached); i++) {
+        g_autofree char *actual = NULL;
+
+        if (i == 2) {
+            if (qemuMonitorTransactionBitmapAdd(actions, "libvirt-1-format",
+                                                "new", true, false, 0) < 0 ||
+                qemuMonitorTransaction(priv->mon, &actions) < 0)
+                goto cleanup;
+        }
+
+        virObjectUnlock(priv->mon);
+        cached[i] = qemuBlockGetNamedNodeDataCached(vm, VIR_ASYNC_JOB_NONE);
+        virObjectLock(priv->mon);
+
+        if (!cached[i] ||
+            !(actual = testQemuBlockBitmapCachedPlans(data->chain, cached[i])))
+            goto cleanup;
+
+        if (STRNEQ(expect, actual)) {
+            VIR_TEST_VERBOSE("plan %zu based on cached data differs:\n%s\n",
+                             i, actual);
+            goto cleanup;
+        }
+    }
+
+    if (cached[1] != cached[0] || cached[2] == cached[1]) {
+        VIR_TEST_VERBOSE("block node data cached when it shouldn't or vice versa\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    /* don't dispose test monitor with VM */
+    priv->mon = NULL;
+    for (i = 0; i < G_N_ELEMENTS(cached); i++)
+        g_clear_pointer(&cached[i], g_hash_table_unref);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -987,6 +1139,7 @@ mymain(void)
     struct testQemuBlockBitmapValidateData blockbitmapvalidatedata;
     struct testQemuBlockBitmapBlockcopyData blockbitmapblockcopydata;
     struct testQemuBlockBitmapBlockcommitData blockbitmapblockcommitdata;
+    struct testQemuBlockBitmapCachedData blockbitmapcacheddata;
     char *capslatest_x86_64 = NULL;
     g_autoptr(virQEMUCaps) caps_x86_64 = NULL;
     g_autoptr(GHashTable) qmp_schema_x86_64 = NULL;
@@ -1390,6 +1543,21 @@ mymain(void)
 
     TEST_BITMAP_BLOCKCOMMIT("snapshots-4-5", 4, 5, "snapshots");
 
+#define TEST_BITMAP_CACHED(ndf) \
+    do { \
+        blockbitmapcacheddata.nodedatafile = ndf; \
+        blockbitmapcacheddata.chain = bitmapSourceChain; \
+        blockbitmapcacheddata.xmlopt = driver.xmlopt; \
+        if (virTestRun("bitmap plans with cached node data " ndf, \
+                       testQemuBlockBitmapCached, \
+                       &blockbitmapcacheddata) < 0) \
+            ret = -1; \
+    } while (0)
+
+    TEST_BITMAP_CACHED("empty");
+    TEST_BITMAP_CACHED("basic");
+    TEST_BITMAP_CACHED("snapshots");
+
  cleanup:
     qemuTestDriverFree(&driver);
     VIR_FREE(capslatest_x86_64);
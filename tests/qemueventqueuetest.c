@@ -0,0 +1,220 @@
+/*
+ * qemueventqueuetest.c: Test the per-domain queues of asynchronous events
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsqemu.h"
+#include "qemu/qemu_domain.h"
+#include "virmetrics.h"
+#include "virthreadpool.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define NVMS 4
+#define NEVENTS 50
+#define NWORKERS 4
+
+static virQEMUDriver driver;
+
+struct testEventState {
+    virMutex lock;
+    virCond cond;
+    int next[NVMS];     /* sequence number of the next expected event */
+    bool busy[NVMS];    /* an event of the domain is being processed */
+    size_t processed;
+    bool failed;
+};
+
+
+/* Mimics qemuProcessEventHandler. The domain index is stored in the
+ * status and the sequence number of the event in the action. */
+static void
+testEventHandler(void *data,
+                 void *opaque)
+{
+    virDomainObj *obj = data;
+    struct testEventState *state = opaque;
+    struct qemuProcessEvent *event;
+    int idx;
+
+    if (!(event = qemuDomainEventQueuePop(obj))) {
+        qemuDomainEventQueueFinish(obj);
+        return;
+    }
+
+    idx = event->status;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&state->lock) {
+        if (state->busy[idx] || event->action != state->next[idx]) {
+            VIR_TEST_DEBUG("vm%d: got event %d while expecting %d (busy=%d)",
+                           idx, event->action, state->next[idx],
+                           state->busy[idx]);
+            state->failed = true;
+        }
+        state->busy[idx] = true;
+        state->next[idx] = event->action + 1;
+    }
+
+    /* let other workers pick events of other domains meanwhile */
+    g_usleep(g_random_int_range(0, 500));
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&state->lock) {
+        state->busy[idx] = false;
+        state->processed++;
+        virCondSignal(&state->cond);
+    }
+
+    virObjectUnref(event->vm);
+    qemuProcessEventFree(event);
+
+    qemuDomainEventQueueFinish(obj);
+}
+
+
+static unsigned long long
+testGetMetric(const char *name)
+{
+    g_autoptr(virTypedParamList) list = virTypedParamListNew();
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+    unsigned long long val = 0;
+
+    virMetricsGetParams(list);
+
+    if (virTypedParamListFetch(list, &params, &nparams) < 0)
+        return 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, name, &val));
+    return val;
+}
+
+
+/* Events of one domain have to be processed one at a time and in the
+ * order they were submitted even though the worker pool processes events
+ * of different domains in parallel. */
+static int
+testOrdering(const void *opaque G_GNUC_UNUSED)
+{
+    struct testEventState state = { 0 };
+    virDomainObj *vms[NVMS] = { NULL };
+    unsigned long long waits;
+    unsigned long long deadline;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (virMutexInit(&state.lock) < 0)
+        return -1;
+    if (virCondInit(&state.cond) < 0) {
+        virMutexDestroy(&state.lock);
+        return -1;
+    }
+
+    waits = testGetMetric("qemu.event.queue_wait.count");
+
+    if (!(driver.workerPool = virThreadPoolNewFull(0, NWORKERS, 0,
+                                                   testEventHandler,
+                                                   "test-event",
+                                                   NULL, &state)))
+        goto cleanup;
+
+    for (i = 0; i < NVMS; i++) {
+        if (!(vms[i] = virDomainObjNew(driver.xmlopt)) ||
+            !(vms[i]->def = virDomainDefNew(driver.xmlopt)))
+            goto cleanup;
+
+        vms[i]->def->name = g_strdup_printf("vm%zu", i);
+    }
+
+    /* interleave the domains so that each has more events queued */
+    for (j = 0; j < NEVENTS; j++) {
+        for (i = 0; i < NVMS; i++) {
+            struct qemuProcessEvent *event = g_new0(struct qemuProcessEvent, 1);
+
+            event->vm = virObjectRef(vms[i]);
+            event->eventType = QEMU_PROCESS_EVENT_RESET;
+            event->action = j;
+            event->status = i;
+
+            qemuDomainEventQueuePush(vms[i], event);
+        }
+    }
+
+    deadline = g_get_real_time() / 1000 + 30 * 1000;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&state.lock) {
+        while (state.processed < NVMS * NEVENTS) {
+            if (virCondWaitUntil(&state.cond, &state.lock, deadline) < 0)
+                break;
+        }
+
+        if (state.processed != NVMS * NEVENTS) {
+            VIR_TEST_DEBUG("Only %zu of %d events were processed",
+                           state.processed, NVMS * NEVENTS);
+            state.failed = true;
+        }
+    }
+
+    /* wait for the workers to drop their references */
+    g_clear_pointer(&driver.workerPool, virThreadPoolFree);
+
+    if (state.failed)
+        goto cleanup;
+
+    for (i = 0; i < NVMS; i++) {
+        if (state.next[i] != NEVENTS) {
+            VIR_TEST_DEBUG("vm%zu: processed %d events", i, state.next[i]);
+            goto cleanup;
+        }
+    }
+
+    if (testGetMetric("qemu.event.queue_wait.count") - waits != NVMS * NEVENTS) {
+        VIR_TEST_DEBUG("Queue latency of events was not recorded");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    g_clear_pointer(&driver.workerPool, virThreadPoolFree);
+    for (i = 0; i < NVMS; i++)
+        virObjectUnref(vms[i]);
+    virCondDestroy(&state.cond);
+    virMutexDestroy(&state.lock);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("per-domain ordering", testOrdering, NULL) < 0)
+        ret = -1;
+
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -26,6 +26,7 @@
 #include "testutilsqemu.h"
 #include "tests/testutilsqemuschema.h"
 #include "qemumonitortestutils.h"
+#include "qemu/qemu_domain.h"
 #include "qemu/qemu_migration_params.h"
 #define LIBVIRT_QEMU_MIGRATION_PARAMSPRIV_H_ALLOW
 #include "qemu/qemu_migration_paramspriv.h"
@@ -181,6 +182,43 @@ qemuMigParamsTestJSON(const void *opaque)
 }
 
 
+/* Changing bandwidth of a running migration must not touch capabilities,
+ * any migrate-set-capabilities would fail as an unexpected command */
+static int
+qemuMigParamsTestSetMaxBandwidth(const void *opaque)
+{
+    const qemuMigParamsData *data = opaque;
+    g_autoptr(qemuMonitorTest) mon = NULL;
+    virDomainObj *vm;
+    qemuDomainObjPrivate *priv;
+    int rc;
+
+    if (!(mon = qemuMonitorTestNewSchema(data->xmlopt, data->qmpschema)))
+        return -1;
+
+    if (qemuMonitorTestAddItemVerbatim(mon,
+                                       "{\"execute\":\"migrate-set-parameters\","
+                                       " \"arguments\":{\"max-bandwidth\":104857600},"
+                                       " \"id\":\"libvirt-1\"}",
+                                       NULL,
+                                       "{\"return\":{}}") < 0)
+        return -1;
+
+    vm = qemuMonitorTestGetDomainObj(mon);
+    priv = vm->privateData;
+    priv->mon = qemuMonitorTestGetMonitor(mon);
+    virObjectUnlock(priv->mon);
+
+    rc = qemuMigrationParamsSetMaxBandwidth(vm, VIR_ASYNC_JOB_NONE, 100);
+
+    virObjectLock(priv->mon);
+    /* don't dispose test monitor with VM */
+    priv->mon = NULL;
+
+    return rc;
+}
+
+
 static int
 mymain(void)
 {
@@ -217,6 +255,10 @@ mymain(void)
     DO_TEST("tls-enabled");
     DO_TEST("tls-hostname");
 
+    if (virTestRun("set max bandwidth", qemuMigParamsTestSetMaxBandwidth,
+                   &(qemuMigParamsData) { driver.xmlopt, NULL, qmpschema }) < 0)
+        ret = -1;
+
     qemuTestDriverFree(&driver);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -0,0 +1,203 @@
+/*
+ * qemumigrationschedtest.c: Test the outgoing migration scheduler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsqemu.h"
+#include "qemu/qemu_migration_sched.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define NVMS 4
+
+static virQEMUDriver driver;
+
+
+static int
+testPrepareDomains(virDomainObj **vms)
+{
+    size_t i;
+
+    for (i = 0; i < NVMS; i++) {
+        if (!(vms[i] = virDomainObjNew(driver.xmlopt)) ||
+            !(vms[i]->def = virDomainDefNew(driver.xmlopt)))
+            return -1;
+
+        vms[i]->def->name = g_strdup_printf("vm%zu", i);
+    }
+
+    return 0;
+}
+
+
+static void
+testFreeDomains(virDomainObj **vms)
+{
+    size_t i;
+
+    for (i = 0; i < NVMS; i++)
+        virObjectUnref(vms[i]);
+}
+
+
+static int
+testCheckActive(qemuMigrationScheduler *sched,
+                virDomainObj **vms,
+                const char *expected)
+{
+    size_t i;
+
+    for (i = 0; i < NVMS; i++) {
+        bool active = qemuMigrationSchedulerIsActive(sched, vms[i]);
+
+        if (active != (expected[i] == '1')) {
+            VIR_TEST_DEBUG("Unexpected state of %s: expected '%s'",
+                           vms[i]->def->name, expected);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testQueue(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(qemuMigrationScheduler) sched = NULL;
+    virDomainObj *vms[NVMS] = { NULL };
+    int ret = -1;
+
+    if (!(sched = qemuMigrationSchedulerNew(2, 0)) ||
+        testPrepareDomains(vms) < 0)
+        goto cleanup;
+
+    /* Two migrations start immediately ... */
+    if (!qemuMigrationSchedulerEnqueue(sched, vms[0], 0, 0) ||
+        !qemuMigrationSchedulerEnqueue(sched, vms[1], 0, 0)) {
+        VIR_TEST_DEBUG("Migrations not started immediately");
+        goto cleanup;
+    }
+
+    /* ... others are queued with the lower dirty rate going first */
+    if (qemuMigrationSchedulerEnqueue(sched, vms[2], 100, 0) ||
+        qemuMigrationSchedulerEnqueue(sched, vms[3], 10, 0)) {
+        VIR_TEST_DEBUG("Migrations not queued");
+        goto cleanup;
+    }
+
+    if (qemuMigrationSchedulerGetPosition(sched, vms[0]) != 0 ||
+        qemuMigrationSchedulerGetPosition(sched, vms[2]) != 2 ||
+        qemuMigrationSchedulerGetPosition(sched, vms[3]) != 1) {
+        VIR_TEST_DEBUG("Unexpected queue positions");
+        goto cleanup;
+    }
+
+    if (testCheckActive(sched, vms, "1100") < 0)
+        goto cleanup;
+
+    qemuMigrationSchedulerRemove(sched, vms[1]);
+    if (testCheckActive(sched, vms, "1001") < 0)
+        goto cleanup;
+
+    /* Removing a queued migration doesn't start anything */
+    qemuMigrationSchedulerRemove(sched, vms[2]);
+    if (testCheckActive(sched, vms, "1001") < 0)
+        goto cleanup;
+
+    qemuMigrationSchedulerRemove(sched, vms[0]);
+    qemuMigrationSchedulerRemove(sched, vms[3]);
+    if (testCheckActive(sched, vms, "0000") < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testFreeDomains(vms);
+    return ret;
+}
+
+
+static int
+testBandwidth(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(qemuMigrationScheduler) sched = NULL;
+    virDomainObj *vms[NVMS] = { NULL };
+    unsigned long long bw;
+    int ret = -1;
+
+    if (!(sched = qemuMigrationSchedulerNew(0, 1000)) ||
+        testPrepareDomains(vms) < 0)
+        goto cleanup;
+
+    ignore_value(qemuMigrationSchedulerEnqueue(sched, vms[0], 0, 0));
+    ignore_value(qemuMigrationSchedulerEnqueue(sched, vms[1], 0, 200));
+    ignore_value(qemuMigrationSchedulerEnqueue(sched, vms[2], 0, 0));
+
+    /* Without dirty rates the budget is split evenly, but the requested
+     * bandwidth is never exceeded */
+    if (qemuMigrationSchedulerGetBandwidth(sched, vms[0], 0) != 333 ||
+        qemuMigrationSchedulerGetBandwidth(sched, vms[1], 0) != 200) {
+        VIR_TEST_DEBUG("Unexpected even split");
+        goto cleanup;
+    }
+
+    qemuMigrationSchedulerRemove(sched, vms[2]);
+
+    /* Half of the budget follows dirty rates */
+    ignore_value(qemuMigrationSchedulerGetBandwidth(sched, vms[1], 100));
+    bw = qemuMigrationSchedulerGetBandwidth(sched, vms[0], 300);
+    if (bw != 250 + 375) {
+        VIR_TEST_DEBUG("Unexpected share %llu", bw);
+        goto cleanup;
+    }
+
+    /* Unknown domains get no share */
+    if (qemuMigrationSchedulerGetBandwidth(sched, vms[3], 0) != 0) {
+        VIR_TEST_DEBUG("Unexpected share of unknown domain");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testFreeDomains(vms);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("queue", testQueue, NULL) < 0)
+        ret = -1;
+    if (virTestRun("bandwidth", testBandwidth, NULL) < 0)
+        ret = -1;
+
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
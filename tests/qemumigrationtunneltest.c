@@ -0,0 +1,292 @@
+/*
+ * qemumigrationtunneltest.c: Test channels of tunnelled migration
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#if defined(WITH_TEST) && !defined(WIN32)
+
+# include <sys/un.h>
+
+# include "testutilsqemu.h"
+# include "virfdstream.h"
+# include "virfile.h"
+# include "viridentity.h"
+# include "virsocket.h"
+# include "viruuid.h"
+# define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+# include "qemu/qemu_migration.h"
+# include "qemu/qemu_migrationpriv.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+/* UUID of the domain defined by test:///default */
+# define TEST_DOMAIN_UUID "6695eb01-f6a4-8304-79aa-97f2502e193f"
+# define TEST_URI "test:///default"
+
+static virQEMUDriver driver;
+
+
+/* Connects to @path the way QEMU opens a migration channel */
+static int
+testConnect(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (virStrcpyStatic(addr.sun_path, path) < 0)
+        return -1;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/* Once a channel can't be forwarded to the destination, the migration
+ * socket has to be closed so that QEMU fails to open other channels
+ * instead of waiting for them forever, and the error has to be reported
+ * when the channels are stopped. The first channel is forwarded to
+ * /dev/null, while the test driver doesn't support adding channels to an
+ * incoming migration, which makes the second channel fail. */
+static int
+testChannelFailure(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *tmpdir = NULL;
+    g_autofree char *path = NULL;
+    virDomainObj *vm = NULL;
+    virNetSocket *sock = NULL;
+    virConnectPtr conn = NULL;
+    virStreamPtr st = NULL;
+    qemuMigrationTunnelChannels *channels = NULL;
+    int fds[2] = { -1, -1 };
+    bool closed = false;
+    int ret = -1;
+    size_t i;
+
+    if (!(tmpdir = g_mkdtemp(g_strdup("/tmp/libvirt_XXXXXX"))))
+        return -1;
+    path = g_strdup_printf("%s/migration.sock", tmpdir);
+
+    if (!(vm = virDomainObjNew(driver.xmlopt)) ||
+        !(vm->def = virDomainDefNew(driver.xmlopt)) ||
+        virUUIDParse(TEST_DOMAIN_UUID, vm->def->uuid) < 0)
+        goto cleanup;
+
+    if (virNetSocketNewListenUNIX(path, 0700, -1, getegid(), &sock) < 0 ||
+        virNetSocketListen(sock, 0) < 0)
+        goto cleanup;
+
+    if (!(conn = virConnectOpen(TEST_URI)) ||
+        !(st = virStreamNew(conn, 0)) ||
+        virFDStreamOpenFile(st, "/dev/null", 0, 0, O_WRONLY) < 0)
+        goto cleanup;
+
+    if (!(channels = qemuMigrationSrcStartTunnelChannels(&driver, vm, sock,
+                                                         st, TEST_URI)))
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(fds); i++) {
+        if ((fds[i] = testConnect(path)) < 0) {
+            VIR_TEST_DEBUG("Failed to open channel %zu", i);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < 1000 && !closed; i++) {
+        VIR_AUTOCLOSE fd = testConnect(path);
+
+        if (fd < 0)
+            closed = true;
+        else
+            g_usleep(10 * 1000);
+    }
+
+    if (!closed) {
+        VIR_TEST_DEBUG("Migration socket was not closed after failed channel");
+        goto cleanup;
+    }
+
+    /* Let the first channel see EOF */
+    VIR_FORCE_CLOSE(fds[0]);
+
+    if (qemuMigrationSrcStopTunnelChannels(g_steal_pointer(&channels),
+                                           false) == 0) {
+        VIR_TEST_DEBUG("Failed channel was not reported");
+        goto cleanup;
+    }
+
+    if (virGetLastErrorCode() != VIR_ERR_NO_SUPPORT) {
+        VIR_TEST_DEBUG("Unexpected error: %s", virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    virResetLastError();
+    ret = 0;
+
+ cleanup:
+    if (channels)
+        qemuMigrationSrcStopTunnelChannels(channels, true);
+    for (i = 0; i < G_N_ELEMENTS(fds); i++)
+        VIR_FORCE_CLOSE(fds[i]);
+    virObjectUnref(st);
+    virObjectUnref(conn);
+    virObjectUnref(sock);
+    virObjectUnref(vm);
+    unlink(path);
+    rmdir(tmpdir);
+    return ret;
+}
+
+
+static virIdentity *
+testIdentityNew(uid_t uid,
+                pid_t pid,
+                const char *dname)
+{
+    g_autoptr(virIdentity) ident = virIdentityNew();
+
+    if (virIdentitySetUNIXUserID(ident, uid) < 0 ||
+        virIdentitySetProcessID(ident, pid) < 0 ||
+        virIdentitySetX509DName(ident, dname) < 0)
+        return NULL;
+
+    return g_steal_pointer(&ident);
+}
+
+
+/* Channels may only be added to an incoming migration by the client which
+ * started it, although they are opened on separate connections. */
+static int
+testAddChannelIdentity(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *tmpdir = NULL;
+    g_autofree char *path = NULL;
+    g_autoptr(virIdentity) other = NULL;
+    g_autoptr(virIdentity) same = NULL;
+    virDomainObj *vm = NULL;
+    qemuDomainObjPrivate *priv;
+    qemuDomainJobPrivate *jobPriv;
+    virNetSocket *sock = NULL;
+    virConnectPtr conn = NULL;
+    virStreamPtr st = NULL;
+    int ret = -1;
+
+    if (!(tmpdir = g_mkdtemp(g_strdup("/tmp/libvirt_XXXXXX"))))
+        return -1;
+    path = g_strdup_printf("%s/migrate-tunnel.sock", tmpdir);
+
+    if (!(vm = virDomainObjNew(driver.xmlopt)) ||
+        !(vm->def = virDomainDefNew(driver.xmlopt)))
+        goto cleanup;
+
+    vm->def->name = g_strdup("guest");
+    priv = vm->privateData;
+    priv->libDir = g_strdup(tmpdir);
+    jobPriv = vm->job->privateData;
+    vm->job->asyncJob = VIR_ASYNC_JOB_MIGRATION_IN;
+    vm->job->apiFlags = VIR_MIGRATE_TUNNELLED | VIR_MIGRATE_PARALLEL;
+
+    if (!(jobPriv->migIdentity = testIdentityNew(1000, 100, "CN=source")) ||
+        !(same = testIdentityNew(1000, 200, "CN=source")) ||
+        !(other = testIdentityNew(1000, 100, "CN=other")))
+        goto cleanup;
+
+    if (virNetSocketNewListenUNIX(path, 0700, -1, getegid(), &sock) < 0 ||
+        virNetSocketListen(sock, 0) < 0)
+        goto cleanup;
+
+    if (!(conn = virConnectOpen(TEST_URI)) ||
+        !(st = virStreamNew(conn, 0)))
+        goto cleanup;
+
+    if (virIdentitySetCurrent(other) < 0)
+        goto cleanup;
+
+    if (qemuMigrationDstAddTunnelChannel(vm, st) == 0) {
+        VIR_TEST_DEBUG("Channel of another client was added");
+        goto cleanup;
+    }
+
+    if (virGetLastErrorCode() != VIR_ERR_OPERATION_DENIED) {
+        VIR_TEST_DEBUG("Unexpected error: %s", virGetLastErrorMessage());
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (virIdentitySetCurrent(same) < 0)
+        goto cleanup;
+
+    if (qemuMigrationDstAddTunnelChannel(vm, st) < 0) {
+        VIR_TEST_DEBUG("Channel of the migrating client was rejected: %s",
+                       virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virIdentitySetCurrent(NULL);
+    if (st)
+        virStreamAbort(st);
+    virObjectUnref(st);
+    virObjectUnref(conn);
+    virObjectUnref(sock);
+    virObjectUnref(vm);
+    unlink(path);
+    rmdir(tmpdir);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("channel failure", testChannelFailure, NULL) < 0)
+        ret = -1;
+    if (virTestRun("add channel identity", testAddChannelIdentity, NULL) < 0)
+        ret = -1;
+
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else /* !WITH_TEST || WIN32 */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* !WITH_TEST || WIN32 */
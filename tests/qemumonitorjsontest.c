@@ -2181,6 +2181,78 @@ testQemuMonitorJSONGetIOThreads(const void *opaque)
     return ret;
 }
 
+static int
+testQemuMonitorJSONPrefetch(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    qemuMonitor *mon;
+    qemuMonitorIOThreadInfo **info = NULL;
+    int ninfo = 0;
+    int ret = -1;
+    size_t i;
+
+    if (!(test = qemuMonitorTestNewSchema(data->xmlopt, data->schema)))
+        return -1;
+
+    mon = qemuMonitorTestGetMonitor(test);
+
+    if (qemuMonitorTestAddItem(test, "query-iothreads",
+                               "{ \"return\": [ "
+                               "  { \"id\": \"iothread1\", \"thread-id\": 30992 }, "
+                               "  { \"id\": \"iothread2\", \"thread-id\": 30993 } "
+                               "] }") < 0 ||
+        qemuMonitorTestAddItem(test, "query-cpus-fast",
+                               "{ \"return\": [] }") < 0)
+        return -1;
+
+    if (qemuMonitorPrefetch(mon, QEMU_MONITOR_PREFETCH_IOTHREADS |
+                                 QEMU_MONITOR_PREFETCH_CPUS) < 0)
+        return -1;
+
+    /* Served from the prefetched reply ... */
+    if (qemuMonitorGetIOThreads(mon, &info, &ninfo) < 0)
+        goto cleanup;
+
+    if (ninfo != 2 || info[1]->thread_id != 30993) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "unexpected prefetched iothreads, ninfo %d", ninfo);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ninfo; i++)
+        VIR_FREE(info[i]);
+    VIR_FREE(info);
+
+    /* ... which is used only once. */
+    if (qemuMonitorTestAddItem(test, "query-iothreads",
+                               "{ \"return\": [ "
+                               "  { \"id\": \"iothread1\", \"thread-id\": 30994 } "
+                               "] }") < 0)
+        goto cleanup;
+
+    if (qemuMonitorGetIOThreads(mon, &info, &ninfo) < 0)
+        goto cleanup;
+
+    if (ninfo != 1 || info[0]->thread_id != 30994) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "unexpected iothreads, ninfo %d", ninfo);
+        goto cleanup;
+    }
+
+    /* The reply to query-cpus-fast was never used */
+    qemuMonitorPrefetchClear(mon);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ninfo; i++)
+        VIR_FREE(info[i]);
+    VIR_FREE(info);
+
+    return ret;
+}
+
 struct testCPUInfoData {
     const char *name;
     size_t maxvcpus;
@@ -2482,6 +2554,54 @@ testQueryJobs(const void *opaque)
 }
 
 
+static int
+testQemuMonitorJSONBlockGeneration(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    g_autoptr(GHashTable) nodedata = NULL;
+    g_autoptr(virJSONValue) actions = virJSONValueNewArray();
+    qemuMonitor *mon;
+    unsigned int generation;
+
+    if (!(test = qemuMonitorTestNewSchema(data->xmlopt, data->schema)))
+        return -1;
+
+    mon = qemuMonitorTestGetMonitor(test);
+    generation = qemuMonitorGetBlockGeneration(mon);
+
+    /* Queries keep the generation ... */
+    if (qemuMonitorTestAddItem(test, "query-named-block-nodes",
+                               "{\"return\":[]}") < 0)
+        return -1;
+
+    if (!(nodedata = qemuMonitorBlockGetNamedNodeData(mon)))
+        return -1;
+
+    if (qemuMonitorGetBlockGeneration(mon) != generation) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "block generation changed by a query");
+        return -1;
+    }
+
+    /* ... other commands change it */
+    if (qemuMonitorTransactionBitmapAdd(actions, "node1", "bitmap1", true, true, 0) < 0 ||
+        qemuMonitorTestAddItem(test, "transaction", "{\"return\":{}}") < 0)
+        return -1;
+
+    if (qemuMonitorTransaction(mon, &actions) < 0)
+        return -1;
+
+    if (qemuMonitorGetBlockGeneration(mon) == generation) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "block generation not changed by a transaction");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 testQemuMonitorJSONTransaction(const void *opaque)
 {
@@ -2914,6 +3034,8 @@ mymain(void)
     DO_TEST(GetDeviceAliases);
     DO_TEST(CPU);
     DO_TEST(GetIOThreads);
+    DO_TEST(Prefetch);
+    DO_TEST(BlockGeneration);
     DO_TEST(GetSEVInfo);
     DO_TEST(Transaction);
     DO_TEST(BlockExportAdd);
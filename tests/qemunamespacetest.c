@@ -0,0 +1,393 @@
+/*
+ * qemunamespacetest.c: Test the protocol of QEMU namespace helper
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef __linux__
+
+# include "virfile.h"
+# include "virsocket.h"
+# include "qemu/qemu_namespace.h"
+# define LIBVIRT_QEMU_NAMESPACEPRIV_H_ALLOW
+# include "qemu/qemu_namespacepriv.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+
+struct testSocketPair {
+    int fds[2];
+};
+
+
+static int
+testSocketPairOpen(struct testSocketPair *pair)
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair->fds) < 0) {
+        fprintf(stderr, "Unable to create socket pair: %s\n", g_strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testSocketPairClose(struct testSocketPair *pair)
+{
+    VIR_FORCE_CLOSE(pair->fds[0]);
+    VIR_FORCE_CLOSE(pair->fds[1]);
+}
+
+
+/* Sends @msg through a socket pair and returns what was received */
+static virJSONValue *
+testSendRecv(virJSONValue *msg)
+{
+    struct testSocketPair pair = { { -1, -1 } };
+    virJSONValue *ret = NULL;
+
+    if (testSocketPairOpen(&pair) < 0)
+        return NULL;
+
+    if (qemuNamespaceHelperSend(pair.fds[0], msg) == 0)
+        ret = qemuNamespaceHelperRecv(pair.fds[1]);
+
+    testSocketPairClose(&pair);
+    return ret;
+}
+
+
+static int
+testMknodItemCompare(qemuNamespaceMknodItem *expect,
+                     qemuNamespaceMknodItem *actual)
+{
+    if (STRNEQ(expect->file, actual->file) ||
+        STRNEQ_NULLABLE(expect->target, actual->target) ||
+        expect->sb.st_mode != actual->sb.st_mode ||
+        expect->sb.st_rdev != actual->sb.st_rdev ||
+        expect->sb.st_uid != actual->sb.st_uid ||
+        expect->sb.st_gid != actual->sb.st_gid) {
+        fprintf(stderr, "Item '%s' doesn't match after round trip\n",
+                expect->file);
+        return -1;
+    }
+
+# ifdef WITH_SELINUX
+    if (STRNEQ_NULLABLE(expect->tcon, actual->tcon)) {
+        fprintf(stderr, "Security context of '%s' doesn't match: '%s' vs '%s'\n",
+                expect->file, NULLSTR(expect->tcon), NULLSTR(actual->tcon));
+        return -1;
+    }
+# endif
+
+    return 0;
+}
+
+
+static int
+testMknodRequest(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(qemuNamespaceMknodItem) dev = { 0 };
+    g_auto(qemuNamespaceMknodItem) link = { 0 };
+    qemuNamespaceMknodItem *items[] = { &dev, &link };
+    g_autoptr(virJSONValue) array = virJSONValueNewArray();
+    g_autoptr(virJSONValue) request = NULL;
+    g_autoptr(virJSONValue) received = NULL;
+    virJSONValue *receivedItems;
+    size_t i;
+
+    dev.file = g_strdup("/dev/null");
+    dev.sb.st_mode = S_IFCHR | 0666;
+    dev.sb.st_rdev = 259;
+    dev.sb.st_uid = 107;
+    dev.sb.st_gid = 36;
+# ifdef WITH_SELINUX
+    dev.tcon = g_strdup("system_u:object_r:null_device_t:s0");
+# endif
+
+    link.file = g_strdup("/dev/disk/by-id/some-disk");
+    link.target = g_strdup("../../sda");
+    link.sb.st_mode = S_IFLNK | 0777;
+
+    for (i = 0; i < G_N_ELEMENTS(items); i++) {
+        g_autoptr(virJSONValue) item = NULL;
+
+        if (!(item = qemuNamespaceMknodItemFormat(items[i])) ||
+            virJSONValueArrayAppend(array, &item) < 0)
+            return -1;
+    }
+
+    if (virJSONValueObjectAdd(&request,
+                              "s:execute", "mknod",
+                              "a:items", &array,
+                              NULL) < 0)
+        return -1;
+
+    if (!(received = testSendRecv(request)))
+        return -1;
+
+    if (STRNEQ_NULLABLE(virJSONValueObjectGetString(received, "execute"), "mknod") ||
+        !(receivedItems = virJSONValueObjectGetArray(received, "items")) ||
+        virJSONValueArraySize(receivedItems) != G_N_ELEMENTS(items)) {
+        fprintf(stderr, "Malformed request received\n");
+        return -1;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(items); i++) {
+        g_auto(qemuNamespaceMknodItem) parsed = { 0 };
+
+        if (qemuNamespaceMknodItemParse(virJSONValueArrayGet(receivedItems, i),
+                                        &parsed) < 0)
+            return -1;
+
+        if (testMknodItemCompare(items[i], &parsed) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testMknodItemMalformed(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(qemuNamespaceMknodItem) parsed = { 0 };
+    g_autoptr(virJSONValue) item = NULL;
+
+    if (virJSONValueObjectAdd(&item,
+                              "s:file", "/dev/null",
+                              "u:uid", 0,
+                              "u:gid", 0,
+                              NULL) < 0)
+        return -1;
+
+    if (qemuNamespaceMknodItemParse(item, &parsed) == 0) {
+        fprintf(stderr, "Item without mode was accepted\n");
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int
+testReplySuccess(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virJSONValue) reply = NULL;
+    g_autoptr(virJSONValue) received = NULL;
+    int rc;
+
+    if (!(reply = qemuNamespaceHelperFormatReply(3)) ||
+        !(received = testSendRecv(reply)))
+        return -1;
+
+    if ((rc = qemuNamespaceHelperParseReply(received)) != 3) {
+        fprintf(stderr, "Expected 3, got %d\n", rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testReplyError(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virJSONValue) reply = NULL;
+    g_autoptr(virJSONValue) received = NULL;
+    const char *msg;
+
+    virReportError(VIR_ERR_OPERATION_FAILED, "%s", "something broke");
+
+    reply = qemuNamespaceHelperFormatReply(-1);
+    virResetLastError();
+
+    if (!reply || !(received = testSendRecv(reply)))
+        return -1;
+
+    if (qemuNamespaceHelperParseReply(received) != -1) {
+        fprintf(stderr, "Error reply wasn't recognized\n");
+        return -1;
+    }
+
+    msg = virGetLastErrorMessage();
+
+    if (virGetLastErrorCode() != VIR_ERR_OPERATION_FAILED ||
+        !strstr(msg, "something broke")) {
+        fprintf(stderr, "Unexpected error raised: %s\n", msg);
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int
+testReplyMalformed(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virJSONValue) reply = NULL;
+
+    if (virJSONValueObjectAdd(&reply, "s:return", "nope", NULL) < 0)
+        return -1;
+
+    if (qemuNamespaceHelperParseReply(reply) != -2) {
+        fprintf(stderr, "Malformed reply wasn't recognized\n");
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int
+testRecvOversized(const void *opaque G_GNUC_UNUSED)
+{
+    struct testSocketPair pair = { { -1, -1 } };
+    uint32_t len = 64 * 1024 * 1024;
+    g_autoptr(virJSONValue) received = NULL;
+    int ret = -1;
+
+    if (testSocketPairOpen(&pair) < 0)
+        return -1;
+
+    if (safewrite(pair.fds[0], &len, sizeof(len)) < 0)
+        goto cleanup;
+
+    if ((received = qemuNamespaceHelperRecv(pair.fds[1]))) {
+        fprintf(stderr, "Oversized message was accepted\n");
+        goto cleanup;
+    }
+
+    virResetLastError();
+    ret = 0;
+
+ cleanup:
+    testSocketPairClose(&pair);
+    return ret;
+}
+
+
+static int
+testRecvClosed(const void *opaque G_GNUC_UNUSED)
+{
+    struct testSocketPair pair = { { -1, -1 } };
+    uint32_t len = 100;
+    g_autoptr(virJSONValue) received = NULL;
+    int ret = -1;
+
+    if (testSocketPairOpen(&pair) < 0)
+        return -1;
+
+    /* Announce more data than is actually sent */
+    if (safewrite(pair.fds[0], &len, sizeof(len)) < 0 ||
+        safewrite(pair.fds[0], "{}", 2) < 0)
+        goto cleanup;
+    VIR_FORCE_CLOSE(pair.fds[0]);
+
+    if ((received = qemuNamespaceHelperRecv(pair.fds[1]))) {
+        fprintf(stderr, "Truncated message was accepted\n");
+        goto cleanup;
+    }
+
+    virResetLastError();
+    ret = 0;
+
+ cleanup:
+    testSocketPairClose(&pair);
+    return ret;
+}
+
+
+static int
+testRecvTimeout(const void *opaque G_GNUC_UNUSED)
+{
+    struct testSocketPair pair = { { -1, -1 } };
+    struct timeval tv = { .tv_usec = 100 * 1000 };
+    g_autoptr(virJSONValue) received = NULL;
+    int ret = -1;
+
+    if (testSocketPairOpen(&pair) < 0)
+        return -1;
+
+    if (setsockopt(pair.fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+        fprintf(stderr, "Unable to set timeout: %s\n", g_strerror(errno));
+        goto cleanup;
+    }
+
+    /* The peer is alive but never replies */
+    if ((received = qemuNamespaceHelperRecv(pair.fds[1]))) {
+        fprintf(stderr, "Received a message nobody sent\n");
+        goto cleanup;
+    }
+
+    if (virGetLastErrorCode() != VIR_ERR_OPERATION_TIMEOUT) {
+        fprintf(stderr, "Unexpected error raised: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    virResetLastError();
+    ret = 0;
+
+ cleanup:
+    testSocketPairClose(&pair);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("mknod request", testMknodRequest, NULL) < 0)
+        ret = -1;
+    if (virTestRun("malformed mknod item", testMknodItemMalformed, NULL) < 0)
+        ret = -1;
+    if (virTestRun("success reply", testReplySuccess, NULL) < 0)
+        ret = -1;
+    if (virTestRun("error reply", testReplyError, NULL) < 0)
+        ret = -1;
+    if (virTestRun("malformed reply", testReplyMalformed, NULL) < 0)
+        ret = -1;
+    if (virTestRun("oversized message", testRecvOversized, NULL) < 0)
+        ret = -1;
+    if (virTestRun("closed connection", testRecvClosed, NULL) < 0)
+        ret = -1;
+    if (virTestRun("timeout", testRecvTimeout, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else /* !__linux__ */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* !__linux__ */
@@ -133,6 +133,188 @@ testDomain(const void *opaque)
 }
 
 
+struct testTransactionData {
+    virMutex lock;
+    size_t fail;
+    GArray *applied;
+    GArray *rolledBack;
+    bool busy;
+    bool overlap;
+};
+
+
+static int
+testTransactionApply(size_t idx,
+                     void *opaque)
+{
+    struct testTransactionData *data = opaque;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        if (idx == data->fail) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "failed %zu", idx);
+            return -1;
+        }
+
+        if (data->busy)
+            data->overlap = true;
+        data->busy = true;
+
+        g_array_append_val(data->applied, idx);
+    }
+
+    /* give other workers a chance to apply an item in the meantime */
+    g_usleep(1000);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        data->busy = false;
+    }
+
+    return 0;
+}
+
+
+static int
+testTransactionRollback(size_t idx,
+                        void *opaque)
+{
+    struct testTransactionData *data = opaque;
+
+    g_array_append_val(data->rolledBack, idx);
+    return 0;
+}
+
+
+static int
+testTransaction(const void *opaque G_GNUC_UNUSED)
+{
+    const char *paths[] = { "/a", "/b", "/a", "/c", NULL, "/d", NULL, "/a" };
+    struct testTransactionData data = { .fail = 3 };
+    g_autoptr(GArray) applied = g_array_new(FALSE, FALSE, sizeof(size_t));
+    g_autoptr(GArray) rolledBack = g_array_new(FALSE, FALSE, sizeof(size_t));
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    data.applied = applied;
+    data.rolledBack = rolledBack;
+
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+
+    if (virSecurityManagerTransactionApply(paths, G_N_ELEMENTS(paths), 4,
+                                           testTransactionApply,
+                                           testTransactionRollback,
+                                           &data) == 0 ||
+        !virGetLastErrorMessage() ||
+        STRNEQ(virGetLastErrorMessage(), "internal error: failed 3")) {
+        VIR_TEST_DEBUG("Expected failure of item 3");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    /* Items on the same path are applied in order ... */
+    for (i = 0; i < applied->len; i++) {
+        for (j = i + 1; j < applied->len; j++) {
+            size_t a = g_array_index(applied, size_t, i);
+            size_t b = g_array_index(applied, size_t, j);
+
+            if (STREQ_NULLABLE(paths[a], paths[b]) && a > b) {
+                VIR_TEST_DEBUG("Item %zu applied before item %zu", a, b);
+                goto cleanup;
+            }
+        }
+    }
+
+    /* ... and all applied items are rolled back in reverse order */
+    if (rolledBack->len != applied->len) {
+        VIR_TEST_DEBUG("Applied %u items, rolled back %u",
+                       applied->len, rolledBack->len);
+        goto cleanup;
+    }
+
+    for (i = 1; i < rolledBack->len; i++) {
+        if (g_array_index(rolledBack, size_t, i - 1) <=
+            g_array_index(rolledBack, size_t, i)) {
+            VIR_TEST_DEBUG("Rollback not in reverse order");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+/* A file referred to through a symlink and a hard link must not be
+ * relabelled by more than one worker at a time */
+static int
+testTransactionAliases(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *tmpdir = NULL;
+    g_autofree char *file = NULL;
+    g_autofree char *symlinkPath = NULL;
+    g_autofree char *hardlinkPath = NULL;
+    struct testTransactionData data = { .fail = SIZE_MAX };
+    g_autoptr(GArray) applied = g_array_new(FALSE, FALSE, sizeof(size_t));
+    g_autoptr(GArray) rolledBack = g_array_new(FALSE, FALSE, sizeof(size_t));
+    size_t i;
+    int ret = -1;
+
+    if (!(tmpdir = g_mkdtemp(g_strdup("/tmp/libvirt_XXXXXX"))))
+        return -1;
+    file = g_strdup_printf("%s/disk", tmpdir);
+    symlinkPath = g_strdup_printf("%s/symlink", tmpdir);
+    hardlinkPath = g_strdup_printf("%s/hardlink", tmpdir);
+
+    data.applied = applied;
+    data.rolledBack = rolledBack;
+
+    if (virMutexInit(&data.lock) < 0)
+        goto rmdir;
+
+    if (virFileTouch(file, 0600) < 0 ||
+        symlink(file, symlinkPath) < 0 ||
+        link(file, hardlinkPath) < 0)
+        goto cleanup;
+
+    {
+        const char *paths[] = { file, symlinkPath, hardlinkPath, file };
+
+        if (virSecurityManagerTransactionApply(paths, G_N_ELEMENTS(paths), 4,
+                                               testTransactionApply,
+                                               testTransactionRollback,
+                                               &data) < 0)
+            goto cleanup;
+    }
+
+    if (data.overlap) {
+        VIR_TEST_DEBUG("Aliases of a file were applied in parallel");
+        goto cleanup;
+    }
+
+    for (i = 0; i < applied->len; i++) {
+        if (g_array_index(applied, size_t, i) != i) {
+            VIR_TEST_DEBUG("Aliases of a file were not applied in order");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexDestroy(&data.lock);
+    unlink(hardlinkPath);
+    unlink(symlinkPath);
+    unlink(file);
+ rmdir:
+    rmdir(tmpdir);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -192,6 +374,11 @@ mymain(void)
     driver.securityManager = g_steal_pointer(&stack);
 
 
+    if (virTestRun("transaction", testTransaction, NULL) < 0)
+        ret = -1;
+    if (virTestRun("transaction aliases", testTransactionAliases, NULL) < 0)
+        ret = -1;
+
 #define DO_TEST_DOMAIN(f) \
     do { \
         struct testData data = {.driver = &driver, .file = f}; \
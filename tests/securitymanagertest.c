@@ -0,0 +1,80 @@
+/*
+ * securitymanagertest.c: Test helpers of the security manager
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "security/security_manager.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+/* Waiting for a contended metadata lock starts with short delays which
+ * grow up to a limit and gives up after ten seconds */
+static int
+testMetadataLockBackoff(const void *opaque G_GNUC_UNUSED)
+{
+    unsigned long long waited = 0;
+    unsigned long long delay = 0;
+    unsigned long long next;
+    size_t attempts = 0;
+
+    while ((next = virSecurityManagerMetadataLockBackoff(waited, delay)) > 0) {
+        if (delay == 0 && next != 1000) {
+            VIR_TEST_DEBUG("First delay is %llu us", next);
+            return -1;
+        }
+
+        if (delay > 0 && next != MIN(delay * 2, 100 * 1000)) {
+            VIR_TEST_DEBUG("Delay %llu us followed by %llu us", delay, next);
+            return -1;
+        }
+
+        delay = next;
+        waited += delay;
+        attempts++;
+    }
+
+    if (waited < 10 * G_USEC_PER_SEC ||
+        waited >= 10 * G_USEC_PER_SEC + 100 * 1000) {
+        VIR_TEST_DEBUG("Gave up after %llu us", waited);
+        return -1;
+    }
+
+    /* polling every millisecond took 10000 attempts */
+    if (attempts > 120) {
+        VIR_TEST_DEBUG("Gave up after %zu attempts", attempts);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("metadata lock backoff", testMetadataLockBackoff, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,290 @@
+/*
+ * virdnsmasqtest.c: Test saving dnsmasq hosts directories
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virdnsmasq.h"
+#include "virfile.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virdnsmasqdir-XXXXXX"
+
+
+/* Saves DHCP hosts named by @names, which are all in 192.168.122.0/24
+ * with the last byte of the address given by @ips, and checks whether
+ * the save required a reload. @cache is passed over to the next save the
+ * same way the network driver does it. */
+static int
+testSave(const char *dir,
+         dnsmasqHostsdirCache **cache,
+         const char **names,
+         const unsigned int *ips,
+         size_t nhosts,
+         bool expectReload)
+{
+    g_autoptr(dnsmasqContext) ctx = NULL;
+    bool reload = !expectReload;
+    size_t i;
+
+    if (!(ctx = dnsmasqContextNew("default", dir)))
+        return -1;
+
+    ctx->hostsdirs = true;
+    ctx->hostsdirCache = g_steal_pointer(cache);
+
+    for (i = 0; i < nhosts; i++) {
+        g_autofree char *ipstr = g_strdup_printf("192.168.122.%u", ips[i]);
+        virSocketAddr ip;
+
+        if (virSocketAddrParse(&ip, ipstr, AF_INET) < 0 ||
+            dnsmasqAddDhcpHost(ctx, NULL, &ip, names[i], NULL, NULL, false) < 0 ||
+            dnsmasqAddHost(ctx, &ip, names[i]) < 0)
+            return -1;
+    }
+
+    if (dnsmasqSaveChanges(ctx, &reload) < 0)
+        return -1;
+
+    *cache = g_steal_pointer(&ctx->hostsdirCache);
+
+    if (reload != expectReload) {
+        VIR_TEST_DEBUG("Expected reload=%d, got %d", expectReload, reload);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testCheckFile(const char *dir,
+              const char *name,
+              const char *expected)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s", dir, name);
+    g_autofree char *actual = NULL;
+
+    if (!expected) {
+        if (virFileExists(path)) {
+            VIR_TEST_DEBUG("File %s was not removed", path);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (virFileReadAll(path, 1024, &actual) < 0)
+        return -1;
+
+    if (STRNEQ(actual, expected)) {
+        VIR_TEST_DEBUG("Unexpected contents of %s: '%s'", path, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testHostsDir(const void *opaque)
+{
+    const char *dir = opaque;
+    g_autofree char *hostsdir = g_strdup_printf("%s/default.hostsdir", dir);
+    g_autofree char *addnhostsdir = g_strdup_printf("%s/default.addnhostsdir", dir);
+    const char *names[] = { "a", "b", "c" };
+    const char *renamed[] = { "a", "b", "x", "b2" };
+    const unsigned int initial[] = { 10, 11 };
+    const unsigned int added[] = { 10, 11, 12 };
+    const unsigned int shared[] = { 10, 11, 12, 11 };
+    const unsigned int removed[] = { 10, 13 };
+    g_autoptr(dnsmasqHostsdirCache) cache = NULL;
+    g_autofree char *path = g_strdup_printf("%s/192.168.122.10", hostsdir);
+
+    /* New hosts are picked up by dnsmasq itself ... */
+    if (testSave(dir, &cache, names, initial, G_N_ELEMENTS(initial), false) < 0 ||
+        testSave(dir, &cache, names, initial, G_N_ELEMENTS(initial), false) < 0 ||
+        testSave(dir, &cache, names, added, G_N_ELEMENTS(added), false) < 0)
+        return -1;
+
+    if (testCheckFile(hostsdir, "192.168.122.12", "c,192.168.122.12\n") < 0 ||
+        testCheckFile(addnhostsdir, "192.168.122.12", "192.168.122.12\tc\t\n") < 0)
+        return -1;
+
+    /* ... but changing them requires a reload ... */
+    if (testSave(dir, &cache, renamed, added, G_N_ELEMENTS(added), true) < 0 ||
+        testCheckFile(hostsdir, "192.168.122.12", "x,192.168.122.12\n") < 0)
+        return -1;
+
+    /* ... unlike changing DNS hosts ... */
+    if (testSave(dir, &cache, renamed, shared, G_N_ELEMENTS(shared), false) < 0)
+        return -1;
+
+    if (testCheckFile(hostsdir, "192.168.122.11-2", "b2,192.168.122.11\n") < 0 ||
+        testCheckFile(addnhostsdir, "192.168.122.11", "192.168.122.11\tb\tb2\t\n") < 0)
+        return -1;
+
+    /* ... and so does removing them */
+    if (testSave(dir, &cache, names, removed, G_N_ELEMENTS(removed), true) < 0)
+        return -1;
+
+    if (testCheckFile(hostsdir, "192.168.122.11", NULL) < 0 ||
+        testCheckFile(hostsdir, "192.168.122.11-2", NULL) < 0 ||
+        testCheckFile(addnhostsdir, "192.168.122.12", NULL) < 0 ||
+        testCheckFile(hostsdir, "192.168.122.13", "b,192.168.122.13\n") < 0)
+        return -1;
+
+    /* Files are compared with what was saved last time rather than read,
+     * so a file changed behind our back stays as it is ... */
+    if (virFileWriteStr(path, "junk\n", 0644) < 0 ||
+        testSave(dir, &cache, names, removed, G_N_ELEMENTS(removed), false) < 0 ||
+        testCheckFile(hostsdir, "192.168.122.10", "junk\n") < 0)
+        return -1;
+
+    /* ... unless there is no record of the last save, e.g. after a daemon
+     * restart, in which case the directory is read */
+    g_clear_pointer(&cache, dnsmasqHostsdirCacheFree);
+
+    if (testSave(dir, &cache, names, removed, G_N_ELEMENTS(removed), true) < 0 ||
+        testCheckFile(hostsdir, "192.168.122.10", "a,192.168.122.10\n") < 0 ||
+        testCheckFile(hostsdir, "192.168.122.13", "b,192.168.122.13\n") < 0)
+        return -1;
+
+    return 0;
+}
+
+#define NMANYHOSTS 4000
+
+/* Saves NMANYHOSTS DHCP hosts in 10.0.0.0/16 of network "many". The host
+ * with index @renamed gets a different name than the others. */
+static int
+testSaveMany(const char *dir,
+             dnsmasqHostsdirCache **cache,
+             ssize_t renamed,
+             bool *reload)
+{
+    g_autoptr(dnsmasqContext) ctx = NULL;
+    size_t i;
+
+    if (!(ctx = dnsmasqContextNew("many", dir)))
+        return -1;
+
+    ctx->hostsdirs = true;
+    ctx->hostsdirCache = g_steal_pointer(cache);
+
+    for (i = 0; i < NMANYHOSTS; i++) {
+        g_autofree char *ipstr = g_strdup_printf("10.0.%zu.%zu",
+                                                 i / 250, i % 250 + 1);
+        g_autofree char *name = g_strdup_printf("%s%zu",
+                                                (ssize_t) i == renamed ? "new" : "host",
+                                                i);
+        virSocketAddr ip;
+
+        if (virSocketAddrParse(&ip, ipstr, AF_INET) < 0 ||
+            dnsmasqAddDhcpHost(ctx, NULL, &ip, name, NULL, NULL, false) < 0)
+            return -1;
+    }
+
+    if (dnsmasqSaveChanges(ctx, reload) < 0)
+        return -1;
+
+    *cache = g_steal_pointer(&ctx->hostsdirCache);
+
+    return 0;
+}
+
+
+/* Changing one of thousands of hosts must rewrite the file of that host
+ * only. Files are replaced by a rename, so a rewritten file has a new
+ * inode. */
+static int
+testManyHosts(const void *opaque)
+{
+    const char *dir = opaque;
+    g_autofree char *hostsdir = g_strdup_printf("%s/many.hostsdir", dir);
+    g_autofree char *changed = g_strdup_printf("%s/10.0.4.1", hostsdir);
+    g_autofree char *unchanged = g_strdup_printf("%s/10.0.15.250", hostsdir);
+    g_autoptr(dnsmasqHostsdirCache) cache = NULL;
+    GStatBuf changedBefore;
+    GStatBuf changedAfter;
+    GStatBuf unchangedBefore;
+    GStatBuf unchangedAfter;
+    bool reload = false;
+
+    if (testSaveMany(dir, &cache, -1, &reload) < 0)
+        return -1;
+
+    if (g_stat(changed, &changedBefore) < 0 ||
+        g_stat(unchanged, &unchangedBefore) < 0) {
+        VIR_TEST_DEBUG("Host files were not created");
+        return -1;
+    }
+
+    /* the host with index 1000 is 10.0.4.1 */
+    if (testSaveMany(dir, &cache, 1000, &reload) < 0)
+        return -1;
+
+    if (!reload) {
+        VIR_TEST_DEBUG("Renaming a DHCP host did not require a reload");
+        return -1;
+    }
+
+    if (testCheckFile(hostsdir, "10.0.4.1", "new1000,10.0.4.1\n") < 0)
+        return -1;
+
+    if (g_stat(changed, &changedAfter) < 0 ||
+        g_stat(unchanged, &unchangedAfter) < 0)
+        return -1;
+
+    if (changedAfter.st_ino == changedBefore.st_ino) {
+        VIR_TEST_DEBUG("File of the changed host was not replaced");
+        return -1;
+    }
+
+    if (unchangedAfter.st_ino != unchangedBefore.st_ino) {
+        VIR_TEST_DEBUG("File of an unchanged host was rewritten");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create virdnsmasqdir");
+        abort();
+    }
+
+    if (virTestRun("hosts directory", testHostsDir, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("many hosts", testManyHosts, scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,37 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "virtime.h"
+#include "virstring.h"
+
+/* Reports the current time moved back by VIR_DOMAIN_JOB_MOCK_TIME_SHIFT
+ * milliseconds so that tests don't have to wait the full job timeout. */
+int
+virTimeMillisNow(unsigned long long *now)
+{
+    const char *shift = g_getenv("VIR_DOMAIN_JOB_MOCK_TIME_SHIFT");
+    unsigned long long ms = 0;
+
+    *now = g_get_real_time() / 1000;
+
+    if (shift && virStrToLong_ull(shift, NULL, 10, &ms) == 0)
+        *now -= ms;
+
+    return 0;
+}
@@ -0,0 +1,457 @@
+/*
+ * virdomainjobtest.c: Test acquiring domain jobs
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "domain_conf.h"
+#include "virdomainjob.h"
+#include "virmetrics.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virDomainXMLOption *xmlopt;
+
+/* Jobs asked for by two threads and the expected order in which the
+ * threads get them */
+struct testHandOverData {
+    virDomainJob jobs[2];
+    int order[2];
+};
+
+struct testJobThread {
+    virDomainObj *obj;
+    virDomainJob job;
+    virDomainAgentJob agentJob;
+    int id;
+    int *order;
+    size_t *norder;
+    int rc;
+    int error;
+};
+
+
+static void
+testEndJob(virDomainObj *obj,
+           virDomainJob job,
+           virDomainAgentJob agentJob)
+{
+    /* Both end functions decrement jobsQueued, which was incremented
+     * only once when both jobs were started together */
+    if (job && agentJob)
+        obj->job->jobsQueued++;
+
+    if (agentJob)
+        virDomainObjEndAgentJob(obj);
+    if (job)
+        virDomainObjEndJob(obj);
+}
+
+
+static void
+testJobThreadRun(void *opaque)
+{
+    struct testJobThread *data = opaque;
+
+    virObjectLock(data->obj);
+
+    data->rc = virDomainObjBeginJobInternal(data->obj, data->obj->job,
+                                            data->job, data->agentJob,
+                                            VIR_ASYNC_JOB_NONE, false);
+    if (data->rc == 0) {
+        data->order[(*data->norder)++] = data->id;
+        testEndJob(data->obj, data->job, data->agentJob);
+    } else {
+        data->error = virGetLastErrorCode();
+        virResetLastError();
+    }
+
+    virObjectUnlock(data->obj);
+}
+
+
+/* Waits until @count threads wait for a job of unlocked @obj */
+static int
+testWaitForWaiters(virDomainObj *obj,
+                   size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < 1000; i++) {
+        size_t waiting;
+
+        virObjectLock(obj);
+        waiting = obj->job->jobsWaiting + obj->job->agentJobsWaiting;
+        virObjectUnlock(obj);
+
+        if (waiting == count)
+            return 0;
+
+        g_usleep(10 * 1000);
+    }
+
+    VIR_TEST_DEBUG("Expected %zu waiting threads", count);
+    return -1;
+}
+
+
+static unsigned long long
+testGetMetric(const char *name)
+{
+    g_autoptr(virTypedParamList) list = virTypedParamListNew();
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+    unsigned long long val = 0;
+
+    virMetricsGetParams(list);
+
+    if (virTypedParamListFetch(list, &params, &nparams) < 0)
+        return 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, name, &val));
+    return val;
+}
+
+
+static virDomainObj *
+testNewDomain(void)
+{
+    virDomainObj *obj;
+
+    if (!(obj = virDomainObjNew(xmlopt)))
+        return NULL;
+
+    obj->def = virDomainDefNew(xmlopt);
+    obj->def->name = g_strdup("test");
+
+    return obj;
+}
+
+
+/* Checks that jobs are handed over to waiting threads in the expected order */
+static int
+testHandOver(const void *opaque)
+{
+    const struct testHandOverData *expected = opaque;
+    virDomainObj *obj = NULL;
+    struct testJobThread data[2] = { 0 };
+    virThread threads[2];
+    size_t nthreads = 0;
+    int order[2] = { 0 };
+    size_t norder = 0;
+    int ret = -1;
+    size_t i;
+
+    if (!(obj = testNewDomain()))
+        return -1;
+
+    if (virDomainObjBeginJob(obj, VIR_JOB_MODIFY) < 0)
+        goto cleanup;
+    virObjectUnlock(obj);
+
+    for (i = 0; i < G_N_ELEMENTS(data); i++) {
+        data[i].obj = obj;
+        data[i].job = expected->jobs[i];
+        data[i].id = i + 1;
+        data[i].order = order;
+        data[i].norder = &norder;
+
+        if (virThreadCreate(&threads[i], true, testJobThreadRun, &data[i]) < 0)
+            break;
+        nthreads++;
+
+        if (testWaitForWaiters(obj, i + 1) < 0)
+            break;
+    }
+
+    virObjectLock(obj);
+    virDomainObjEndJob(obj);
+    virObjectUnlock(obj);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virObjectLock(obj);
+
+    if (nthreads != G_N_ELEMENTS(data) || norder != G_N_ELEMENTS(data))
+        goto cleanup;
+
+    for (i = 0; i < norder; i++) {
+        if (data[i].rc < 0 || order[i] != expected->order[i]) {
+            VIR_TEST_DEBUG("Job %zu was started by thread %d, expected %d",
+                           i, order[i], expected->order[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainObjEndAPI(&obj);
+    return ret;
+}
+
+
+static int
+testFailBusyQueries(const void *opaque G_GNUC_UNUSED)
+{
+    virDomainObj *obj = NULL;
+    unsigned long long waits = testGetMetric("domain.job_wait.query.count");
+    unsigned long long busy = testGetMetric("domain.job_wait.query.busy.count");
+    int ret = -1;
+
+    if (!(obj = testNewDomain()))
+        return -1;
+
+    obj->job->failBusyQueries = true;
+
+    if (virDomainObjBeginJob(obj, VIR_JOB_QUERY) < 0)
+        goto cleanup;
+
+    if (virDomainObjBeginJob(obj, VIR_JOB_QUERY) == 0) {
+        VIR_TEST_DEBUG("Query job was started twice");
+        virDomainObjEndJob(obj);
+        virDomainObjEndJob(obj);
+        goto cleanup;
+    }
+
+    virDomainObjEndJob(obj);
+
+    if (virGetLastErrorCode() != VIR_ERR_RESOURCE_BUSY) {
+        VIR_TEST_DEBUG("Expected 'resource busy' error");
+        goto cleanup;
+    }
+
+    if (obj->job->jobsWaiting != 0 || obj->job->jobsQueued != 0) {
+        VIR_TEST_DEBUG("Busy query was left in the queue");
+        goto cleanup;
+    }
+
+    if (testGetMetric("domain.job_wait.query.count") - waits != 1 ||
+        testGetMetric("domain.job_wait.query.busy.count") - busy != 1) {
+        VIR_TEST_DEBUG("Wait for the job or the busy error was not recorded");
+        goto cleanup;
+    }
+
+    virResetLastError();
+    ret = 0;
+
+ cleanup:
+    virDomainObjEndAPI(&obj);
+    return ret;
+}
+
+
+/* A thread waiting for both a job and an agent job because the agent job
+ * is taken must not block threads which want just the free job */
+static int
+testAgentMix(const void *opaque G_GNUC_UNUSED)
+{
+    virDomainObj *obj = NULL;
+    int order[2] = { 0 };
+    size_t norder = 0;
+    struct testJobThread both = {
+        .job = VIR_JOB_MODIFY, .agentJob = VIR_AGENT_JOB_MODIFY,
+        .id = 1, .order = order, .norder = &norder,
+    };
+    struct testJobThread query = {
+        .job = VIR_JOB_QUERY,
+        .id = 2, .order = order, .norder = &norder,
+    };
+    virThread bothThread;
+    virThread queryThread;
+    bool bothStarted = false;
+    bool agentJob = false;
+    int ret = -1;
+
+    if (!(obj = testNewDomain()))
+        return -1;
+
+    both.obj = query.obj = obj;
+
+    if (virDomainObjBeginAgentJob(obj, VIR_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
+    agentJob = true;
+    virObjectUnlock(obj);
+
+    if (virThreadCreate(&bothThread, true, testJobThreadRun, &both) < 0) {
+        virObjectLock(obj);
+        goto cleanup;
+    }
+    bothStarted = true;
+
+    if (testWaitForWaiters(obj, 2) < 0 ||
+        virThreadCreate(&queryThread, true, testJobThreadRun, &query) < 0) {
+        virObjectLock(obj);
+        goto cleanup;
+    }
+
+    /* Must not wait for the agent job to end */
+    virThreadJoin(&queryThread);
+    virObjectLock(obj);
+
+    if (query.rc < 0 || norder != 1 || order[0] != query.id) {
+        VIR_TEST_DEBUG("Query job waited behind job with agent");
+        goto cleanup;
+    }
+
+    virDomainObjEndAgentJob(obj);
+    agentJob = false;
+    virObjectUnlock(obj);
+
+    virThreadJoin(&bothThread);
+    bothStarted = false;
+    virObjectLock(obj);
+
+    if (both.rc < 0 || norder != 2 || order[1] != both.id) {
+        VIR_TEST_DEBUG("Job with agent wasn't started");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (agentJob)
+        virDomainObjEndAgentJob(obj);
+    if (bothStarted) {
+        virObjectUnlock(obj);
+        virThreadJoin(&bothThread);
+        virObjectLock(obj);
+    }
+    virDomainObjEndAPI(&obj);
+    return ret;
+}
+
+
+/* A thread which times out leaves the queue without affecting others */
+static int
+testTimeout(const void *opaque G_GNUC_UNUSED)
+{
+    virDomainObj *obj = NULL;
+    int order[2] = { 0 };
+    size_t norder = 0;
+    struct testJobThread data[2] = {
+        { .job = VIR_JOB_QUERY, .id = 1, .order = order, .norder = &norder },
+        { .job = VIR_JOB_QUERY, .id = 2, .order = order, .norder = &norder },
+    };
+    virThread threads[2];
+    size_t nthreads = 0;
+    bool timedOut = false;
+    unsigned long long timeouts = testGetMetric("domain.job_wait.query.timeout.count");
+    int ret = -1;
+    size_t i;
+
+    if (!(obj = testNewDomain()))
+        return -1;
+
+    if (virDomainObjBeginJob(obj, VIR_JOB_MODIFY) < 0)
+        goto cleanup;
+    virObjectUnlock(obj);
+
+    for (i = 0; i < G_N_ELEMENTS(data); i++) {
+        data[i].obj = obj;
+
+        /* The first thread gives up after a second instead of the usual
+         * 30 seconds, the other one waits for the job */
+        if (i == 0)
+            g_setenv("VIR_DOMAIN_JOB_MOCK_TIME_SHIFT", "29000", TRUE);
+
+        if (virThreadCreate(&threads[i], true, testJobThreadRun, &data[i]) < 0)
+            break;
+        nthreads++;
+
+        if (testWaitForWaiters(obj, i + 1) < 0)
+            break;
+
+        g_unsetenv("VIR_DOMAIN_JOB_MOCK_TIME_SHIFT");
+    }
+    g_unsetenv("VIR_DOMAIN_JOB_MOCK_TIME_SHIFT");
+
+    if (nthreads > 0)
+        virThreadJoin(&threads[0]);
+
+    virObjectLock(obj);
+
+    if (data[0].rc != -2 || data[0].error != VIR_ERR_OPERATION_TIMEOUT) {
+        VIR_TEST_DEBUG("Expected the first job to time out");
+    } else if (obj->job->jobsWaiting != nthreads - 1 ||
+               obj->job->jobsQueued != (int) nthreads) {
+        VIR_TEST_DEBUG("Timed out thread was left in the queue");
+    } else if (testGetMetric("domain.job_wait.query.timeout.count") - timeouts != 1) {
+        VIR_TEST_DEBUG("Wait which timed out was not recorded");
+    } else {
+        timedOut = true;
+    }
+
+    virDomainObjEndJob(obj);
+    virObjectUnlock(obj);
+
+    for (i = 1; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virObjectLock(obj);
+
+    if (!timedOut || nthreads != G_N_ELEMENTS(data))
+        goto cleanup;
+
+    if (data[1].rc < 0 || norder != 1 || order[0] != data[1].id) {
+        VIR_TEST_DEBUG("Job wasn't handed over after the other waiter timed out");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainObjEndAPI(&obj);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    struct testHandOverData fifo = {
+        { VIR_JOB_MODIFY, VIR_JOB_QUERY }, { 1, 2 },
+    };
+    struct testHandOverData destroy = {
+        { VIR_JOB_QUERY, VIR_JOB_DESTROY }, { 2, 1 },
+    };
+
+    if (!(xmlopt = virDomainXMLOptionNew(NULL, NULL, NULL, NULL, NULL, NULL)))
+        return EXIT_FAILURE;
+
+    virMetricsSetEnabled(true);
+
+    if (virTestRun("hand over in order", testHandOver, &fifo) < 0)
+        ret = -1;
+    if (virTestRun("hand over destroy first", testHandOver, &destroy) < 0)
+        ret = -1;
+    if (virTestRun("fail busy queries", testFailBusyQueries, NULL) < 0)
+        ret = -1;
+    if (virTestRun("agent job does not block job", testAgentMix, NULL) < 0)
+        ret = -1;
+    if (virTestRun("time out waiting for job", testTimeout, NULL) < 0)
+        ret = -1;
+
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virdomainjob"))
@@ -329,6 +329,58 @@ testFileIsSharedFSType(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static int
+testFileACLsRoundTrip(const void *opaque G_GNUC_UNUSED)
+{
+#ifndef WITH_LIBACL
+    return EXIT_AM_SKIP;
+#else
+    const char *file = abs_srcdir "/virfiletest.c";
+    void *acl = NULL;
+    void *parsed = NULL;
+    void *garbage = NULL;
+    g_autofree char *str = NULL;
+    g_autofree char *reformatted = NULL;
+    int ret = -1;
+
+    if (virFileGetACLs(file, &acl) < 0) {
+        if (errno == ENOTSUP)
+            return EXIT_AM_SKIP;
+
+        fprintf(stderr, "Unable to get ACLs of %s: %s\n", file, g_strerror(errno));
+        return -1;
+    }
+
+    if (!(str = virFileFormatACLs(acl)) ||
+        virFileParseACLs(str, &parsed) < 0 ||
+        !(reformatted = virFileFormatACLs(parsed))) {
+        fprintf(stderr, "Unable to format or parse ACLs: %s\n", g_strerror(errno));
+        goto cleanup;
+    }
+
+    if (STRNEQ(str, reformatted)) {
+        fprintf(stderr, "ACLs changed after round trip: '%s' vs '%s'\n",
+                str, reformatted);
+        goto cleanup;
+    }
+
+    if (virFileParseACLs("", &garbage) == 0 ||
+        virFileParseACLs("Zm9v", &garbage) == 0) {
+        fprintf(stderr, "Malformed ACLs were parsed\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virFileFreeACLs(&acl);
+    virFileFreeACLs(&parsed);
+    virFileFreeACLs(&garbage);
+    return ret;
+#endif
+}
+
+
 static int
 mymain(void)
 {
@@ -439,6 +491,9 @@ mymain(void)
     DO_TEST_FILE_IS_SHARED_FS_TYPE("mounts3.txt", "/gpfs/data", true);
     DO_TEST_FILE_IS_SHARED_FS_TYPE("mounts3.txt", "/quobyte", true);
 
+    if (virTestRun("ACLs round trip", testFileACLsRoundTrip, NULL) < 0)
+        ret = -1;
+
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
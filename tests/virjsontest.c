@@ -272,6 +272,152 @@ testJSONLookup(const void *data)
 }
 
 
+/* Objects with many members are looked up via a hash table index which
+ * must be kept in sync with the members. */
+static int
+testJSONLookupMany(const void *data G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virJSONValue) json = NULL;
+    g_autoptr(virJSONValue) copy = NULL;
+    g_autoptr(virJSONValue) removed = NULL;
+    g_autofree char *doc = NULL;
+    size_t nkeys = 100;
+    size_t i;
+
+    virBufferAddLit(&buf, "{");
+    for (i = 0; i < nkeys; i++)
+        virBufferAsprintf(&buf, "\"key%zu\": %zu, ", i, i);
+    virBufferAddLit(&buf, "\"key0\": 42}");
+    doc = virBufferContentAndReset(&buf);
+
+    if (!(json = virJSONValueFromString(doc)))
+        return -1;
+
+    if (virJSONValueObjectKeysNumber(json) != (int) nkeys) {
+        VIR_TEST_VERBOSE("duplicate key was not merged");
+        return -1;
+    }
+
+    for (i = 0; i < nkeys; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i);
+        unsigned long long expect = i == 0 ? 42 : i;
+        unsigned long long value;
+
+        if (virJSONValueObjectGetNumberUlong(json, key, &value) < 0 ||
+            value != expect) {
+            VIR_TEST_VERBOSE("lookup for '%s' failed", key);
+            return -1;
+        }
+    }
+
+    if (virJSONValueObjectRemoveKey(json, "key50", &removed) != 1 ||
+        virJSONValueObjectHasKey(json, "key50") ||
+        virJSONValueObjectGet(json, "key50")) {
+        VIR_TEST_VERBOSE("removed key 'key50' is still present");
+        return -1;
+    }
+
+    if (virJSONValueObjectPrependString(json, "key50", "back") < 0 ||
+        virJSONValueObjectAppendString(json, "new", "value") < 0)
+        return -1;
+
+    if (!(copy = virJSONValueCopy(json)))
+        return -1;
+
+    if (STRNEQ_NULLABLE(virJSONValueObjectGetString(copy, "key50"), "back") ||
+        STRNEQ_NULLABLE(virJSONValueObjectGetString(copy, "new"), "value") ||
+        virJSONValueObjectHasKey(copy, "key100")) {
+        VIR_TEST_VERBOSE("lookup in modified object failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Values created by the parser keep their strings and numbers in the
+ * same allocation and containers are trimmed to their size. Subtrees
+ * stolen from a reply must stay valid after the reply is freed and must
+ * still grow when modified. */
+static int
+testJSONParseReply(const void *data G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virJSONValue) reply = NULL;
+    g_autoptr(virJSONValue) result = NULL;
+    g_autoptr(virJSONValue) copy = NULL;
+    g_autofree char *doc = NULL;
+    g_autofree char *resultstr = NULL;
+    g_autofree char *copystr = NULL;
+    size_t nvalues = 200;
+    size_t i;
+
+    virBufferAddLit(&buf, "{\"return\": [");
+    for (i = 0; i < nvalues; i++) {
+        virBufferAsprintf(&buf,
+                          "%s{\"node-name\": \"node%zu\", "
+                          "\"file\": \"/var/lib/\\\"img%zu\\\"\", "
+                          "\"size\": %zu}",
+                          i ? ", " : "", i, i, i * 1024);
+    }
+    virBufferAddLit(&buf, "], \"id\": \"libvirt-42\"}");
+    doc = virBufferContentAndReset(&buf);
+
+    if (!(reply = virJSONValueFromString(doc)))
+        return -1;
+
+    if (!(result = virJSONValueObjectStealArray(reply, "return"))) {
+        VIR_TEST_VERBOSE("reply has no 'return' array");
+        return -1;
+    }
+
+    g_clear_pointer(&reply, virJSONValueFree);
+
+    if (virJSONValueArraySize(result) != nvalues) {
+        VIR_TEST_VERBOSE("expected %zu values, got %zu",
+                         nvalues, virJSONValueArraySize(result));
+        return -1;
+    }
+
+    for (i = 0; i < nvalues; i++) {
+        virJSONValue *val = virJSONValueArrayGet(result, i);
+        g_autofree char *name = g_strdup_printf("node%zu", i);
+        g_autofree char *file = g_strdup_printf("/var/lib/\"img%zu\"", i);
+        unsigned long long size;
+
+        if (STRNEQ_NULLABLE(virJSONValueObjectGetString(val, "node-name"), name) ||
+            STRNEQ_NULLABLE(virJSONValueObjectGetString(val, "file"), file) ||
+            virJSONValueObjectGetNumberUlong(val, "size", &size) < 0 ||
+            size != i * 1024) {
+            VIR_TEST_VERBOSE("value %zu was not parsed correctly", i);
+            return -1;
+        }
+    }
+
+    /* containers trimmed by the parser grow again */
+    if (virJSONValueArrayAppendString(result, "appended") < 0 ||
+        virJSONValueObjectAppendString(virJSONValueArrayGet(result, 0),
+                                       "driver", "qcow2") < 0)
+        return -1;
+
+    if (!(copy = virJSONValueCopy(result)))
+        return -1;
+
+    if (!(resultstr = virJSONValueToString(result, false)) ||
+        !(copystr = virJSONValueToString(copy, false)))
+        return -1;
+
+    if (STRNEQ(resultstr, copystr)) {
+        if (virTestGetVerbose())
+            virTestDifference(stderr, resultstr, copystr);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 testJSONCopy(const void *data)
 {
@@ -468,6 +614,109 @@ testJSONObjectFormatSteal(const void *opaque G_GNUC_UNUSED)
 }
 
 
+/* Every member of an object has to be found by a lookup, whether the
+ * object is scanned linearly or has an index. */
+static int
+testJSONCheckLookups(virJSONValue *value)
+{
+    int nkeys;
+    size_t i;
+
+    switch (virJSONValueGetType(value)) {
+    case VIR_JSON_TYPE_OBJECT:
+        nkeys = virJSONValueObjectKeysNumber(value);
+
+        for (i = 0; i < (size_t) nkeys; i++) {
+            const char *key = virJSONValueObjectGetKey(value, i);
+            virJSONValue *member = virJSONValueObjectGetValue(value, i);
+
+            if (virJSONValueObjectGet(value, key) != member) {
+                VIR_TEST_VERBOSE("lookup of '%s' in object with %d keys failed",
+                                 key, nkeys);
+                return -1;
+            }
+
+            if (testJSONCheckLookups(member) < 0)
+                return -1;
+        }
+        break;
+
+    case VIR_JSON_TYPE_ARRAY:
+        for (i = 0; i < virJSONValueArraySize(value); i++) {
+            if (testJSONCheckLookups(virJSONValueArrayGet(value, i)) < 0)
+                return -1;
+        }
+        break;
+
+    case VIR_JSON_TYPE_STRING:
+    case VIR_JSON_TYPE_NUMBER:
+    case VIR_JSON_TYPE_BOOLEAN:
+    case VIR_JSON_TYPE_NULL:
+        break;
+    }
+
+    return 0;
+}
+
+
+/* Parses the QMP replies recorded in a capabilities file, which contain
+ * objects with hundreds of members, and checks that the lookups and the
+ * formatted documents are stable. */
+static int
+testJSONParseReplies(const void *data)
+{
+    const struct testInfo *info = data;
+    g_autofree char *file = NULL;
+    g_autofree char *replies = NULL;
+    g_auto(GStrv) docs = NULL;
+    size_t nparsed = 0;
+    size_t i;
+
+    file = g_strdup_printf("%s/qemucapabilitiesdata/%s.replies",
+                           abs_srcdir, info->doc);
+
+    if (virTestLoadFile(file, &replies) < 0)
+        return -1;
+
+    docs = g_strsplit(replies, "\n\n", 0);
+
+    for (i = 0; docs[i]; i++) {
+        g_autoptr(virJSONValue) json = NULL;
+        g_autoptr(virJSONValue) reparsed = NULL;
+        g_autofree char *formatted = NULL;
+        g_autofree char *reformatted = NULL;
+
+        if (virStringIsEmpty(docs[i]))
+            continue;
+
+        if (!(json = virJSONValueFromString(docs[i]))) {
+            VIR_TEST_VERBOSE("failed to parse reply %zu of '%s'", i, file);
+            return -1;
+        }
+
+        if (testJSONCheckLookups(json) < 0)
+            return -1;
+
+        if (!(formatted = virJSONValueToString(json, false)) ||
+            !(reparsed = virJSONValueFromString(formatted)) ||
+            !(reformatted = virJSONValueToString(reparsed, false)))
+            return -1;
+
+        if (STRNEQ(formatted, reformatted)) {
+            if (virTestGetVerbose())
+                virTestDifference(stderr, formatted, reformatted);
+            return -1;
+        }
+
+        nparsed++;
+    }
+
+    VIR_TEST_DEBUG("parsed %zu replies of '%s'", nparsed, file);
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -575,6 +824,23 @@ mymain(void)
                        "[ {[\"key1\", \"key2\"]: \"value\"} ]");
     DO_TEST_PARSE_FAIL("object with unterminated key", "{ \"key:7 }");
 
+    DO_TEST_PARSE("unicode escapes", "[\"\\u0041\\u00e9\\ud83d\\ude00\"]",
+                  "[\"A\xc3\xa9\xf0\x9f\x98\x80\"]");
+    DO_TEST_PARSE("unpaired surrogate", "[\"\\ud83d\"]", "[\"\xef\xbf\xbd\"]");
+    DO_TEST_PARSE("duplicate keys", "{\"a\":1,\"b\":2,\"a\":3}",
+                  "{\"a\":3,\"b\":2}");
+    DO_TEST_PARSE("nested 32 levels",
+                  "[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]",
+                  NULL);
+    DO_TEST_PARSE_FAIL("nested 33 levels",
+                       "[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]");
+    DO_TEST_PARSE_FAIL("number with leading zero", "[ 01 ]");
+    DO_TEST_PARSE_FAIL("number without fraction", "[ 1. ]");
+    DO_TEST_PARSE_FAIL("control character in string", "[\"a\tb\"]");
+    DO_TEST_PARSE_FAIL("invalid escape", "[\"\\x\"]");
+    DO_TEST_PARSE_FAIL("trailing comma in array", "[ 1, ]");
+    DO_TEST_PARSE_FAIL("trailing comma in object", "{ \"a\": 1, }");
+
     DO_TEST_FULL("lookup on array", Lookup,
                  "[ 1 ]", NULL, false);
     DO_TEST_FULL("lookup on string", Lookup,
@@ -587,6 +853,12 @@ mymain(void)
     DO_TEST_FULL("lookup with correct type", Lookup,
                  "{ \"a\": {}, \"b\": 1, \"c\": \"str\", \"d\": [] }",
                  NULL, true);
+    DO_TEST_FULL("lookup in object with many keys", LookupMany,
+                 NULL, NULL, true);
+    DO_TEST_FULL("parse reply and steal its result", ParseReply,
+                 NULL, NULL, true);
+    DO_TEST_FULL("parse QMP replies of QEMU 10.0.0", ParseReplies,
+                 "caps_10.0.0_x86_64", NULL, true);
     DO_TEST_FULL("create object with nested json in attribute", EscapeObj,
                  NULL, NULL, true);
     DO_TEST_FULL("stealing of attributes while creating objects",
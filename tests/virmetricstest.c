@@ -0,0 +1,206 @@
+/*
+ * virmetricstest.c: Test latency histograms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virmetrics.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+static int
+testCheckParam(virTypedParameterPtr params,
+               size_t nparams,
+               const char *name,
+               unsigned long long expected)
+{
+    unsigned long long value;
+
+    if (virTypedParamsGetULLong(params, nparams, name, &value) != 1) {
+        VIR_TEST_DEBUG("Missing parameter %s", name);
+        return -1;
+    }
+
+    if (value != expected) {
+        VIR_TEST_DEBUG("Expected %s=%llu, got %llu", name, expected, value);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testHistogram(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virTypedParamList) list = virTypedParamListNew();
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+    virMetricsHistogram *hist = virMetricsHistogramGet("test.%s", "hist");
+
+    /* The same name gives the same histogram */
+    if (hist != virMetricsHistogramGet("test.hist")) {
+        VIR_TEST_DEBUG("Histogram was registered twice");
+        return -1;
+    }
+
+    virMetricsHistogramAdd(hist, 0);
+    virMetricsHistogramAdd(hist, 1);
+    virMetricsHistogramAdd(hist, 5);
+    virMetricsHistogramAdd(hist, 7);
+    virMetricsHistogramAdd(hist, 1ULL << 40);
+
+    virMetricsGetParams(list);
+
+    if (virTypedParamListFetch(list, &params, &nparams) < 0)
+        return -1;
+
+    if (testCheckParam(params, nparams, "test.hist.count", 5) < 0 ||
+        testCheckParam(params, nparams, "test.hist.sum", 13 + (1ULL << 40)) < 0 ||
+        testCheckParam(params, nparams, "test.hist.max", 1ULL << 40) < 0 ||
+        testCheckParam(params, nparams, "test.hist.bucket.1", 1) < 0 ||
+        testCheckParam(params, nparams, "test.hist.bucket.2", 1) < 0 ||
+        testCheckParam(params, nparams, "test.hist.bucket.8", 2) < 0 ||
+        testCheckParam(params, nparams, "test.hist.bucket.inf", 1) < 0)
+        return -1;
+
+    /* Empty buckets are not reported */
+    if (virTypedParamsGet(params, nparams, "test.hist.bucket.4")) {
+        VIR_TEST_DEBUG("Empty bucket was reported");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Histograms owned by objects are reported only by their owner */
+static int
+testOwnedHistogram(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virTypedParamList) global = virTypedParamListNew();
+    g_autoptr(virTypedParamList) owned = virTypedParamListNew();
+    g_autoptr(virMetricsHistogram) hist = virMetricsHistogramNew("test.%s", "owned");
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+
+    virMetricsHistogramAdd(hist, 3);
+    virMetricsHistogramAdd(hist, 4);
+
+    virMetricsGetParams(global);
+    if (virTypedParamListFetch(global, &params, &nparams) < 0)
+        return -1;
+
+    if (virTypedParamsGet(params, nparams, "test.owned.count")) {
+        VIR_TEST_DEBUG("Owned histogram was reported globally");
+        return -1;
+    }
+
+    virMetricsHistogramGetParams(hist, owned);
+    if (virTypedParamListFetch(owned, &params, &nparams) < 0)
+        return -1;
+
+    if (testCheckParam(params, nparams, "test.owned.count", 2) < 0 ||
+        testCheckParam(params, nparams, "test.owned.sum", 7) < 0 ||
+        testCheckParam(params, nparams, "test.owned.max", 4) < 0 ||
+        testCheckParam(params, nparams, "test.owned.bucket.4", 1) < 0 ||
+        testCheckParam(params, nparams, "test.owned.bucket.8", 1) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static void
+testSourceGetParams(virTypedParamList *list)
+{
+    virTypedParamListAddULLong(list, 42, "test.source.counter");
+}
+
+
+static int
+testSource(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virTypedParamList) list = virTypedParamListNew();
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+
+    virMetricsRegisterSource(testSourceGetParams);
+
+    virMetricsGetParams(list);
+
+    if (virTypedParamListFetch(list, &params, &nparams) < 0)
+        return -1;
+
+    if (testCheckParam(params, nparams, "test.source.counter", 42) < 0)
+        return -1;
+
+    /* Sources are reported after histograms */
+    if (nparams == 0 ||
+        STRNEQ(params[nparams - 1].field, "test.source.counter")) {
+        VIR_TEST_DEBUG("Source was not reported last");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testEnabled(const void *opaque G_GNUC_UNUSED)
+{
+    if (virMetricsIsEnabled()) {
+        VIR_TEST_DEBUG("Metrics are enabled by default");
+        return -1;
+    }
+
+    virMetricsSetEnabled(true);
+    if (!virMetricsIsEnabled()) {
+        VIR_TEST_DEBUG("Metrics were not enabled");
+        return -1;
+    }
+
+    virMetricsSetEnabled(false);
+    if (virMetricsIsEnabled()) {
+        VIR_TEST_DEBUG("Metrics were not disabled");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("histogram", testHistogram, NULL) < 0)
+        ret = -1;
+    if (virTestRun("owned histogram", testOwnedHistogram, NULL) < 0)
+        ret = -1;
+    if (virTestRun("source", testSource, NULL) < 0)
+        ret = -1;
+    if (virTestRun("enabled", testEnabled, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,225 @@
+/*
+ * virnumatest.c: Test the built-in NUMA placement engine
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virnuma.h"
+#include "virfilewrapper.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define GiB (1024ULL * 1024)
+
+
+static int
+checkNodeset(virBitmap *nodeset,
+             const char *expected)
+{
+    g_autofree char *actual = NULL;
+
+    if (!nodeset)
+        return -1;
+
+    actual = virBitmapFormat(nodeset);
+
+    if (STRNEQ_NULLABLE(actual, expected)) {
+        VIR_TEST_DEBUG("Expected nodeset '%s', got '%s'",
+                       expected, NULLSTR(actual));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Node 2 is loaded by other guests, node 3 has no CPUs. */
+static const virNumaPlacementNode testNodes[] = {
+    { .id = 0, .ncpus = 4, .memTotal = 4 * GiB, .memFree = 4 * GiB },
+    { .id = 1, .ncpus = 4, .memTotal = 4 * GiB, .memFree = 4 * GiB,
+      .hugeFree = 2 * GiB },
+    { .id = 2, .ncpus = 8, .memTotal = 8 * GiB, .memFree = 2 * GiB,
+      .vcpus = 8, .memory = 6 * GiB },
+    { .id = 3, .ncpus = 0, .memTotal = 16 * GiB, .memFree = 16 * GiB },
+};
+
+struct testChooseData {
+    unsigned int vcpus;
+    unsigned long long memory;
+    bool hugepages;
+    const char *expected;
+};
+
+
+static int
+testChoose(const void *opaque)
+{
+    const struct testChooseData *data = opaque;
+    g_autoptr(virBitmap) nodeset = NULL;
+
+    nodeset = virNumaPlacementChoose(testNodes, G_N_ELEMENTS(testNodes),
+                                     data->vcpus, data->memory,
+                                     data->hugepages);
+
+    return checkNodeset(nodeset, data->expected);
+}
+
+
+static int
+testChooseNoNodes(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virBitmap) nodeset = NULL;
+
+    /* Only the node without CPUs */
+    nodeset = virNumaPlacementChoose(testNodes + 3, 1, 1, GiB, false);
+
+    if (nodeset) {
+        VIR_TEST_DEBUG("Expected failure, got a nodeset");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testHostNodes(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree virNumaPlacementNode *nodes = NULL;
+    size_t nnodes;
+    size_t i;
+
+    if (!(nodes = virNumaPlacementGetHostNodes(2048, &nnodes)))
+        return -1;
+
+    if (nnodes != 4) {
+        VIR_TEST_DEBUG("Expected 4 nodes, got %zu", nnodes);
+        return -1;
+    }
+
+    /* virnumamock reports (id + 1) GiB of memory, 1 GiB of it free, and
+     * (id + 2) * 1024 free 2 MiB pages. Free 1 GiB pages must not be
+     * counted. */
+    for (i = 0; i < nnodes; i++) {
+        if (nodes[i].id != i ||
+            nodes[i].ncpus != 4 ||
+            nodes[i].memTotal != (i + 1) * GiB ||
+            nodes[i].memFree != GiB ||
+            nodes[i].hugeFree != (i + 2) * 2 * GiB) {
+            VIR_TEST_DEBUG("Unexpected data of node %zu", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testPlacement(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virNumaPlacement) placement = NULL;
+    g_autoptr(virBitmap) nodeset = NULL;
+    struct {
+        const char *key;
+        unsigned int vcpus;
+        unsigned long long memory;
+        const char *expected;
+    } guests[] = {
+        /* Nodes are loaded one by one, cheapest first ... */
+        { "g1", 2, GiB / 2, "0" },
+        { "g2", 2, GiB / 2, "1" },
+        { "g3", 2, GiB / 2, "2" },
+        { "g4", 2, GiB / 2, "3" },
+        /* ... then the cheapest node still fitting the guest ... */
+        { "g5", 2, GiB / 2, "0" },
+        /* ... guests are not accounted against themselves ... */
+        { "g2", 2, GiB / 2, "1" },
+        /* ... and large guests are spread over multiple nodes. */
+        { "g6", 8, 3 * GiB, "1-3" },
+        { "g7", 64, 3 * GiB, "0-3" },
+    };
+    size_t i;
+
+    if (!(placement = virNumaPlacementNew()))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(guests); i++) {
+        g_clear_pointer(&nodeset, virBitmapFree);
+
+        nodeset = virNumaPlacementPlace(placement, guests[i].key,
+                                        guests[i].vcpus, guests[i].memory,
+                                        0);
+
+        if (checkNodeset(nodeset, guests[i].expected) < 0) {
+            VIR_TEST_DEBUG("Placement of %s failed", guests[i].key);
+            return -1;
+        }
+    }
+
+    /* Once guests are gone their nodes become cheap again. */
+    for (i = 0; i < G_N_ELEMENTS(guests); i++)
+        virNumaPlacementRemove(placement, guests[i].key);
+
+    g_clear_pointer(&nodeset, virBitmapFree);
+    nodeset = virNumaPlacementPlace(placement, "g8", 2, GiB / 2, 0);
+
+    return checkNodeset(nodeset, "0");
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    g_autofree char *system = NULL;
+
+#define DO_TEST_CHOOSE(name, vcpus, memory, hugepages, expected) \
+    do { \
+        struct testChooseData data = { vcpus, memory, hugepages, expected }; \
+        if (virTestRun("choose " name, testChoose, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* Ties are broken by node ID */
+    DO_TEST_CHOOSE("small", 2, GiB, false, "0");
+    DO_TEST_CHOOSE("small hugepages", 2, GiB, true, "1");
+    /* A single loaded node is preferred over spreading */
+    DO_TEST_CHOOSE("many vcpus", 6, GiB, false, "2");
+    DO_TEST_CHOOSE("spread", 2, 6 * GiB, false, "0-1");
+    DO_TEST_CHOOSE("no fit hugepages", 2, 3 * GiB, true, "0-2");
+
+    if (virTestRun("choose no nodes", testChooseNoNodes, NULL) < 0)
+        ret = -1;
+
+    system = g_strdup_printf("%s/vircaps2xmldata/linux-basic/system",
+                             abs_srcdir);
+    virFileWrapperAddPrefix("/sys/devices/system", system);
+
+    if (virTestRun("host nodes", testHostNodes, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("placement", testPlacement, NULL) < 0)
+        ret = -1;
+
+    virFileWrapperClearPrefixes();
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virnuma"))
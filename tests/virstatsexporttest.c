@@ -0,0 +1,424 @@
+/*
+ * virstatsexporttest.c: Test the shared memory statistics export
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "testutils.h"
+#include "virstatsexport.h"
+#include "virfile.h"
+#include "virtypedparam.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#if WITH_MMAP
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/virstatsexportdir-XXXXXX"
+
+
+static void
+testRecordsFill(virStatsExportRecord *records,
+                size_t nrecords,
+                size_t nparams)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < nrecords; i++) {
+        int maxparams = 0;
+
+        records[i].name = g_strdup_printf("domain-%zu", i);
+
+        for (j = 0; j < nparams; j++) {
+            g_autofree char *field = g_strdup_printf("param.%zu", j);
+            g_autofree char *value = g_strdup_printf("value-%zu-%zu", i, j);
+
+            switch (j % 7) {
+            case 0:
+                virTypedParamsAddInt(&records[i].params, &records[i].nparams,
+                                     &maxparams, field, -(int) j);
+                break;
+            case 1:
+                virTypedParamsAddUInt(&records[i].params, &records[i].nparams,
+                                      &maxparams, field, j);
+                break;
+            case 2:
+                virTypedParamsAddLLong(&records[i].params, &records[i].nparams,
+                                       &maxparams, field, -(1LL << 40));
+                break;
+            case 3:
+                virTypedParamsAddULLong(&records[i].params, &records[i].nparams,
+                                        &maxparams, field, 1ULL << 63);
+                break;
+            case 4:
+                virTypedParamsAddDouble(&records[i].params, &records[i].nparams,
+                                        &maxparams, field, 0.5 * j);
+                break;
+            case 5:
+                virTypedParamsAddBoolean(&records[i].params, &records[i].nparams,
+                                         &maxparams, field, j % 2);
+                break;
+            case 6:
+                virTypedParamsAddString(&records[i].params, &records[i].nparams,
+                                        &maxparams, field, value);
+                break;
+            }
+        }
+    }
+}
+
+
+static int
+testRecordsCompare(virStatsExportRecord *expected,
+                   size_t nexpected,
+                   virStatsExportRecord *actual,
+                   size_t nactual)
+{
+    size_t i;
+    int j;
+
+    if (nexpected != nactual) {
+        VIR_TEST_DEBUG("Expected %zu records, got %zu", nexpected, nactual);
+        return -1;
+    }
+
+    for (i = 0; i < nexpected; i++) {
+        if (STRNEQ(expected[i].name, actual[i].name) ||
+            expected[i].nparams != actual[i].nparams) {
+            VIR_TEST_DEBUG("Record %zu differs", i);
+            return -1;
+        }
+
+        for (j = 0; j < expected[i].nparams; j++) {
+            virTypedParameterPtr e = expected[i].params + j;
+            virTypedParameterPtr a = actual[i].params + j;
+            bool equal = false;
+
+            if (STRNEQ(e->field, a->field) || e->type != a->type) {
+                VIR_TEST_DEBUG("Parameter %d of record %zu differs", j, i);
+                return -1;
+            }
+
+            switch ((virTypedParameterType) e->type) {
+            case VIR_TYPED_PARAM_INT:
+                equal = e->value.i == a->value.i;
+                break;
+            case VIR_TYPED_PARAM_UINT:
+                equal = e->value.ui == a->value.ui;
+                break;
+            case VIR_TYPED_PARAM_LLONG:
+                equal = e->value.l == a->value.l;
+                break;
+            case VIR_TYPED_PARAM_ULLONG:
+                equal = e->value.ul == a->value.ul;
+                break;
+            case VIR_TYPED_PARAM_DOUBLE:
+                equal = e->value.d == a->value.d;
+                break;
+            case VIR_TYPED_PARAM_BOOLEAN:
+                equal = e->value.b == a->value.b;
+                break;
+            case VIR_TYPED_PARAM_STRING:
+                equal = STREQ(e->value.s, a->value.s);
+                break;
+            case VIR_TYPED_PARAM_LAST:
+                break;
+            }
+
+            if (!equal) {
+                VIR_TEST_DEBUG("Value of %s in record %zu differs", e->field, i);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+struct testRoundTripData {
+    const char *dir;
+    size_t nrecords;
+    size_t nparams;
+};
+
+
+static int
+testRoundTrip(const void *opaque)
+{
+    const struct testRoundTripData *data = opaque;
+    g_autofree char *path = g_strdup_printf("%s/domstats", data->dir);
+    g_autoptr(virStatsExport) exp = NULL;
+    virStatsExportRecord *records = NULL;
+    virStatsExportRecord *actual = NULL;
+    size_t nactual = 0;
+    unsigned long long timestamp = 0;
+    int ret = -1;
+
+    records = g_new0(virStatsExportRecord, data->nrecords);
+    testRecordsFill(records, data->nrecords, data->nparams);
+
+    if (!(exp = virStatsExportNew(path, (gid_t)-1)))
+        goto cleanup;
+
+    /* Nothing published yet */
+    if (virStatsExportRead(path, &actual, &nactual, &timestamp) < 0 ||
+        testRecordsCompare(NULL, 0, actual, nactual) < 0)
+        goto cleanup;
+
+    g_clear_pointer(&actual, g_free);
+
+    /* Publishing twice replaces data; the second time with the file
+     * already big enough. */
+    if (virStatsExportPublish(exp, records, data->nrecords) < 0 ||
+        virStatsExportPublish(exp, records, data->nrecords) < 0)
+        goto cleanup;
+
+    if (virStatsExportRead(path, &actual, &nactual, &timestamp) < 0)
+        goto cleanup;
+
+    if (testRecordsCompare(records, data->nrecords, actual, nactual) < 0)
+        goto cleanup;
+
+    if (timestamp == 0) {
+        VIR_TEST_DEBUG("Missing timestamp");
+        goto cleanup;
+    }
+
+    g_clear_pointer(&exp, virStatsExportFree);
+
+    if (virFileExists(path)) {
+        VIR_TEST_DEBUG("File %s not removed", path);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStatsExportRecordsFree(records, data->nrecords);
+    virStatsExportRecordsFree(actual, nactual);
+    return ret;
+}
+
+
+static int
+testHeader(const void *opaque)
+{
+    const char *dir = opaque;
+    g_autofree char *path = g_strdup_printf("%s/header", dir);
+    g_autoptr(virStatsExport) exp = NULL;
+    virStatsExportRecord records[] = { { .name = (char *) "dom" } };
+    virStatsExportHeader hdr;
+    VIR_AUTOCLOSE fd = -1;
+
+    if (!(exp = virStatsExportNew(path, (gid_t)-1)) ||
+        virStatsExportPublish(exp, records, G_N_ELEMENTS(records)) < 0)
+        return -1;
+
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        saferead(fd, &hdr, sizeof(hdr)) != (ssize_t) sizeof(hdr))
+        return -1;
+
+    /* The layout is an ABI shared with readers outside of libvirt */
+    if (memcmp(hdr.magic, "LVSTATS", 8) != 0 ||
+        hdr.version != 1 ||
+        hdr.seq != 2 ||
+        hdr.nrecords != 1 ||
+        hdr.length != 4 + 3 + 4) {
+        VIR_TEST_DEBUG("Unexpected header");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBadMagic(const void *opaque)
+{
+    const char *dir = opaque;
+    g_autofree char *path = g_strdup_printf("%s/badmagic", dir);
+    char buf[VIR_STATS_EXPORT_HEADER_SIZE] = "NOSTATS";
+    virStatsExportRecord *records = NULL;
+    size_t nrecords = 0;
+    unsigned long long timestamp;
+    VIR_AUTOCLOSE fd = -1;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, buf, sizeof(buf)) != (ssize_t) sizeof(buf))
+        return -1;
+
+    if (virStatsExportRead(path, &records, &nrecords, &timestamp) == 0) {
+        VIR_TEST_DEBUG("Reading a file with bad magic succeeded");
+        virStatsExportRecordsFree(records, nrecords);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Members of the group passed to virStatsExportNew may read the file */
+static int
+testGroup(const void *opaque)
+{
+    const char *dir = opaque;
+    g_autofree char *path = g_strdup_printf("%s/group", dir);
+    g_autoptr(virStatsExport) exp = NULL;
+    struct stat sb;
+
+    if (!(exp = virStatsExportNew(path, getegid())))
+        return -1;
+
+    if (stat(path, &sb) < 0)
+        return -1;
+
+    if ((sb.st_mode & 0777) != 0640 || sb.st_gid != getegid()) {
+        VIR_TEST_DEBUG("Unexpected mode %o or group %u",
+                       (unsigned int) sb.st_mode & 0777,
+                       (unsigned int) sb.st_gid);
+        return -1;
+    }
+
+    g_clear_pointer(&exp, virStatsExportFree);
+
+    if (!(exp = virStatsExportNew(path, (gid_t)-1)))
+        return -1;
+
+    if (stat(path, &sb) < 0)
+        return -1;
+
+    if ((sb.st_mode & 0777) != 0600) {
+        VIR_TEST_DEBUG("Unexpected mode %o", (unsigned int) sb.st_mode & 0777);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* The public API returns the same records as the internal reader */
+static int
+testPublicRead(const void *opaque)
+{
+    const char *dir = opaque;
+    g_autofree char *path = g_strdup_printf("%s/public", dir);
+    g_autoptr(virStatsExport) exp = NULL;
+    virStatsExportRecord *records = NULL;
+    virStatsExportRecord *actual = NULL;
+    virDomainStatsExportRecordPtr *list = NULL;
+    unsigned long long timestamp = 0;
+    size_t nrecords = 3;
+    int nlist;
+    size_t i;
+    int ret = -1;
+
+    records = g_new0(virStatsExportRecord, nrecords);
+    testRecordsFill(records, nrecords, 7);
+
+    if (!(exp = virStatsExportNew(path, (gid_t)-1)) ||
+        virStatsExportPublish(exp, records, nrecords) < 0)
+        goto cleanup;
+
+    if ((nlist = virDomainStatsExportRead(path, &list, &timestamp, 0)) < 0)
+        goto cleanup;
+
+    if (!list || list[nlist] || timestamp == 0) {
+        VIR_TEST_DEBUG("Records are not NULL terminated or timestamp missing");
+        goto cleanup;
+    }
+
+    /* Compare using the internal record structure */
+    actual = g_new0(virStatsExportRecord, nlist);
+    for (i = 0; i < (size_t) nlist; i++) {
+        actual[i].name = list[i]->name;
+        actual[i].params = list[i]->params;
+        actual[i].nparams = list[i]->nparams;
+    }
+
+    if (testRecordsCompare(records, nrecords, actual, nlist) < 0)
+        goto cleanup;
+
+    if (virDomainStatsExportRead(path, &list, NULL, 1) == 0) {
+        VIR_TEST_DEBUG("Unknown flags were accepted");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    ret = 0;
+
+ cleanup:
+    g_free(actual);
+    virDomainStatsExportRecordListFree(list);
+    virStatsExportRecordsFree(records, nrecords);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create virstatsexportdir");
+        abort();
+    }
+
+# define DO_TEST_ROUND_TRIP(name, nrecords, nparams) \
+    do { \
+        struct testRoundTripData data = { scratchdir, nrecords, nparams }; \
+        if (virTestRun("round trip " name, testRoundTrip, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_ROUND_TRIP("empty", 0, 0);
+    DO_TEST_ROUND_TRIP("no params", 3, 0);
+    DO_TEST_ROUND_TRIP("all types", 2, 14);
+    /* Needs the file to grow beyond the initial mapping */
+    DO_TEST_ROUND_TRIP("large", 200, 300);
+
+    if (virTestRun("header", testHeader, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("bad magic", testBadMagic, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("group", testGroup, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("public read", testPublicRead, scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#else /* !WITH_MMAP */
+
+static int
+mymain(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* !WITH_MMAP */
+
+VIR_TEST_MAIN(mymain)
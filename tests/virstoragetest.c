@@ -25,6 +25,7 @@
 #include "vircommand.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virmetrics.h"
 
 #include "storage/storage_driver.h"
 
@@ -129,6 +130,87 @@ testPrepImages(void)
 }
 
 
+static int
+testStorageHeaderCache(const void *args G_GNUC_UNUSED)
+{
+    const char *path = abs_srcdir "/virstoragetestdata/images/qcow2_raw-raw-relative.qcow2";
+    g_autoptr(virStorageSource) first = NULL;
+    g_autoptr(virStorageSource) second = NULL;
+    g_autoptr(virStorageSource) third = NULL;
+    g_autoptr(virStorageSource) fourth = NULL;
+    unsigned long long prevHits;
+    unsigned long long prevMisses;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long reported;
+    g_autoptr(virTypedParamList) list = virTypedParamListNew();
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+
+    if (!(first = testStorageFileGetMetadata(path, VIR_STORAGE_FILE_QCOW2, -1, -1)))
+        return -1;
+
+    virStorageSourceHeaderCacheGetStats(&prevHits, &prevMisses);
+
+    if (!(second = testStorageFileGetMetadata(path, VIR_STORAGE_FILE_QCOW2, -1, -1)))
+        return -1;
+
+    virStorageSourceHeaderCacheGetStats(&hits, &misses);
+
+    if (hits <= prevHits || misses != prevMisses) {
+        fprintf(stderr, "unchanged chain was not served from the cache\n");
+        return -1;
+    }
+
+    if (STRNEQ_NULLABLE(first->backingStoreRaw, second->backingStoreRaw) ||
+        first->capacity != second->capacity ||
+        !second->backingStore ||
+        STRNEQ_NULLABLE(first->backingStore->path, second->backingStore->path)) {
+        fprintf(stderr, "cached chain differs from the probed one\n");
+        return -1;
+    }
+
+    virStorageSourceHeaderCacheInvalidate(second);
+    prevMisses = misses;
+
+    if (!(third = testStorageFileGetMetadata(path, VIR_STORAGE_FILE_QCOW2, -1, -1)))
+        return -1;
+
+    virStorageSourceHeaderCacheGetStats(&hits, &misses);
+
+    if (misses != prevMisses + 1) {
+        fprintf(stderr, "invalidated image was not read again\n");
+        return -1;
+    }
+
+    /* Headers read by the daemon must not be served to other identities */
+    prevHits = hits;
+
+    if (!(fourth = testStorageFileGetMetadata(path, VIR_STORAGE_FILE_QCOW2,
+                                              getuid(), getgid())))
+        return -1;
+
+    virStorageSourceHeaderCacheGetStats(&hits, &misses);
+
+    if (hits != prevHits) {
+        fprintf(stderr, "header was served to a different uid:gid\n");
+        return -1;
+    }
+
+    virMetricsGetParams(list);
+
+    if (virTypedParamListFetch(list, &params, &nparams) < 0 ||
+        virTypedParamsGetULLong(params, nparams,
+                                "storage.header_cache.hits", &reported) != 1 ||
+        reported != hits) {
+        fprintf(stderr, "cache hits are not reported as metrics\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 enum {
     EXP_PASS = 0,
     EXP_FAIL = 1,
@@ -475,6 +557,9 @@ mymain(void)
                abs_srcdir "/virstoragetestdata/images/qcow2_raw-raw-relative.qcow2",
                VIR_STORAGE_FILE_AUTO, EXP_PASS);
 
+    if (virTestRun("header cache", testStorageHeaderCache, NULL) < 0)
+        ret = -1;
+
     /* qcow2 chain with absolute backing formatted with a real qemu-img */
 
     /* Prep some files with qemu-img; if that is not found on PATH, the test
@@ -18,9 +18,13 @@
 
 
 #include "testutils.h"
+#include "virfile.h"
 #include "virlog.h"
+#include "virmetrics.h"
 
 #include "storage/storage_util.h"
+#define LIBVIRT_STORAGE_UTILPRIV_H_ALLOW
+#include "storage/storage_utilpriv.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -67,6 +71,333 @@ testGlusterExtractPoolSources(const void *opaque)
 }
 
 
+#define TEST_WIPE_FILL 0xAA
+#define TEST_MIB (1024 * 1024)
+
+struct testWipeData {
+    unsigned long long size;
+    off_t start;              /* used when calling the write engine directly */
+    unsigned long long len;
+    bool zero_end;
+    bool direct;              /* call storageBackendWipeLocalWrite */
+};
+
+
+/* Creates @path of @size bytes filled with TEST_WIPE_FILL */
+static int
+testWipeCreateFile(const char *path,
+                   unsigned long long size)
+{
+    g_autofree char *buf = g_new0(char, TEST_MIB);
+    VIR_AUTOCLOSE fd = -1;
+
+    memset(buf, TEST_WIPE_FILL, TEST_MIB);
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+        return -1;
+
+    while (size > 0) {
+        size_t len = MIN(size, TEST_MIB);
+
+        if (safewrite(fd, buf, len) < 0)
+            return -1;
+        size -= len;
+    }
+
+    return 0;
+}
+
+
+/* Checks that only bytes in [start, start + len) of @path were zeroed */
+static int
+testWipeCheckFile(const char *path,
+                  unsigned long long size,
+                  unsigned long long start,
+                  unsigned long long len)
+{
+    g_autofree char *buf = g_new0(char, TEST_MIB);
+    unsigned long long offset = 0;
+    VIR_AUTOCLOSE fd = -1;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+
+    while (offset < size) {
+        ssize_t got;
+        ssize_t i;
+
+        if ((got = saferead(fd, buf, TEST_MIB)) <= 0) {
+            VIR_TEST_DEBUG("File is shorter than %llu bytes", size);
+            return -1;
+        }
+
+        for (i = 0; i < got; i++, offset++) {
+            char expect = 0;
+
+            if (offset < start || offset >= start + len)
+                expect = TEST_WIPE_FILL;
+
+            if (buf[i] != expect) {
+                VIR_TEST_DEBUG("Unexpected byte 0x%02hhx at offset %llu",
+                               buf[i], offset);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/* Regular files are never zeroed by BLKZEROOUT so all the tests below
+ * exercise the fallback to writing zeroes in chunks */
+static int
+testWipeOffloadFallback(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *tmpdir = NULL;
+    g_autofree char *path = NULL;
+    VIR_AUTOCLOSE fd = -1;
+    int ret = -1;
+
+    if (!(tmpdir = g_mkdtemp(g_strdup("/tmp/libvirt_XXXXXX"))))
+        return -1;
+    path = g_strdup_printf("%s/volume", tmpdir);
+
+    if (testWipeCreateFile(path, TEST_MIB) < 0 ||
+        (fd = open(path, O_RDWR)) < 0)
+        goto cleanup;
+
+    if (storageBackendWipeLocalOffload(path, fd, 0, TEST_MIB, NULL) != 1) {
+        VIR_TEST_DEBUG("Regular file wasn't left to the write fallback");
+        goto cleanup;
+    }
+
+    if (testWipeCheckFile(path, TEST_MIB, 0, 0) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    unlink(path);
+    rmdir(tmpdir);
+    return ret;
+}
+
+
+static int
+testWipe(const void *opaque)
+{
+    const struct testWipeData *data = opaque;
+    g_autofree char *tmpdir = NULL;
+    g_autofree char *path = NULL;
+    unsigned long long start = data->start;
+    VIR_AUTOCLOSE fd = -1;
+    int rc;
+    int ret = -1;
+
+    if (!(tmpdir = g_mkdtemp(g_strdup("/tmp/libvirt_XXXXXX"))))
+        return -1;
+    path = g_strdup_printf("%s/volume", tmpdir);
+
+    if (testWipeCreateFile(path, data->size) < 0 ||
+        (fd = open(path, O_RDWR)) < 0)
+        goto cleanup;
+
+    if (data->direct) {
+        rc = storageBackendWipeLocalWrite(path, fd, start, data->len, 4096,
+                                          NULL);
+    } else {
+        rc = storageBackendWipeLocal(path, fd, data->len, 4096, data->zero_end,
+                                     NULL);
+        start = data->zero_end ? data->size - data->len : 0;
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    VIR_FORCE_CLOSE(fd);
+
+    if (testWipeCheckFile(path, data->size, start, data->len) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    unlink(path);
+    rmdir(tmpdir);
+    return ret;
+}
+
+
+/* Progress of a wipe is accounted to its job, which can abort the wipe
+ * once it started zeroing */
+static int
+testWipeJob(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *tmpdir = NULL;
+    g_autofree char *path = NULL;
+    virStorageVolWipeJob *job = NULL;
+    unsigned long long size = 16 * TEST_MIB;
+    VIR_AUTOCLOSE fd = -1;
+    int ret = -1;
+
+    if (!(tmpdir = g_mkdtemp(g_strdup("/tmp/libvirt_XXXXXX"))))
+        return -1;
+    path = g_strdup_printf("%s/volume", tmpdir);
+
+    if (testWipeCreateFile(path, size) < 0 ||
+        (fd = open(path, O_RDWR)) < 0 ||
+        !(job = virStorageVolWipeJobNew()))
+        goto cleanup;
+
+    if (virStorageVolWipeJobAbort(job) == 0) {
+        VIR_TEST_DEBUG("Wipe was aborted before zeroing started");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (storageBackendWipeLocal(path, fd, size, 4096, false, job) < 0)
+        goto cleanup;
+
+    if (job->total != size || job->done != size) {
+        VIR_TEST_DEBUG("Unexpected progress %llu/%llu", job->done, job->total);
+        goto cleanup;
+    }
+
+    if (testWipeCreateFile(path, size) < 0 ||
+        virStorageVolWipeJobAbort(job) < 0)
+        goto cleanup;
+
+    if (storageBackendWipeLocal(path, fd, size, 4096, false, job) == 0) {
+        VIR_TEST_DEBUG("Aborted wipe succeeded");
+        goto cleanup;
+    }
+
+    if (virGetLastErrorCode() != VIR_ERR_OPERATION_ABORTED) {
+        VIR_TEST_DEBUG("Unexpected error: %s", virGetLastErrorMessage());
+        goto cleanup;
+    }
+    virResetLastError();
+
+    /* every worker stops after its first chunk */
+    if (job->done >= size) {
+        VIR_TEST_DEBUG("Aborted wipe zeroed the whole volume");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStorageVolWipeJobFree(job);
+    unlink(path);
+    rmdir(tmpdir);
+    return ret;
+}
+
+
+struct testCopyData {
+    bool sparse;
+};
+
+
+static unsigned long long
+testCopyCount(const char *method)
+{
+    g_autoptr(virTypedParamList) list = virTypedParamListNew();
+    g_autofree char *name = g_strdup_printf("storage.copy.%s.count", method);
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+    unsigned long long count = 0;
+
+    virMetricsGetParams(list);
+
+    if (virTypedParamListFetch(list, &params, &nparams) < 0 ||
+        virTypedParamsGetULLong(params, nparams, name, &count) < 0)
+        return 0;
+
+    return count;
+}
+
+
+/* Copies a file with a hole in its second MiB and checks the hole is
+ * allocated in the copy unless sparse output was allowed */
+static int
+testCopy(const void *opaque)
+{
+    const struct testCopyData *data = opaque;
+    g_autofree char *tmpdir = NULL;
+    g_autofree char *inputpath = NULL;
+    g_autofree char *path = NULL;
+    g_autofree char *buf = g_new0(char, TEST_MIB);
+    virStorageVolDef inputvol = { 0 };
+    virStorageVolDef vol = { 0 };
+    unsigned long long size = 3 * TEST_MIB;
+    unsigned long long remain = size;
+    unsigned long long copies = testCopyCount("read_write");
+    struct stat st;
+    VIR_AUTOCLOSE inputfd = -1;
+    VIR_AUTOCLOSE fd = -1;
+    int ret = -1;
+
+    if (!(tmpdir = g_mkdtemp(g_strdup("/tmp/libvirt_XXXXXX"))))
+        return -1;
+    inputpath = g_strdup_printf("%s/input", tmpdir);
+    path = g_strdup_printf("%s/volume", tmpdir);
+    inputvol.target.path = inputpath;
+    vol.target.path = path;
+
+    memset(buf, TEST_WIPE_FILL, TEST_MIB);
+
+    if ((inputfd = open(inputpath, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(inputfd, buf, TEST_MIB) < 0 ||
+        lseek(inputfd, 2 * TEST_MIB, SEEK_SET) < 0 ||
+        safewrite(inputfd, buf, TEST_MIB) < 0)
+        goto cleanup;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        ftruncate(fd, size) < 0)
+        goto cleanup;
+
+    if (virStorageBackendCopyToFD(&vol, &inputvol, fd, &remain,
+                                  data->sparse, data->sparse, false) < 0)
+        goto cleanup;
+
+    if (remain != 0) {
+        VIR_TEST_DEBUG("%llu bytes were not copied", remain);
+        goto cleanup;
+    }
+
+    if (!data->sparse) {
+        if (fstat(fd, &st) < 0)
+            goto cleanup;
+
+        if ((unsigned long long)st.st_blocks * 512 < size) {
+            VIR_TEST_DEBUG("Only %llu bytes of the copy are allocated",
+                           (unsigned long long)st.st_blocks * 512);
+            goto cleanup;
+        }
+
+        if (testCopyCount("read_write") != copies + 1) {
+            VIR_TEST_DEBUG("The copy wasn't reported as read_write");
+            goto cleanup;
+        }
+    }
+
+    VIR_FORCE_CLOSE(fd);
+
+    if (testWipeCheckFile(path, size, TEST_MIB, TEST_MIB) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    unlink(inputpath);
+    unlink(path);
+    rmdir(tmpdir);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -101,6 +432,43 @@ mymain(void)
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_NETFS
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL
 
+    if (virTestRun("wipe offload fallback", testWipeOffloadFallback, NULL) < 0)
+        ret = -1;
+
+#define DO_TEST_WIPE(testname, ...) \
+    do { \
+        struct testWipeData data = { __VA_ARGS__ }; \
+        if (virTestRun("wipe " testname, testWipe, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* more chunks than concurrent writers and an unaligned tail */
+    DO_TEST_WIPE("whole", .size = 9 * TEST_MIB + 3 * 4096 + 123,
+                 .len = 9 * TEST_MIB + 3 * 4096 + 123);
+    DO_TEST_WIPE("end", .size = 3 * TEST_MIB, .len = TEST_MIB + 77,
+                 .zero_end = true);
+    DO_TEST_WIPE("aligned range", .size = 6 * TEST_MIB, .start = TEST_MIB,
+                 .len = 4 * TEST_MIB, .direct = true);
+    DO_TEST_WIPE("unaligned range", .size = 4 * TEST_MIB, .start = 1000,
+                 .len = 2 * TEST_MIB + 5, .direct = true);
+
+#undef DO_TEST_WIPE
+
+    if (virTestRun("wipe job", testWipeJob, NULL) < 0)
+        ret = -1;
+
+#define DO_TEST_COPY(testname, ...) \
+    do { \
+        struct testCopyData data = { __VA_ARGS__ }; \
+        if (virTestRun("copy " testname, testCopy, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_COPY("sparse", .sparse = true);
+    DO_TEST_COPY("preallocated", .sparse = false);
+
+#undef DO_TEST_COPY
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -49,6 +49,9 @@
 
 #if defined(LIBVIRT_NSS_GUEST)
 # include "libvirt_nss_macs.h"
+# define LEASE_INDEX_KEY VIR_LEASE_INDEX_KEY_DOMAIN
+#else /* !LIBVIRT_NSS_GUEST */
+# define LEASE_INDEX_KEY VIR_LEASE_INDEX_KEY_HOSTNAME
 #endif /* !LIBVIRT_NSS_GUEST */
 
 #define LEASEDIR LOCALSTATEDIR "/lib/libvirt/dnsmasq/"
@@ -116,6 +119,7 @@ findLease(const char *name,
     size_t nmacs = 0;
     size_t i;
     time_t now;
+    int rv;
 
     *address = NULL;
     *naddress = 0;
@@ -132,6 +136,25 @@ findLease(const char *name,
         goto cleanup;
     }
 
+    if ((now = time(NULL)) == (time_t)-1) {
+        ERROR("Failed to get time");
+        goto cleanup;
+    }
+
+    /* The index covers all networks, the lease files and MAC maps need to
+     * be parsed only if it's missing */
+    if ((rv = findLeasesInIndex(LEASEDIR VIR_LEASE_INDEX_FILE,
+                                LEASE_INDEX_KEY, name, af, now,
+                                address, naddress, found)) < 0)
+        goto cleanup;
+
+    if (rv == 0) {
+        DEBUG("Found %zu addresses in index", *naddress);
+        sortAddr(*address, *naddress);
+        ret = 0;
+        goto cleanup;
+    }
+
     dir = opendir(leaseDir);
     if (!dir) {
         ERROR("Failed to open dir '%s'", leaseDir);
@@ -179,11 +202,6 @@ findLease(const char *name,
         DEBUG("  %s", macs[i]);
 #endif
 
-    if ((now = time(NULL)) == (time_t)-1) {
-        ERROR("Failed to get time");
-        goto cleanup;
-    }
-
     for (i = 0; i < nleaseFiles; i++) {
         if (findLeases(leaseFiles[i],
                        name, macs, nmacs,
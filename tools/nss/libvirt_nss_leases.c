@@ -26,6 +26,8 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <netdb.h>
 
@@ -33,6 +35,47 @@
 
 #include "libvirt_nss_leases.h"
 #include "libvirt_nss.h"
+#include "virleaseindex.h"
+
+
+static int
+appendBinaryAddr(leaseAddress **tmpAddress,
+                 size_t *ntmpAddress,
+                 const unsigned char *addr,
+                 int family,
+                 long long expirytime,
+                 int af)
+{
+    size_t len = family == AF_INET ? 4 : 16;
+    size_t i;
+    leaseAddress *newAddr;
+
+    if (af != AF_UNSPEC && af != family) {
+        DEBUG("Skipping address which family is %d, %d requested", family, af);
+        return 0;
+    }
+
+    for (i = 0; i < *ntmpAddress; i++) {
+        if ((*tmpAddress)[i].af == family &&
+            memcmp((*tmpAddress)[i].addr, addr, len) == 0) {
+            DEBUG("IP address already in the list");
+            return 0;
+        }
+    }
+
+    newAddr = realloc(*tmpAddress, sizeof(*newAddr) * (*ntmpAddress + 1));
+    if (!newAddr) {
+        ERROR("Out of memory");
+        return -1;
+    }
+    *tmpAddress = newAddr;
+
+    (*tmpAddress)[*ntmpAddress].expirytime = expirytime;
+    (*tmpAddress)[*ntmpAddress].af = family;
+    memcpy((*tmpAddress)[*ntmpAddress].addr, addr, len);
+    (*ntmpAddress)++;
+    return 0;
+}
 
 
 static int
@@ -44,7 +87,6 @@ appendAddr(const char *name __attribute__((unused)),
            int af)
 {
     int family;
-    size_t i;
     struct addrinfo hints = {0};
     struct addrinfo *res = NULL;
     union {
@@ -54,7 +96,6 @@ appendAddr(const char *name __attribute__((unused)),
     } sa;
     unsigned char addr[16];
     int err;
-    leaseAddress *newAddr;
 
     DEBUG("IP address: %s", ipAddr);
 
@@ -84,50 +125,8 @@ appendAddr(const char *name __attribute__((unused)),
         return 0;
     }
 
-    if (af != AF_UNSPEC && af != family) {
-        DEBUG("Skipping address which family is %d, %d requested", family, af);
-        return 0;
-    }
-
-    for (i = 0; i < *ntmpAddress; i++) {
-        if (family == AF_INET) {
-            if ((*tmpAddress)[i].af == AF_INET &&
-                memcmp((*tmpAddress)[i].addr,
-                       &sa.sin.sin_addr,
-                       sizeof(sa.sin.sin_addr)) == 0) {
-                DEBUG("IP address already in the list");
-                return 0;
-            }
-        } else {
-            if ((*tmpAddress)[i].af == AF_INET6 &&
-                memcmp((*tmpAddress)[i].addr,
-                       &sa.sin6.sin6_addr,
-                       sizeof(sa.sin6.sin6_addr)) == 0) {
-                DEBUG("IP address already in the list");
-                return 0;
-            }
-        }
-    }
-
-    newAddr = realloc(*tmpAddress, sizeof(*newAddr) * (*ntmpAddress + 1));
-    if (!newAddr) {
-        ERROR("Out of memory");
-        return -1;
-    }
-    *tmpAddress = newAddr;
-
-    (*tmpAddress)[*ntmpAddress].expirytime = expirytime;
-    (*tmpAddress)[*ntmpAddress].af = family;
-    if (family == AF_INET)
-        memcpy((*tmpAddress)[*ntmpAddress].addr,
-               &sa.sin.sin_addr,
-               sizeof(sa.sin.sin_addr));
-    else
-        memcpy((*tmpAddress)[*ntmpAddress].addr,
-               &sa.sin6.sin6_addr,
-               sizeof(sa.sin6.sin6_addr));
-    (*ntmpAddress)++;
-    return 0;
+    return appendBinaryAddr(tmpAddress, ntmpAddress, addr,
+                            family, expirytime, af);
 }
 
 
@@ -247,6 +246,175 @@ findLeaseInJSON(json_object *jobj,
     return 0;
 }
 
+/* Looks up entries of @type matching @key in the index and appends their
+ * addresses. Returns 0 on success, 1 if the index is malformed, -1 on
+ * error. */
+static int
+findKeyInIndex(const unsigned char *map,
+               const virLeaseIndexHeader *hdr,
+               virLeaseIndexKeyType type,
+               const char *key,
+               int af,
+               time_t now,
+               leaseAddress **addrs,
+               size_t *naddrs,
+               bool *found)
+{
+    const uint32_t *buckets = (const uint32_t *)(map + sizeof(*hdr));
+    const virLeaseIndexEntry *entries;
+    const char *strings;
+    uint32_t idx;
+    uint32_t steps = 0;
+
+    entries = (const virLeaseIndexEntry *)(map + virLeaseIndexEntriesOffset(hdr));
+    strings = (const char *)(map + virLeaseIndexStringsOffset(hdr));
+
+    idx = buckets[virLeaseIndexHash(key, type) & (hdr->nbuckets - 1)];
+
+    while (idx) {
+        const virLeaseIndexEntry *entry;
+        const char *entryKey;
+        int family;
+
+        if (idx > hdr->nentries || steps++ >= hdr->nentries)
+            return 1;
+
+        entry = entries + idx - 1;
+        idx = entry->next;
+
+        if (entry->key >= hdr->strings)
+            return 1;
+
+        entryKey = strings + entry->key;
+
+        if (entry->type != type)
+            continue;
+
+        if (type == VIR_LEASE_INDEX_KEY_MAC) {
+            if (strcmp(entryKey, key) != 0)
+                continue;
+        } else {
+            if (strcasecmp(entryKey, key) != 0)
+                continue;
+        }
+
+        if (entry->expirytime > 0 && entry->expirytime < now) {
+            DEBUG("Skipping expired lease for %s", key);
+            continue;
+        }
+
+        if (entry->family == 4) {
+            family = AF_INET;
+        } else if (entry->family == 6) {
+            family = AF_INET6;
+        } else {
+            return 1;
+        }
+
+        DEBUG("Found record for %s", key);
+        *found = true;
+
+        if (appendBinaryAddr(addrs, naddrs, entry->addr,
+                             family, entry->expirytime, af) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * findLeasesInIndex
+ *
+ * @file: the index of leases of all networks
+ * @type: type of @key
+ * @key: hostname, MAC address or domain name to look up
+ * @af: the requested address family
+ * @now: current time (to eliminate expired leases)
+ * @addrs: the returned matching addresses
+ * @naddrs: size of the returned array
+ * @found: whether a match was found
+ *
+ * Looks up leases in the index maintained by the leases helper and the
+ * network driver, which costs a single hash lookup regardless of the
+ * number of networks instead of parsing lease files of all of them.
+ *
+ * Returns 0 even if nothing was found
+ *         1 if the index is missing or malformed
+ *        -1 on error
+ */
+int
+findLeasesInIndex(const char *file,
+                  virLeaseIndexKeyType type,
+                  const char *key,
+                  int af,
+                  time_t now,
+                  leaseAddress **addrs,
+                  size_t *naddrs,
+                  bool *found)
+{
+    int fd = -1;
+    struct stat st = { 0 };
+    void *map = MAP_FAILED;
+    const virLeaseIndexHeader *hdr;
+    unsigned long long size;
+    int ret = 1;
+
+    if ((fd = open(file, O_RDONLY)) < 0) {
+        DEBUG("No index %s", file);
+        goto cleanup;
+    }
+
+    if (fstat(fd, &st) < 0 ||
+        st.st_size < (off_t) sizeof(*hdr))
+        goto cleanup;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        goto cleanup;
+
+    hdr = map;
+
+    if (memcmp(hdr->magic, VIR_LEASE_INDEX_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != VIR_LEASE_INDEX_VERSION ||
+        hdr->nbuckets == 0 ||
+        (hdr->nbuckets & (hdr->nbuckets - 1)) != 0) {
+        DEBUG("Malformed index %s", file);
+        goto cleanup;
+    }
+
+    size = sizeof(*hdr) +
+        (unsigned long long) hdr->nbuckets * sizeof(uint32_t) +
+        (unsigned long long) hdr->nentries * sizeof(virLeaseIndexEntry) +
+        hdr->strings;
+
+    if (size != (unsigned long long) st.st_size ||
+        (hdr->strings > 0 &&
+         ((const char *) map)[st.st_size - 1] != '\0')) {
+        DEBUG("Malformed index %s", file);
+        goto cleanup;
+    }
+
+    DEBUG("Using index %s", file);
+
+    ret = findKeyInIndex(map, hdr, type, key, af, now, addrs, naddrs, found);
+
+    /* Let the caller parse the lease files instead */
+    if (ret == 1) {
+        free(*addrs);
+        *addrs = NULL;
+        *naddrs = 0;
+        *found = false;
+    }
+
+ cleanup:
+    if (map != MAP_FAILED)
+        munmap(map, st.st_size);
+    if (fd != -1)
+        close(fd);
+    return ret;
+}
+
 
 int
 findLeases(const char *file,
@@ -268,6 +436,7 @@ findLeases(const char *file,
     size_t nreadTotal = 0;
 
     DEBUG("Processing %s", file);
+
     if ((fd = open(file, O_RDONLY)) < 0) {
         ERROR("Cannot open %s", file);
         goto cleanup;
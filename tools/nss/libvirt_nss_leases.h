@@ -22,12 +22,24 @@
 
 #include <sys/types.h>
 
+#include "virleaseindex.h"
+
 typedef struct {
     unsigned char addr[16];
     int af;
     long long expirytime;
 } leaseAddress;
 
+int
+findLeasesInIndex(const char *file,
+                  virLeaseIndexKeyType type,
+                  const char *key,
+                  int af,
+                  time_t now,
+                  leaseAddress **addrs,
+                  size_t *naddrs,
+                  bool *found);
+
 int
 findLeases(const char *file,
            const char *name,
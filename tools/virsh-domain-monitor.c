@@ -2078,6 +2078,10 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report only stats that are accessible instantly"),
     },
+    {.name = "delta",
+     .type = VSH_OT_BOOL,
+     .help = N_("report only stats that changed since the previous call"),
+    },
     {.name = "domain",
      .type = VSH_OT_ARGV,
      .positional = true,
@@ -2192,6 +2196,9 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "nowait"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT;
 
+    if (vshCommandOptBool(cmd, "delta"))
+        flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_DELTA;
+
     if ((doms = vshCommandOptArgv(cmd, "domain"))) {
         domlist = g_new0(virDomainPtr, 1);
         ndoms = 1;
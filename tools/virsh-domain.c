@@ -6558,6 +6558,7 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
     unsigned long long value;
     unsigned int flags = 0;
     int ivalue;
+    unsigned int uivalue;
     const char *svalue;
     int op;
     int rc;
@@ -6811,6 +6812,14 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         vshPrint(ctl, "%-17s %-13llu\n", _("Compression overflows:"), value);
     }
 
+    if ((rc = virTypedParamsGetUInt(params, nparams,
+                                    VIR_DOMAIN_JOB_QUEUE_POSITION,
+                                    &uivalue)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12u\n", _("Queue position:"), uivalue);
+    }
+
     if ((rc = virTypedParamsGetInt(params, nparams,
                                    VIR_DOMAIN_JOB_AUTO_CONVERGE_THROTTLE,
                                    &ivalue)) < 0) {
@@ -6837,6 +6846,18 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         vshPrint(ctl, "%-17s %-.3lf %s\n", _("Temporary disk space total:"), val, unit);
     }
 
+    for (i = 0; i < nparams; i++) {
+        const char *phase;
+
+        if (params[i].type != VIR_TYPED_PARAM_ULLONG ||
+            !(phase = STRSKIP(params[i].field,
+                              VIR_DOMAIN_JOB_STARTUP_PHASE_PREFIX)))
+            continue;
+
+        vshPrint(ctl, "%-17s %-15s %llu us\n", _("Startup phase:"),
+                 phase, params[i].value.ul);
+    }
+
     if ((rc = virTypedParamsGetString(params, nparams, VIR_DOMAIN_JOB_ERRMSG,
                                       &svalue)) < 0) {
         goto save_error;
@@ -932,6 +932,38 @@ cmdVolWipe(vshControl *ctl, const vshCmd *cmd)
 }
 
 
+/*
+ * "vol-wipe-abort" command
+ */
+static const vshCmdInfo info_vol_wipe_abort = {
+    .help = N_("abort wiping of a vol"),
+    .desc = N_("Abort wiping of a vol which is currently being wiped"),
+};
+
+static const vshCmdOptDef opts_vol_wipe_abort[] = {
+    VIRSH_COMMON_OPT_VOL_FULL,
+    VIRSH_COMMON_OPT_POOL_OPTIONAL,
+    {.name = NULL}
+};
+
+static bool
+cmdVolWipeAbort(vshControl *ctl, const vshCmd *cmd)
+{
+    g_autoptr(virshStorageVol) vol = NULL;
+    const char *name;
+
+    if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", &name)))
+        return false;
+
+    if (virStorageVolWipeAbort(vol, 0) < 0) {
+        vshError(ctl, _("Failed to abort wiping of vol %1$s"), name);
+        return false;
+    }
+
+    return true;
+}
+
+
 VIR_ENUM_DECL(virshStorageVol);
 VIR_ENUM_IMPL(virshStorageVol,
               VIR_STORAGE_VOL_LAST,
@@ -1667,5 +1699,11 @@ const vshCmdDef storageVolCmds[] = {
      .info = &info_vol_wipe,
      .flags = 0
     },
+    {.name = "vol-wipe-abort",
+     .handler = cmdVolWipeAbort,
+     .opts = opts_vol_wipe_abort,
+     .info = &info_vol_wipe_abort,
+     .flags = 0
+    },
     {.name = NULL}
 };
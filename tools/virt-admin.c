@@ -794,6 +794,63 @@ cmdSrvClientsInfo(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/* ---------------------
+ * Command server-stats
+ * ---------------------
+ */
+
+static const vshCmdInfo info_srv_stats = {
+    .help = N_("get statistics collected by the daemon"),
+    .desc = N_("Retrieve latency histograms collected by the daemon "
+               "running the server"),
+};
+
+static const vshCmdOptDef opts_srv_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_STRING,
+     .positional = true,
+     .required = true,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve the statistics from."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControl *priv = ctl->privData;
+
+    if (vshCommandOptString(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetStats(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve server statistics"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        g_autofree char *str = virTypedParameterToString(&params[i]);
+        vshPrint(ctl, "%s: %s\n", params[i].field, str);
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
 /* --------------------------
  * Command server-clients-set
  * --------------------------
@@ -1449,6 +1506,15 @@ static const vshCmdDef monitoringCmds[] = {
      .info = &info_srv_clients_info,
      .flags = 0
     },
+    {.name = "srv-stats",
+     .alias = "server-stats"
+    },
+    {.name = "server-stats",
+     .handler = cmdSrvStats,
+     .opts = opts_srv_stats,
+     .info = &info_srv_stats,
+     .flags = 0
+    },
     {.name = NULL}
 };
 